@@ -182,6 +182,7 @@ pair<uint32_t, vector<Sound>> wsys_decode(const void* vdata, const char* base_di
       if (wav_entry->type < 2) {
         ret_snd.afc_data = string(aw_file_contents.data() + wav_entry->offset, wav_entry->size);
         ret_snd.afc_large_frames = (wav_entry->type == 1);
+        ret_snd.afc_decode_pending = true;
         ret_snd.num_channels = 1;
 
       } else if (wav_entry->type < 4) {
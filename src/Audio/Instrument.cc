@@ -17,9 +17,10 @@ namespace ResourceDASM {
 namespace Audio {
 
 const vector<float>& Sound::samples() const {
-  if (this->decoded_samples.empty()) {
+  if (this->afc_decode_pending) {
     this->decoded_samples = decode_afc(this->afc_data.data(), this->afc_data.size(), this->afc_large_frames);
     this->afc_data.clear();
+    this->afc_decode_pending = false;
   }
   return this->decoded_samples;
 }
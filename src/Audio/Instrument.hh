@@ -17,6 +17,9 @@ namespace Audio {
 struct Sound {
   mutable std::string afc_data;
   bool afc_large_frames = false;
+  // True if afc_data still needs to be decoded into decoded_samples (which
+  // may legitimately be empty after decoding)
+  mutable bool afc_decode_pending = false;
   mutable std::vector<float> decoded_samples;
   size_t num_channels = 1;
   size_t sample_rate = 0;
@@ -960,6 +960,21 @@ bool MODSynthesizer::render_current_division_audio() {
       }
       track.last_effective_volume = effective_volume;
 
+      // None of the volume or panning factors change during the tick, so compute them once here instead of for
+      // every sample. The surround effect (enabled with effect 8A4) plays the same sample in both ears, but with one
+      // inverted.
+      float overall_volume_factor = (this->opts->volume_exponent == 1.0)
+          ? (track_volume_factor * ins_volume_factor)
+          : pow(track_volume_factor * ins_volume_factor, this->opts->volume_exponent);
+      float l_factor, r_factor;
+      if (track.enable_surround_effect) {
+        l_factor = (track.index & 1) ? -0.5 : 0.5;
+        r_factor = (track.index & 1) ? 0.5 : -0.5;
+      } else {
+        l_factor = (1.0 - static_cast<float>(track.panning) / 128.0);
+        r_factor = (static_cast<float>(track.panning) / 128.0);
+      }
+
       // Apply the appropriate portion of the instrument's sample data to the tick output data.
       const vector<float>* resampled_data = nullptr;
       ssize_t segment_index = -1;
@@ -1015,10 +1030,6 @@ bool MODSynthesizer::render_current_division_audio() {
           break;
         }
 
-        float overall_volume_factor = (this->opts->volume_exponent == 1.0)
-            ? (track_volume_factor * ins_volume_factor)
-            : pow(track_volume_factor * ins_volume_factor, this->opts->volume_exponent);
-
         // When a new sample is played on a track and it interrupts another already-playing sample, the waveform can
         // become discontinuous, which causes an audible ticking sound. To avoid this, we store a DC offset in each
         // track and adjust it so that the new sample begins at the same amplitude. The DC offset then decays after
@@ -1035,16 +1046,7 @@ bool MODSynthesizer::render_current_division_audio() {
         }
         track.decay_dc_offset(this->dc_offset_decay);
 
-        // Apply panning and produce the final sample. The surround effect (enabled with effect 8A4) plays the same
-        // sample in both ears, but with one inverted.
-        float l_factor, r_factor;
-        if (track.enable_surround_effect) {
-          l_factor = (track.index & 1) ? -0.5 : 0.5;
-          r_factor = (track.index & 1) ? 0.5 : -0.5;
-        } else {
-          l_factor = (1.0 - static_cast<float>(track.panning) / 128.0);
-          r_factor = (static_cast<float>(track.panning) / 128.0);
-        }
+        // Apply panning and produce the final sample
         tick_samples[tick_output_offset + 0] += track.last_sample * l_factor * this->opts->global_volume;
         tick_samples[tick_output_offset + 1] += track.last_sample * r_factor * this->opts->global_volume;
 
@@ -0,0 +1,72 @@
+#include "Mixing.hh"
+
+#include <math.h>
+
+using namespace std;
+
+namespace ResourceDASM {
+namespace Audio {
+
+void mix_samples(float* dest, const float* src, size_t count) {
+  for (size_t z = 0; z < count; z++) {
+    dest[z] += src[z];
+  }
+}
+
+void pan_mono_to_stereo(float* dest, const float* src, size_t frames, float l_gain, float r_gain) {
+  for (size_t z = 0; z < frames; z++) {
+    dest[2 * z + 0] = l_gain * src[z];
+    dest[2 * z + 1] = r_gain * src[z];
+  }
+}
+
+vector<float> make_sinc_table(double cutoff) {
+  if (cutoff > 1.0) {
+    cutoff = 1.0;
+  }
+
+  vector<float> ret((SINC_PHASES + 1) * SINC_TAPS);
+  for (size_t phase = 0; phase <= SINC_PHASES; phase++) {
+    double frac = static_cast<double>(phase) / SINC_PHASES;
+    float* row = &ret[phase * SINC_TAPS];
+    for (size_t tap = 0; tap < SINC_TAPS; tap++) {
+      // Distance (in input samples) from the output position to this tap
+      double x = static_cast<double>(tap) - static_cast<double>(SINC_HALF_WIDTH - 1) - frac;
+      double sinc_x = x * cutoff * M_PI;
+      double sinc = (sinc_x == 0.0) ? 1.0 : (sin(sinc_x) / sinc_x);
+      // Blackman window over [-SINC_HALF_WIDTH, SINC_HALF_WIDTH]
+      double window_x = M_PI * x / SINC_HALF_WIDTH;
+      double window = 0.42 + 0.5 * cos(window_x) + 0.08 * cos(2 * window_x);
+      row[tap] = cutoff * sinc * window;
+    }
+  }
+  return ret;
+}
+
+float apply_sinc_filter(const float* table, const float* src, double frac) {
+  double table_pos = frac * SINC_PHASES;
+  size_t phase = static_cast<size_t>(table_pos);
+  if (phase >= SINC_PHASES) {
+    phase = SINC_PHASES - 1;
+  }
+  float phase_frac = table_pos - phase;
+  const float* row0 = &table[phase * SINC_TAPS];
+  const float* row1 = row0 + SINC_TAPS;
+
+  // Floating-point addition isn't associative, so the compiler won't split a
+  // single sum across vector lanes by itself. We do it explicitly instead, by
+  // keeping separate sums for each lane and adding them at the end.
+  static_assert((SINC_TAPS % 8) == 0, "SINC_TAPS must be a multiple of 8");
+  float lane_sums[8] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  for (size_t tap = 0; tap < SINC_TAPS; tap += 8) {
+    for (size_t lane = 0; lane < 8; lane++) {
+      size_t z = tap + lane;
+      lane_sums[lane] += (row0[z] + (row1[z] - row0[z]) * phase_frac) * src[z];
+    }
+  }
+  return ((lane_sums[0] + lane_sums[4]) + (lane_sums[1] + lane_sums[5])) +
+      ((lane_sums[2] + lane_sums[6]) + (lane_sums[3] + lane_sums[7]));
+}
+
+} // namespace Audio
+} // namespace ResourceDASM
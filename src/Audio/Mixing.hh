@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace ResourceDASM {
+namespace Audio {
+
+// These are the inner loops of the synthesizers. They're written as simple
+// loops over contiguous arrays with no dependencies between iterations, so the
+// compiler can vectorize them. mix_samples and pan_mono_to_stereo produce
+// exactly the same results as the equivalent scalar expressions;
+// apply_sinc_filter sums its taps in a different order than a simple loop
+// would, so its results may differ from that in the last few bits.
+
+// dest[z] += src[z] for each z in [0, count)
+void mix_samples(float* dest, const float* src, size_t count);
+
+// Converts mono samples to interleaved stereo, with separate gains for each
+// side: dest[2z] = l_gain * src[z], dest[2z + 1] = r_gain * src[z]
+void pan_mono_to_stereo(float* dest, const float* src, size_t frames, float l_gain, float r_gain);
+
+// Number of input samples on each side of the output position that contribute
+// to each output sample in windowed-sinc resampling
+constexpr size_t SINC_HALF_WIDTH = 16;
+constexpr size_t SINC_TAPS = 2 * SINC_HALF_WIDTH;
+// Number of fractional positions between input samples for which the filter is
+// precomputed. Positions between these are linearly interpolated.
+constexpr size_t SINC_PHASES = 256;
+
+// Returns (SINC_PHASES + 1) rows of SINC_TAPS filter coefficients each. Row p
+// is the filter for an output position p / SINC_PHASES of the way between two
+// input samples; its taps apply to the input samples from
+// (SINC_HALF_WIDTH - 1) before that position through SINC_HALF_WIDTH after it.
+// cutoff is the lowpass cutoff as a fraction of the input's Nyquist frequency
+// (it should be less than 1 when downsampling, to avoid aliasing).
+std::vector<float> make_sinc_table(double cutoff);
+
+// Computes one output sample by applying the filter for the given fraction
+// (in [0, 1)) to the SINC_TAPS input samples starting at src
+float apply_sinc_filter(const float* table, const float* src, double frac);
+
+} // namespace Audio
+} // namespace ResourceDASM
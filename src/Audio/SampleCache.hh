@@ -10,6 +10,8 @@
 #include <unordered_map>
 #include <vector>
 
+#include "Mixing.hh"
+
 namespace ResourceDASM {
 namespace Audio {
 
@@ -68,54 +70,102 @@ std::vector<ToT> convert_samples(const std::vector<FromT>& samples) {
 enum class ResampleMethod {
   EXTEND = 0,
   LINEAR_INTERPOLATE,
+  WINDOWED_SINC,
 };
 
-template <typename SampleT, ResampleMethod Method>
-std::vector<SampleT> resample_audio(const std::vector<SampleT>& input_samples, size_t num_channels, double ratio) {
+template <typename SampleT>
+std::vector<SampleT> resample_audio_windowed_sinc(
+    const std::vector<SampleT>& input_samples, size_t num_channels, double ratio) {
   size_t num_frames = input_samples.size() / num_channels;
+  if (num_frames == 0) {
+    return std::vector<SampleT>();
+  }
 
-  std::vector<float> prev_samples(num_channels, 0.0);
-  std::vector<float> current_samples(num_channels, 0.0);
-  for (size_t z = 0; z < num_channels; z++) {
-    prev_samples[z] = sample_to_float<SampleT>(input_samples[z]);
+  // This produces the same number of output frames as the other methods (see
+  // resample_audio below), so the methods can be used interchangeably
+  size_t num_output_frames = static_cast<size_t>(ceil((num_frames + 1) * ratio)) -
+      static_cast<size_t>(ceil(ratio));
+  std::vector<SampleT> ret(num_output_frames * num_channels);
+
+  // When downsampling, the cutoff has to be below the output's Nyquist
+  // frequency to avoid aliasing
+  auto table = make_sinc_table(std::min<double>(ratio, 1.0));
+
+  // The filter reads SINC_HALF_WIDTH samples on either side of each output
+  // position, so we pad the input with silence on both ends instead of
+  // checking bounds for each tap
+  std::vector<float> padded(num_frames + SINC_TAPS + 1, 0.0f);
+  for (size_t channel = 0; channel < num_channels; channel++) {
+    for (size_t z = 0; z < num_frames; z++) {
+      padded[z + SINC_HALF_WIDTH] = sample_to_float<SampleT>(input_samples[z * num_channels + channel]);
+    }
+    for (size_t z = 0; z < num_output_frames; z++) {
+      double in_pos = static_cast<double>(z) / ratio;
+      size_t in_frame = std::min<size_t>(static_cast<size_t>(in_pos), num_frames);
+      // The first tap is (SINC_HALF_WIDTH - 1) frames before in_frame, which
+      // is at padded[in_frame + SINC_HALF_WIDTH]
+      float sample = apply_sinc_filter(table.data(), &padded[in_frame + 1], in_pos - in_frame);
+      ret[z * num_channels + channel] = sample_from_float<SampleT>(sample);
+    }
   }
-  // in_frame_index starts at 1 because frame 0 is already in prev_samples
-  size_t in_frame_index = 1;
-
-  std::vector<SampleT> ret;
-  ret.reserve(input_samples.size() * ratio);
-
-  auto write_current_output_frames = [&]() -> void {
-    size_t frames_to_write =
-        static_cast<size_t>(ceil((in_frame_index + 1) * ratio)) -
-        static_cast<size_t>(ceil(in_frame_index * ratio));
-    for (size_t frame_index = 0; frame_index < frames_to_write; frame_index++) {
-      if constexpr (Method == ResampleMethod::EXTEND) {
-        // Just use the previous sample for the entire timestep
-        for (size_t sample_index = 0; sample_index < num_channels; sample_index++) {
-          ret.emplace_back(prev_samples[sample_index]);
-        }
-      } else if constexpr (Method == ResampleMethod::LINEAR_INTERPOLATE) {
-        // Linearly interpolate this output sample between the previous and next input samples
-        float progress_factor = static_cast<float>(frame_index) / frames_to_write;
-        for (size_t sample_index = 0; sample_index < num_channels; sample_index++) {
-          ret.emplace_back(prev_samples[sample_index] * (1.0 - progress_factor) + current_samples[sample_index] * progress_factor);
+  return ret;
+}
+
+template <typename SampleT, ResampleMethod Method>
+std::vector<SampleT> resample_audio(const std::vector<SampleT>& input_samples, size_t num_channels, double ratio) {
+  if constexpr (Method == ResampleMethod::WINDOWED_SINC) {
+    return resample_audio_windowed_sinc<SampleT>(input_samples, num_channels, ratio);
+  } else {
+    size_t num_frames = input_samples.size() / num_channels;
+    if (num_frames == 0) {
+      return std::vector<SampleT>();
+    }
+
+    // Input frame N (for N >= 1) produces the output frames in the range
+    // [ceil(N * ratio), ceil((N + 1) * ratio)), which cover the time between
+    // input frames N - 1 and N. There's one extra step at the end, which
+    // ensures the last input frame is represented in the output. All of these
+    // ranges are shifted so that the output begins at index 0.
+    auto output_frame_start = [&](size_t in_frame_index) -> size_t {
+      return static_cast<size_t>(ceil(in_frame_index * ratio));
+    };
+    size_t base_output_frame = output_frame_start(1);
+    std::vector<SampleT> ret((output_frame_start(num_frames + 1) - base_output_frame) * num_channels);
+
+    SampleT* out = ret.data();
+    const SampleT* prev_frame = input_samples.data();
+    for (size_t in_frame_index = 1; in_frame_index <= num_frames; in_frame_index++) {
+      const SampleT* current_frame = (in_frame_index < num_frames)
+          ? &input_samples[in_frame_index * num_channels]
+          : prev_frame;
+      size_t frames_to_write = output_frame_start(in_frame_index + 1) - output_frame_start(in_frame_index);
+
+      for (size_t channel = 0; channel < num_channels; channel++) {
+        float prev_sample = sample_to_float<SampleT>(prev_frame[channel]);
+        if constexpr (Method == ResampleMethod::EXTEND) {
+          // Just use the previous sample for the entire timestep
+          SampleT value = sample_from_float<SampleT>(prev_sample);
+          for (size_t frame_index = 0; frame_index < frames_to_write; frame_index++) {
+            out[frame_index * num_channels + channel] = value;
+          }
+        } else if constexpr (Method == ResampleMethod::LINEAR_INTERPOLATE) {
+          // Linearly interpolate each output sample between the previous and next input samples
+          float current_sample = sample_to_float<SampleT>(current_frame[channel]);
+          for (size_t frame_index = 0; frame_index < frames_to_write; frame_index++) {
+            float progress_factor = static_cast<float>(frame_index) / frames_to_write;
+            out[frame_index * num_channels + channel] = sample_from_float<SampleT>(
+                prev_sample * (1.0 - progress_factor) + current_sample * progress_factor);
+          }
+        } else {
+          static_assert(phosg::always_false<SampleT>::value, "Invalid resampling method");
         }
-      } else {
-        static_assert(phosg::always_false<SampleT>::value, "Invalid resampling method");
       }
-    }
-  };
 
-  for (; in_frame_index < num_frames; in_frame_index++) {
-    for (size_t z = 0; z < num_channels; z++) {
-      current_samples[z] = sample_to_float<SampleT>(input_samples[in_frame_index + z]);
+      out += frames_to_write * num_channels;
+      prev_frame = current_frame;
     }
-    write_current_output_frames();
-    prev_samples = current_samples;
+    return ret;
   }
-  write_current_output_frames(); // Ensure the last sample is represented in the output
-  return ret;
 }
 
 template <typename SampleT>
@@ -126,6 +176,8 @@ std::vector<SampleT> resample_audio(
       return resample_audio<SampleT, ResampleMethod::EXTEND>(input_samples, num_channels, ratio);
     case ResampleMethod::LINEAR_INTERPOLATE:
       return resample_audio<SampleT, ResampleMethod::LINEAR_INTERPOLATE>(input_samples, num_channels, ratio);
+    case ResampleMethod::WINDOWED_SINC:
+      return resample_audio<SampleT, ResampleMethod::WINDOWED_SINC>(input_samples, num_channels, ratio);
     default:
       throw std::logic_error("Invalid resampling method");
   }
@@ -9,7 +9,10 @@
 #include <phosg/Filesystem.hh>
 #include <phosg/Strings.hh>
 #include <phosg/Time.hh>
+#include <phosg/Tools.hh>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "MODSynthesizer.hh"
 #include "WAVFile.hh"
@@ -62,7 +65,7 @@ void print_usage() {
 \n\
 modsynth - a synthesizer for Protracker/Soundtracker modules\n\
 \n\
-Usage: modsynth <mode> [options] <input_filename>\n\
+Usage: modsynth <mode> [options] <input_filename> [input_filename...]\n\
 \n\
 The --disassemble mode generates a human-readable representation of the\n\
 instruments and sequence program from the module.\n\
@@ -76,7 +79,8 @@ instrument has at most one sample. Each sample is saved as\n\
 floating-point format during export. This mode has no other options.\n\
 \n\
 The --render mode generates a rasterized version of the sequence and saves the\n\
-result as <input_filename>.wav.\n\
+result as <input_filename>.wav. Multiple input files may be given in this mode\n\
+(unless --write-stdout is used); each is rendered independently.\n\
 \n\
 The --play mode plays the sequence through the default audio device. This is\n\
 only available if modsynth is ubilt with SDL3.\n\
@@ -86,10 +90,10 @@ Options for --render and --play:\n\
       Output audio at this sample rate (default 48000). The sample format is\n\
       always 32-bit float.\n\
   --resample-method=METHOD\n\
-      Use this method for resampling instruments. Values are sinc-best,\n\
-      sinc-medium, sinc-fast, hold, and linear. The default is hold, which most\n\
-      closely approximates what happens on old systems when they play these\n\
-      kinds of modules.\n\
+      Use this method for resampling instruments. Values are hold, linear, and\n\
+      sinc (windowed sinc, which is slower but has less aliasing). The default\n\
+      is hold, which most closely approximates what happens on old systems\n\
+      when they play these kinds of modules.\n\
   --volume=N\n\
       Set global volume to N (-1.0-1.0). With --render this doesn\'t really\n\
       matter unless --skip-normalize is also used, but with --play it overrides\n\
@@ -156,6 +160,10 @@ Options for --render only:\n\
       Instead of saving to a file, write raw float32 data to stdout, which can\n\
       be piped to audiocat --play --format=stereo-f32. Generally only useful\n\
       for debugging problems with --render that don\'t occur when using --play.\n\
+  --threads=N\n\
+      Render up to this many input files at once (default is the number of CPU\n\
+      cores). Status is not printed while rendering if N is not 1 and multiple\n\
+      input files are given. The output files are the same regardless of N.\n\
 \n\
 Options for all usage modes:\n\
   --color/--no-color\n\
@@ -165,6 +173,26 @@ Options for all usage modes:\n\
 \n");
 }
 
+static void render_to_file(
+    shared_ptr<const Module> mod,
+    shared_ptr<const MODSynthesizer::Options> opts,
+    const string& input_filename,
+    bool trim_ending_silence_after_render,
+    bool normalize_after_render) {
+  string output_filename = input_filename + ".wav";
+  MODRenderer renderer(mod, opts);
+  renderer.run_all();
+  auto result = renderer.result();
+  if (trim_ending_silence_after_render) {
+    trim_ending_silence(result);
+  }
+  if (normalize_after_render) {
+    normalize_amplitude(result);
+  }
+  phosg::fwrite_fmt(stderr, "... {}\n", output_filename);
+  save_wav(output_filename, result, opts->sample_rate, 2);
+}
+
 int main(int argc, char** argv) {
   enum class Behavior {
     DISASSEMBLE,
@@ -175,7 +203,8 @@ int main(int argc, char** argv) {
   };
 
   Behavior behavior = Behavior::DISASSEMBLE;
-  const char* input_filename = nullptr;
+  vector<const char*> input_filenames;
+  size_t num_threads = 0;
   bool write_stdout = false;
   bool use_default_global_volume = true;
   bool trim_ending_silence_after_render = true;
@@ -198,9 +227,13 @@ int main(int argc, char** argv) {
       opts->resample_method = ResampleMethod::EXTEND;
     } else if (!strcmp(argv[x], "--resample-method=linear")) {
       opts->resample_method = ResampleMethod::LINEAR_INTERPOLATE;
+    } else if (!strcmp(argv[x], "--resample-method=sinc")) {
+      opts->resample_method = ResampleMethod::WINDOWED_SINC;
 
     } else if (!strcmp(argv[x], "--write-stdout")) {
       write_stdout = true;
+    } else if (!strncmp(argv[x], "--threads=", 10)) {
+      num_threads = strtoull(&argv[x][10], nullptr, 0);
     } else if (!strcmp(argv[x], "--debug")) {
       opts->print_track_debug_while_playing = true;
 
@@ -260,27 +293,32 @@ int main(int argc, char** argv) {
     } else if (!strncmp(argv[x], "--sample-rate=", 14)) {
       opts->sample_rate = atoi(&argv[x][14]);
 
-    } else if (!input_filename) {
-      input_filename = argv[x];
-
-    } else {
-      phosg::fwrite_fmt(stderr, "error: multiple filenames given, or unknown option: {}\n",
-          argv[x]);
+    } else if (!strncmp(argv[x], "--", 2)) {
+      phosg::fwrite_fmt(stderr, "error: unknown option: {}\n", argv[x]);
       print_usage();
       return 1;
+
+    } else {
+      input_filenames.emplace_back(argv[x]);
     }
   }
-  if (!input_filename) {
+  if (input_filenames.empty()) {
     phosg::fwrite_fmt(stderr, "error: no input filename given\n");
     print_usage();
     return 1;
   }
+  if ((input_filenames.size() > 1) && ((behavior != Behavior::RENDER) || write_stdout)) {
+    phosg::fwrite_fmt(stderr, "error: multiple filenames given\n");
+    print_usage();
+    return 1;
+  }
+  const char* input_filename = input_filenames[0];
 
   bool behavior_is_disassemble = ((behavior == Behavior::DISASSEMBLE) || (behavior == Behavior::DISASSEMBLE_DIRECTORY));
   opts->use_color = (isatty(fileno(behavior_is_disassemble ? stdout : stderr)));
 
   shared_ptr<Module> mod;
-  if (behavior != Behavior::DISASSEMBLE_DIRECTORY) {
+  if ((behavior != Behavior::DISASSEMBLE_DIRECTORY) && (input_filenames.size() == 1)) {
     mod = Module::parse(phosg::load_file(input_filename));
   }
 
@@ -321,25 +359,57 @@ int main(int argc, char** argv) {
       mod->export_instruments(input_filename);
       break;
     case Behavior::RENDER: {
-      mod->print_text(stderr);
       if (write_stdout) {
+        mod->print_text(stderr);
         MODWriter writer(mod, opts, stdout);
         writer.run_all();
-      } else {
-        string output_filename = string(input_filename) + ".wav";
-        MODRenderer renderer(mod, opts);
+
+      } else if (input_filenames.size() == 1) {
+        mod->print_text(stderr);
         phosg::fwrite_fmt(stderr, "Synthesis:\n");
-        renderer.run_all();
-        phosg::fwrite_fmt(stderr, "Assembling result\n");
-        auto result = renderer.result();
-        if (trim_ending_silence_after_render) {
-          trim_ending_silence(result);
+        render_to_file(mod, opts, input_filename, trim_ending_silence_after_render, normalize_after_render);
+
+      } else {
+        // Each file is rendered by a separate MODRenderer, so the files don't
+        // interact and the results are the same as rendering them one at a
+        // time. The status display would be unreadable if multiple files
+        // wrote it at the same time, so it's disabled in this case.
+        if (num_threads == 0) {
+          num_threads = thread::hardware_concurrency();
+        }
+        if (num_threads != 1) {
+          opts->print_status_while_playing = false;
+        }
+        vector<exception_ptr> exceptions(input_filenames.size());
+        vector<size_t> indexes;
+        while (indexes.size() < input_filenames.size()) {
+          indexes.emplace_back(indexes.size());
+        }
+        auto render_task = [&](const size_t& index, size_t) -> bool {
+          try {
+            auto file_mod = Module::parse(phosg::load_file(input_filenames[index]));
+            render_to_file(file_mod, opts, input_filenames[index], trim_ending_silence_after_render, normalize_after_render);
+          } catch (const exception&) {
+            exceptions[index] = current_exception();
+          }
+          return false;
+        };
+        phosg::parallel_range(indexes, render_task, num_threads);
+
+        size_t num_failed = 0;
+        for (size_t z = 0; z < input_filenames.size(); z++) {
+          if (exceptions[z]) {
+            try {
+              rethrow_exception(exceptions[z]);
+            } catch (const exception& e) {
+              phosg::fwrite_fmt(stderr, "failed to render {}: {}\n", input_filenames[z], e.what());
+            }
+            num_failed++;
+          }
         }
-        if (normalize_after_render) {
-          normalize_amplitude(result);
+        if (num_failed) {
+          return 2;
         }
-        phosg::fwrite_fmt(stderr, "... {}\n", output_filename);
-        save_wav(output_filename, result, opts->sample_rate, 2);
       }
       break;
     }
@@ -4,16 +4,22 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <format>
 #include <map>
+#include <mutex>
 #include <phosg/Encoding.hh>
 #include <phosg/Filesystem.hh>
 #include <phosg/Time.hh>
 #include <string>
+#include <thread>
 #include <unordered_map>
 
 #include "AAFArchive.hh"
 #include "Constants.hh"
+#include "Mixing.hh"
 #include "SampleCache.hh"
 #include "WAVFile.hh"
 
@@ -760,7 +766,8 @@ public:
         note_off_decay_remaining(-1) {}
   virtual ~Voice() = default;
 
-  virtual vector<float> render(size_t count, float freq_mult, float volume_bias) = 0;
+  // Writes count stereo frames (2 * count floats) to out
+  virtual void render(float* out, size_t count, float freq_mult, float volume_bias) = 0;
 
   void off() {
     // TODO: for now we use a constant release time of 1/5 second except in SMS SONG resources; we probably should get
@@ -800,9 +807,9 @@ public:
       : Voice(sample_rate, note, vel, true, channel) {}
   virtual ~SilentVoice() = default;
 
-  virtual vector<float> render(size_t count, float, float) {
+  virtual void render(float* out, size_t count, float, float) {
     this->advance_note_off_factor();
-    return vector<float>(count * 2, 0.0f);
+    fill(out, out + 2 * count, 0.0f);
   }
 };
 
@@ -812,32 +819,32 @@ public:
       : Voice(sample_rate, note, vel, true, channel), offset(0) {}
   virtual ~SineVoice() = default;
 
-  virtual vector<float> render(size_t count, float, float volume_bias) {
+  virtual void render(float* out, size_t count, float, float volume_bias) {
     // TODO: implement pitch bend and freq_mult somehow
-    vector<float> data(count * 2, 0.0f);
-
     double frequency = frequency_for_note(this->note);
     float vel_factor = static_cast<float>(this->vel) / 0x7F;
     for (size_t x = 0; x < count; x++) {
       // Panning is 0.0f (left) - 1.0f (right)
       float off_factor = this->advance_note_off_factor();
-      data[2 * x + 0] = volume_bias * vel_factor * off_factor * (1.0f - this->channel->panning) * this->channel->volume * sin((2.0f * M_PI * frequency) / this->sample_rate * (x + this->offset));
-      data[2 * x + 1] = volume_bias * vel_factor * off_factor * this->channel->panning * this->channel->volume * sin((2.0f * M_PI * frequency) / this->sample_rate * (x + this->offset));
+      out[2 * x + 0] = volume_bias * vel_factor * off_factor * (1.0f - this->channel->panning) * this->channel->volume * sin((2.0f * M_PI * frequency) / this->sample_rate * (x + this->offset));
+      out[2 * x + 1] = volume_bias * vel_factor * off_factor * this->channel->panning * this->channel->volume * sin((2.0f * M_PI * frequency) / this->sample_rate * (x + this->offset));
     }
     this->offset += count;
-
-    return data;
   }
 
   size_t offset;
 };
 
+// Plays a sampled sound. Instead of resampling the entire sound whenever the
+// pitch changes, this keeps track of the current (fractional) position within
+// the original sound and interpolates between its samples as it goes, so pitch
+// bends don't cost anything extra.
 class SampleVoice : public Voice {
 public:
   SampleVoice(
       size_t sample_rate,
       shared_ptr<const SoundEnvironment> env,
-      shared_ptr<SampleCache<const Sound*>> cache,
+      ResampleMethod resample_method,
       uint16_t bank_id,
       uint16_t instrument_id,
       int8_t note,
@@ -850,9 +857,10 @@ public:
         instrument(&this->instrument_bank->id_to_instrument.at(instrument_id)),
         key_region(&this->instrument->region_for_key(note)),
         vel_region(&this->key_region->region_for_velocity(vel)),
-        src_ratio(1.0f),
-        offset(0),
-        cache(cache) {
+        resample_method(resample_method),
+        src_ratio(0.0f),
+        phase(0.0),
+        phase_increment(1.0) {
 
     if (!this->vel_region->sound) {
       throw out_of_range("instrument sound is missing");
@@ -862,12 +870,15 @@ public:
       throw invalid_argument(format("sampled sound is multi-channel: {}:{:X}",
           this->vel_region->sound->source_filename, this->vel_region->sound->source_offset));
     }
+
+    // Sounds are decoded lazily, which isn't thread-safe, so do it here
+    // instead of in render() (which may be called on a worker thread)
+    this->vel_region->sound->samples();
   }
 
   virtual ~SampleVoice() = default;
 
-  const vector<float>& get_samples(float pitch_bend,
-      float pitch_bend_semitone_range, float freq_mult) {
+  void update_src_ratio(float pitch_bend, float pitch_bend_semitone_range, float freq_mult) {
     // Stretch it out by the sample rate difference
     float sample_rate_factor = static_cast<float>(sample_rate) /
         static_cast<float>(this->vel_region->sound->sample_rate);
@@ -881,96 +892,203 @@ public:
         ? 1.0
         : (frequency_for_note(base_note) / frequency_for_note(this->note));
 
-    {
-      float pitch_bend_factor = pow(2, (pitch_bend * pitch_bend_semitone_range) / 12.0) * freq_mult;
-      float new_src_ratio = note_factor * sample_rate_factor / (this->vel_region->freq_mult * pitch_bend_factor);
-      this->loop_start_offset = this->vel_region->sound->loop_start * new_src_ratio;
-      this->loop_end_offset = this->vel_region->sound->loop_end * new_src_ratio;
-      this->offset = this->offset * (new_src_ratio / this->src_ratio);
-      this->src_ratio = new_src_ratio;
-    }
-
-    try {
-      return this->cache->at(this->vel_region->sound, this->src_ratio);
-    } catch (const out_of_range&) {
-      const auto& ret = this->cache->resample_add(
-          this->vel_region->sound, this->vel_region->sound->samples(),
-          this->vel_region->sound->num_channels, this->src_ratio);
-      if (debug_flags & DebugFlag::SHOW_RESAMPLE_EVENTS) {
-        string key_low_str = name_for_note(this->key_region->key_low);
-        string key_high_str = name_for_note(this->key_region->key_high);
-        phosg::fwrite_fmt(stderr,
-            "[{}:{:X}] resampled note {:02X} in range [{:02X},{:02X}] [{},{}] (base {:02X} from {}) ({:g}), "
-            "with freq_mult {:g}, from {}Hz to {}Hz ({:g}) with loop at [{},{}]->[{},{}] for an overall "
-            "ratio of {:g}; {} samples were converted to {} samples\n",
-            this->vel_region->sound->source_filename,
-            this->vel_region->sound->sound_id,
-            this->note,
-            this->key_region->key_low,
-            this->key_region->key_high,
-            key_low_str,
-            key_high_str,
-            base_note,
-            (this->vel_region->base_note == -1) ? "sample" : "vel region",
-            note_factor,
-            this->vel_region->freq_mult,
-            this->vel_region->sound->sample_rate,
-            this->sample_rate,
-            sample_rate_factor,
-            this->vel_region->sound->loop_start,
-            this->vel_region->sound->loop_end,
-            this->loop_start_offset,
-            this->loop_end_offset,
-            this->src_ratio,
-            this->vel_region->sound->samples().size(),
-            ret.size());
-      }
-      return ret;
+    float pitch_bend_factor = pow(2, (pitch_bend * pitch_bend_semitone_range) / 12.0) * freq_mult;
+    float new_src_ratio = note_factor * sample_rate_factor / (this->vel_region->freq_mult * pitch_bend_factor);
+    if (new_src_ratio == this->src_ratio) {
+      return;
+    }
+    this->src_ratio = new_src_ratio;
+    this->phase_increment = 1.0 / this->src_ratio;
+
+    if (debug_flags & DebugFlag::SHOW_RESAMPLE_EVENTS) {
+      string key_low_str = name_for_note(this->key_region->key_low);
+      string key_high_str = name_for_note(this->key_region->key_high);
+      phosg::fwrite_fmt(stderr,
+          "[{}:{:X}] resampling note {:02X} in range [{:02X},{:02X}] [{},{}] (base {:02X} from {}) ({:g}), "
+          "with freq_mult {:g}, from {}Hz to {}Hz ({:g}) with loop at [{},{}] for an overall ratio of {:g}\n",
+          this->vel_region->sound->source_filename,
+          this->vel_region->sound->sound_id,
+          this->note,
+          this->key_region->key_low,
+          this->key_region->key_high,
+          key_low_str,
+          key_high_str,
+          base_note,
+          (this->vel_region->base_note == -1) ? "sample" : "vel region",
+          note_factor,
+          this->vel_region->freq_mult,
+          this->vel_region->sound->sample_rate,
+          this->sample_rate,
+          sample_rate_factor,
+          this->vel_region->sound->loop_start,
+          this->vel_region->sound->loop_end,
+          this->src_ratio);
     }
   }
 
-  virtual vector<float> render(size_t count, float freq_mult, float volume_bias) {
-    vector<float> data(count * 2, 0.0f);
+  virtual void render(float* out, size_t count, float freq_mult, float volume_bias) {
+    this->update_src_ratio(this->channel->pitch_bend, this->channel->pitch_bend_semitone_range, freq_mult);
+
+    const auto& sound = *this->vel_region->sound;
+    const auto& samples = sound.samples();
+    double end_phase = samples.size();
+    bool has_loop = (sound.loop_end > 0) && (sound.loop_start <= sound.loop_end) && (sound.loop_end < samples.size());
+    // The sample after loop_end is loop_start, so a loop lasts for
+    // (loop_end + 1 - loop_start) samples
+    double loop_end_phase = static_cast<double>(sound.loop_end) + 1.0;
+    double loop_length = loop_end_phase - static_cast<double>(sound.loop_start);
 
-    const auto& samples = this->get_samples(this->channel->pitch_bend,
-        this->channel->pitch_bend_semitone_range, freq_mult);
     float vel_factor = static_cast<float>(this->vel) / 0x7F;
-    for (size_t x = 0; (x < count) && (this->offset < samples.size()); x++) {
+    this->mono_samples.resize(count);
+    size_t x = 0;
+    for (; (x < count) && (this->phase < end_phase); x++) {
+      bool looping = has_loop && (this->note_off_decay_remaining < 0);
+
+      size_t index = static_cast<size_t>(this->phase);
+      float sample = samples[index];
+      if (this->resample_method == ResampleMethod::LINEAR_INTERPOLATE) {
+        size_t next_index = (looping && (index == sound.loop_end)) ? sound.loop_start : (index + 1);
+        float next_sample = (next_index < samples.size()) ? samples[next_index] : sample;
+        sample += (next_sample - sample) * static_cast<float>(this->phase - index);
+      }
+
       float off_factor = this->advance_note_off_factor();
-      data[2 * x + 0] = volume_bias * vel_factor * off_factor * (1.0f - this->channel->panning) * this->channel->volume * samples[this->offset];
-      data[2 * x + 1] = volume_bias * vel_factor * off_factor * this->channel->panning * this->channel->volume * samples[this->offset];
+      this->mono_samples[x] = volume_bias * vel_factor * off_factor * this->channel->volume * sample * this->vel_region->volume_mult;
 
-      this->offset++;
-      if ((this->note_off_decay_remaining < 0) && (this->loop_end_offset > 0) && (this->offset > this->loop_end_offset)) {
-        this->offset = this->loop_start_offset;
+      this->phase += this->phase_increment;
+      if (looping && (this->phase >= loop_end_phase)) {
+        this->phase -= loop_length;
       }
     }
+    // Panning is 0.0f (left) - 1.0f (right)
+    pan_mono_to_stereo(out, this->mono_samples.data(), x, 1.0f - this->channel->panning, this->channel->panning);
+    fill(out + 2 * x, out + 2 * count, 0.0f);
 
-    if (this->offset == samples.size()) {
+    if (this->phase >= end_phase) {
       this->note_off_decay_remaining = 0;
     }
-
-    // Apply instrument volume factor
-    if (this->vel_region->volume_mult != 1) {
-      for (float& s : data) {
-        s *= this->vel_region->volume_mult;
-      }
-    }
-
-    return data;
   }
 
   const InstrumentBank* instrument_bank;
   const Instrument* instrument;
   const KeyRegion* key_region;
   const VelocityRegion* vel_region;
-  float src_ratio;
+  ResampleMethod resample_method;
+  float src_ratio; // Output samples per input sample
+  // Output of render() before panning is applied
+  vector<float> mono_samples;
+
+  // Position within the sound's samples, and how much to advance it for each
+  // output sample (1 / src_ratio)
+  double phase;
+  double phase_increment;
+};
 
-  size_t loop_start_offset;
-  size_t loop_end_offset;
-  size_t offset;
+// Runs the same function on a range of indexes using a fixed set of worker
+// threads. The threads are reused for every call to run(), since it's called
+// for every time step in the song, and most time steps are very short.
+class VoiceRenderPool {
+public:
+  // num_threads includes the thread that calls run()
+  explicit VoiceRenderPool(size_t num_threads)
+      : fn(nullptr),
+        count(0),
+        next_index(0),
+        workers_active(0),
+        generation(0),
+        should_exit(false) {
+    for (size_t z = 1; z < num_threads; z++) {
+      this->threads.emplace_back(&VoiceRenderPool::worker_thread_fn, this);
+    }
+  }
+  VoiceRenderPool(const VoiceRenderPool&) = delete;
+  VoiceRenderPool(VoiceRenderPool&&) = delete;
+  VoiceRenderPool& operator=(const VoiceRenderPool&) = delete;
+  VoiceRenderPool& operator=(VoiceRenderPool&&) = delete;
+
+  ~VoiceRenderPool() {
+    {
+      lock_guard g(this->lock);
+      this->should_exit = true;
+    }
+    this->work_cv.notify_all();
+    for (auto& t : this->threads) {
+      t.join();
+    }
+  }
+
+  // Calls fn(index) for each index in [0, count), and returns when all calls
+  // are done. If any call throws, the first exception is rethrown here.
+  void run(size_t count, const function<void(size_t)>& fn) {
+    {
+      lock_guard g(this->lock);
+      this->fn = &fn;
+      this->count = count;
+      this->next_index = 0;
+      this->exc = nullptr;
+      this->workers_active = this->threads.size();
+      this->generation++;
+    }
+    this->work_cv.notify_all();
 
-  shared_ptr<SampleCache<const Sound*>> cache;
+    this->work();
+
+    unique_lock g(this->lock);
+    this->done_cv.wait(g, [&]() -> bool { return this->workers_active == 0; });
+    this->fn = nullptr;
+    if (this->exc) {
+      rethrow_exception(this->exc);
+    }
+  }
+
+private:
+  vector<thread> threads;
+  mutex lock;
+  condition_variable work_cv;
+  condition_variable done_cv;
+
+  const function<void(size_t)>* fn;
+  size_t count;
+  atomic<size_t> next_index;
+  size_t workers_active;
+  uint64_t generation;
+  bool should_exit;
+  exception_ptr exc;
+
+  void work() {
+    for (size_t index = this->next_index++; index < this->count; index = this->next_index++) {
+      try {
+        (*this->fn)(index);
+      } catch (...) {
+        lock_guard g(this->lock);
+        if (!this->exc) {
+          this->exc = current_exception();
+        }
+      }
+    }
+  }
+
+  void worker_thread_fn() {
+    unique_lock g(this->lock);
+    uint64_t last_generation = 0;
+    for (;;) {
+      this->work_cv.wait(g, [&]() -> bool {
+        return this->should_exit || (this->generation != last_generation);
+      });
+      if (this->should_exit) {
+        return;
+      }
+      last_generation = this->generation;
+
+      g.unlock();
+      this->work();
+      g.lock();
+
+      if (--this->workers_active == 0) {
+        this->done_cv.notify_all();
+      }
+    }
+  }
 };
 
 class Renderer {
@@ -1048,7 +1166,12 @@ protected:
   bool decay_when_off;
   float decay_seconds;
 
-  shared_ptr<SampleCache<const Sound*>> cache;
+  ResampleMethod resample_method;
+
+  // One buffer for each voice in the current time step. These are reused in
+  // each time step, to avoid allocating memory.
+  vector<vector<float>> voice_buffers;
+  unique_ptr<VoiceRenderPool> render_pool;
 
   virtual void execute_opcode(multimap<uint64_t, shared_ptr<Track>>::iterator track_it) = 0;
 
@@ -1058,7 +1181,7 @@ protected:
     if (this->env) {
       try {
         SampleVoice* v = new SampleVoice(
-            this->sample_rate, this->env, this->cache, t->bank, t->instrument, key, vel,
+            this->sample_rate, this->env, this->resample_method, t->bank, t->instrument, key, vel,
             this->decay_when_off, this->decay_seconds, c);
         t->voices[voice_id].reset(v);
       } catch (const out_of_range& e) {
@@ -1105,10 +1228,20 @@ public:
         disable_tracks(disable_tracks),
         decay_when_off(decay_when_off),
         decay_seconds(0.2f),
-        cache(new SampleCache<const Sound*>(resample_method)) {}
+        resample_method(resample_method) {}
 
   virtual ~Renderer() = default;
 
+  // Renders voices on this many threads at once. The output is the same
+  // regardless of the number of threads.
+  void set_render_threads(size_t num_threads) {
+    if (num_threads > 1) {
+      this->render_pool = make_unique<VoiceRenderPool>(num_threads);
+    } else {
+      this->render_pool.reset();
+    }
+  }
+
   bool can_render() const {
     // If there are pending opcodes, we can continue rendering
     if (!this->next_event_to_track.empty()) {
@@ -1166,37 +1299,63 @@ public:
     double usecs_per_pulse = static_cast<double>(usecs_per_qnote) / this->pulse_rate;
     size_t samples_per_pulse = (usecs_per_pulse * this->sample_rate) / 1000000;
 
-    // Render this timestep
+    // Render this timestep. All voices are rendered into their own buffers
+    // first (possibly in parallel), then they're mixed together in the same
+    // order as when rendering on a single thread, so the result doesn't depend
+    // on the number of threads.
     vector<float> step_samples(2 * samples_per_pulse, 0);
-    char notes_table[0x81];
-    memset(notes_table, ' ', 0x80);
-    notes_table[0x80] = 0;
+    vector<pair<shared_ptr<Track>, vector<shared_ptr<Voice>>>> track_voices;
+    size_t num_voices = 0;
     for (const auto& t : this->tracks) {
       // Get all voices, including those that are fading
       unordered_set<shared_ptr<Voice>> all_voices = t->voices_off;
       for (auto& it : t->voices) {
         all_voices.insert(it.second);
       }
+      auto& voices = track_voices.emplace_back(t, vector<shared_ptr<Voice>>()).second;
+      voices.assign(all_voices.begin(), all_voices.end());
+      num_voices += voices.size();
+    }
 
-      // Render all the voices
-      for (auto v : all_voices) {
-        vector<float> voice_samples;
-        try {
-          voice_samples = v->render(samples_per_pulse, t->freq_mult, this->volume_bias);
-        } catch (...) {
-          phosg::fwrite_fmt(stderr, "error while rendering voices for track {} (freq_mult={:g})\n",
-              t->id, t->freq_mult);
-          throw;
-        }
-        if (voice_samples.size() != step_samples.size()) {
-          throw logic_error(format(
-              "voice produced incorrect sample count (returned {} samples, expected {} samples)",
-              voice_samples.size(), step_samples.size()));
-        }
+    vector<pair<const Track*, Voice*>> render_order;
+    render_order.reserve(num_voices);
+    for (const auto& [t, voices] : track_voices) {
+      for (const auto& v : voices) {
+        render_order.emplace_back(t.get(), v.get());
+      }
+    }
+    if (this->voice_buffers.size() < num_voices) {
+      this->voice_buffers.resize(num_voices);
+    }
+    auto render_voice = [&](size_t index) -> void {
+      const auto* t = render_order[index].first;
+      auto& buffer = this->voice_buffers[index];
+      buffer.resize(step_samples.size());
+      try {
+        render_order[index].second->render(buffer.data(), samples_per_pulse, t->freq_mult, this->volume_bias);
+      } catch (...) {
+        phosg::fwrite_fmt(stderr, "error while rendering voices for track {} (freq_mult={:g})\n",
+            t->id, t->freq_mult);
+        throw;
+      }
+    };
+    if (this->render_pool && (num_voices > 1)) {
+      this->render_pool->run(num_voices, render_voice);
+    } else {
+      for (size_t z = 0; z < num_voices; z++) {
+        render_voice(z);
+      }
+    }
+
+    char notes_table[0x81];
+    memset(notes_table, ' ', 0x80);
+    notes_table[0x80] = 0;
+    size_t voice_index = 0;
+    for (const auto& [t, voices] : track_voices) {
+      for (const auto& v : voices) {
+        const auto& voice_samples = this->voice_buffers[voice_index++];
         if (!this->mute_tracks.count(t->id)) {
-          for (size_t y = 0; y < voice_samples.size(); y++) {
-            step_samples[y] += voice_samples[y];
-          }
+          mix_samples(step_samples.data(), voice_samples.data(), voice_samples.size());
         }
 
         // Only draw the note in the text view if it's on
@@ -1957,6 +2116,8 @@ Synthesis options:\n\
   --sample-rate=N: generate output at this sample rate (default 48000).\n\
   --resample-method=METHOD: use this method for resampling waveforms. Values\n\
       are hold or linear.\n\
+  --threads=N: render voices on this many threads when writing an output file\n\
+      (default 1). The output is the same regardless of the number of threads.\n\
 \n\
 Logging options:\n\
   --silent: don't print any status information.\n\
@@ -2013,6 +2174,7 @@ int main(int argc, char** argv) {
   bool decay_when_off = true;
   float decay_seconds = -1.0f;
   ResampleMethod resample_method = ResampleMethod::LINEAR_INTERPOLATE;
+  size_t num_threads = 1;
   string env_json_filename;
   for (int x = 1; x < argc; x++) {
     if (!strncmp(argv[x], "--disable-track=", 16)) {
@@ -2071,6 +2233,8 @@ int main(int argc, char** argv) {
       resample_method = ResampleMethod::EXTEND;
     } else if (!strcmp(argv[x], "--resample-method=linear")) {
       resample_method = ResampleMethod::LINEAR_INTERPOLATE;
+    } else if (!strncmp(argv[x], "--threads=", 10)) {
+      num_threads = strtoull(&argv[x][10], nullptr, 0);
     } else if (!strncmp(argv[x], "--default-bank=", 15)) {
       default_bank = atoi(&argv[x][15]);
     } else if (!strncmp(argv[x], "--tempo-bias=", 13)) {
@@ -2236,6 +2400,12 @@ int main(int argc, char** argv) {
         allow_program_change));
   }
 
+  // Only offline rendering can use multiple threads; when playing, each time
+  // step is too short for it to be worth it
+  if (output_filename) {
+    r->set_render_threads(num_threads);
+  }
+
   // Skip the first bit if requested
   if (start_time) {
     r->render_until_seconds(start_time);
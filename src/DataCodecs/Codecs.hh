@@ -2,6 +2,8 @@
 
 #include <sys/types.h>
 
+#include <functional>
+#include <memory>
 #include <string>
 
 #include "../ResourceFile.hh"
@@ -13,6 +15,9 @@ using namespace phosg;
 // PackBits.cc
 std::string unpack_bits(const void* data, size_t size);
 std::string unpack_bits(const std::string& data);
+// Replaces the contents of `out` with the unpacked data. Reusing `out` across
+// calls avoids reallocating it if it's already big enough.
+void unpack_bits(const void* data, size_t size, std::string& out);
 // unpacks until `uncompressed_size` have been written to `uncompressed_data`
 void unpack_bits(StringReader& in, void* uncompressed_data, uint32_t uncompressed_size);
 
@@ -58,4 +63,70 @@ std::string decompress_macski_multi(const std::string& data);
 std::string decompress_soundmusicsys_lzss(const void* vsrc, size_t size);
 std::string decompress_soundmusicsys_lzss(const std::string& data);
 
+// StreamDecoders.cc
+// Incremental versions of some of the above decoders. Input can be passed to
+// feed() in chunks of any size (commands may be split across chunks), and
+// decoded data is passed to the output function as it's produced, in chunks
+// of up to STREAM_DECODER_CHUNK_SIZE bytes. Only as much of the output as
+// back-references can reach is kept in memory. finish() must be called after
+// all the input has been fed; it flushes any remaining output and throws if
+// the input ended early or the output isn't the expected size.
+constexpr size_t STREAM_DECODER_CHUNK_SIZE = 0x10000;
+
+class StreamDecoder {
+public:
+  using OutputFn = std::function<void(const void* data, size_t size)>;
+
+  StreamDecoder(OutputFn output_fn, size_t window_size);
+  StreamDecoder(const StreamDecoder&) = delete;
+  StreamDecoder(StreamDecoder&&) = delete;
+  StreamDecoder& operator=(const StreamDecoder&) = delete;
+  StreamDecoder& operator=(StreamDecoder&&) = delete;
+  virtual ~StreamDecoder() = default;
+
+  void feed(const void* data, size_t size);
+  void finish();
+
+  inline size_t input_size() const {
+    return this->input_bytes;
+  }
+  inline size_t output_size() const {
+    return this->output_bytes;
+  }
+
+protected:
+  // Decodes as many complete commands from data as possible and returns the
+  // number of bytes consumed. Unconsumed bytes are passed again (followed by
+  // the next chunk's data) on the next call.
+  virtual size_t decode(const uint8_t* data, size_t size) = 0;
+  // Called by finish() with the input that decode() didn't consume
+  virtual void on_finish(const uint8_t* data, size_t size) = 0;
+
+  void put_u8(uint8_t v);
+  void write(const void* data, size_t size);
+  void fill(uint8_t v, size_t count);
+  // Throws out_of_range if distance is zero, goes back past the beginning of
+  // the output, or is larger than the window size
+  void copy_backreference(size_t distance, size_t count);
+
+private:
+  OutputFn output_fn;
+  std::string pending_input;
+  std::string output_buffer;
+  std::string window; // Ring buffer; size is a power of 2 (or zero)
+  size_t input_bytes;
+  size_t output_bytes;
+
+  void append_to_window(const void* data, size_t size);
+  void flush_output();
+};
+
+std::unique_ptr<StreamDecoder> make_unpack_bits_stream_decoder(StreamDecoder::OutputFn output_fn);
+std::unique_ptr<StreamDecoder> make_unpack_pathways_stream_decoder(StreamDecoder::OutputFn output_fn);
+std::unique_ptr<StreamDecoder> make_presage_lzss_stream_decoder(StreamDecoder::OutputFn output_fn);
+std::unique_ptr<StreamDecoder> make_soundmusicsys_lzss_stream_decoder(StreamDecoder::OutputFn output_fn);
+// Like decompress_dinopark_tycoon_data, this decodes either LZSS or RLE data
+// depending on the header, and passes through data that has neither header
+std::unique_ptr<StreamDecoder> make_dinopark_tycoon_stream_decoder(StreamDecoder::OutputFn output_fn);
+
 } // namespace ResourceDASM
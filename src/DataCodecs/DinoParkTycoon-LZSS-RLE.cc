@@ -1,4 +1,5 @@
 #include "Codecs.hh"
+#include "LZOutputBuffer.hh"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,7 +32,7 @@ string decompress_dinopark_tycoon_lzss(const void* data, size_t size) {
     throw runtime_error("not all compressed data is present");
   }
 
-  StringWriter w;
+  LZOutputBuffer w(decompressed_size);
   while (w.size() < decompressed_size) {
     uint8_t control_bits = r.get_u8();
     for (size_t x = 0; (x < 8) && (w.size() < decompressed_size); x++) {
@@ -39,11 +40,7 @@ string decompress_dinopark_tycoon_lzss(const void* data, size_t size) {
         w.put_u8(r.get_u8());
       } else {
         uint16_t args = r.get_u16l();
-        size_t offset = w.size() - (args >> 6);
-        size_t count = (args & 0x3F) + 3;
-        for (size_t x = 0; x < count; x++) {
-          w.put_u8(w.str().at(offset++));
-        }
+        w.copy_backreference(args >> 6, (args & 0x3F) + 3);
       }
       control_bits >>= 1;
     }
@@ -54,7 +51,7 @@ string decompress_dinopark_tycoon_lzss(const void* data, size_t size) {
         "decompression produced 0x{:X} bytes (expected 0x{:X} bytes)", w.size(), decompressed_size));
   }
 
-  return std::move(w.str());
+  return w.finish();
 }
 
 string decompress_dinopark_tycoon_lzss(const string& data) {
@@ -74,20 +71,14 @@ string decompress_dinopark_tycoon_rle(const void* data, size_t size) {
     throw runtime_error("not all compressed data is present");
   }
 
-  StringWriter w;
+  LZOutputBuffer w(decompressed_size);
   while (!r.eof()) {
     uint8_t cmd = r.get_u8();
     if (cmd & 0x80) {
-      uint8_t v = r.get_u8();
-      size_t count = 0x101 - cmd;
-      for (size_t z = 0; z < count; z++) {
-        w.put_u8(v);
-      }
+      w.fill(r.get_u8(), 0x101 - cmd);
     } else {
       size_t count = cmd + 1;
-      for (size_t z = 0; z < count; z++) {
-        w.put_u8(r.get_u8());
-      }
+      w.write(r.getv(count), count);
     }
   }
 
@@ -96,7 +87,7 @@ string decompress_dinopark_tycoon_rle(const void* data, size_t size) {
         "decompression produced 0x{:X} bytes (expected 0x{:X} bytes)", w.size(), decompressed_size));
   }
 
-  return std::move(w.str());
+  return w.finish();
 }
 
 string decompress_dinopark_tycoon_rle(const string& data) {
@@ -108,7 +99,7 @@ string decompress_dinopark_tycoon_data(const void* data, size_t size) {
   uint32_t format = r.get_u32b();
   if (format == 0x4C5A5353) { // 'LZSS'
     return decompress_dinopark_tycoon_lzss(data, size);
-  } else if (r.get_u32b() != 0x524C4520) { // 'RLE '
+  } else if (format == 0x524C4520) { // 'RLE '
     return decompress_dinopark_tycoon_rle(data, size);
   } else {
     return string(reinterpret_cast<const char*>(data), size);
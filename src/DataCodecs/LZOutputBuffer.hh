@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace ResourceDASM {
+
+// Output buffer shared by the LZ- and RLE-family decompressors. The buffer is
+// preallocated to the expected output size (if known) and grows geometrically
+// past that, so appends don't go through std::string's per-byte bookkeeping,
+// and back-references are copied with memcpy/memset instead of byte-by-byte.
+class LZOutputBuffer {
+public:
+  // Sizes in compressed headers are untrusted, so the initial allocation is
+  // capped; if the output really is larger, the buffer grows as needed.
+  static constexpr size_t MAX_INITIAL_SIZE = 0x01000000;
+
+  explicit LZOutputBuffer(size_t expected_size = 0)
+      : data(std::min<size_t>(expected_size, MAX_INITIAL_SIZE), '\0'),
+        bytes_written(0) {}
+  LZOutputBuffer(const LZOutputBuffer&) = delete;
+  LZOutputBuffer(LZOutputBuffer&&) = default;
+  LZOutputBuffer& operator=(const LZOutputBuffer&) = delete;
+  LZOutputBuffer& operator=(LZOutputBuffer&&) = default;
+  ~LZOutputBuffer() = default;
+
+  inline size_t size() const {
+    return this->bytes_written;
+  }
+
+  inline void put_u8(uint8_t v) {
+    this->reserve_additional(1);
+    this->data[this->bytes_written++] = static_cast<char>(v);
+  }
+
+  inline void write(const void* src, size_t count) {
+    this->reserve_additional(count);
+    memcpy(this->data.data() + this->bytes_written, src, count);
+    this->bytes_written += count;
+  }
+
+  inline void fill(uint8_t v, size_t count) {
+    this->reserve_additional(count);
+    memset(this->data.data() + this->bytes_written, v, count);
+    this->bytes_written += count;
+  }
+
+  // Appends count bytes starting distance bytes before the current end of the
+  // output. If distance < count, the source overlaps the bytes being written,
+  // so the last distance bytes repeat as a pattern (as they would if copied
+  // one byte at a time). Throws out_of_range if distance is zero or points
+  // before the beginning of the output.
+  void copy_backreference(size_t distance, size_t count) {
+    if (distance == 0 || distance > this->bytes_written) {
+      throw std::out_of_range("backreference is out of range");
+    }
+    this->reserve_additional(count);
+    char* dest = this->data.data() + this->bytes_written;
+    const char* src = dest - distance;
+    this->bytes_written += count;
+
+    if (distance >= count) {
+      memcpy(dest, src, count);
+    } else if (distance == 1) {
+      memset(dest, *src, count);
+    } else {
+      // The bytes between src and dest are the repeating pattern; each copy
+      // doubles the amount of pattern available, so this takes log(count /
+      // distance) memcpys rather than count single-byte copies
+      size_t chunk_size = distance;
+      while (count > 0) {
+        size_t bytes = std::min<size_t>(chunk_size, count);
+        memcpy(dest, src, bytes);
+        dest += bytes;
+        count -= bytes;
+        chunk_size += bytes;
+      }
+    }
+  }
+
+  // Returns the decompressed data. The buffer should not be used afterward.
+  std::string finish() {
+    this->data.resize(this->bytes_written);
+    return std::move(this->data);
+  }
+
+private:
+  std::string data;
+  size_t bytes_written;
+
+  inline void reserve_additional(size_t count) {
+    size_t needed = this->bytes_written + count;
+    if (needed > this->data.size()) {
+      this->data.resize(std::max<size_t>(needed, this->data.size() * 2));
+    }
+  }
+};
+
+} // namespace ResourceDASM
@@ -1,4 +1,5 @@
 #include "Codecs.hh"
+#include "LZOutputBuffer.hh"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,7 +32,7 @@ string decompress_macski_RUN4(const void* vdata, size_t size) {
   uint8_t repeat_5_command = r.get_u8();
   uint8_t repeat_var_command = r.get_u8();
 
-  string ret;
+  LZOutputBuffer ret(decompressed_size);
   while (ret.size() < decompressed_size) {
     uint8_t command = r.get_u8();
     size_t count;
@@ -52,16 +53,14 @@ string decompress_macski_RUN4(const void* vdata, size_t size) {
       count = 1;
     }
 
-    for (; count != 0; count--) {
-      ret += static_cast<char>(command);
-    }
+    ret.fill(command, count);
 
     if (ret.size() > decompressed_size) {
       throw runtime_error("decompression produced too much data");
     }
   }
 
-  return ret;
+  return ret.finish();
 }
 
 string decompress_macski_RUN4(const string& data) {
@@ -115,7 +114,7 @@ string decompress_macski_COOK_CO2K(const void* vdata, size_t size) {
     copy_command_far = copy_5_command_far = copy_4_command_far = copy_var_command;
   }
 
-  string ret;
+  LZOutputBuffer ret(decompressed_size);
   while (ret.size() < decompressed_size) {
     uint8_t command = r.get_u8();
     uint32_t size;
@@ -153,7 +152,7 @@ string decompress_macski_COOK_CO2K(const void* vdata, size_t size) {
     }
 
     if (size == 0) {
-      ret += static_cast<char>(command);
+      ret.put_u8(command);
       continue;
     }
 
@@ -167,12 +166,9 @@ string decompress_macski_COOK_CO2K(const void* vdata, size_t size) {
       if (offset > ret.size()) {
         throw runtime_error("backreference out of bounds");
       }
-      const uint8_t* src = reinterpret_cast<const uint8_t*>(ret.data()) + ret.size() - offset;
-      for (; size > 0; size--) {
-        ret += static_cast<char>(*(src++));
-      }
+      ret.copy_backreference(offset, size);
     } else {
-      ret += static_cast<char>(command);
+      ret.put_u8(command);
     }
   }
 
@@ -180,7 +176,7 @@ string decompress_macski_COOK_CO2K(const void* vdata, size_t size) {
     throw runtime_error("decompression produced too much data");
   }
 
-  return ret;
+  return ret.finish();
 }
 
 string decompress_macski_COOK_CO2K(const string& data) {
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <sys/types.h>
 
+#include <bit>
 #include <phosg/Encoding.hh>
 #include <phosg/Strings.hh>
 #include <stdexcept>
@@ -15,33 +16,105 @@ using namespace phosg;
 
 namespace ResourceDASM {
 
-string unpack_bits(const void* data, size_t size) {
-  StringReader r(data, size);
-  StringWriter w;
+// Loads 8 bytes in little-endian order, so that the first byte in memory is
+// always the least-significant byte of the result
+static inline uint64_t load_u64l(const uint8_t* data) {
+  uint64_t ret;
+  memcpy(&ret, data, sizeof(ret));
+  if constexpr (std::endian::native == std::endian::big) {
+    ret = std::byteswap(ret);
+  }
+  return ret;
+}
 
-  // Commands:
-  // 0CCCCCCC <data> - write data (1 + C bytes of it) directly from the input
-  // 1CCCCCCC DDDDDDDD - write (1 - C) bytes of D (C treated as negative number)
-  // 10000000 - no-op (for some reason)
-  while (!r.eof()) {
-    int8_t cmd = r.get_s8();
+// Returns the index of the first byte in [offset, end) that isn't v, or end if
+// all of them are v. This checks 8 bytes at a time.
+static size_t find_run_end(const uint8_t* data, size_t offset, size_t end, uint8_t v) {
+  uint64_t pattern = 0x0101010101010101ULL * v;
+  for (; offset + 8 <= end; offset += 8) {
+    uint64_t diff = load_u64l(&data[offset]) ^ pattern;
+    if (diff) {
+      return offset + (std::countr_zero(diff) >> 3);
+    }
+  }
+  for (; (offset < end) && (data[offset] == v); offset++) {
+  }
+  return offset;
+}
+
+// Returns the index of the first byte in [offset, end) that is the same as
+// the byte before it, or end if there are none. offset must be at least 1.
+// This checks 8 bytes at a time.
+static size_t find_repeated_byte(const uint8_t* data, size_t offset, size_t end) {
+  for (; offset + 8 <= end; offset += 8) {
+    // Bytes that are the same as their predecessors are zero in diff. The
+    // lowest set bit in has_zero is always in the first zero byte (borrows
+    // can only cause false positives in higher bytes).
+    uint64_t diff = load_u64l(&data[offset]) ^ load_u64l(&data[offset - 1]);
+    uint64_t has_zero = (diff - 0x0101010101010101ULL) & ~diff & 0x8080808080808080ULL;
+    if (has_zero) {
+      return offset + (std::countr_zero(has_zero) >> 3);
+    }
+  }
+  for (; (offset < end) && (data[offset] != data[offset - 1]); offset++) {
+  }
+  return offset;
+}
+
+// Commands:
+// 0CCCCCCC <data> - write data (1 + C bytes of it) directly from the input
+// 1CCCCCCC DDDDDDDD - write (1 - C) bytes of D (C treated as negative number)
+// 10000000 - no-op (for some reason)
+
+void unpack_bits(const void* data, size_t size, string& out) {
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+
+  // Compute the output size first, so the output buffer only has to be resized
+  // once (and not at all if it's being reused and is already big enough)
+  size_t out_size = 0;
+  for (size_t offset = 0; offset < size;) {
+    int8_t cmd = in[offset++];
     if (cmd == -128) {
       continue;
     } else if (cmd < 0) {
-      uint8_t v = r.get_u8();
-      size_t count = 1 - cmd;
-      for (size_t z = 0; z < count; z++) {
-        w.put_u8(v);
+      if (offset >= size) {
+        throw out_of_range("PackBits run command is missing its data");
       }
+      offset++;
+      out_size += 1 - cmd;
     } else {
       size_t count = 1 + cmd;
-      for (size_t z = 0; z < count; z++) {
-        w.put_u8(r.get_u8());
+      if (size - offset < count) {
+        throw out_of_range("PackBits data command is truncated");
       }
+      offset += count;
+      out_size += count;
     }
   }
 
-  return std::move(w.str());
+  out.resize(out_size);
+  uint8_t* out_data = reinterpret_cast<uint8_t*>(out.data());
+  for (size_t offset = 0; offset < size;) {
+    int8_t cmd = in[offset++];
+    if (cmd == -128) {
+      continue;
+    } else if (cmd < 0) {
+      size_t count = 1 - cmd;
+      memset(out_data, in[offset++], count);
+      out_data += count;
+    } else {
+      size_t count = 1 + cmd;
+      memcpy(out_data, &in[offset], count);
+      offset += count;
+      out_data += count;
+    }
+  }
+}
+
+string unpack_bits(const void* data, size_t size) {
+  string ret;
+  unpack_bits(data, size, ret);
+  return ret;
 }
 
 string unpack_bits(const string& data) {
@@ -60,9 +133,9 @@ void unpack_bits(StringReader& in, void* uncompressed_data, uint32_t uncompresse
     if (len < 0) {
       // -len+1 repetitions of the next byte
       uint8_t byte = in.get_u8();
-      for (int i = 0; (i < -len + 1) && (out < out_end); ++i) {
-        *out++ = byte;
-      }
+      size_t count = min<size_t>(out_end - out, -len + 1);
+      memset(out, byte, count);
+      out += count;
     } else {
       // len + 1 raw bytes
       size_t to_read = min<size_t>(out_end - out, len + 1);
@@ -74,42 +147,40 @@ void unpack_bits(StringReader& in, void* uncompressed_data, uint32_t uncompresse
 
 string pack_bits(const void* data, size_t size) {
   // See unpack_bits (above) for descriptions of the commands.
-  StringReader r(data, size);
-  StringWriter w;
-
-  size_t run_start_offset;
-  while (!r.eof()) {
-    uint8_t ch = r.get_u8();
-    if (r.eof()) {
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+  string ret;
+  ret.reserve(size + (size / 128) + 1);
+
+  size_t offset = 0;
+  while (offset < size) {
+    size_t run_start_offset = offset;
+    uint8_t ch = in[offset++];
+    if (offset == size) {
       // Only one byte left in the input; just write it verbatim
-      w.put_u8(0x00);
-      w.put_u8(ch);
+      ret.push_back(0x00);
+      ret.push_back(ch);
       break;
     }
 
-    run_start_offset = r.where() - 1;
-
-    if (r.get_u8() == ch) { // Run of same byte
-      while (((r.where() - run_start_offset) < 128) &&
-          !r.eof() &&
-          (r.get_u8(false) == ch)) {
-        r.skip(1);
-      }
-      w.put_u8(1 - (r.where() - run_start_offset));
-      w.put_u8(ch);
+    size_t max_end_offset = min<size_t>(size, run_start_offset + 128);
+    if (in[offset++] == ch) { // Run of same byte
+      offset = find_run_end(in, offset, max_end_offset, ch);
+      ret.push_back(1 - (offset - run_start_offset));
+      ret.push_back(ch);
 
     } else { // Run of different bytes
-      while (((r.where() - run_start_offset) < 128) &&
-          !r.eof() &&
-          (r.get_u8(false) != ch)) {
-        ch = r.get_u8();
+      // The run ends before the first byte that's the same as the byte before
+      // it, except that the third byte is compared to the first byte instead
+      // of the second
+      if ((offset < max_end_offset) && (in[offset] != ch)) {
+        offset = find_repeated_byte(in, offset + 1, max_end_offset);
       }
-      w.put_u8(r.where() - run_start_offset - 1);
-      w.write(r.pread(run_start_offset, r.where() - run_start_offset));
+      ret.push_back(offset - run_start_offset - 1);
+      ret.append(reinterpret_cast<const char*>(&in[run_start_offset]), offset - run_start_offset);
     }
   }
 
-  return std::move(w.str());
+  return ret;
 }
 
 string pack_bits(const string& data) {
@@ -117,23 +188,19 @@ string pack_bits(const string& data) {
 }
 
 string decompress_packed_icns_data(const void* data, size_t size) {
-  StringWriter w;
+  string ret;
   StringReader r(data, size);
   while (!r.eof()) {
     uint16_t cmd = r.get_u8();
     if (cmd < 0x80) {
       // 00-7F: Write (cmd + 1) bytes directly from the input
-      w.write(r.getv(cmd + 1), cmd + 1);
+      ret.append(reinterpret_cast<const char*>(r.getv(cmd + 1)), cmd + 1);
     } else {
       // 80-FF VV: Write (cmd - 0x80 + 3) bytes of VV
-      size_t target_size = w.size() + (cmd - 0x80 + 3);
-      uint8_t v = r.get_u8();
-      while (w.size() < target_size) {
-        w.put_u8(v);
-      }
+      ret.append(cmd - 0x80 + 3, r.get_u8());
     }
   }
-  return std::move(w.str());
+  return ret;
 }
 
 string decompress_packed_icns_data(const string& data) {
@@ -1,4 +1,5 @@
 #include "Codecs.hh"
+#include "LZOutputBuffer.hh"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,7 +19,7 @@ namespace ResourceDASM {
 string decompress_presage_lzss(StringReader& r, size_t max_output_bytes) {
   size_t decompressed_size = max_output_bytes ? max_output_bytes : r.get_u32b();
 
-  StringWriter w;
+  LZOutputBuffer w(decompressed_size);
   while (w.size() < decompressed_size) {
     uint8_t control_bits = r.get_u8();
     for (size_t x = 0; (x < 8) && (w.size() < decompressed_size); x++) {
@@ -26,18 +27,14 @@ string decompress_presage_lzss(StringReader& r, size_t max_output_bytes) {
       control_bits >>= 1;
       if (is_backreference) {
         uint16_t args = r.get_u16b();
-        size_t offset = w.size() - ((args & 0x0FFF) + 1);
-        size_t count = ((args >> 12) & 0x000F) + 3;
-        for (size_t x = 0; x < count; x++) {
-          w.put_u8(w.str().at(offset++));
-        }
+        w.copy_backreference((args & 0x0FFF) + 1, ((args >> 12) & 0x000F) + 3);
       } else {
         w.put_u8(r.get_u8());
       }
     }
   }
 
-  return std::move(w.str());
+  return w.finish();
 }
 
 string decompress_presage_lzss(const void* data, size_t size, size_t max_output_bytes) {
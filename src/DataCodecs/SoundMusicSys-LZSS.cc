@@ -1,4 +1,5 @@
 #include "Codecs.hh"
+#include "LZOutputBuffer.hh"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,38 +18,33 @@ namespace ResourceDASM {
 
 string decompress_soundmusicsys_lzss(const void* vsrc, size_t size) {
   StringReader r(vsrc, size);
-  string ret;
+  // The decompressed size isn't stored in the data, so this is only a guess
+  LZOutputBuffer ret(size * 2);
 
   for (;;) {
     if (r.eof()) {
-      return ret;
+      return ret.finish();
     }
     uint8_t control_bits = r.get_u8();
 
     for (uint8_t control_mask = 0x01; control_mask; control_mask <<= 1) {
       if (control_bits & control_mask) {
         if (r.eof()) {
-          return ret;
+          return ret.finish();
         }
-        ret += static_cast<char>(r.get_s8());
+        ret.put_u8(r.get_u8());
 
       } else {
         if (r.where() >= r.size() - 1) {
-          return ret;
+          return ret.finish();
         }
         uint16_t params = r.get_u16b();
 
-        size_t copy_offset = ret.size() - ((1 << 12) - (params & 0x0FFF));
-        uint8_t count = ((params >> 12) & 0x0F) + 3;
-        size_t copy_end_offset = copy_offset + count;
-
-        for (; copy_offset != copy_end_offset; copy_offset++) {
-          ret += ret.at(copy_offset);
-        }
+        ret.copy_backreference((1 << 12) - (params & 0x0FFF), ((params >> 12) & 0x0F) + 3);
       }
     }
   }
-  return ret;
+  return ret.finish();
 }
 
 string decompress_soundmusicsys_lzss(const string& data) {
@@ -0,0 +1,490 @@
+#include "Codecs.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <phosg/Encoding.hh>
+#include <phosg/Strings.hh>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace phosg;
+
+namespace ResourceDASM {
+
+StreamDecoder::StreamDecoder(OutputFn output_fn, size_t window_size)
+    : output_fn(std::move(output_fn)),
+      window(window_size, '\0'),
+      input_bytes(0),
+      output_bytes(0) {
+  if (window_size & (window_size - 1)) {
+    throw invalid_argument("window size must be a power of 2");
+  }
+  this->output_buffer.reserve(STREAM_DECODER_CHUNK_SIZE);
+}
+
+void StreamDecoder::feed(const void* data, size_t size) {
+  this->input_bytes += size;
+  if (this->pending_input.empty()) {
+    size_t consumed = this->decode(reinterpret_cast<const uint8_t*>(data), size);
+    this->pending_input.assign(reinterpret_cast<const char*>(data) + consumed, size - consumed);
+  } else {
+    this->pending_input.append(reinterpret_cast<const char*>(data), size);
+    size_t consumed = this->decode(
+        reinterpret_cast<const uint8_t*>(this->pending_input.data()), this->pending_input.size());
+    this->pending_input.erase(0, consumed);
+  }
+}
+
+void StreamDecoder::finish() {
+  this->on_finish(reinterpret_cast<const uint8_t*>(this->pending_input.data()), this->pending_input.size());
+  this->pending_input.clear();
+  this->flush_output();
+}
+
+void StreamDecoder::put_u8(uint8_t v) {
+  if (!this->window.empty()) {
+    this->window[this->output_bytes & (this->window.size() - 1)] = v;
+  }
+  this->output_bytes++;
+  this->output_buffer.push_back(v);
+  if (this->output_buffer.size() >= STREAM_DECODER_CHUNK_SIZE) {
+    this->flush_output();
+  }
+}
+
+void StreamDecoder::write(const void* data, size_t size) {
+  this->append_to_window(data, size);
+  this->output_bytes += size;
+
+  const char* bytes = reinterpret_cast<const char*>(data);
+  while (size > 0) {
+    size_t chunk_size = min<size_t>(size, STREAM_DECODER_CHUNK_SIZE - this->output_buffer.size());
+    this->output_buffer.append(bytes, chunk_size);
+    bytes += chunk_size;
+    size -= chunk_size;
+    if (this->output_buffer.size() >= STREAM_DECODER_CHUNK_SIZE) {
+      this->flush_output();
+    }
+  }
+}
+
+void StreamDecoder::fill(uint8_t v, size_t count) {
+  if (!this->window.empty()) {
+    size_t mask = this->window.size() - 1;
+    for (size_t z = 0; z < min<size_t>(count, this->window.size()); z++) {
+      this->window[(this->output_bytes + z) & mask] = v;
+    }
+  }
+  this->output_bytes += count;
+
+  while (count > 0) {
+    size_t chunk_size = min<size_t>(count, STREAM_DECODER_CHUNK_SIZE - this->output_buffer.size());
+    this->output_buffer.append(chunk_size, v);
+    count -= chunk_size;
+    if (this->output_buffer.size() >= STREAM_DECODER_CHUNK_SIZE) {
+      this->flush_output();
+    }
+  }
+}
+
+void StreamDecoder::copy_backreference(size_t distance, size_t count) {
+  if ((distance == 0) || (distance > this->output_bytes) || (distance > this->window.size())) {
+    throw out_of_range("backreference is out of range");
+  }
+  // put_u8 updates the window, so this works for overlapping references too
+  size_t mask = this->window.size() - 1;
+  for (; count > 0; count--) {
+    this->put_u8(this->window[(this->output_bytes - distance) & mask]);
+  }
+}
+
+void StreamDecoder::append_to_window(const void* data, size_t size) {
+  if (this->window.empty()) {
+    return;
+  }
+  // Only the last window.size() bytes can ever be referenced
+  const char* bytes = reinterpret_cast<const char*>(data);
+  size_t start_offset = this->output_bytes;
+  if (size > this->window.size()) {
+    bytes += size - this->window.size();
+    start_offset += size - this->window.size();
+    size = this->window.size();
+  }
+  size_t window_offset = start_offset & (this->window.size() - 1);
+  size_t first_size = min<size_t>(size, this->window.size() - window_offset);
+  memcpy(this->window.data() + window_offset, bytes, first_size);
+  memcpy(this->window.data(), bytes + first_size, size - first_size);
+}
+
+void StreamDecoder::flush_output() {
+  if (!this->output_buffer.empty()) {
+    this->output_fn(this->output_buffer.data(), this->output_buffer.size());
+    this->output_buffer.clear();
+  }
+}
+
+// See unpack_bits in PackBits.cc for a description of the commands
+class UnpackBitsStreamDecoder : public StreamDecoder {
+public:
+  explicit UnpackBitsStreamDecoder(OutputFn output_fn)
+      : StreamDecoder(std::move(output_fn), 0) {}
+  virtual ~UnpackBitsStreamDecoder() = default;
+
+protected:
+  virtual size_t decode(const uint8_t* data, size_t size) {
+    size_t offset = 0;
+    while (offset < size) {
+      int8_t cmd = data[offset];
+      if (cmd == -128) {
+        offset++;
+      } else if (cmd < 0) {
+        if (size - offset < 2) {
+          break;
+        }
+        this->fill(data[offset + 1], 1 - cmd);
+        offset += 2;
+      } else {
+        size_t count = 1 + cmd;
+        if (size - offset - 1 < count) {
+          break;
+        }
+        this->write(&data[offset + 1], count);
+        offset += count + 1;
+      }
+    }
+    return offset;
+  }
+
+  virtual void on_finish(const uint8_t* data, size_t size) {
+    if (size > 0) {
+      throw out_of_range((static_cast<int8_t>(data[0]) < 0)
+              ? "PackBits run command is missing its data"
+              : "PackBits data command is truncated");
+    }
+  }
+};
+
+// See unpack_pathways in Bungie.cc
+class UnpackPathwaysStreamDecoder : public StreamDecoder {
+public:
+  explicit UnpackPathwaysStreamDecoder(OutputFn output_fn)
+      : StreamDecoder(std::move(output_fn), 0),
+        has_header(false),
+        decompressed_size(0) {}
+  virtual ~UnpackPathwaysStreamDecoder() = default;
+
+protected:
+  virtual size_t decode(const uint8_t* data, size_t size) {
+    size_t offset = 0;
+    if (!this->has_header) {
+      if (size < 4) {
+        return 0;
+      }
+      this->decompressed_size = *reinterpret_cast<const be_uint32_t*>(data);
+      this->has_header = true;
+      offset = 4;
+    }
+
+    while (this->output_size() < this->decompressed_size) {
+      if (offset >= size) {
+        break;
+      }
+      uint8_t cmd = data[offset];
+      if (cmd >= 0x80) {
+        size_t count = cmd - 0x7F;
+        if (size - offset - 1 < count) {
+          break;
+        }
+        this->write(&data[offset + 1], count);
+        offset += count + 1;
+      } else {
+        if (size - offset < 2) {
+          break;
+        }
+        this->fill(data[offset + 1], cmd + 3);
+        offset += 2;
+      }
+    }
+
+    // Anything after the end of the compressed data is ignored
+    return (this->has_header && (this->output_size() >= this->decompressed_size)) ? size : offset;
+  }
+
+  virtual void on_finish(const uint8_t*, size_t) {
+    if (!this->has_header || (this->output_size() < this->decompressed_size)) {
+      throw out_of_range("compressed data is truncated");
+    }
+  }
+
+private:
+  bool has_header;
+  size_t decompressed_size;
+};
+
+// Shared by the LZSS variants below, which all group commands in blocks of 8
+// with a control byte before each block (read from the low bit up)
+class LZSSStreamDecoder : public StreamDecoder {
+public:
+  LZSSStreamDecoder(OutputFn output_fn, size_t window_size)
+      : StreamDecoder(std::move(output_fn), window_size),
+        control_bits(0),
+        control_bits_remaining(0) {}
+  virtual ~LZSSStreamDecoder() = default;
+
+protected:
+  uint8_t control_bits;
+  uint8_t control_bits_remaining;
+
+  // Returns false if there's no input left for the next control byte
+  inline bool read_control_bits(const uint8_t* data, size_t size, size_t& offset) {
+    if (this->control_bits_remaining == 0) {
+      if (offset >= size) {
+        return false;
+      }
+      this->control_bits = data[offset++];
+      this->control_bits_remaining = 8;
+    }
+    return true;
+  }
+
+  inline void advance_control_bits() {
+    this->control_bits >>= 1;
+    this->control_bits_remaining--;
+  }
+};
+
+// See decompress_presage_lzss in Presage-LZSS.cc
+class PresageLZSSStreamDecoder : public LZSSStreamDecoder {
+public:
+  explicit PresageLZSSStreamDecoder(OutputFn output_fn)
+      : LZSSStreamDecoder(std::move(output_fn), 0x1000),
+        has_header(false),
+        decompressed_size(0) {}
+  virtual ~PresageLZSSStreamDecoder() = default;
+
+protected:
+  virtual size_t decode(const uint8_t* data, size_t size) {
+    size_t offset = 0;
+    if (!this->has_header) {
+      if (size < 4) {
+        return 0;
+      }
+      this->decompressed_size = *reinterpret_cast<const be_uint32_t*>(data);
+      this->has_header = true;
+      offset = 4;
+    }
+
+    while (this->output_size() < this->decompressed_size) {
+      if (!this->read_control_bits(data, size, offset)) {
+        break;
+      }
+      if (this->control_bits & 1) {
+        if (size - offset < 2) {
+          break;
+        }
+        uint16_t args = *reinterpret_cast<const be_uint16_t*>(&data[offset]);
+        offset += 2;
+        this->copy_backreference((args & 0x0FFF) + 1, ((args >> 12) & 0x000F) + 3);
+      } else {
+        if (offset >= size) {
+          break;
+        }
+        this->put_u8(data[offset++]);
+      }
+      this->advance_control_bits();
+    }
+
+    return (this->has_header && (this->output_size() >= this->decompressed_size)) ? size : offset;
+  }
+
+  virtual void on_finish(const uint8_t*, size_t) {
+    if (!this->has_header || (this->output_size() < this->decompressed_size)) {
+      throw out_of_range("compressed data is truncated");
+    }
+  }
+
+private:
+  bool has_header;
+  size_t decompressed_size;
+};
+
+// See decompress_soundmusicsys_lzss in SoundMusicSys-LZSS.cc
+class SoundMusicSysLZSSStreamDecoder : public LZSSStreamDecoder {
+public:
+  explicit SoundMusicSysLZSSStreamDecoder(OutputFn output_fn)
+      : LZSSStreamDecoder(std::move(output_fn), 0x1000) {}
+  virtual ~SoundMusicSysLZSSStreamDecoder() = default;
+
+protected:
+  virtual size_t decode(const uint8_t* data, size_t size) {
+    size_t offset = 0;
+    while (this->read_control_bits(data, size, offset)) {
+      if (this->control_bits & 1) {
+        if (offset >= size) {
+          break;
+        }
+        this->put_u8(data[offset++]);
+      } else {
+        if (size - offset < 2) {
+          break;
+        }
+        uint16_t params = *reinterpret_cast<const be_uint16_t*>(&data[offset]);
+        offset += 2;
+        this->copy_backreference((1 << 12) - (params & 0x0FFF), ((params >> 12) & 0x0F) + 3);
+      }
+      this->advance_control_bits();
+    }
+    return offset;
+  }
+
+  virtual void on_finish(const uint8_t*, size_t) {
+    // This format has no end marker; as in the non-streaming decoder, a
+    // trailing partial command is ignored
+  }
+};
+
+// See DinoParkTycoon-LZSS-RLE.cc
+class DinoParkTycoonStreamDecoder : public LZSSStreamDecoder {
+public:
+  explicit DinoParkTycoonStreamDecoder(OutputFn output_fn)
+      : LZSSStreamDecoder(std::move(output_fn), 0x400),
+        format(Format::UNKNOWN),
+        compressed_size(0),
+        decompressed_size(0) {}
+  virtual ~DinoParkTycoonStreamDecoder() = default;
+
+protected:
+  virtual size_t decode(const uint8_t* data, size_t size) {
+    size_t offset = 0;
+    if (this->format == Format::UNKNOWN) {
+      if (size < 4) {
+        return 0;
+      }
+      uint32_t magic = *reinterpret_cast<const be_uint32_t*>(data);
+      if ((magic == 0x4C5A5353) || (magic == 0x524C4520)) { // 'LZSS' or 'RLE '
+        if (size < 0x10) {
+          return 0;
+        }
+        this->format = (magic == 0x4C5A5353) ? Format::LZSS : Format::RLE;
+        this->compressed_size = *reinterpret_cast<const be_uint32_t*>(&data[4]);
+        this->decompressed_size = *reinterpret_cast<const be_uint32_t*>(&data[8]);
+        offset = 0x10; // The last header field is unknown; seems to always be zero?
+      } else {
+        this->format = Format::RAW;
+      }
+    }
+
+    switch (this->format) {
+      case Format::UNKNOWN:
+        throw logic_error("format was not determined");
+      case Format::RAW:
+        this->write(&data[offset], size - offset);
+        return size;
+      case Format::LZSS:
+        return this->decode_lzss(data, size, offset);
+      case Format::RLE:
+        return this->decode_rle(data, size, offset);
+    }
+    throw logic_error("invalid format");
+  }
+
+  virtual void on_finish(const uint8_t*, size_t size) {
+    if (this->format == Format::UNKNOWN) {
+      throw out_of_range("input is too short");
+    }
+    if (this->format == Format::RAW) {
+      return;
+    }
+    if (this->input_size() - 0x10 < this->compressed_size) {
+      throw runtime_error("not all compressed data is present");
+    }
+    if ((this->format == Format::LZSS) ? (this->output_size() < this->decompressed_size) : (size > 0)) {
+      throw out_of_range("compressed data is truncated");
+    }
+    if (this->output_size() != this->decompressed_size) {
+      throw runtime_error(std::format(
+          "decompression produced 0x{:X} bytes (expected 0x{:X} bytes)", this->output_size(), this->decompressed_size));
+    }
+  }
+
+private:
+  enum class Format {
+    UNKNOWN = 0,
+    RAW,
+    LZSS,
+    RLE,
+  };
+  Format format;
+  size_t compressed_size;
+  size_t decompressed_size;
+
+  size_t decode_lzss(const uint8_t* data, size_t size, size_t offset) {
+    while (this->output_size() < this->decompressed_size) {
+      if (!this->read_control_bits(data, size, offset)) {
+        break;
+      }
+      if (this->control_bits & 1) {
+        if (offset >= size) {
+          break;
+        }
+        this->put_u8(data[offset++]);
+      } else {
+        if (size - offset < 2) {
+          break;
+        }
+        uint16_t args = *reinterpret_cast<const le_uint16_t*>(&data[offset]);
+        offset += 2;
+        this->copy_backreference(args >> 6, (args & 0x3F) + 3);
+      }
+      this->advance_control_bits();
+    }
+    return (this->output_size() >= this->decompressed_size) ? size : offset;
+  }
+
+  size_t decode_rle(const uint8_t* data, size_t size, size_t offset) {
+    while (offset < size) {
+      uint8_t cmd = data[offset];
+      if (cmd & 0x80) {
+        if (size - offset < 2) {
+          break;
+        }
+        this->fill(data[offset + 1], 0x101 - cmd);
+        offset += 2;
+      } else {
+        size_t count = cmd + 1;
+        if (size - offset - 1 < count) {
+          break;
+        }
+        this->write(&data[offset + 1], count);
+        offset += count + 1;
+      }
+    }
+    return offset;
+  }
+};
+
+unique_ptr<StreamDecoder> make_unpack_bits_stream_decoder(StreamDecoder::OutputFn output_fn) {
+  return make_unique<UnpackBitsStreamDecoder>(std::move(output_fn));
+}
+
+unique_ptr<StreamDecoder> make_unpack_pathways_stream_decoder(StreamDecoder::OutputFn output_fn) {
+  return make_unique<UnpackPathwaysStreamDecoder>(std::move(output_fn));
+}
+
+unique_ptr<StreamDecoder> make_presage_lzss_stream_decoder(StreamDecoder::OutputFn output_fn) {
+  return make_unique<PresageLZSSStreamDecoder>(std::move(output_fn));
+}
+
+unique_ptr<StreamDecoder> make_soundmusicsys_lzss_stream_decoder(StreamDecoder::OutputFn output_fn) {
+  return make_unique<SoundMusicSysLZSSStreamDecoder>(std::move(output_fn));
+}
+
+unique_ptr<StreamDecoder> make_dinopark_tycoon_stream_decoder(StreamDecoder::OutputFn output_fn) {
+  return make_unique<DinoParkTycoonStreamDecoder>(std::move(output_fn));
+}
+
+} // namespace ResourceDASM
@@ -1,10 +1,24 @@
 #include "InterruptManager.hh"
 
+#include <algorithm>
+
 using namespace std;
 
 namespace ResourceDASM {
 
-InterruptManager::InterruptManager() : cycle_count(0) {}
+InterruptManager::InterruptManager()
+    : cycle_count(0),
+      next_deadline(UINT64_MAX),
+      next_sequence(0) {}
+
+// std::push_heap and friends build max-heaps, so this orders later calls
+// first to put the earliest call at the front
+bool InterruptManager::call_is_later(const ScheduledCall& a, const ScheduledCall& b) {
+  if (a.at_cycle_count != b.at_cycle_count) {
+    return a.at_cycle_count > b.at_cycle_count;
+  }
+  return a.sequence > b.sequence;
+}
 
 shared_ptr<InterruptManager::PendingCall> InterruptManager::add(uint64_t after_cycles, function<bool()> fn) {
   auto ret = make_shared<PendingCall>();
@@ -13,38 +27,35 @@ shared_ptr<InterruptManager::PendingCall> InterruptManager::add(uint64_t after_c
   ret->completed = false;
   ret->fn = std::move(fn);
 
-  if (!this->head.get()) {
-    this->head = ret;
-  } else {
-    if (ret->at_cycle_count < this->head->at_cycle_count) {
-      ret->next = this->head;
-      this->head = ret;
-    } else {
-      shared_ptr<PendingCall> prev = this->head;
-      shared_ptr<PendingCall> next = this->head->next;
-      while (next.get() && next->at_cycle_count < ret->at_cycle_count) {
-        prev = next;
-        next = next->next;
-      }
-      ret->next = next;
-      prev->next = ret;
-    }
-  }
+  this->pending_calls.emplace_back(ScheduledCall{ret->at_cycle_count, this->next_sequence++, ret});
+  push_heap(this->pending_calls.begin(), this->pending_calls.end(), call_is_later);
+  this->update_next_deadline();
 
   return ret;
 }
 
-void InterruptManager::on_cycle_start() {
-  this->cycle_count++;
-
-  while (this->head.get() && (this->head->at_cycle_count <= this->cycle_count)) {
-    shared_ptr<PendingCall> c = this->head;
-    this->head = c->next;
+bool InterruptManager::run_pending_calls() {
+  bool any_called = false;
+  while (!this->pending_calls.empty() && (this->pending_calls.front().at_cycle_count <= this->cycle_count)) {
+    pop_heap(this->pending_calls.begin(), this->pending_calls.end(), call_is_later);
+    shared_ptr<PendingCall> c = std::move(this->pending_calls.back().call);
+    this->pending_calls.pop_back();
+    // The called function may add more calls, so the deadline has to be
+    // correct before calling it
+    this->update_next_deadline();
     if (!c->canceled) {
       c->fn();
+      any_called = true;
     }
     c->completed = true;
   }
+  return any_called;
+}
+
+void InterruptManager::update_next_deadline() {
+  this->next_deadline = this->pending_calls.empty()
+      ? UINT64_MAX
+      : this->pending_calls.front().at_cycle_count;
 }
 
 uint64_t InterruptManager::cycles() const {
@@ -5,6 +5,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace ResourceDASM {
 
@@ -14,7 +15,6 @@ public:
   ~InterruptManager() = default;
 
   struct PendingCall {
-    std::shared_ptr<PendingCall> next;
     uint64_t at_cycle_count;
     bool canceled;
     bool completed;
@@ -25,15 +25,40 @@ public:
     }
   };
 
+  // Schedules fn to be called after the given number of cycles. Calls
+  // scheduled for the same cycle are run in the order they were added.
   std::shared_ptr<PendingCall> add(uint64_t cycle_count, std::function<bool()> fn);
 
-  void on_cycle_start();
+  // Returns true if any pending call was run. This is called before every
+  // emulated instruction, so the common case (nothing is due yet) is inlined
+  // and only compares the cycle count against the earliest pending deadline.
+  inline bool on_cycle_start() {
+    if (++this->cycle_count < this->next_deadline) {
+      return false;
+    }
+    return this->run_pending_calls();
+  }
 
   uint64_t cycles() const;
 
 protected:
+  struct ScheduledCall {
+    uint64_t at_cycle_count;
+    uint64_t sequence;
+    std::shared_ptr<PendingCall> call;
+  };
+
   uint64_t cycle_count;
-  std::shared_ptr<PendingCall> head;
+  // Cycle count of the earliest entry in pending_calls, or UINT64_MAX if there
+  // are none
+  uint64_t next_deadline;
+  uint64_t next_sequence;
+  // Binary min-heap ordered by (at_cycle_count, sequence)
+  std::vector<ScheduledCall> pending_calls;
+
+  static bool call_is_later(const ScheduledCall& a, const ScheduledCall& b);
+  bool run_pending_calls();
+  void update_next_deadline();
 };
 
 } // namespace ResourceDASM
@@ -3,12 +3,14 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
 #include <array>
 #include <deque>
 #include <filesystem>
 #include <forward_list>
 #include <phosg/Encoding.hh>
 #include <phosg/Filesystem.hh>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 
@@ -414,7 +416,12 @@ void M68KEmulator::Regs::write_stack_s8(shared_ptr<MemoryContext> mem, int8_t v)
   mem->write_s8(this->a[7], v);
 }
 
-M68KEmulator::M68KEmulator(shared_ptr<MemoryContext> mem) : EmulatorBase(mem) {}
+M68KEmulator::M68KEmulator(shared_ptr<MemoryContext> mem)
+    : EmulatorBase(mem),
+      block_cache_enabled(true),
+      block_cache_write_detected(false),
+      block_cache_epoch(0),
+      code_granules_base(0) {}
 
 M68KEmulator::Regs& M68KEmulator::registers() {
   return this->regs;
@@ -532,6 +539,9 @@ void M68KEmulator::write(const ResolvedAddress& addr, uint32_t value, uint8_t si
 }
 
 void M68KEmulator::write(uint32_t addr, uint32_t value, uint8_t size) {
+  if (!this->code_granules.empty()) {
+    this->invalidate_cached_blocks_for_write(addr, size);
+  }
   if (size == SIZE_BYTE) {
     this->mem->write_u8(addr, value);
   } else if (size == SIZE_WORD) {
@@ -1170,38 +1180,53 @@ string M68KEmulator::dasm_unimplemented(DisassemblyState& s) {
   return std::format(".unimplemented {:04X}", s.r.get_u16b());
 }
 
-void M68KEmulator::exec_0123(uint16_t opcode) {
-  // 1, 2, 3 are actually also handled by 0 (this is the only case where the i field is split)
-  uint8_t i = op_get_i(opcode);
-  if (i) {
-    uint8_t size = size_for_dsize[i];
-    if (op_get_b(opcode) == 1) { // movea.S An, ADDR
-      if (size == SIZE_BYTE) {
-        throw runtime_error("invalid movea.b opcode");
-      }
+template <uint8_t Size>
+void M68KEmulator::exec_move(uint16_t opcode) {
+  // move.S ADDR1, ADDR2
+  uint8_t source_M = op_get_c(opcode);
+  uint8_t source_Xn = op_get_d(opcode);
+  auto source_addr = this->resolve_address(source_M, source_Xn, Size);
 
-      uint8_t source_M = op_get_c(opcode);
-      uint8_t source_Xn = op_get_d(opcode);
-      auto source = this->resolve_address(source_M, source_Xn, size);
+  // Note: this isn't a bug; the instruction format really is <r1><m1><m2><r2>
+  uint8_t dest_M = op_get_b(opcode);
+  uint8_t dest_Xn = op_get_a(opcode);
+  auto dest_addr = this->resolve_address(dest_M, dest_Xn, Size);
 
-      // movea is always a long write, even if it's a word read - so we don't use this->write, etc.
-      this->regs.a[op_get_a(opcode)] = sign_extend(this->read(source, size), size);
-      return;
+  uint32_t value = this->read(source_addr, Size);
+  this->write(dest_addr, value, Size);
+  this->regs.set_ccr_flags(-1, is_negative(value, Size), (value == 0), 0, 0);
+}
 
-    } else { // move.S ADDR1, ADDR2
-      uint8_t source_M = op_get_c(opcode);
-      uint8_t source_Xn = op_get_d(opcode);
-      auto source_addr = this->resolve_address(source_M, source_Xn, size);
+template <uint8_t Size>
+void M68KEmulator::exec_movea(uint16_t opcode) {
+  // movea.S An, ADDR
+  if (Size == SIZE_BYTE) {
+    throw runtime_error("invalid movea.b opcode");
+  }
 
-      // Note: this isn't a bug; the instruction format really is <r1><m1><m2><r2>
-      uint8_t dest_M = op_get_b(opcode);
-      uint8_t dest_Xn = op_get_a(opcode);
-      auto dest_addr = this->resolve_address(dest_M, dest_Xn, size);
+  uint8_t source_M = op_get_c(opcode);
+  uint8_t source_Xn = op_get_d(opcode);
+  auto source = this->resolve_address(source_M, source_Xn, Size);
 
-      uint32_t value = this->read(source_addr, size);
-      this->write(dest_addr, value, size);
-      this->regs.set_ccr_flags(-1, is_negative(value, size), (value == 0), 0, 0);
-      return;
+  // movea is always a long write, even if it's a word read - so we don't use this->write, etc.
+  this->regs.a[op_get_a(opcode)] = sign_extend(this->read(source, Size), Size);
+}
+
+void M68KEmulator::exec_0123(uint16_t opcode) {
+  // 1, 2, 3 are actually also handled by 0 (this is the only case where the i field is split). opcode_fns dispatches
+  // these directly to exec_move or exec_movea, but we handle them here too for completeness.
+  uint8_t i = op_get_i(opcode);
+  if (i) {
+    bool is_movea = (op_get_b(opcode) == 1);
+    switch (size_for_dsize[i]) {
+      case SIZE_BYTE:
+        return is_movea ? this->exec_movea<SIZE_BYTE>(opcode) : this->exec_move<SIZE_BYTE>(opcode);
+      case SIZE_WORD:
+        return is_movea ? this->exec_movea<SIZE_WORD>(opcode) : this->exec_move<SIZE_WORD>(opcode);
+      case SIZE_LONG:
+        return is_movea ? this->exec_movea<SIZE_LONG>(opcode) : this->exec_move<SIZE_LONG>(opcode);
+      default:
+        throw logic_error("invalid move size");
     }
   }
 
@@ -1339,41 +1364,46 @@ void M68KEmulator::exec_0123(uint16_t opcode) {
   }
 }
 
-string M68KEmulator::dasm_0123(DisassemblyState& s) {
-  // 1, 2, 3 are actually also handled by 0 (this is the only case where the i field is split)
+string M68KEmulator::dasm_move(DisassemblyState& s) {
   uint16_t op = s.r.get_u16b();
   uint8_t i = op_get_i(op);
-  if (i) {
-    ValueType value_type = value_type_for_dsize.at(i);
-    if (op_get_b(op) == 1) {
-      // movea isn't valid with the byte operand size. We'll disassemble it anyway, but complain at the end of the line
+  ValueType value_type = value_type_for_dsize.at(i);
+  if (op_get_b(op) == 1) {
+    // movea isn't valid with the byte operand size. We'll disassemble it anyway, but complain at the end of the line
 
-      uint8_t source_M = op_get_c(op);
-      uint8_t source_Xn = op_get_d(op);
-      string source_addr = M68KEmulator::dasm_address(s, source_M, source_Xn, value_type);
-
-      uint8_t An = op_get_a(op);
-      if (i == SIZE_BYTE) {
-        return std::format(".invalid   A{}, {} // movea not valid with byte operand size", An, source_addr);
-      } else {
-        return std::format("movea.{}    A{}, {}", char_for_dsize.at(i), An, source_addr);
-      }
+    uint8_t source_M = op_get_c(op);
+    uint8_t source_Xn = op_get_d(op);
+    string source_addr = M68KEmulator::dasm_address(s, source_M, source_Xn, value_type);
 
+    uint8_t An = op_get_a(op);
+    if (i == SIZE_BYTE) {
+      return std::format(".invalid   A{}, {} // movea not valid with byte operand size", An, source_addr);
     } else {
-      // Note: empirically the order seems to be source addr first, then dest addr. This is relevant when both contain
-      // displacements or extensions
-      uint8_t source_M = op_get_c(op);
-      uint8_t source_Xn = op_get_d(op);
-      string source_addr = M68KEmulator::dasm_address(s, source_M, source_Xn, value_type);
+      return std::format("movea.{}    A{}, {}", char_for_dsize.at(i), An, source_addr);
+    }
 
-      // Note: this isn't a bug; the instruction format really is <r1><m1><m2><r2>
-      uint8_t dest_M = op_get_b(op);
-      uint8_t dest_Xn = op_get_a(op);
-      string dest_addr = M68KEmulator::dasm_address(s, dest_M, dest_Xn, value_type);
+  } else {
+    // Note: empirically the order seems to be source addr first, then dest addr. This is relevant when both contain
+    // displacements or extensions
+    uint8_t source_M = op_get_c(op);
+    uint8_t source_Xn = op_get_d(op);
+    string source_addr = M68KEmulator::dasm_address(s, source_M, source_Xn, value_type);
 
-      return std::format("move.{}     {}, {}", char_for_dsize.at(i), dest_addr, source_addr);
-    }
+    // Note: this isn't a bug; the instruction format really is <r1><m1><m2><r2>
+    uint8_t dest_M = op_get_b(op);
+    uint8_t dest_Xn = op_get_a(op);
+    string dest_addr = M68KEmulator::dasm_address(s, dest_M, dest_Xn, value_type);
+
+    return std::format("move.{}     {}, {}", char_for_dsize.at(i), dest_addr, source_addr);
+  }
+}
+
+string M68KEmulator::dasm_0123(DisassemblyState& s) {
+  // 1, 2, 3 are actually also handled by 0 (this is the only case where the i field is split)
+  if (op_get_i(s.r.get_u16b(false))) {
+    return M68KEmulator::dasm_move(s);
   }
+  uint16_t op = s.r.get_u16b();
 
   // Note: i == 0 if we get here
 
@@ -1471,7 +1501,188 @@ string M68KEmulator::dasm_0123(DisassemblyState& s) {
   return std::format("{} {}, {}{}", operation, addr, imm, invalid_str);
 }
 
+void M68KEmulator::exec_nop(uint16_t) {}
+
+void M68KEmulator::exec_rts(uint16_t) {
+  this->regs.pc = this->read(this->regs.a[7], SIZE_LONG);
+  this->regs.a[7] += 4;
+}
+
+void M68KEmulator::exec_link(uint16_t opcode) {
+  uint8_t d = op_get_d(opcode);
+  this->regs.a[7] -= 4;
+  this->write(this->regs.a[7], this->regs.a[d], SIZE_LONG);
+  this->regs.a[d] = this->regs.a[7];
+  this->regs.a[7] += this->fetch_instruction_word_signed();
+  // Note: ccr not affected
+}
+
+void M68KEmulator::exec_unlk(uint16_t opcode) {
+  uint8_t d = op_get_d(opcode);
+  this->regs.a[7] = this->regs.a[d];
+  this->regs.a[d] = this->read(this->regs.a[7], SIZE_LONG);
+  this->regs.a[7] += 4;
+  // Note: ccr not affected
+}
+
+void M68KEmulator::exec_jsr(uint16_t opcode) {
+  uint32_t addr = this->resolve_address_control(op_get_c(opcode), op_get_d(opcode));
+  this->regs.a[7] -= 4;
+  this->write(this->regs.a[7], this->regs.pc, SIZE_LONG);
+  this->regs.pc = addr;
+  // Note: ccr not affected
+}
+
+void M68KEmulator::exec_jmp(uint16_t opcode) {
+  this->regs.pc = this->resolve_address_control(op_get_c(opcode), op_get_d(opcode));
+  // Note: ccr not affected
+}
+
+void M68KEmulator::exec_lea(uint16_t opcode) {
+  this->regs.a[op_get_a(opcode)] = this->resolve_address_control(op_get_c(opcode), op_get_d(opcode));
+  // Note: ccr not affected
+}
+
+template <uint8_t Size>
+void M68KEmulator::exec_clr(uint16_t opcode) {
+  // clr.S ADDR
+  auto addr = this->resolve_address(op_get_c(opcode), op_get_d(opcode), Size);
+  this->write(addr, 0, Size);
+  this->regs.set_ccr_flags(-1, 0, 1, 0, 0);
+}
+
+template <uint8_t Size>
+void M68KEmulator::exec_neg(uint16_t opcode) {
+  // neg.S ADDR
+  auto addr = this->resolve_address(op_get_c(opcode), op_get_d(opcode), Size);
+  int32_t value = -static_cast<int32_t>(this->read(addr, Size));
+  this->write(addr, value, Size);
+  this->regs.set_ccr_flags((value != 0), is_negative(value, Size), (value == 0), (-value == value), (value != 0));
+}
+
+template <uint8_t Size>
+void M68KEmulator::exec_not(uint16_t opcode) {
+  // not.S ADDR
+  auto addr = this->resolve_address(op_get_c(opcode), op_get_d(opcode), Size);
+  uint32_t value = ~static_cast<int32_t>(this->read(addr, Size));
+  this->write(addr, value, Size);
+  this->regs.set_ccr_flags(-1, is_negative(value, Size), (value == 0), 0, 0);
+}
+
+template <uint8_t Size>
+void M68KEmulator::exec_ext(uint16_t opcode) {
+  // ext.S REG
+  uint8_t d = op_get_d(opcode);
+  if (Size == SIZE_WORD) { // extend byte to word
+    this->regs.d[d].u = (this->regs.d[d].u & 0xFFFF00FF) | ((this->regs.d[d].u & 0x00000080) ? 0x0000FF00 : 0x00000000);
+  } else { // extend word to long
+    this->regs.d[d].u = (this->regs.d[d].u & 0x0000FFFF) | ((this->regs.d[d].u & 0x00008000) ? 0xFFFF0000 : 0x00000000);
+  }
+  this->regs.set_ccr_flags(-1, is_negative(this->regs.d[d].u, SIZE_LONG), (this->regs.d[d].u == 0), 0, 0);
+}
+
+template <uint8_t Size>
+void M68KEmulator::exec_movem_store(uint16_t opcode) {
+  // movem.S ADDR REGMASK
+  uint8_t bytes_per_value = bytes_for_size[Size];
+  uint8_t M = op_get_c(opcode);
+  uint8_t Xn = op_get_d(opcode);
+  uint16_t reg_mask = this->fetch_instruction_word();
+
+  // Predecrement mode is special-cased for this opcode. In this mode we write the registers in reverse order
+  if (M == 4) {
+    // bit 15 is D0, bit 0 is A7
+    for (size_t x = 0; x < 8; x++) {
+      if (reg_mask & (1 << x)) {
+        this->regs.a[Xn] -= bytes_per_value;
+        this->write(this->regs.a[Xn], this->regs.a[7 - x], Size);
+      }
+    }
+    for (size_t x = 0; x < 8; x++) {
+      if (reg_mask & (1 << (x + 8))) {
+        this->regs.a[Xn] -= bytes_per_value;
+        this->write(this->regs.a[Xn], this->regs.d[7 - x].u, Size);
+      }
+    }
+
+  } else {
+    // bit 15 is A7, bit 0 is D0
+    uint32_t addr = this->resolve_address_control(M, Xn);
+    for (size_t x = 0; x < 8; x++) {
+      if (reg_mask & (1 << x)) {
+        this->write(addr, this->regs.d[x].u, Size);
+        addr += bytes_per_value;
+      }
+    }
+    for (size_t x = 0; x < 8; x++) {
+      if (reg_mask & (1 << (x + 8))) {
+        this->write(addr, this->regs.a[x], Size);
+        addr += bytes_per_value;
+      }
+    }
+  }
+
+  // Note: ccr not affected
+}
+
+template <uint8_t Size>
+void M68KEmulator::exec_movem_load(uint16_t opcode) {
+  // movem.S REGMASK ADDR
+  uint8_t bytes_per_value = bytes_for_size[Size];
+  uint8_t M = op_get_c(opcode);
+  uint8_t Xn = op_get_d(opcode);
+  uint16_t reg_mask = this->fetch_instruction_word();
+
+  // Postincrement mode is special-cased for this opcode
+  uint32_t addr = (M == 3) ? this->regs.a[Xn] : this->resolve_address_control(M, Xn);
+
+  // Load the regs; bit 15 is A7, bit 0 is D0
+  for (size_t x = 0; x < 8; x++) {
+    if (reg_mask & (1 << x)) {
+      this->regs.d[x].u = this->read(addr, Size);
+      addr += bytes_per_value;
+    }
+  }
+  for (size_t x = 0; x < 8; x++) {
+    if (reg_mask & (1 << (x + 8))) {
+      this->regs.a[x] = this->read(addr, Size);
+      addr += bytes_per_value;
+    }
+  }
+
+  // In postincrement mode, update the address register
+  if (M == 3) {
+    this->regs.a[Xn] = addr;
+  }
+
+  // Note: ccr not affected
+}
+
+void M68KEmulator::exec_swap(uint16_t opcode) {
+  // swap.w REG
+  uint8_t reg = op_get_d(opcode);
+  this->regs.d[reg].u = (this->regs.d[reg].u >> 16) | (this->regs.d[reg].u << 16);
+}
+
+void M68KEmulator::exec_pea(uint16_t opcode) {
+  // pea.l ADDR
+  uint32_t addr = this->resolve_address_control(op_get_c(opcode), op_get_d(opcode));
+  this->regs.a[7] -= 4;
+  this->write(this->regs.a[7], addr, SIZE_LONG);
+  // Note: ccr not affected
+}
+
+template <uint8_t Size>
+void M68KEmulator::exec_tst(uint16_t opcode) {
+  // tst.S ADDR
+  auto addr = this->resolve_address(op_get_c(opcode), op_get_d(opcode), Size);
+  uint32_t value = this->read(addr, Size);
+  this->regs.set_ccr_flags(-1, is_negative(value, Size), (value == 0), 0, 0);
+}
+
 void M68KEmulator::exec_4(uint16_t opcode) {
+  // The common instructions in this group (those for which specialized_fns_4 returns handlers) never get here, since
+  // opcode_fns dispatches them directly to their own handlers
   uint8_t g = op_get_g(opcode);
 
   if (g == 0) {
@@ -1482,18 +1693,12 @@ void M68KEmulator::exec_4(uint16_t opcode) {
       switch (opcode & 0x000F) {
         case 0: // reset
           throw terminate_emulation();
-        case 1: // nop
-          return;
         case 2: // stop IMM
           throw runtime_error("unimplemented: stop IMM");
         case 3: // rte
           throw runtime_error("unimplemented: rte");
         case 4: // rtd IMM
           throw runtime_error("unimplemented: rtd IMM");
-        case 5: // rts
-          this->regs.pc = this->read(this->regs.a[7], SIZE_LONG);
-          this->regs.a[7] += 4;
-          return;
         case 6: // trapv
           if (this->regs.sr & Condition::V) {
             throw runtime_error("unimplemented: overflow trap");
@@ -1529,124 +1734,18 @@ void M68KEmulator::exec_4(uint16_t opcode) {
         }
         throw runtime_error("invalid opcode 4:1");
 
-      } else { // s is a valid SIZE_*
-        switch (a) {
-          case 0: // negx.S ADDR
-            throw runtime_error("unimplemented: negx.S ADDR");
-          case 1: // clr.S ADDR
-            this->write(addr, 0, size);
-            this->regs.set_ccr_flags(-1, 0, 1, 0, 0);
-            return;
-          case 2: { // neg.S ADDR
-            int32_t value = -static_cast<int32_t>(this->read(addr, size));
-            this->write(addr, value, size);
-            this->regs.set_ccr_flags(
-                (value != 0), is_negative(value, size), (value == 0), (-value == value), (value != 0));
-            return;
-          }
-          case 3: { // not.S ADDR
-            uint32_t value = ~static_cast<int32_t>(this->read(addr, size));
-            this->write(addr, value, size);
-            this->regs.set_ccr_flags(-1, is_negative(value, size), (value == 0), 0, 0);
-            return;
-          }
-        }
+      } else if (a == 0) { // negx.S ADDR
+        throw runtime_error("unimplemented: negx.S ADDR");
       }
 
     } else { // a & 0x04
       uint8_t b = op_get_b(opcode); // b must be 0-3 since we already checked that g = 0
 
       if (a == 4) {
-        uint8_t M = op_get_c(opcode);
-        if (b & 2) {
-          if (M == 0) { // ext.S REG
-            uint8_t d = op_get_d(opcode);
-            switch (b) {
-              case 2: // extend byte to word
-                this->regs.d[d].u = (this->regs.d[d].u & 0xFFFF00FF) |
-                    ((this->regs.d[d].u & 0x00000080) ? 0x0000FF00 : 0x00000000);
-                this->regs.set_ccr_flags(
-                    -1, is_negative(this->regs.d[d].u, SIZE_LONG), (this->regs.d[d].u == 0), 0, 0);
-                return;
-
-              case 3: // extend word to long
-                this->regs.d[d].u = (this->regs.d[d].u & 0x0000FFFF) |
-                    ((this->regs.d[d].u & 0x00008000) ? 0xFFFF0000 : 0x00000000);
-                this->regs.set_ccr_flags(
-                    -1, is_negative(this->regs.d[d].u, SIZE_LONG), (this->regs.d[d].u == 0), 0, 0);
-                return;
-
-              case 7: // extend byte to long
-                this->regs.d[d].u = (this->regs.d[d].u & 0x000000FF) |
-                    ((this->regs.d[d].u & 0x00000080) ? 0xFFFFFF00 : 0x00000000);
-                this->regs.set_ccr_flags(
-                    -1, is_negative(this->regs.d[d].u, SIZE_LONG), (this->regs.d[d].u == 0), 0, 0);
-                return;
-
-              default:
-                throw runtime_error("unimplemented: like ext.S REG");
-            }
-
-          } else { // movem.S ADDR REGMASK
-            uint8_t size = size_for_tsize[op_get_t(opcode)];
-            uint8_t bytes_per_value = bytes_for_size[size];
-            uint8_t Xn = op_get_d(opcode);
-            uint16_t reg_mask = this->fetch_instruction_word();
-
-            // Predecrement mode is special-cased for this opcode. In this mode we write the registers in reverse order
-            if (M == 4) {
-              // bit 15 is D0, bit 0 is A7
-              for (size_t x = 0; x < 8; x++) {
-                if (reg_mask & (1 << x)) {
-                  this->regs.a[Xn] -= bytes_per_value;
-                  this->write(this->regs.a[Xn], this->regs.a[7 - x], size);
-                }
-              }
-              for (size_t x = 0; x < 8; x++) {
-                if (reg_mask & (1 << (x + 8))) {
-                  this->regs.a[Xn] -= bytes_per_value;
-                  this->write(this->regs.a[Xn], this->regs.d[7 - x].u, size);
-                }
-              }
-
-            } else {
-              // bit 15 is A7, bit 0 is D0
-              uint32_t addr = this->resolve_address_control(M, Xn);
-              for (size_t x = 0; x < 8; x++) {
-                if (reg_mask & (1 << x)) {
-                  this->write(addr, this->regs.d[x].u, size);
-                  addr += bytes_per_value;
-                }
-              }
-              for (size_t x = 0; x < 8; x++) {
-                if (reg_mask & (1 << (x + 8))) {
-                  this->write(addr, this->regs.a[x], size);
-                  addr += bytes_per_value;
-                }
-              }
-            }
-
-            // Note: ccr not affected
-            return;
-          }
-        }
         if (b == 0) { // nbcd.b ADDR
-          // void* addr = this->resolve_address(M, op_get_d(opcode), SIZE_BYTE);
+          // void* addr = this->resolve_address(op_get_c(opcode), op_get_d(opcode), SIZE_BYTE);
           throw runtime_error("unimplemented: nbcd.b ADDR");
         }
-        // b == 1
-        if (M == 0) { // swap.w REG
-          uint8_t reg = op_get_d(opcode);
-          this->regs.d[reg].u = (this->regs.d[reg].u >> 16) | (this->regs.d[reg].u << 16);
-          return;
-        }
-
-        // pea.l ADDR
-        uint32_t addr = this->resolve_address_control(op_get_c(opcode), op_get_d(opcode));
-        this->regs.a[7] -= 4;
-        this->write(this->regs.a[7], addr, SIZE_LONG);
-        // Note: ccr not affected
-        return;
 
       } else if (a == 5) {
         if (b == 3) { // tas.b ADDR
@@ -1654,90 +1753,20 @@ void M68KEmulator::exec_4(uint16_t opcode) {
           throw runtime_error("unimplemented: tas.b ADDR");
         }
 
-        // tst.S ADDR
-        auto addr = this->resolve_address(op_get_c(opcode), op_get_d(opcode), b);
-        uint8_t size = op_get_b(opcode) & 3;
-        uint32_t value = this->read(addr, size);
-        this->regs.set_ccr_flags(-1, is_negative(value, size), (value == 0), 0, 0);
-        return;
-
       } else if (a == 6) {
         if ((b & (~1)) == 0) {
           throw runtime_error("unimplemented: muls/mulu/divs/divu (long)");
-
-        } else {
-          // movem.S REGMASK ADDR
-          uint8_t size = size_for_tsize[op_get_t(opcode)];
-          uint8_t bytes_per_value = bytes_for_size[size];
-          uint8_t M = op_get_c(opcode);
-          uint8_t Xn = op_get_d(opcode);
-          uint16_t reg_mask = this->fetch_instruction_word();
-
-          // Postincrement mode is special-cased for this opcode
-          uint32_t addr = (M == 3) ? this->regs.a[Xn] : this->resolve_address_control(M, Xn);
-
-          // Load the regs; bit 15 is A7, bit 0 is D0
-          for (size_t x = 0; x < 8; x++) {
-            if (reg_mask & (1 << x)) {
-              this->regs.d[x].u = this->read(addr, size);
-              addr += bytes_per_value;
-            }
-          }
-          for (size_t x = 0; x < 8; x++) {
-            if (reg_mask & (1 << (x + 8))) {
-              this->regs.a[x] = this->read(addr, size);
-              addr += bytes_per_value;
-            }
-          }
-
-          // In postincrement mode, update the address register
-          if (M == 3) {
-            this->regs.a[Xn] = addr;
-          }
-
-          // Note: ccr not affected
-          return;
         }
 
       } else if (a == 7) {
         if (b == 1) {
           uint8_t c = op_get_c(opcode);
-          if (c == 2) { // link
-            uint8_t d = op_get_d(opcode);
-            this->regs.a[7] -= 4;
-            this->write(this->regs.a[7], this->regs.a[d], SIZE_LONG);
-            this->regs.a[d] = this->regs.a[7];
-            this->regs.a[7] += this->fetch_instruction_word_signed();
-            // Note: ccr not affected
-            return;
-
-          } else if (c == 3) { // unlink
-            uint8_t d = op_get_d(opcode);
-            this->regs.a[7] = this->regs.a[d];
-            this->regs.a[d] = this->read(this->regs.a[7], SIZE_LONG);
-            this->regs.a[7] += 4;
-            // Note: ccr not affected
-            return;
-
-          } else if ((c & 6) == 0) { // trap NUM
+          if ((c & 6) == 0) { // trap NUM
             throw runtime_error("unimplemented: trap NUM"); // num is v field
 
           } else if ((c & 6) == 4) { // move USP, AREG or AREG, USP
             throw runtime_error("unimplemented: move USP AREG STORE/LOAD"); // areg is d field, c&1 means store
           }
-
-        } else if (b == 2) { // jsr ADDR
-          uint32_t addr = this->resolve_address_control(op_get_c(opcode), op_get_d(opcode));
-          this->regs.a[7] -= 4;
-          this->write(this->regs.a[7], this->regs.pc, SIZE_LONG);
-          this->regs.pc = addr;
-          // Note: ccr not affected
-          return;
-
-        } else if (b == 3) { // jmp ADDR
-          this->regs.pc = this->resolve_address_control(op_get_c(opcode), op_get_d(opcode));
-          // Note: ccr not affected
-          return;
         }
 
       } else {
@@ -1747,12 +1776,7 @@ void M68KEmulator::exec_4(uint16_t opcode) {
 
   } else { // g == 1
     uint8_t b = op_get_b(opcode);
-    if (b == 7) { // lea.l AREG, ADDR
-      this->regs.a[op_get_a(opcode)] = this->resolve_address_control(op_get_c(opcode), op_get_d(opcode));
-      // Note: ccr not affected
-      return;
-
-    } else if (b == 5) { // chk.w DREG, ADDR
+    if (b == 5) { // chk.w DREG, ADDR
       // void* addr = this->resolve_address(op_get_c(opcode), op_get_d(opcode), SIZE_WORD);
       throw runtime_error("unimplemented: chk.w DREG ADDR"); // dreg is a field
     }
@@ -1761,7 +1785,198 @@ void M68KEmulator::exec_4(uint16_t opcode) {
   throw runtime_error("invalid opcode 4");
 }
 
+string M68KEmulator::dasm_nop(DisassemblyState& s) {
+  s.r.get_u16b();
+  return "nop";
+}
+
+string M68KEmulator::dasm_rts(DisassemblyState& s) {
+  s.r.get_u16b();
+  s.prev_was_return = true;
+  return "rts";
+}
+
+string M68KEmulator::dasm_link(DisassemblyState& s) {
+  uint16_t op = s.r.get_u16b();
+  int16_t delta = s.r.get_s16b();
+  if (delta >= 0) {
+    return std::format("link       A{}, 0x{:04X}", op_get_d(op), delta);
+  } else if (delta == -0x8000) {
+    return std::format("link       A{}, -0x8000", op_get_d(op));
+  } else {
+    return std::format("link       A{}, -0x{:04X}", op_get_d(op), -delta);
+  }
+}
+
+string M68KEmulator::dasm_unlk(DisassemblyState& s) {
+  return std::format("unlink     A{}", op_get_d(s.r.get_u16b()));
+}
+
+string M68KEmulator::dasm_jsr(DisassemblyState& s) {
+  uint16_t op = s.r.get_u16b();
+  string addr = M68KEmulator::dasm_address(
+      s, op_get_c(op), op_get_d(op), ValueType::LONG, AddressDisassemblyType::FUNCTION_CALL);
+  return std::format("jsr        {}", addr);
+}
+
+string M68KEmulator::dasm_jmp(DisassemblyState& s) {
+  uint16_t op = s.r.get_u16b();
+  string addr = M68KEmulator::dasm_address(
+      s, op_get_c(op), op_get_d(op), ValueType::LONG, AddressDisassemblyType::JUMP);
+  s.prev_was_return = (op == 0x4ED0); // jmp [A0]
+  return std::format("jmp        {}", addr);
+}
+
+string M68KEmulator::dasm_lea(DisassemblyState& s) {
+  uint16_t op = s.r.get_u16b();
+  string addr = M68KEmulator::dasm_address(s, op_get_c(op), op_get_d(op), ValueType::LONG);
+  return std::format("lea.l      A{}, {}", op_get_a(op), addr);
+}
+
+string M68KEmulator::dasm_clr_neg_not(DisassemblyState& s) {
+  uint16_t op = s.r.get_u16b();
+  string addr = M68KEmulator::dasm_address(s, op_get_c(op), op_get_d(op), ValueType::LONG);
+  char size_ch = char_for_size.at(op_get_size(op));
+  switch (op_get_a(op)) {
+    case 1:
+      return std::format("clr.{}      {}", size_ch, addr);
+    case 2:
+      return std::format("neg.{}      {}", size_ch, addr);
+    default:
+      return std::format("not.{}      {}", size_ch, addr);
+  }
+}
+
+string M68KEmulator::dasm_ext(DisassemblyState& s) {
+  uint16_t op = s.r.get_u16b();
+  return std::format("ext.{}      D{}", char_for_tsize.at(op_get_t(op)), op_get_d(op));
+}
+
+string M68KEmulator::dasm_movem(DisassemblyState& s) {
+  uint16_t op = s.r.get_u16b();
+  uint8_t t = op_get_t(op);
+  uint8_t M = op_get_c(op);
+  string reg_mask = M68KEmulator::dasm_reg_mask(s.r.get_u16b(), (M == 4));
+  string addr = M68KEmulator::dasm_address(s, M, op_get_d(op), value_type_for_tsize.at(t));
+  if (op_get_a(op) == 6) { // load
+    return std::format("movem.{}    {}, {}", char_for_tsize.at(t), reg_mask, addr);
+  } else { // store
+    return std::format("movem.{}    {}, {}", char_for_tsize.at(t), addr, reg_mask);
+  }
+}
+
+string M68KEmulator::dasm_swap(DisassemblyState& s) {
+  return std::format("swap.w     D{}", op_get_d(s.r.get_u16b()));
+}
+
+string M68KEmulator::dasm_pea(DisassemblyState& s) {
+  uint16_t op = s.r.get_u16b();
+  // Special-case `pea.l [IMM]` since the 32-bit form is likely to contain an OSType, which we should ASCII-decode if
+  // possible
+  if ((op & 0xFFFE) == 0x4878) {
+    string imm = format_immediate(read_immediate_int(s.r, (op & 1) ? SIZE_LONG : SIZE_WORD));
+    return std::format("push.l     {}", imm);
+  } else {
+    string addr = M68KEmulator::dasm_address(s, op_get_c(op), op_get_d(op), ValueType::LONG);
+    return std::format("pea.l      {}", addr);
+  }
+}
+
+string M68KEmulator::dasm_tst(DisassemblyState& s) {
+  uint16_t op = s.r.get_u16b();
+  uint8_t size = op_get_size(op);
+  string addr = M68KEmulator::dasm_address(s, op_get_c(op), op_get_d(op), value_type_for_size.at(size));
+  return std::format("tst.{}      {}", char_for_size.at(size), addr);
+}
+
+M68KEmulator::OpcodeImplementation M68KEmulator::specialized_fns_4(uint16_t op) {
+  static const OpcodeImplementation clr_neg_not_fns[3][3] = {
+      {
+          {&M68KEmulator::exec_clr<SIZE_BYTE>, &M68KEmulator::dasm_clr_neg_not},
+          {&M68KEmulator::exec_clr<SIZE_WORD>, &M68KEmulator::dasm_clr_neg_not},
+          {&M68KEmulator::exec_clr<SIZE_LONG>, &M68KEmulator::dasm_clr_neg_not},
+      },
+      {
+          {&M68KEmulator::exec_neg<SIZE_BYTE>, &M68KEmulator::dasm_clr_neg_not},
+          {&M68KEmulator::exec_neg<SIZE_WORD>, &M68KEmulator::dasm_clr_neg_not},
+          {&M68KEmulator::exec_neg<SIZE_LONG>, &M68KEmulator::dasm_clr_neg_not},
+      },
+      {
+          {&M68KEmulator::exec_not<SIZE_BYTE>, &M68KEmulator::dasm_clr_neg_not},
+          {&M68KEmulator::exec_not<SIZE_WORD>, &M68KEmulator::dasm_clr_neg_not},
+          {&M68KEmulator::exec_not<SIZE_LONG>, &M68KEmulator::dasm_clr_neg_not},
+      },
+  };
+  static const OpcodeImplementation tst_fns[3] = {
+      {&M68KEmulator::exec_tst<SIZE_BYTE>, &M68KEmulator::dasm_tst},
+      {&M68KEmulator::exec_tst<SIZE_WORD>, &M68KEmulator::dasm_tst},
+      {&M68KEmulator::exec_tst<SIZE_LONG>, &M68KEmulator::dasm_tst},
+  };
+
+  uint8_t a = op_get_a(op);
+  uint8_t b = op_get_b(op);
+  uint8_t c = op_get_c(op);
+  if (op_get_g(op)) {
+    if (b == 7) { // lea.l AREG, ADDR
+      return {&M68KEmulator::exec_lea, &M68KEmulator::dasm_lea};
+    }
+    return {nullptr, nullptr};
+  }
+
+  // b must be 0-3 since g = 0
+  switch (a) {
+    case 1: // clr.S ADDR
+    case 2: // neg.S ADDR
+    case 3: // not.S ADDR
+      if (b != 3) {
+        return clr_neg_not_fns[a - 1][b];
+      }
+      break;
+    case 4:
+      if ((b & 2) && (c == 0)) { // ext.S REG
+        return {(b & 1) ? &M68KEmulator::exec_ext<SIZE_LONG> : &M68KEmulator::exec_ext<SIZE_WORD>,
+            &M68KEmulator::dasm_ext};
+      } else if (b & 2) { // movem.S ADDR REGMASK
+        return {(b & 1) ? &M68KEmulator::exec_movem_store<SIZE_LONG> : &M68KEmulator::exec_movem_store<SIZE_WORD>,
+            &M68KEmulator::dasm_movem};
+      } else if ((b == 1) && (c == 0)) { // swap.w REG
+        return {&M68KEmulator::exec_swap, &M68KEmulator::dasm_swap};
+      } else if (b == 1) { // pea.l ADDR
+        return {&M68KEmulator::exec_pea, &M68KEmulator::dasm_pea};
+      }
+      break;
+    case 5: // tst.S ADDR (b == 3 is tas.b, bgnd, or illegal)
+      if (b != 3) {
+        return tst_fns[b];
+      }
+      break;
+    case 6: // movem.S REGMASK ADDR
+      if (b & 2) {
+        return {(b & 1) ? &M68KEmulator::exec_movem_load<SIZE_LONG> : &M68KEmulator::exec_movem_load<SIZE_WORD>,
+            &M68KEmulator::dasm_movem};
+      }
+      break;
+    case 7:
+      if (op == 0x4E71) {
+        return {&M68KEmulator::exec_nop, &M68KEmulator::dasm_nop};
+      } else if (op == 0x4E75) {
+        return {&M68KEmulator::exec_rts, &M68KEmulator::dasm_rts};
+      } else if ((b == 1) && (c == 2)) {
+        return {&M68KEmulator::exec_link, &M68KEmulator::dasm_link};
+      } else if ((b == 1) && (c == 3)) {
+        return {&M68KEmulator::exec_unlk, &M68KEmulator::dasm_unlk};
+      } else if (b == 2) {
+        return {&M68KEmulator::exec_jsr, &M68KEmulator::dasm_jsr};
+      } else if (b == 3) {
+        return {&M68KEmulator::exec_jmp, &M68KEmulator::dasm_jmp};
+      }
+      break;
+  }
+  return {nullptr, nullptr};
+}
+
 string M68KEmulator::dasm_4(DisassemblyState& s) {
+  // As in exec_4, the instructions handled by specialized_fns_4 never get here
   uint16_t op = s.r.get_u16b();
   uint8_t g = op_get_g(op);
 
@@ -1776,8 +1991,6 @@ string M68KEmulator::dasm_4(DisassemblyState& s) {
       switch (op & 0x000F) {
         case 0:
           return "reset";
-        case 1:
-          return "nop";
         case 2:
           return std::format("stop       0x{:04X}", s.r.get_u16b());
         case 3:
@@ -1785,9 +1998,6 @@ string M68KEmulator::dasm_4(DisassemblyState& s) {
         case 4:
           s.prev_was_return = true;
           return std::format("rtd        0x{:04X}", s.r.get_u16b());
-        case 5:
-          s.prev_was_return = true;
-          return "rts";
         case 6:
           return "trapv";
         case 7:
@@ -1810,52 +2020,18 @@ string M68KEmulator::dasm_4(DisassemblyState& s) {
         }
         return std::format(".invalid   {} // invalid opcode 4 with subtype 1", addr);
 
-      } else { // s is a valid SIZE_x
-        char size_ch = char_for_size.at(size);
-        switch (a) {
-          case 0:
-            return std::format("negx.{}     {}", size_ch, addr);
-          case 1:
-            return std::format("clr.{}      {}", size_ch, addr);
-          case 2:
-            return std::format("neg.{}      {}", size_ch, addr);
-          case 3:
-            return std::format("not.{}      {}", size_ch, addr);
-        }
+      } else if (a == 0) {
+        return std::format("negx.{}     {}", char_for_size.at(size), addr);
       }
 
     } else { // a & 0x04
       uint8_t b = op_get_b(op); // b must be 0-3 since we already checked that g = 0
 
       if (a == 4) {
-        uint8_t M = op_get_c(op);
-        if (b & 2) {
-          if (M == 0) {
-            return std::format("ext.{}      D{}", char_for_tsize.at(op_get_t(op)), op_get_d(op));
-          } else {
-            uint8_t t = op_get_t(op);
-            string reg_mask = M68KEmulator::dasm_reg_mask(s.r.get_u16b(), (M == 4));
-            string addr = M68KEmulator::dasm_address(s, M, op_get_d(op), value_type_for_tsize.at(t));
-            return std::format("movem.{}    {}, {}", char_for_tsize.at(t), addr, reg_mask);
-          }
-        }
         if (b == 0) {
-          string addr = M68KEmulator::dasm_address(s, M, op_get_d(op), ValueType::BYTE);
+          string addr = M68KEmulator::dasm_address(s, op_get_c(op), op_get_d(op), ValueType::BYTE);
           return std::format("nbcd.b     {}", addr);
         }
-        // b == 1
-        if (M == 0) {
-          return std::format("swap.w     D{}", op_get_d(op));
-        }
-        // Special-case `pea.l [IMM]` since the 32-bit form is likely to contain an OSType, which we should ASCII-
-        // decode if possible
-        if ((op & 0xFFFE) == 0x4878) {
-          string imm = format_immediate(read_immediate_int(s.r, (op & 1) ? SIZE_LONG : SIZE_WORD));
-          return std::format("push.l     {}", imm);
-        } else {
-          string addr = M68KEmulator::dasm_address(s, M, op_get_d(op), ValueType::LONG);
-          return std::format("pea.l      {}", addr);
-        }
 
       } else if (a == 5) {
         if (b == 3) {
@@ -1863,9 +2039,6 @@ string M68KEmulator::dasm_4(DisassemblyState& s) {
           return std::format("tas.b      {}", addr);
         }
 
-        string addr = M68KEmulator::dasm_address(s, op_get_c(op), op_get_d(op), value_type_for_size.at(b));
-        return std::format("tst.{}      {}", char_for_size.at(b), addr);
-
       } else if (a == 6) {
         if ((b & (~1)) == 0) {
           string addr = M68KEmulator::dasm_address(s, op_get_c(op), op_get_d(op), ValueType::LONG);
@@ -1893,30 +2066,12 @@ string M68KEmulator::dasm_4(DisassemblyState& s) {
               return std::format("mul{}.l     D{}, {}", is_signed ? 's' : 'u', rl, addr);
             }
           }
-
-        } else {
-          uint8_t t = op_get_t(op);
-          uint8_t M = op_get_c(op);
-          string reg_mask = M68KEmulator::dasm_reg_mask(s.r.get_u16b(), (M == 4));
-          string addr = M68KEmulator::dasm_address(s, M, op_get_d(op), value_type_for_tsize.at(t));
-          return std::format("movem.{}    {}, {}", char_for_tsize.at(t), reg_mask, addr);
         }
 
       } else if (a == 7) {
         if (b == 1) {
           uint8_t c = op_get_c(op);
-          if (c == 2) {
-            int16_t delta = s.r.get_s16b();
-            if (delta >= 0) {
-              return std::format("link       A{}, 0x{:04X}", op_get_d(op), delta);
-            } else if (delta == -0x8000) {
-              return std::format("link       A{}, -0x8000", op_get_d(op));
-            } else {
-              return std::format("link       A{}, -0x{:04X}", op_get_d(op), -delta);
-            }
-          } else if (c == 3) {
-            return std::format("unlink     A{}", op_get_d(op));
-          } else if ((c & 6) == 0) {
+          if ((c & 6) == 0) {
             return std::format("trap       {}", op_get_v(op));
           } else if ((c & 6) == 4) {
             if (c & 1) {
@@ -1925,17 +2080,6 @@ string M68KEmulator::dasm_4(DisassemblyState& s) {
               return std::format("move       USP, A{}", op_get_d(op));
             }
           }
-
-        } else if (b == 2) {
-          string addr = M68KEmulator::dasm_address(
-              s, op_get_c(op), op_get_d(op), ValueType::LONG, AddressDisassemblyType::FUNCTION_CALL);
-          return std::format("jsr        {}", addr);
-
-        } else if (b == 3) {
-          string addr = M68KEmulator::dasm_address(
-              s, op_get_c(op), op_get_d(op), ValueType::LONG, AddressDisassemblyType::JUMP);
-          s.prev_was_return = (op == 0x4ED0); // jmp [A0]
-          return std::format("jmp        {}", addr);
         }
       }
 
@@ -1944,11 +2088,7 @@ string M68KEmulator::dasm_4(DisassemblyState& s) {
 
   } else { // g == 1
     uint8_t b = op_get_b(op);
-    if (b == 7) {
-      string addr = M68KEmulator::dasm_address(s, op_get_c(op), op_get_d(op), ValueType::LONG);
-      return std::format("lea.l      A{}, {}", op_get_a(op), addr);
-
-    } else if (b == 5) {
+    if (b == 5) {
       string addr = M68KEmulator::dasm_address(s, op_get_c(op), op_get_d(op), ValueType::WORD);
       return std::format("chk.w      D{}, {}", op_get_a(op), addr);
 
@@ -2337,6 +2477,7 @@ string M68KEmulator::dasm_9D(DisassemblyState& s) {
 
 void M68KEmulator::exec_A(uint16_t opcode) {
   if (this->syscall_handler) {
+    this->on_memory_modified_externally();
     this->syscall_handler(*this, opcode);
   } else {
     this->exec_unimplemented(opcode);
@@ -2576,22 +2717,173 @@ string M68KEmulator::dasm_C(DisassemblyState& s) {
   throw logic_error("no cases matched for 1100bbb opcode");
 }
 
-void M68KEmulator::exec_E(uint16_t opcode) {
-  uint8_t size = op_get_size(opcode);
+template <uint8_t Size, uint8_t K>
+void M68KEmulator::exec_shift(uint16_t opcode) {
+  // asr/asl/lsr/lsl/roxr/roxl/ror/rol DREG, COUNT/REG
+  using ValueT = conditional_t<Size == SIZE_BYTE, uint8_t, conditional_t<Size == SIZE_WORD, uint16_t, uint32_t>>;
+  using SignedValueT = make_signed_t<ValueT>;
+  constexpr uint8_t bits = sizeof(ValueT) * 8;
+  constexpr bool left_shift = (K & 1);
+  constexpr bool logical_shift = (K & 2);
+  constexpr bool rotate = (K & 4);
+
   uint8_t Xn = op_get_d(opcode);
-  if (size == 3) {
-    uint8_t which = (opcode >> 8) & 0x0F;
-    switch (which) {
-      case 0xB: // bfexts
-      case 0x9: { // bfextu
-        bool is_signed = which & 2;
-        uint16_t options = this->fetch_instruction_word();
-        auto source = this->resolve_address(op_get_c(opcode), op_get_d(opcode), SIZE_LONG);
-        uint8_t dest_reg = op_get_i(options) & 7;
-        int32_t offset = (options >> 6) & 0x1F;
-        uint32_t width = options & 0x1F;
-        if (options & 0x0800) { // offset is a D reg
-          offset = this->regs.d[offset & 7].s;
+  uint8_t a = op_get_a(opcode);
+  uint8_t shift_amount;
+  if (op_get_c(opcode) & 4) { // shift count is in a register
+    shift_amount = this->regs.d[a].u & (bits - 1);
+  } else {
+    shift_amount = (a == 0) ? 8 : a;
+    if (shift_amount == 8 && Size == SIZE_BYTE) {
+      throw runtime_error("unimplemented: shift opcode with size=byte and shift=8");
+    }
+  }
+
+  this->regs.sr &= 0xFFE0;
+  if (shift_amount == 0) {
+    this->regs.set_ccr_flags(-1, is_negative(this->regs.d[Xn].u, SIZE_LONG), (this->regs.d[Xn].u == 0), 0, 0);
+    return;
+  }
+
+  ValueT& target = *reinterpret_cast<ValueT*>(&this->regs.d[Xn].u);
+
+  int8_t last_shifted_bit =
+      (left_shift ? (target & (1 << (bits - shift_amount))) : (target & (1 << (shift_amount - 1))));
+
+  bool msb_changed;
+  if (!rotate && logical_shift && left_shift) {
+    uint32_t msb_values = (target >> (bits - shift_amount));
+    uint32_t mask = (1 << shift_amount) - 1;
+    msb_values &= mask;
+    msb_changed = ((msb_values == mask) || (msb_values == 0));
+  } else {
+    msb_changed = false;
+  }
+
+  if (rotate) {
+    if (logical_shift) { // rotate without extend (rol, ror)
+      if (left_shift) {
+        target = (target << shift_amount) | (target >> (bits - shift_amount));
+      } else {
+        target = (target >> shift_amount) | (target << (bits - shift_amount));
+      }
+      last_shifted_bit = -1; // X unaffected for these opcodes
+
+    } else { // rotate with extend (roxl, roxr) (TODO)
+      throw runtime_error("unimplemented: roxl/roxr DREG, COUNT/REG");
+    }
+
+  } else {
+    if (logical_shift) {
+      if (left_shift) {
+        target <<= shift_amount;
+      } else {
+        target >>= shift_amount;
+      }
+    } else {
+      SignedValueT& signed_target = *reinterpret_cast<SignedValueT*>(&this->regs.d[Xn].u);
+      if (left_shift) {
+        signed_target <<= shift_amount;
+      } else {
+        signed_target >>= shift_amount;
+      }
+    }
+  }
+
+  constexpr ValueT msb = static_cast<ValueT>(1) << (bits - 1);
+  this->regs.set_ccr_flags(last_shifted_bit, (target & msb), (target == 0), msb_changed, last_shifted_bit);
+}
+
+string M68KEmulator::dasm_shift(DisassemblyState& s) {
+  static const array<const char*, 8> op_names = {
+      "asr   ", "asl   ", "lsr   ", "lsl   ", "roxr  ", "roxl  ", "ror   ", "rol   "};
+
+  uint16_t op = s.r.get_u16b();
+  uint8_t size = op_get_size(op);
+  uint8_t Xn = op_get_d(op);
+  uint8_t c = op_get_c(op);
+  bool shift_is_reg = (c & 4);
+  uint8_t a = op_get_a(op);
+  uint8_t k = ((c & 3) << 1) | op_get_g(op);
+  const char* op_name = op_names[k];
+
+  string dest_reg_str;
+  if (size == SIZE_BYTE) {
+    dest_reg_str = std::format("D{}.b", Xn);
+  } else if (size == SIZE_WORD) {
+    dest_reg_str = std::format("D{}.w", Xn);
+  } else {
+    dest_reg_str = std::format("D{}", Xn);
+  }
+
+  if (shift_is_reg) {
+    return std::format("{}     {}, D{}", op_name, dest_reg_str, a);
+  } else {
+    if (!a) {
+      a = 8;
+    }
+    return std::format("{}     {}, {}", op_name, dest_reg_str, a);
+  }
+}
+
+M68KEmulator::OpcodeImplementation M68KEmulator::specialized_fns_E(uint16_t op) {
+  // Indexed by [size][k], where k is the operation (see dasm_shift for the names)
+  static const OpcodeImplementation shift_fns[3][8] = {
+      {
+          {&M68KEmulator::exec_shift<SIZE_BYTE, 0>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_BYTE, 1>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_BYTE, 2>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_BYTE, 3>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_BYTE, 4>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_BYTE, 5>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_BYTE, 6>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_BYTE, 7>, &M68KEmulator::dasm_shift},
+      },
+      {
+          {&M68KEmulator::exec_shift<SIZE_WORD, 0>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_WORD, 1>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_WORD, 2>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_WORD, 3>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_WORD, 4>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_WORD, 5>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_WORD, 6>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_WORD, 7>, &M68KEmulator::dasm_shift},
+      },
+      {
+          {&M68KEmulator::exec_shift<SIZE_LONG, 0>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_LONG, 1>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_LONG, 2>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_LONG, 3>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_LONG, 4>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_LONG, 5>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_LONG, 6>, &M68KEmulator::dasm_shift},
+          {&M68KEmulator::exec_shift<SIZE_LONG, 7>, &M68KEmulator::dasm_shift},
+      },
+  };
+
+  uint8_t size = op_get_size(op);
+  if (size == 3) { // bitfield instructions
+    return {nullptr, nullptr};
+  }
+  return shift_fns[size][((op_get_c(op) & 3) << 1) | op_get_g(op)];
+}
+
+void M68KEmulator::exec_E(uint16_t opcode) {
+  // The shift and rotate instructions (size != 3) are dispatched to exec_shift by opcode_fns, so only the bitfield
+  // instructions get here
+  if (op_get_size(opcode) == 3) {
+    uint8_t which = (opcode >> 8) & 0x0F;
+    switch (which) {
+      case 0xB: // bfexts
+      case 0x9: { // bfextu
+        bool is_signed = which & 2;
+        uint16_t options = this->fetch_instruction_word();
+        auto source = this->resolve_address(op_get_c(opcode), op_get_d(opcode), SIZE_LONG);
+        uint8_t dest_reg = op_get_i(options) & 7;
+        int32_t offset = (options >> 6) & 0x1F;
+        uint32_t width = options & 0x1F;
+        if (options & 0x0800) { // offset is a D reg
+          offset = this->regs.d[offset & 7].s;
         }
         if (options & 0x0020) {
           width = this->regs.d[width & 7].u & 0x1F;
@@ -2640,211 +2932,13 @@ void M68KEmulator::exec_E(uint16_t opcode) {
     }
     return;
   }
-
-  uint8_t c = op_get_c(opcode);
-  bool shift_is_reg = (c & 4);
-  uint8_t a = op_get_a(opcode);
-  uint8_t k = ((c & 3) << 1) | op_get_g(opcode);
-
-  uint8_t shift_amount;
-  if (shift_is_reg) {
-    if (size == SIZE_BYTE) {
-      shift_amount = this->regs.d[a].u & 0x00000007;
-    } else if (size == SIZE_WORD) {
-      shift_amount = this->regs.d[a].u & 0x0000000F;
-    } else {
-      shift_amount = this->regs.d[a].u & 0x0000001F;
-    }
-  } else {
-    shift_amount = (a == 0) ? 8 : a;
-    if (shift_amount == 8 && size == SIZE_BYTE) {
-      throw runtime_error("unimplemented: shift opcode with size=byte and shift=8");
-    }
-  }
-
-  switch (k) {
-    case 0x00: // asr DREG, COUNT/REG
-    case 0x01: // asl DREG, COUNT/REG
-    case 0x02: // lsr DREG, COUNT/REG
-    case 0x03: // lsl DREG, COUNT/REG
-    case 0x04: // roxr DREG, COUNT/REG
-    case 0x05: // roxl DREG, COUNT/REG
-    case 0x06: // ror DREG, COUNT/REG
-    case 0x07: { // rol DREG, COUNT/REG
-      bool left_shift = (k & 1);
-      bool logical_shift = (k & 2);
-      bool rotate = (k & 4);
-
-      this->regs.sr &= 0xFFE0;
-      if (shift_amount == 0) {
-        this->regs.set_ccr_flags(-1, is_negative(this->regs.d[Xn].u, SIZE_LONG), (this->regs.d[Xn].u == 0), 0, 0);
-
-      } else if (size == SIZE_BYTE) {
-        uint8_t& target = *reinterpret_cast<uint8_t*>(&this->regs.d[Xn].u);
-
-        int8_t last_shifted_bit = (left_shift ? (target & (1 << (8 - shift_amount))) : (target & (1 << (shift_amount - 1))));
-
-        bool msb_changed;
-        if (!rotate && logical_shift && left_shift) {
-          uint32_t msb_values = (target >> (8 - shift_amount));
-          uint32_t mask = (1 << shift_amount) - 1;
-          msb_values &= mask;
-          msb_changed = ((msb_values == mask) || (msb_values == 0));
-        } else {
-          msb_changed = false;
-        }
-
-        if (rotate) {
-          if (logical_shift) { // rotate without extend (rol, ror)
-            if (left_shift) {
-              target = (target << shift_amount) | (target >> (8 - shift_amount));
-            } else {
-              target = (target >> shift_amount) | (target << (8 - shift_amount));
-            }
-            last_shifted_bit = -1; // X unaffected for these opcodes
-
-          } else { // rotate with extend (roxl, roxr) (TODO)
-            throw runtime_error("unimplemented: roxl/roxr DREG, COUNT/REG");
-          }
-
-        } else {
-          if (logical_shift) {
-            if (left_shift) {
-              target <<= shift_amount;
-            } else {
-              target >>= shift_amount;
-            }
-          } else {
-            int8_t& signed_target = *reinterpret_cast<int8_t*>(&this->regs.d[Xn].u);
-            if (left_shift) {
-              signed_target <<= shift_amount;
-            } else {
-              signed_target >>= shift_amount;
-            }
-          }
-        }
-
-        this->regs.set_ccr_flags(last_shifted_bit, (target & 0x80), (target == 0), msb_changed, last_shifted_bit);
-
-      } else if (size == SIZE_WORD) {
-        uint16_t& target = *reinterpret_cast<uint16_t*>(&this->regs.d[Xn].u);
-
-        int8_t last_shifted_bit =
-            (left_shift ? (target & (1 << (16 - shift_amount))) : (target & (1 << (shift_amount - 1))));
-
-        bool msb_changed;
-        if (!rotate && logical_shift && left_shift) {
-          uint32_t msb_values = (target >> (16 - shift_amount));
-          uint32_t mask = (1 << shift_amount) - 1;
-          msb_values &= mask;
-          msb_changed = ((msb_values == mask) || (msb_values == 0));
-        } else {
-          msb_changed = false;
-        }
-
-        if (rotate) {
-          if (logical_shift) { // rotate without extend (rol, ror)
-            if (left_shift) {
-              target = (target << shift_amount) | (target >> (16 - shift_amount));
-            } else {
-              target = (target >> shift_amount) | (target << (16 - shift_amount));
-            }
-            last_shifted_bit = -1; // X unaffected for these opcodes
-
-          } else { // rotate with extend (roxl, roxr) (TODO)
-            throw runtime_error("unimplemented: roxl/roxr DREG, COUNT/REG");
-          }
-
-        } else {
-          if (logical_shift) {
-            if (left_shift) {
-              target <<= shift_amount;
-            } else {
-              target >>= shift_amount;
-            }
-          } else {
-            int16_t& signed_target = *reinterpret_cast<int16_t*>(&this->regs.d[Xn].u);
-            if (left_shift) {
-              signed_target <<= shift_amount;
-            } else {
-              signed_target >>= shift_amount;
-            }
-          }
-        }
-
-        this->regs.set_ccr_flags(last_shifted_bit, (target & 0x8000), (target == 0), msb_changed, last_shifted_bit);
-
-      } else if (size == SIZE_LONG) {
-        uint32_t& target = this->regs.d[Xn].u;
-
-        int8_t last_shifted_bit =
-            (left_shift ? (target & (1 << (32 - shift_amount))) : (target & (1 << (shift_amount - 1))));
-
-        bool msb_changed;
-        if (!rotate && logical_shift && left_shift) {
-          uint32_t msb_values = (target >> (32 - shift_amount));
-          uint32_t mask = (1 << shift_amount) - 1;
-          msb_values &= mask;
-          msb_changed = ((msb_values == mask) || (msb_values == 0));
-        } else {
-          msb_changed = false;
-        }
-
-        if (rotate) {
-          if (logical_shift) { // rotate without extend (rol, ror)
-            if (left_shift) {
-              target = (target << shift_amount) | (target >> (32 - shift_amount));
-            } else {
-              target = (target >> shift_amount) | (target << (32 - shift_amount));
-            }
-            last_shifted_bit = -1; // X unaffected for these opcodes
-
-          } else { // rotate with extend (roxl, roxr) (TODO)
-            throw runtime_error("unimplemented: roxl/roxr DREG, COUNT/REG");
-          }
-
-        } else {
-          if (logical_shift) {
-            if (left_shift) {
-              target <<= shift_amount;
-            } else {
-              target >>= shift_amount;
-            }
-          } else {
-            int32_t& signed_target = *reinterpret_cast<int32_t*>(&this->regs.d[Xn].u);
-            if (left_shift) {
-              signed_target <<= shift_amount;
-            } else {
-              signed_target >>= shift_amount;
-            }
-          }
-        }
-
-        this->regs.set_ccr_flags(
-            last_shifted_bit, (target & 0x80000000), (target == 0), msb_changed, last_shifted_bit);
-
-      } else {
-        throw runtime_error("invalid size for bit shift operation");
-      }
-      break;
-    }
-
-    case 0x08: // bftst
-    case 0x09: // bfextu
-    case 0x0A: // bfchg
-    case 0x0B: // bfexts
-    case 0x0C: // bfclr
-    case 0x0D: // bfffo
-    case 0x0E: // bfset
-    case 0x0F: // bfins
-    default:
-      throw runtime_error("unimplemented: opcode E+k");
-  }
+  throw logic_error("shift opcodes should be handled by exec_shift");
 }
 
 string M68KEmulator::dasm_E(DisassemblyState& s) {
   uint16_t op = s.r.get_u16b();
 
+  // As in exec_E, the shift and rotate instructions are handled by dasm_shift instead
   static const vector<const char*> op_names = {
       "asr   ", "asl   ", "lsr   ", "lsl   ", "roxr  ", "roxl  ", "ror   ", "rol   ",
       "bftst ", "bfextu", "bfchg ", "bfexts", "bfclr ", "bfffo ", "bfset ", "bfins "};
@@ -2884,37 +2978,13 @@ string M68KEmulator::dasm_E(DisassemblyState& s) {
     }
     return std::format("{}.w   {}", op_name, M68KEmulator::dasm_address(s, M, Xn, ValueType::WORD));
   }
-
-  uint8_t c = op_get_c(op);
-  bool shift_is_reg = (c & 4);
-  uint8_t a = op_get_a(op);
-  uint8_t k = ((c & 3) << 1) | op_get_g(op);
-  const char* op_name = op_names[k];
-
-  string dest_reg_str;
-  if (size == SIZE_BYTE) {
-    dest_reg_str = std::format("D{}.b", Xn);
-  } else if (size == SIZE_WORD) {
-    dest_reg_str = std::format("D{}.w", Xn);
-  } else if (size == SIZE_LONG) {
-    dest_reg_str = std::format("D{}", Xn);
-  } else {
-    dest_reg_str = std::format("D{}.?", Xn);
-  }
-
-  if (shift_is_reg) {
-    return std::format("{}     {}, D{}", op_name, dest_reg_str, a);
-  } else {
-    if (!a) {
-      a = 8;
-    }
-    return std::format("{}     {}, {}", op_name, dest_reg_str, a);
-  }
+  return std::format(".invalid   // shift opcode {:04X} in dasm_E", op);
 }
 
 void M68KEmulator::exec_F(uint16_t opcode) {
   // TODO: Implement floating-point opcodes here
   if (this->syscall_handler) {
+    this->on_memory_modified_externally();
     this->syscall_handler(*this, opcode);
   } else {
     this->exec_unimplemented(opcode);
@@ -3189,24 +3259,65 @@ string M68KEmulator::dasm_F(DisassemblyState& s) {
   throw logic_error("all F-subopcode cases should return");
 }
 
-const M68KEmulator::OpcodeImplementation M68KEmulator::fns[0x10] = {
-    {&M68KEmulator::exec_0123, &M68KEmulator::dasm_0123},
-    {&M68KEmulator::exec_0123, &M68KEmulator::dasm_0123},
-    {&M68KEmulator::exec_0123, &M68KEmulator::dasm_0123},
-    {&M68KEmulator::exec_0123, &M68KEmulator::dasm_0123},
-    {&M68KEmulator::exec_4, &M68KEmulator::dasm_4},
-    {&M68KEmulator::exec_5, &M68KEmulator::dasm_5},
-    {&M68KEmulator::exec_6, &M68KEmulator::dasm_6},
-    {&M68KEmulator::exec_7, &M68KEmulator::dasm_7},
-    {&M68KEmulator::exec_8, &M68KEmulator::dasm_8},
-    {&M68KEmulator::exec_9D, &M68KEmulator::dasm_9D},
-    {&M68KEmulator::exec_A, &M68KEmulator::dasm_A},
-    {&M68KEmulator::exec_B, &M68KEmulator::dasm_B},
-    {&M68KEmulator::exec_C, &M68KEmulator::dasm_C},
-    {&M68KEmulator::exec_9D, &M68KEmulator::dasm_9D},
-    {&M68KEmulator::exec_E, &M68KEmulator::dasm_E},
-    {&M68KEmulator::exec_F, &M68KEmulator::dasm_F},
-};
+const vector<M68KEmulator::OpcodeImplementation> M68KEmulator::opcode_fns = []() {
+  // By default, each opcode goes to the handler for its group (the high 4 bits), which decodes the rest of the opcode
+  static const OpcodeImplementation group_fns[0x10] = {
+      {&M68KEmulator::exec_0123, &M68KEmulator::dasm_0123},
+      {&M68KEmulator::exec_0123, &M68KEmulator::dasm_0123},
+      {&M68KEmulator::exec_0123, &M68KEmulator::dasm_0123},
+      {&M68KEmulator::exec_0123, &M68KEmulator::dasm_0123},
+      {&M68KEmulator::exec_4, &M68KEmulator::dasm_4},
+      {&M68KEmulator::exec_5, &M68KEmulator::dasm_5},
+      {&M68KEmulator::exec_6, &M68KEmulator::dasm_6},
+      {&M68KEmulator::exec_7, &M68KEmulator::dasm_7},
+      {&M68KEmulator::exec_8, &M68KEmulator::dasm_8},
+      {&M68KEmulator::exec_9D, &M68KEmulator::dasm_9D},
+      {&M68KEmulator::exec_A, &M68KEmulator::dasm_A},
+      {&M68KEmulator::exec_B, &M68KEmulator::dasm_B},
+      {&M68KEmulator::exec_C, &M68KEmulator::dasm_C},
+      {&M68KEmulator::exec_9D, &M68KEmulator::dasm_9D},
+      {&M68KEmulator::exec_E, &M68KEmulator::dasm_E},
+      {&M68KEmulator::exec_F, &M68KEmulator::dasm_F},
+  };
+  vector<OpcodeImplementation> ret;
+  ret.reserve(0x10000);
+  for (size_t op = 0; op < 0x10000; op++) {
+    ret.emplace_back(group_fns[op >> 12]);
+  }
+
+  // The most common instructions get their own handlers, so they don't have to be decoded again when executed. The
+  // conditions here (and in specialized_fns_4/E) must match the decoding logic in the group handlers exactly; exec_4,
+  // dasm_4, exec_E, and dasm_E don't handle the opcodes that are sent elsewhere.
+  for (size_t op = 0x1000; op < 0x4000; op++) {
+    bool is_movea = (op_get_b(op) == 1);
+    switch (size_for_dsize[op_get_i(op)]) {
+      case SIZE_BYTE:
+        ret[op].exec = is_movea ? &M68KEmulator::exec_movea<SIZE_BYTE> : &M68KEmulator::exec_move<SIZE_BYTE>;
+        break;
+      case SIZE_WORD:
+        ret[op].exec = is_movea ? &M68KEmulator::exec_movea<SIZE_WORD> : &M68KEmulator::exec_move<SIZE_WORD>;
+        break;
+      case SIZE_LONG:
+        ret[op].exec = is_movea ? &M68KEmulator::exec_movea<SIZE_LONG> : &M68KEmulator::exec_move<SIZE_LONG>;
+        break;
+    }
+    ret[op].dasm = &M68KEmulator::dasm_move;
+  }
+  for (size_t op = 0x4000; op < 0x5000; op++) {
+    auto fns = M68KEmulator::specialized_fns_4(op);
+    if (fns.exec) {
+      ret[op] = fns;
+    }
+  }
+  for (size_t op = 0xE000; op < 0xF000; op++) {
+    auto fns = M68KEmulator::specialized_fns_E(op);
+    if (fns.exec) {
+      ret[op] = fns;
+    }
+  }
+
+  return ret;
+}();
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -3363,8 +3474,7 @@ string M68KEmulator::disassemble_one(DisassemblyState& s) {
     // Didn't decode any MacsBug symbol: disassemble instruction
     s.opcode_start_address = s.start_address + s.r.where();
     try {
-      uint8_t fn_index = (s.r.get_u8(false) >> 4) & 0x000F;
-      opcode_disassembly = M68KEmulator::fns[fn_index].dasm(s);
+      opcode_disassembly = M68KEmulator::opcode_fns[s.r.get_u16b(false)].dasm(s);
     } catch (const out_of_range&) {
       if (s.r.where() == opcode_offset) {
         // There must be at least 1 byte available since r.eof() was false
@@ -3417,7 +3527,8 @@ string M68KEmulator::disassemble_one(
   return M68KEmulator::disassemble_one(s);
 }
 
-string M68KEmulator::disassemble(
+void M68KEmulator::disassemble(
+    function<void(const char*, size_t)> write,
     const void* vdata,
     size_t size,
     uint32_t start_address,
@@ -3429,124 +3540,123 @@ string M68KEmulator::disassemble(
     labels = &empty_labels_map;
   }
 
-  map<uint32_t, pair<string, uint32_t>> lines; // {pc: (line, next_pc)}
-
-  // Phase 1: Generate the disassembly for each opcode, and collect branch target addresses
-  // TODO: Rewrite this to use a queue of pending PCs to disassemble instead of explicitly doing backups in a separate
-  // phase. The code should look like:
-  //   while there are still PCs to disassemble:
-  //     if the first PC in the queue is out of range:
-  //       discard it
-  //     else:
-  //       disassemble the first PC in the queue and add it to lines
-  //       add any new branch targets to the end of the queue
-  //       add the address after the disassembled opcode to the queue
+  // All disassembled lines are stored end-to-end in text_arena; the lines map refers to them by offset, so each line's
+  // text is only stored once no matter how many times it appears in the output.
+  struct Line {
+    size_t text_offset;
+    size_t text_size;
+    uint32_t next_pc;
+  };
+  string text_arena;
+  map<uint32_t, Line> lines;
+
+  // Phase 1: Disassemble everything reachable from the pending PC queue. The queue initially contains only the start
+  // address, from which we do a linear sweep of the entire input. After that, we follow each branch target and label
+  // found (including those found while following other branches) until we reach an opcode that has already been
+  // disassembled. Because opcodes can be different lengths in the 68K architecture, sometimes the linear sweep mis-
+  // disassembles an opcode because it starts during a previous "opcode" that is actually unused or data; these backup
+  // branches handle that case.
   DisassemblyState s(vdata, size, start_address, is_mac_environment, jump_table);
-  while (!s.r.eof()) {
-    s.opcode_start_address = s.r.where() + s.start_address;
-    string line = std::format("{:08X} ", s.opcode_start_address);
-    line += M68KEmulator::disassemble_one(s);
-    line += '\n';
-    uint32_t next_pc = s.r.where() + s.start_address;
-    lines.emplace(s.opcode_start_address, make_pair(std::move(line), next_pc));
-  }
+  auto pc_in_range = [&](uint32_t pc) -> bool {
+    return !(pc & 1) && (pc >= s.start_address) && (pc < s.start_address + size);
+  };
 
-  // Phase 2: Handle backups. Because opcodes can be different lengths in the 68K architecture, sometimes we mis-
-  // disassemble an opcode because it starts during a previous "opcode" that is actually unused or data. To handle
-  // this, we re-disassemble any branch targets and labels that are word-aligned, are within the address space, and do
-  // not have an existing line.
-  unordered_set<uint32_t> pending_start_addrs;
-  for (const auto& target_it : s.branch_target_addresses) {
-    uint32_t target_pc = target_it.first;
-    if (!(target_pc & 1) && (target_pc >= s.start_address) && (target_pc < s.start_address + size) && !lines.count(target_pc)) {
-      pending_start_addrs.emplace(target_pc);
-    }
+  set<pair<uint32_t, uint32_t>> backup_branches; // {start_pc, end_pc}
+  deque<uint32_t> pending_pcs;
+  bool in_linear_sweep = (size > 0);
+  uint32_t branch_start_pc = start_address;
+  if (in_linear_sweep) {
+    pending_pcs.emplace_back(start_address);
   }
-  for (const auto& label_it : *labels) {
-    uint32_t target_pc = label_it.first;
-    if (!(target_pc & 1) && (target_pc >= s.start_address) && (target_pc < s.start_address + size) && !lines.count(target_pc)) {
-      pending_start_addrs.emplace(target_pc);
+  for (;;) {
+    if (pending_pcs.empty()) {
+      if (!in_linear_sweep) {
+        break;
+      }
+      // The linear sweep is done; queue up all the branch targets and labels it found
+      in_linear_sweep = false;
+      for (const auto& target_it : s.branch_target_addresses) {
+        pending_pcs.emplace_back(target_it.first);
+      }
+      for (const auto& label_it : *labels) {
+        pending_pcs.emplace_back(label_it.first);
+      }
+      continue;
     }
-  }
-  set<pair<uint32_t, uint32_t>> backup_branches; // {start_pc, end_pc}
-  while (!pending_start_addrs.empty()) {
-    auto pending_start_addrs_it = pending_start_addrs.begin();
-    uint32_t branch_start_pc = *pending_start_addrs_it;
-    pending_start_addrs.erase(pending_start_addrs_it);
-    uint32_t pc = branch_start_pc;
-    s.r.go(pc - s.start_address);
 
-    s.prev_was_return = false;
-    while (!lines.count(pc) && !s.r.eof()) {
-      string line = std::format("{:08X} ", pc);
-      map<uint32_t, bool> temp_branch_target_addresses;
-      s.branch_target_addresses.swap(temp_branch_target_addresses);
-      line += M68KEmulator::disassemble_one(s);
-      s.branch_target_addresses.swap(temp_branch_target_addresses);
-      line += '\n';
-      uint32_t next_pc = s.r.where() + s.start_address;
-      lines.emplace(pc, make_pair(std::move(line), next_pc));
-      pc = next_pc;
+    uint32_t pc = pending_pcs.front();
+    pending_pcs.pop_front();
+    if (!in_linear_sweep) {
+      if (!pc_in_range(pc) || lines.count(pc)) {
+        continue;
+      }
+      branch_start_pc = pc;
+      s.prev_was_return = false;
+    }
 
-      // If any new branch target addresses were generated, we may need to do more backups for them as well - we need
-      // to add them to both sets.
-      for (const auto& target_it : temp_branch_target_addresses) {
-        uint32_t addr = target_it.first;
-        bool is_function_call = target_it.second;
-        s.branch_target_addresses.emplace(addr, is_function_call);
-        if (!(addr & 1)) {
-          pending_start_addrs.emplace(addr);
+    // Disassemble opcodes until we reach one that was already done (or the end of the input)
+    s.r.go(pc - s.start_address);
+    while (!s.r.eof() && !lines.count(pc)) {
+      size_t text_offset = text_arena.size();
+      text_arena += std::format("{:08X} ", pc);
+      if (in_linear_sweep) {
+        s.opcode_start_address = pc;
+        text_arena += M68KEmulator::disassemble_one(s);
+      } else {
+        // New branch targets found during backups don't override the function-call flag of existing ones, and are
+        // also queued up for backups
+        map<uint32_t, bool> temp_branch_target_addresses;
+        s.branch_target_addresses.swap(temp_branch_target_addresses);
+        text_arena += M68KEmulator::disassemble_one(s);
+        s.branch_target_addresses.swap(temp_branch_target_addresses);
+        for (const auto& target_it : temp_branch_target_addresses) {
+          s.branch_target_addresses.emplace(target_it.first, target_it.second);
+          pending_pcs.emplace_back(target_it.first);
         }
       }
+      text_arena += '\n';
+      uint32_t next_pc = s.r.where() + s.start_address;
+      lines.emplace(pc, Line{text_offset, text_arena.size() - text_offset, next_pc});
+      pc = next_pc;
     }
 
-    if (pc != branch_start_pc) {
+    if (!in_linear_sweep && (pc != branch_start_pc)) {
       backup_branches.emplace(branch_start_pc, pc);
     }
   }
 
-  // Phase 3: generate output lines, including passed-in labels, branch target labels, and alternate branches
-  size_t ret_bytes = 0;
-  deque<string> ret_lines;
+  // Phase 2: write the output lines, including passed-in labels, branch target labels, and alternate branches. This
+  // can't start until phase 1 is done, since any backup branch can add a branch target label anywhere in the output.
   auto branch_target_it = s.branch_target_addresses.lower_bound(s.start_address);
   auto label_it = labels->lower_bound(s.start_address);
   auto backup_branch_it = backup_branches.begin();
 
-  auto add_line = [&](uint32_t pc, const string& line) {
+  auto write_str = [&](const string& str) {
+    write(str.data(), str.size());
+  };
+  auto write_line = [&](uint32_t pc, const Line& line) {
     for (; label_it != labels->end() && label_it->first <= pc; label_it++) {
-      string label;
       if (label_it->first != pc) {
-        label = std::format("{}: // at {:08X} (misaligned)\n", label_it->second, label_it->first);
+        write_str(std::format("{}: // at {:08X} (misaligned)\n", label_it->second, label_it->first));
       } else {
-        label = std::format("{}:\n", label_it->second);
+        write_str(std::format("{}:\n", label_it->second));
       }
-      ret_bytes += label.size();
-      ret_lines.emplace_back(std::move(label));
     }
     for (; (branch_target_it != s.branch_target_addresses.end()) &&
         (branch_target_it->first <= pc);
         branch_target_it++) {
-      string label;
       const char* label_type = branch_target_it->second ? "fn" : "label";
       if (branch_target_it->first != pc) {
-        label = std::format("{}{:08X}: // (misaligned)\n", label_type, branch_target_it->first);
+        write_str(std::format("{}{:08X}: // (misaligned)\n", label_type, branch_target_it->first));
       } else {
-        label = std::format("{}{:08X}:\n", label_type, branch_target_it->first);
+        write_str(std::format("{}{:08X}:\n", label_type, branch_target_it->first));
       }
-      ret_bytes += label.size();
-      ret_lines.emplace_back(std::move(label));
     }
-
-    ret_bytes += line.size();
-    // TODO: we can eliminate this copy by making ret_lines instead keep references into the lines map. We can't just
-    // move the line contents into ret_lines here because disassembly lines may appear multiple times in the output.
-    // (Technically this should not be true, but I'm too lazy to verify as such right now.)
-    ret_lines.emplace_back(line);
+    write(text_arena.data() + line.text_offset, line.text_size);
   };
 
-  for (auto line_it = lines.begin(); line_it != lines.end(); line_it = lines.find(line_it->second.second)) {
+  for (auto line_it = lines.begin(); line_it != lines.end(); line_it = lines.find(line_it->second.next_pc)) {
     uint32_t pc = line_it->first;
-    string& line = line_it->second.first;
 
     // Write branches first, if there are any here
     for (; backup_branch_it != backup_branches.end() && backup_branch_it->first <= pc; backup_branch_it++) {
@@ -3557,62 +3667,299 @@ string M68KEmulator::disassemble(
       branch_target_it = s.branch_target_addresses.lower_bound(start_pc);
       label_it = labels->lower_bound(start_pc);
 
-      string branch_start_comment = std::format("// begin alternate branch {:08X}-{:08X}\n", start_pc, end_pc);
-      ret_bytes += branch_start_comment.size();
-      ret_lines.emplace_back(std::move(branch_start_comment));
-
+      write_str(std::format("// begin alternate branch {:08X}-{:08X}\n", start_pc, end_pc));
       for (auto backup_line_it = lines.find(start_pc);
           (backup_line_it != lines.end()) && (backup_line_it->first != end_pc);
-          backup_line_it = lines.find(backup_line_it->second.second)) {
-        add_line(backup_line_it->first, backup_line_it->second.first);
+          backup_line_it = lines.find(backup_line_it->second.next_pc)) {
+        write_line(backup_line_it->first, backup_line_it->second);
       }
-
-      string branch_end_comment = std::format("// end alternate branch {:08X}-{:08X}\n", start_pc, end_pc);
-      ret_bytes += branch_end_comment.size();
-      ret_lines.emplace_back(std::move(branch_end_comment));
+      write_str(std::format("// end alternate branch {:08X}-{:08X}\n", start_pc, end_pc));
 
       branch_target_it = orig_branch_target_it;
       label_it = orig_label_it;
     }
 
-    add_line(pc, line);
+    write_line(pc, line_it->second);
   }
+}
+
+void M68KEmulator::disassemble(
+    FILE* stream,
+    const void* vdata,
+    size_t size,
+    uint32_t start_address,
+    const multimap<uint32_t, string>* labels,
+    bool is_mac_environment,
+    const vector<JumpTableEntry>* jump_table) {
+  M68KEmulator::disassemble([&](const char* data, size_t bytes) -> void {
+    fwritex(stream, data, bytes);
+  },
+      vdata, size, start_address, labels, is_mac_environment, jump_table);
+}
 
-  // Phase 4: assemble the output lines into a single string and return it
+string M68KEmulator::disassemble(
+    const void* vdata,
+    size_t size,
+    uint32_t start_address,
+    const multimap<uint32_t, string>* labels,
+    bool is_mac_environment,
+    const vector<JumpTableEntry>* jump_table) {
   string ret;
-  ret.reserve(ret_bytes);
-  for (const auto& line : ret_lines) {
-    ret += line;
-  }
+  M68KEmulator::disassemble([&](const char* data, size_t bytes) -> void {
+    ret.append(data, bytes);
+  },
+      vdata, size, start_address, labels, is_mac_environment, jump_table);
   return ret;
 }
 
-void M68KEmulator::execute() {
-  if (!this->interrupt_manager.get()) {
-    this->interrupt_manager = make_shared<InterruptManager>();
+void M68KEmulator::clear_block_cache() {
+  this->cached_blocks.clear();
+  this->cached_block_addrs_for_granule.clear();
+  this->code_granules_base = 0;
+  this->code_granules.clear();
+  this->block_cache_write_detected = true;
+}
+
+void M68KEmulator::on_memory_modified_externally() {
+  // We don't know what was changed, so every cached block has to be checked
+  // against memory again before it's next used
+  this->block_cache_epoch++;
+  this->block_cache_write_detected = true;
+}
+
+void M68KEmulator::invalidate_cached_blocks_for_write(uint32_t addr, uint8_t size) {
+  uint32_t start_granule = addr >> CODE_GRANULE_BITS;
+  uint32_t end_granule = (addr + bytes_for_size[size & 3] - 1) >> CODE_GRANULE_BITS;
+  for (uint32_t granule = start_granule; granule <= end_granule; granule++) {
+    size_t index = granule - this->code_granules_base;
+    if (index >= this->code_granules.size() || !this->code_granules[index]) {
+      continue;
+    }
+    this->code_granules[index] = 0;
+
+    auto it = this->cached_block_addrs_for_granule.find(granule);
+    if (it != this->cached_block_addrs_for_granule.end()) {
+      // Blocks that span multiple granules are also listed under the other
+      // granules; those entries become stale but erasing them later is harmless
+      for (uint32_t block_addr : it->second) {
+        this->cached_blocks.erase(block_addr);
+      }
+      this->cached_block_addrs_for_granule.erase(it);
+    }
+    this->block_cache_write_detected = true;
   }
+}
 
-  for (;;) {
-    try {
-      // Call debug hook if present
-      if (this->debug_hook) {
-        this->debug_hook(*this);
+bool M68KEmulator::validate_cached_block(const CachedBlock& block) const {
+  try {
+    for (const auto& inst : block.instructions) {
+      if (this->mem->read_u16b(inst.pc) != inst.opcode) {
+        return false;
+      }
+    }
+    return true;
+  } catch (const out_of_range&) {
+    return false;
+  }
+}
+
+void M68KEmulator::add_cached_block(uint32_t start_pc, shared_ptr<CachedBlock> block) {
+  // Instructions executed while recording the block could have modified any of
+  // the earlier instructions in it, so make sure it's still accurate
+  if (!this->validate_cached_block(*block)) {
+    return;
+  }
+  block->validated_epoch = this->block_cache_epoch;
+
+  // Code is usually contiguous, so code_granules covers the range from the
+  // lowest to the highest granule containing cached code. If this block is too
+  // far away from the existing code, just don't cache it.
+  uint32_t min_granule = block->instructions[0].pc >> CODE_GRANULE_BITS;
+  uint32_t max_granule = min_granule;
+  for (const auto& inst : block->instructions) {
+    min_granule = min<uint32_t>(min_granule, inst.pc >> CODE_GRANULE_BITS);
+    max_granule = max<uint32_t>(max_granule, (inst.pc + 1) >> CODE_GRANULE_BITS);
+  }
+  if (!this->code_granules.empty()) {
+    min_granule = min<uint32_t>(min_granule, this->code_granules_base);
+    max_granule = max<uint32_t>(max_granule, this->code_granules_base + this->code_granules.size() - 1);
+  }
+  if (max_granule - min_granule >= MAX_CODE_GRANULES) {
+    return;
+  }
+  if (this->code_granules.empty()) {
+    this->code_granules_base = min_granule;
+  } else if (min_granule < this->code_granules_base) {
+    this->code_granules.insert(this->code_granules.begin(), this->code_granules_base - min_granule, 0);
+    this->code_granules_base = min_granule;
+  }
+  this->code_granules.resize(max_granule - min_granule + 1, 0);
+
+  for (const auto& inst : block->instructions) {
+    uint32_t start_granule = inst.pc >> CODE_GRANULE_BITS;
+    uint32_t end_granule = (inst.pc + 1) >> CODE_GRANULE_BITS;
+    for (uint32_t granule = start_granule; granule <= end_granule; granule++) {
+      this->code_granules[granule - this->code_granules_base] = 1;
+      auto& block_addrs = this->cached_block_addrs_for_granule[granule];
+      if (block_addrs.empty() || block_addrs.back() != start_pc) {
+        block_addrs.emplace_back(start_pc);
+      }
+    }
+  }
+
+  this->cached_blocks[start_pc] = std::move(block);
+}
+
+void M68KEmulator::execute_one_uncached() {
+  uint16_t opcode = this->fetch_instruction_word();
+  auto fn = this->opcode_fns[opcode].exec;
+  (this->*fn)(opcode);
+
+  this->instructions_executed++;
+}
+
+template <bool CheckInterrupts>
+void M68KEmulator::execute_cached_block() {
+  auto block_it = this->cached_blocks.find(this->regs.pc);
+  if (block_it == this->cached_blocks.end()) {
+    this->execute_and_record_block<CheckInterrupts>();
+    return;
+  }
+
+  // Hold a reference so the block isn't destroyed if it's invalidated by one of
+  // its own instructions
+  auto block = block_it->second;
+  if (block->validated_epoch != this->block_cache_epoch) {
+    if (!this->validate_cached_block(*block)) {
+      this->cached_blocks.erase(block_it);
+      this->execute_and_record_block<CheckInterrupts>();
+      return;
+    }
+    block->validated_epoch = this->block_cache_epoch;
+  }
+
+  this->block_cache_write_detected = false;
+  for (const auto& inst : block->instructions) {
+    if ((this->regs.pc != inst.pc) || this->block_cache_write_detected) {
+      return;
+    }
+
+    if constexpr (CheckInterrupts) {
+      if (this->interrupt_manager->on_cycle_start()) {
+        // The interrupt function may have modified memory, so don't trust the
+        // cached opcode for this instruction
+        this->on_memory_modified_externally();
+        this->execute_one_uncached();
+        return;
       }
+    }
 
-      // Call any timer interrupt functions scheduled for this cycle
-      this->interrupt_manager->on_cycle_start();
+    this->regs.pc += 2;
+    (this->*inst.exec)(inst.opcode);
+    this->instructions_executed++;
+  }
+}
 
-      // Execute a cycle
-      uint16_t opcode = this->fetch_instruction_word();
-      auto fn = this->fns[(opcode >> 12) & 0x000F].exec;
-      (this->*fn)(opcode);
+template <bool CheckInterrupts>
+void M68KEmulator::execute_and_record_block() {
+  uint32_t start_pc = this->regs.pc;
+  auto block = make_shared<CachedBlock>();
 
-      this->instructions_executed++;
+  for (;;) {
+    bool interrupted = false;
+    if constexpr (CheckInterrupts) {
+      if (this->interrupt_manager->on_cycle_start()) {
+        this->on_memory_modified_externally();
+        interrupted = true;
+      }
+    }
 
-    } catch (const terminate_emulation&) {
+    uint32_t pc = this->regs.pc;
+    uint16_t opcode = this->fetch_instruction_word();
+    auto fn = this->opcode_fns[opcode].exec;
+    block->instructions.emplace_back(CachedInstruction{pc, opcode, fn});
+    (this->*fn)(opcode);
+    this->instructions_executed++;
+
+    // A-traps and F-traps end the block, since the syscall handler may modify
+    // memory (or replace the interrupt manager), and so do interrupts, for the
+    // same reason. Also stop when we reach the start of this or any other block.
+    uint8_t opcode_class = (opcode >> 12) & 0x000F;
+    if (interrupted ||
+        (opcode_class == 0x0A) ||
+        (opcode_class == 0x0F) ||
+        (block->instructions.size() >= MAX_CACHED_BLOCK_INSTRUCTIONS) ||
+        (this->regs.pc == start_pc) ||
+        this->cached_blocks.count(this->regs.pc)) {
       break;
     }
   }
+
+  this->add_cached_block(start_pc, std::move(block));
+}
+
+template <bool CallDebugHook, bool CheckInterrupts>
+void M68KEmulator::execute_loop() {
+  // The debug hook, syscall handler, and interrupt functions can all install or
+  // remove the debug hook and interrupt manager, so each loop returns when they
+  // no longer match its template parameters, and execute() picks another one.
+  // The cached loop only checks between blocks; blocks end at A-traps and
+  // F-traps, which is where the syscall handler runs.
+  if constexpr (CallDebugHook) {
+    while (this->debug_hook && ((this->interrupt_manager != nullptr) == CheckInterrupts)) {
+      this->debug_hook(*this);
+      this->on_memory_modified_externally();
+      // The hook may have just removed the interrupt manager
+      if (CheckInterrupts && this->interrupt_manager) {
+        this->interrupt_manager->on_cycle_start();
+      }
+      this->execute_one_uncached();
+    }
+
+  } else if (this->block_cache_enabled) {
+    while (!this->debug_hook && this->block_cache_enabled &&
+        ((this->interrupt_manager != nullptr) == CheckInterrupts)) {
+      this->execute_cached_block<CheckInterrupts>();
+    }
+
+  } else {
+    while (!this->debug_hook && !this->block_cache_enabled &&
+        ((this->interrupt_manager != nullptr) == CheckInterrupts)) {
+      if constexpr (CheckInterrupts) {
+        this->interrupt_manager->on_cycle_start();
+      }
+      this->execute_one_uncached();
+    }
+  }
+}
+
+void M68KEmulator::execute() {
+  // The caller may have modified memory since the last time we ran
+  this->on_memory_modified_externally();
+
+  // Each combination of debug hook and interrupt manager gets its own loop, so
+  // the per-instruction path doesn't check for things that can't happen. The
+  // loops return when either is installed or removed, so this is re-evaluated
+  // each time.
+  try {
+    for (;;) {
+      bool check_interrupts = (this->interrupt_manager.get() != nullptr);
+      if (this->debug_hook) {
+        if (check_interrupts) {
+          this->execute_loop<true, true>();
+        } else {
+          this->execute_loop<true, false>();
+        }
+      } else {
+        if (check_interrupts) {
+          this->execute_loop<false, true>();
+        } else {
+          this->execute_loop<false, false>();
+        }
+      }
+    }
+  } catch (const terminate_emulation&) {
+  }
 }
 
 void M68KEmulator::import_state(FILE* stream) {
@@ -5,9 +5,12 @@
 
 #include <functional>
 #include <map>
+#include <memory>
 #include <phosg/Strings.hh>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "EmulatorBase.hh"
 #include "InterruptManager.hh"
@@ -124,6 +127,23 @@ public:
       uint32_t start_address,
       bool is_mac_environment = true,
       const std::vector<JumpTableEntry>* jump_table = nullptr);
+  // Disassembles the given code, calling write with each chunk of output text in order
+  static void disassemble(
+      std::function<void(const char*, size_t)> write,
+      const void* vdata,
+      size_t size,
+      uint32_t start_address = 0,
+      const std::multimap<uint32_t, std::string>* labels = nullptr,
+      bool is_mac_environment = true,
+      const std::vector<JumpTableEntry>* jump_table = nullptr);
+  static void disassemble(
+      FILE* stream,
+      const void* vdata,
+      size_t size,
+      uint32_t start_address = 0,
+      const std::multimap<uint32_t, std::string>* labels = nullptr,
+      bool is_mac_environment = true,
+      const std::vector<JumpTableEntry>* jump_table = nullptr);
   static std::string disassemble(
       const void* vdata,
       size_t size,
@@ -149,10 +169,21 @@ public:
     this->debug_hook = hook;
   }
 
+  // If no interrupt manager is set, execute() doesn't check for scheduled
+  // interrupts at all.
   inline void set_interrupt_manager(std::shared_ptr<InterruptManager> im) {
     this->interrupt_manager = im;
   }
 
+  // The block cache is enabled by default. It is never used while a debug hook
+  // is set, since the debugger may modify memory or registers at any time.
+  inline void set_block_cache_enabled(bool enabled) {
+    this->block_cache_enabled = enabled;
+    if (!enabled) {
+      this->clear_block_cache();
+    }
+  }
+
   virtual void execute();
 
 private:
@@ -166,7 +197,56 @@ private:
     void (M68KEmulator::*exec)(uint16_t);
     std::string (*dasm)(DisassemblyState& s);
   };
-  static const OpcodeImplementation fns[0x10];
+  // Handlers for every possible opcode. Most opcodes go to the handler for their group (the high 4 bits of the opcode),
+  // but common instructions (move, most of groups 4 and E) go directly to a handler that doesn't need to decode the
+  // opcode again.
+  static const std::vector<OpcodeImplementation> opcode_fns;
+
+  // The block cache holds runs of instructions (traces) as they were executed
+  // the first time, with their opcodes already fetched and dispatched. When a
+  // trace is replayed, each cached instruction is only used if the PC still
+  // matches, so taken and not-taken branches simply end the replay early.
+  // Extension words are not cached; they are still fetched from memory by the
+  // exec functions. Cached opcodes are invalidated precisely when the emulated
+  // CPU writes to them, and are revalidated against memory after anything else
+  // (syscalls, interrupts, or the caller between execute() calls) may have
+  // modified memory.
+  struct CachedInstruction {
+    uint32_t pc;
+    uint16_t opcode;
+    void (M68KEmulator::*exec)(uint16_t);
+  };
+  struct CachedBlock {
+    std::vector<CachedInstruction> instructions;
+    uint64_t validated_epoch;
+  };
+  static constexpr size_t MAX_CACHED_BLOCK_INSTRUCTIONS = 0x100;
+  static constexpr uint8_t CODE_GRANULE_BITS = 6;
+  static constexpr size_t MAX_CODE_GRANULES = 0x100000;
+
+  bool block_cache_enabled;
+  bool block_cache_write_detected;
+  uint64_t block_cache_epoch;
+  std::unordered_map<uint32_t, std::shared_ptr<CachedBlock>> cached_blocks;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> cached_block_addrs_for_granule;
+  uint32_t code_granules_base;
+  std::vector<uint8_t> code_granules;
+
+  void clear_block_cache();
+  void on_memory_modified_externally();
+  void invalidate_cached_blocks_for_write(uint32_t addr, uint8_t size);
+  bool validate_cached_block(const CachedBlock& block) const;
+  void add_cached_block(uint32_t start_pc, std::shared_ptr<CachedBlock> block);
+  void execute_one_uncached();
+  template <bool CheckInterrupts>
+  void execute_cached_block();
+  template <bool CheckInterrupts>
+  void execute_and_record_block();
+  // Runs until terminate_emulation is thrown, or until the debug hook, interrupt
+  // manager, or block cache setting changes so that execute() should switch to
+  // a different variant.
+  template <bool CallDebugHook, bool CheckInterrupts>
+  void execute_loop();
 
   struct ResolvedAddress {
     enum class Location {
@@ -219,6 +299,49 @@ private:
 
   void exec_0123(uint16_t opcode);
   static std::string dasm_0123(DisassemblyState& s);
+  template <uint8_t Size>
+  void exec_move(uint16_t opcode);
+  template <uint8_t Size>
+  void exec_movea(uint16_t opcode);
+  static std::string dasm_move(DisassemblyState& s);
+  void exec_nop(uint16_t opcode);
+  void exec_rts(uint16_t opcode);
+  void exec_link(uint16_t opcode);
+  void exec_unlk(uint16_t opcode);
+  void exec_jsr(uint16_t opcode);
+  void exec_jmp(uint16_t opcode);
+  void exec_lea(uint16_t opcode);
+  static std::string dasm_nop(DisassemblyState& s);
+  static std::string dasm_rts(DisassemblyState& s);
+  static std::string dasm_link(DisassemblyState& s);
+  static std::string dasm_unlk(DisassemblyState& s);
+  static std::string dasm_jsr(DisassemblyState& s);
+  static std::string dasm_jmp(DisassemblyState& s);
+  static std::string dasm_lea(DisassemblyState& s);
+  template <uint8_t Size>
+  void exec_clr(uint16_t opcode);
+  template <uint8_t Size>
+  void exec_neg(uint16_t opcode);
+  template <uint8_t Size>
+  void exec_not(uint16_t opcode);
+  static std::string dasm_clr_neg_not(DisassemblyState& s);
+  template <uint8_t Size>
+  void exec_ext(uint16_t opcode);
+  static std::string dasm_ext(DisassemblyState& s);
+  template <uint8_t Size>
+  void exec_movem_store(uint16_t opcode);
+  template <uint8_t Size>
+  void exec_movem_load(uint16_t opcode);
+  static std::string dasm_movem(DisassemblyState& s);
+  void exec_swap(uint16_t opcode);
+  static std::string dasm_swap(DisassemblyState& s);
+  void exec_pea(uint16_t opcode);
+  static std::string dasm_pea(DisassemblyState& s);
+  template <uint8_t Size>
+  void exec_tst(uint16_t opcode);
+  static std::string dasm_tst(DisassemblyState& s);
+  // Returns the handlers for opcodes in group 4 that have their own, or nulls if the opcode should go to exec_4/dasm_4
+  static OpcodeImplementation specialized_fns_4(uint16_t op);
   void exec_4(uint16_t opcode);
   static std::string dasm_4(DisassemblyState& s);
   void exec_5(uint16_t opcode);
@@ -237,6 +360,12 @@ private:
   static std::string dasm_B(DisassemblyState& s);
   void exec_C(uint16_t opcode);
   static std::string dasm_C(DisassemblyState& s);
+  template <uint8_t Size, uint8_t K>
+  void exec_shift(uint16_t opcode);
+  static std::string dasm_shift(DisassemblyState& s);
+  // Returns the shift/rotate handlers for opcodes in group E, or nulls for the bitfield opcodes (which go to
+  // exec_E/dasm_E)
+  static OpcodeImplementation specialized_fns_E(uint16_t op);
   void exec_E(uint16_t opcode);
   static std::string dasm_E(DisassemblyState& s);
   void exec_F(uint16_t opcode);
@@ -61,7 +61,9 @@ MemoryContext::MemoryContext()
       size(0),
       allocated_bytes(0),
       free_bytes(0),
-      strict(false) {
+      strict(false),
+      strict_last_block_addr(0),
+      strict_last_block_end(0) {
 
   if (this->page_size == 0) {
     throw invalid_argument("system page size is zero");
@@ -93,6 +95,8 @@ MemoryContext::MemoryContext(MemoryContext&& other)
       allocated_bytes(other.allocated_bytes),
       free_bytes(other.free_bytes),
       strict(other.strict),
+      strict_last_block_addr(other.strict_last_block_addr),
+      strict_last_block_end(other.strict_last_block_end),
       arenas_by_addr(std::move(other.arenas_by_addr)),
       arenas_by_host_addr(std::move(other.arenas_by_host_addr)),
       arena_for_page_number(std::move(other.arena_for_page_number)),
@@ -102,6 +106,7 @@ MemoryContext::MemoryContext(MemoryContext&& other)
   other.allocated_bytes = 0;
   other.free_bytes = 0;
   other.strict = false;
+  other.clear_strict_cache();
 }
 
 MemoryContext& MemoryContext::operator=(MemoryContext&& other) {
@@ -112,6 +117,8 @@ MemoryContext& MemoryContext::operator=(MemoryContext&& other) {
   this->allocated_bytes = other.allocated_bytes;
   this->free_bytes = other.free_bytes;
   this->strict = other.strict;
+  this->strict_last_block_addr = other.strict_last_block_addr;
+  this->strict_last_block_end = other.strict_last_block_end;
   this->arenas_by_addr = std::move(other.arenas_by_addr);
   this->arenas_by_host_addr = std::move(other.arenas_by_host_addr);
   this->arena_for_page_number = std::move(other.arena_for_page_number);
@@ -121,6 +128,7 @@ MemoryContext& MemoryContext::operator=(MemoryContext&& other) {
   other.allocated_bytes = 0;
   other.free_bytes = 0;
   other.strict = false;
+  other.clear_strict_cache();
   return *this;
 }
 
@@ -459,6 +467,7 @@ void MemoryContext::delete_arena(shared_ptr<Arena> arena) {
   }
 
   // Clear the arena from the page pointers list
+  this->clear_strict_cache();
   size_t end_page_num = this->page_number_for_addr(arena->addr + arena->size - 1);
   for (size_t z = this->page_number_for_addr(arena->addr); z <= end_page_num; z++) {
     if (this->arena_for_page_number[z] != arena) {
@@ -489,6 +498,7 @@ void MemoryContext::free(uint32_t addr) {
 
   // Delete the allocated block. If there are no allocated blocks remaining in the arena, don't bother cleaning up the
   // free maps and instead delete the entire arena.
+  this->clear_strict_cache();
   size_t size = allocated_block_it->second;
   arena->allocated_blocks.erase(allocated_block_it);
   if (arena->allocated_blocks.empty()) {
@@ -570,6 +580,7 @@ bool MemoryContext::resize(uint32_t addr, size_t new_size) {
   if (new_size == existing_size) {
     return true; // nothing to do
   }
+  this->clear_strict_cache();
 
   // Find the free block after the allocated block (if any)
   uint32_t existing_free_block_addr = addr + existing_size;
@@ -928,11 +939,10 @@ void MemoryContext::Arena::verify() const {
   }
 }
 
-bool MemoryContext::Arena::is_within_allocated_block(
-    uint32_t addr, size_t size) const {
+pair<uint32_t, uint64_t> MemoryContext::Arena::allocated_block_containing(uint32_t addr, size_t size) const {
   auto it = this->allocated_blocks.upper_bound(addr);
   if (it == this->allocated_blocks.begin()) {
-    return false;
+    return make_pair(0, 0);
   }
   it--;
   if (it->first > addr) {
@@ -941,12 +951,25 @@ bool MemoryContext::Arena::is_within_allocated_block(
   // Note: We use a uint64_t here in case the block ends exactly at the top of the address space
   uint64_t block_end = static_cast<uint64_t>(it->first) + it->second;
   if (addr >= block_end) {
-    return false;
+    return make_pair(0, 0);
   }
   if (static_cast<uint64_t>(addr) + size > block_end) {
-    return false;
+    return make_pair(0, 0);
   }
-  return true;
+  return make_pair(it->first, block_end);
+}
+
+bool MemoryContext::Arena::is_within_allocated_block(uint32_t addr, size_t size) const {
+  return this->allocated_block_containing(addr, size).second != 0;
+}
+
+void MemoryContext::check_strict_access(const Arena* arena, uint32_t addr, size_t size) const {
+  auto [block_addr, block_end] = arena->allocated_block_containing(addr, size);
+  if (block_end == 0) {
+    throw out_of_range("data is not within an allocated block");
+  }
+  this->strict_last_block_addr = block_addr;
+  this->strict_last_block_end = block_end;
 }
 
 } // namespace ResourceDASM
@@ -33,31 +33,11 @@ public:
 
   template <typename T>
   T* at(uint32_t addr, size_t size = sizeof(T), bool skip_strict = false) {
-    // This breaks if addr == 0 and size == 0. This was originally unintentional, but it turns out to be useful to
-    // detect accidental usage of memcpy() and the like on empty handles, so we keep this failure mode.
-    size_t start_page_num = this->page_number_for_addr(addr);
-    size_t end_page_num = this->page_number_for_addr(addr + size - 1);
-    auto arena = this->arena_for_page_number[start_page_num];
-    if (!arena.get()) {
-      throw std::out_of_range("address not within any arena");
-    }
-    for (size_t z = start_page_num + 1; z <= end_page_num; z++) {
-      if (this->arena_for_page_number[z] != arena) {
-        if (addr == 0 && size == 0) {
-          throw std::out_of_range("MemoryContext::at(0, 0)");
-        }
-        throw std::out_of_range("data not entirely contained within one arena");
-      }
-    }
-    if (this->strict && !skip_strict && !arena->is_within_allocated_block(addr, size)) {
-      throw std::out_of_range("data is not within an allocated block");
-    }
-    return reinterpret_cast<T*>(
-        reinterpret_cast<uint8_t*>(arena->host_addr) + (addr - arena->addr));
+    return reinterpret_cast<T*>(this->host_addr_for(addr, size, skip_strict));
   }
   template <typename T>
   const T* at(uint32_t addr, size_t size = sizeof(T), bool skip_strict = false) const {
-    return const_cast<MemoryContext*>(this)->at<T>(addr, size, skip_strict);
+    return reinterpret_cast<const T*>(this->host_addr_for(addr, size, skip_strict));
   }
 
   inline uint32_t at(const void* host_addr) const {
@@ -287,6 +267,7 @@ public:
 
   inline void set_strict(bool strict) {
     this->strict = strict;
+    this->clear_strict_cache();
   }
 
   void print_state(FILE* stream) const;
@@ -307,6 +288,11 @@ private:
   size_t free_bytes;
 
   bool strict;
+  // The allocated block that most recently passed a strict access check. The end is a uint64_t in case the block ends
+  // exactly at the top of the address space; if no block is cached, both fields are zero. These are only a cache, so
+  // const accesses update them too.
+  mutable uint32_t strict_last_block_addr;
+  mutable uint64_t strict_last_block_end;
 
   struct Arena {
     uint32_t addr;
@@ -331,6 +317,8 @@ private:
     void verify() const;
 
     bool is_within_allocated_block(uint32_t addr, size_t size) const;
+    // Returns (addr, end) for the allocated block containing the given range, or (0, 0) if there isn't one
+    std::pair<uint32_t, uint64_t> allocated_block_containing(uint32_t addr, size_t size) const;
 
     void split_free_block(uint32_t free_block_addr, uint32_t allocate_addr, uint32_t allocate_size);
     void delete_free_block(uint32_t addr, uint32_t size);
@@ -365,6 +353,39 @@ private:
     return this->page_size_for_size(size) >> this->page_bits;
   }
 
+  inline void clear_strict_cache() {
+    this->strict_last_block_addr = 0;
+    this->strict_last_block_end = 0;
+  }
+  void check_strict_access(const Arena* arena, uint32_t addr, size_t size) const;
+
+  // Implements both versions of at(). This is called for every emulated memory access, so it avoids touching the
+  // arena's shared_ptr refcount. Arenas always cover a contiguous range of pages, so it suffices to check that the
+  // access ends within the arena containing its first byte, rather than checking every page the access spans.
+  inline void* host_addr_for(uint32_t addr, size_t size, bool skip_strict) const {
+    const Arena* arena = this->arena_for_page_number[this->page_number_for_addr(addr)].get();
+    if (!arena) {
+      throw std::out_of_range("address not within any arena");
+    }
+    // This breaks if addr == 0 and size == 0. This was originally unintentional, but it turns out to be useful to
+    // detect accidental usage of memcpy() and the like on empty handles, so we keep this failure mode.
+    if (addr == 0 && size == 0) {
+      throw std::out_of_range("MemoryContext::at(0, 0)");
+    }
+    size_t offset = addr - arena->addr;
+    if (size > arena->size - offset) {
+      throw std::out_of_range("data not entirely contained within one arena");
+    }
+    if (this->strict && !skip_strict) {
+      // Accesses tend to hit the same block repeatedly, so check the last block we found before searching the arena
+      if ((addr < this->strict_last_block_addr) ||
+          (static_cast<uint64_t>(addr) + size > this->strict_last_block_end)) {
+        this->check_strict_access(arena, addr, size);
+      }
+    }
+    return reinterpret_cast<uint8_t*>(arena->host_addr) + offset;
+  }
+
   std::shared_ptr<Arena> create_arena(uint32_t addr, size_t min_size);
   void delete_arena(std::shared_ptr<Arena> arena);
 };
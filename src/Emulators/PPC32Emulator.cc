@@ -6201,30 +6201,50 @@ void PPC32Emulator::print_state(FILE* stream) const {
   }
 }
 
-void PPC32Emulator::execute() {
-  if (!this->interrupt_manager.get()) {
-    this->interrupt_manager = make_shared<InterruptManager>();
-  }
+template <bool CallDebugHook, bool CheckInterrupts>
+void PPC32Emulator::execute_loop() {
+  while ((static_cast<bool>(this->debug_hook) == CallDebugHook) &&
+      ((this->interrupt_manager != nullptr) == CheckInterrupts)) {
+    if constexpr (CallDebugHook) {
+      this->debug_hook(*this);
+    }
 
-  for (;;) {
-    try {
-      if (this->debug_hook) {
-        this->debug_hook(*this);
+    if constexpr (CheckInterrupts) {
+      // The debug hook may have just removed the interrupt manager
+      if (!CallDebugHook || this->interrupt_manager) {
+        this->interrupt_manager->on_cycle_start();
       }
+    }
 
-      this->interrupt_manager->on_cycle_start();
-
-      uint32_t full_op = this->mem->read<be_uint32_t>(this->regs.pc);
-      uint8_t op = op_get_op(full_op);
-      auto fn = this->fns[op].exec;
-      (this->*fn)(full_op);
-      this->regs.pc += 4;
-      this->regs.tbr += this->regs.tbr_ticks_per_cycle;
-      this->instructions_executed++;
+    uint32_t full_op = this->mem->read<be_uint32_t>(this->regs.pc);
+    uint8_t op = op_get_op(full_op);
+    auto fn = this->fns[op].exec;
+    (this->*fn)(full_op);
+    this->regs.pc += 4;
+    this->regs.tbr += this->regs.tbr_ticks_per_cycle;
+    this->instructions_executed++;
+  }
+}
 
-    } catch (const terminate_emulation&) {
-      break;
+void PPC32Emulator::execute() {
+  try {
+    for (;;) {
+      bool check_interrupts = (this->interrupt_manager.get() != nullptr);
+      if (this->debug_hook) {
+        if (check_interrupts) {
+          this->execute_loop<true, true>();
+        } else {
+          this->execute_loop<true, false>();
+        }
+      } else {
+        if (check_interrupts) {
+          this->execute_loop<false, true>();
+        } else {
+          this->execute_loop<false, false>();
+        }
+      }
     }
+  } catch (const terminate_emulation&) {
   }
 }
 
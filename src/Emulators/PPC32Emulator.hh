@@ -137,6 +137,8 @@ public:
     this->debug_hook = hook;
   }
 
+  // If no interrupt manager is set, execute() doesn't check for scheduled
+  // interrupts at all.
   inline void set_interrupt_manager(std::shared_ptr<InterruptManager> im) {
     this->interrupt_manager = im;
   }
@@ -172,6 +174,12 @@ private:
   std::function<void(PPC32Emulator&)> debug_hook;
   std::shared_ptr<InterruptManager> interrupt_manager;
 
+  // Runs until terminate_emulation is thrown, or until the debug hook or
+  // interrupt manager is installed or removed (e.g. by the syscall handler), so
+  // execute() can switch loops.
+  template <bool CallDebugHook, bool CheckInterrupts>
+  void execute_loop();
+
   struct DisassemblyState {
     uint32_t pc;
     const std::multimap<uint32_t, std::string>* labels;
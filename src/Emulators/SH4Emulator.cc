@@ -1427,44 +1427,50 @@ void SH4Emulator::execute_one(uint16_t op) {
   }
 }
 
+template <bool CallDebugHook>
+void SH4Emulator::execute_loop() {
+  while (static_cast<bool>(this->debug_hook) == CallDebugHook) {
+    if constexpr (CallDebugHook) {
+      this->debug_hook(*this);
+    }
+    this->assert_aligned(this->regs.pc, 2);
+    this->execute_one(this->mem->read_u16l(this->regs.pc));
+    this->instructions_executed++;
+
+    switch (this->regs.instructions_until_branch ? Regs::PendingBranchType::NONE : this->regs.pending_branch_type) {
+      case Regs::PendingBranchType::NONE:
+        this->regs.pc += 2;
+        break;
+      case Regs::PendingBranchType::CALL:
+        this->regs.pr = this->regs.pc + 2;
+        [[fallthrough]];
+      case Regs::PendingBranchType::BRANCH:
+        this->regs.pc = this->regs.pending_branch_target;
+        this->regs.pending_branch_type = Regs::PendingBranchType::NONE;
+        break;
+      case Regs::PendingBranchType::RETURN:
+        this->regs.pc = this->regs.pr;
+        this->regs.pending_branch_type = Regs::PendingBranchType::NONE;
+        break;
+      default:
+        throw logic_error("unimplemented branch type");
+    }
+    if (this->regs.instructions_until_branch) {
+      this->regs.instructions_until_branch--;
+    }
+  }
+}
+
 void SH4Emulator::execute() {
-  for (;;) {
-    try {
+  try {
+    for (;;) {
       if (this->debug_hook) {
-        try {
-          this->debug_hook(*this);
-        } catch (const terminate_emulation&) {
-          break;
-        }
-      }
-      this->assert_aligned(this->regs.pc, 2);
-      this->execute_one(this->mem->read_u16l(this->regs.pc));
-      this->instructions_executed++;
-
-      switch (this->regs.instructions_until_branch ? Regs::PendingBranchType::NONE : this->regs.pending_branch_type) {
-        case Regs::PendingBranchType::NONE:
-          this->regs.pc += 2;
-          break;
-        case Regs::PendingBranchType::CALL:
-          this->regs.pr = this->regs.pc + 2;
-          [[fallthrough]];
-        case Regs::PendingBranchType::BRANCH:
-          this->regs.pc = this->regs.pending_branch_target;
-          this->regs.pending_branch_type = Regs::PendingBranchType::NONE;
-          break;
-        case Regs::PendingBranchType::RETURN:
-          this->regs.pc = this->regs.pr;
-          this->regs.pending_branch_type = Regs::PendingBranchType::NONE;
-          break;
-        default:
-          throw logic_error("unimplemented branch type");
-      }
-      if (this->regs.instructions_until_branch) {
-        this->regs.instructions_until_branch--;
+        this->execute_loop<true>();
+      } else {
+        this->execute_loop<false>();
       }
-    } catch (const terminate_emulation&) {
-      break;
     }
+  } catch (const terminate_emulation&) {
   }
 }
 
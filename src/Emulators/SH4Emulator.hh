@@ -223,6 +223,12 @@ private:
   Regs regs;
   std::function<void(SH4Emulator&)> debug_hook;
 
+  // Runs until terminate_emulation is thrown, or until the debug hook is
+  // installed or removed (e.g. by the syscall handler), so execute() can switch
+  // loops.
+  template <bool CallDebugHook>
+  void execute_loop();
+
   static inline void assert_aligned(uint32_t addr, uint32_t alignment) {
     if (addr & (alignment - 1)) {
       throw std::runtime_error("misaligned memory access");
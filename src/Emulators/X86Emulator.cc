@@ -212,6 +212,11 @@ X86Emulator::Regs::Regs() {
   // 0x00000200 (bit 9) = interrupts enabled
   // 0x00000002 (bit 1) = reserved, but apparently always set in EFLAGS
   this->eflags = 0x00200202;
+  this->lazy_flags_mask = 0;
+  this->lazy_flags_op = LazyFlagsOp::RESULT;
+  this->lazy_flags_size = 4;
+  this->lazy_flags_a = 0;
+  this->lazy_flags_b = 0;
   this->eip = 0;
 }
 
@@ -269,7 +274,7 @@ void X86Emulator::Regs::set_by_name(const string& reg_name, uint32_t value) {
     this->w_edi(value);
 
   } else if (lower_name == "eflags") {
-    this->eflags = value;
+    this->write_eflags(value);
   } else {
     throw invalid_argument("unknown x86 register");
   }
@@ -367,11 +372,16 @@ X86Emulator::Regs::XMMReg X86Emulator::Regs::read_xmm(uint8_t which, uint8_t siz
 }
 
 bool X86Emulator::Regs::read_flag(uint32_t mask) {
+  if (this->lazy_flags_mask & mask) {
+    this->resolve_lazy_flags();
+  }
   return this->eflags & mask;
 }
 
 void X86Emulator::Regs::replace_flag(uint32_t mask, bool value) {
-  this->eflags = (this->eflags & ~mask) | (value ? mask : 0);
+  // The pending operation no longer determines this flag
+  this->lazy_flags_mask &= ~mask;
+  this->store_flag(mask, value);
 }
 
 string X86Emulator::Regs::flags_str(uint32_t flags) {
@@ -388,7 +398,7 @@ string X86Emulator::Regs::flags_str(uint32_t flags) {
 }
 
 string X86Emulator::Regs::flags_str() const {
-  return this->flags_str(this->eflags);
+  return this->flags_str(this->read_eflags());
 }
 
 bool X86Emulator::Regs::check_condition(uint8_t cc) {
@@ -422,15 +432,15 @@ bool X86Emulator::Regs::check_condition(uint8_t cc) {
   }
 }
 
-template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
-void X86Emulator::Regs::set_flags_integer_result(T res, uint32_t apply_mask) {
+template <typename T>
+void X86Emulator::Regs::apply_flags_integer_result(T res, uint32_t apply_mask) const {
   if (apply_mask & SF) {
     // SF should be set if the result is negative
-    this->replace_flag(SF, res & msb_for_type<T>);
+    this->store_flag(SF, res & msb_for_type<T>);
   }
   if (apply_mask & ZF) {
     // ZF should be set if the result is zero
-    this->replace_flag(ZF, (res == 0));
+    this->store_flag(ZF, (res == 0));
   }
   if (apply_mask & PF) {
     // PF should be set if the number of ones is even. However, x86's PF
@@ -439,35 +449,35 @@ void X86Emulator::Regs::set_flags_integer_result(T res, uint32_t apply_mask) {
     for (uint8_t v = res; v != 0; v >>= 1) {
       pf ^= (v & 1);
     }
-    this->replace_flag(PF, pf);
+    this->store_flag(PF, pf);
   }
 }
 
-template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
-void X86Emulator::Regs::set_flags_bitwise_result(T res, uint32_t apply_mask) {
-  this->set_flags_integer_result(res, apply_mask);
+template <typename T>
+void X86Emulator::Regs::apply_flags_bitwise_result(T res, uint32_t apply_mask) const {
+  this->apply_flags_integer_result(res, apply_mask);
   if (apply_mask & OF) {
-    this->replace_flag(OF, false);
+    this->store_flag(OF, false);
   }
   if (apply_mask & CF) {
-    this->replace_flag(CF, false);
+    this->store_flag(CF, false);
   }
   // The manuals say that AF is undefined for bitwise operations (so it MAY be
   // changed). We just leave it alone here.
 }
 
-template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
-T X86Emulator::Regs::set_flags_integer_add(T a, T b, uint32_t apply_mask) {
+template <typename T>
+void X86Emulator::Regs::apply_flags_integer_add(T a, T b, uint32_t apply_mask) const {
   T res = a + b;
 
-  this->set_flags_integer_result(res, apply_mask);
+  this->apply_flags_integer_result(res, apply_mask);
 
   if (apply_mask & OF) {
     // OF should be set if the result overflows the destination location, as if
     // the operation was signed. Equivalently, OF should be set if a and b have
     // the same sign and the result has the opposite sign (that is, the signed
     // result has overflowed).
-    this->replace_flag(OF,
+    this->store_flag(OF,
         ((a & msb_for_type<T>) == (b & msb_for_type<T>)) &&
             ((a & msb_for_type<T>) != (res & msb_for_type<T>)));
   }
@@ -477,29 +487,23 @@ T X86Emulator::Regs::set_flags_integer_add(T a, T b, uint32_t apply_mask) {
     // result is less than either input operand, because a full wrap-around
     // cannot occur: the maximum value that can be added to any other value is
     // one less than would result in a full wrap-around.
-    this->replace_flag(CF, (res < a) || (res < b));
+    this->store_flag(CF, (res < a) || (res < b));
   }
   if (apply_mask & AF) {
     // AF should be set if any nonzero bits were carried out of the lowest
     // nybble. The logic here is similar to the CF logic, but applies only to
     // the lowest 4 bytes.
-    this->replace_flag(AF, ((res & 0x0F) < (a & 0x0F)) || ((res & 0x0F) < (b & 0x0F)));
+    this->store_flag(AF, ((res & 0x0F) < (a & 0x0F)) || ((res & 0x0F) < (b & 0x0F)));
   }
-
-  return res;
 }
 
-template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
-T X86Emulator::Regs::set_flags_integer_add_with_carry(T a, T b, uint32_t apply_mask) {
-  // If CF is not set, this operation is the same as a normal add. The rest of
-  // this function will assume CF was set.
-  if (!this->read_flag(Regs::CF)) {
-    return this->set_flags_integer_add(a, b, apply_mask);
-  }
-
+// This is only used if CF was set before the operation; if it wasn't, the
+// operation is recorded as a normal add instead.
+template <typename T>
+void X86Emulator::Regs::apply_flags_integer_add_with_carry(T a, T b, uint32_t apply_mask) const {
   T res = a + b + 1;
 
-  this->set_flags_integer_result(res, apply_mask);
+  this->apply_flags_integer_result(res, apply_mask);
 
   if (apply_mask & OF) {
     // The same rules as for add-without-carry apply here. The edge cases that
@@ -518,7 +522,7 @@ T X86Emulator::Regs::set_flags_integer_add_with_carry(T a, T b, uint32_t apply_m
     // 80 80 1 01 1 (-128 + -128 + 1 != 1)
     // 80 FF 1 80 0 (-128 + -1   + 1 == -128)
     // FF FF 1 FF 0 (-1   + -1   + 1 == -1)
-    this->replace_flag(OF,
+    this->store_flag(OF,
         ((a & msb_for_type<T>) == (b & msb_for_type<T>)) &&
             ((a & msb_for_type<T>) != (res & msb_for_type<T>)));
   }
@@ -528,22 +532,20 @@ T X86Emulator::Regs::set_flags_integer_add_with_carry(T a, T b, uint32_t apply_m
     // result is less than or equal to either input operand, because at most
     // exactly one full wrap-around can occur, and the result must be greater
     // than at least one of the input operands because CF was set.
-    this->replace_flag(CF, (res <= a) || (res <= b));
+    this->store_flag(CF, (res <= a) || (res <= b));
   }
   if (apply_mask & AF) {
     // AF should be set if any nonzero bits were carried out of the lowest
     // nybble. Similar reasoning as for CF applies here (about why we use <=).
-    this->replace_flag(AF, ((res & 0x0F) <= (a & 0x0F)) || ((res & 0x0F) <= (b & 0x0F)));
+    this->store_flag(AF, ((res & 0x0F) <= (a & 0x0F)) || ((res & 0x0F) <= (b & 0x0F)));
   }
-
-  return res;
 }
 
-template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
-T X86Emulator::Regs::set_flags_integer_subtract(T a, T b, uint32_t apply_mask) {
+template <typename T>
+void X86Emulator::Regs::apply_flags_integer_subtract(T a, T b, uint32_t apply_mask) const {
   T res = a - b;
 
-  this->set_flags_integer_result(res, apply_mask);
+  this->apply_flags_integer_result(res, apply_mask);
 
   if (apply_mask & OF) {
     // OF should be set if the result overflows the destination location, as if
@@ -574,7 +576,7 @@ T X86Emulator::Regs::set_flags_integer_subtract(T a, T b, uint32_t apply_mask) {
     // FF 7F 80 0 (-1   - 127  == -128)  -+ - 0
     // FF 80 7F 0 (-1   - -128 == 127)   -- + 0
     // FF FF 00 0 (-1   - -1   == 0)     -- + 0
-    this->replace_flag(OF,
+    this->store_flag(OF,
         ((a & msb_for_type<T>) != (b & msb_for_type<T>)) &&
             ((a & msb_for_type<T>) != (res & msb_for_type<T>)));
   }
@@ -584,29 +586,23 @@ T X86Emulator::Regs::set_flags_integer_subtract(T a, T b, uint32_t apply_mask) {
     // result is greater than the input minuend operand, because a full
     // wrap-around cannot occur: the maximum value that can be subtracted from
     // any other value is one less than would result in a full wrap-around.
-    this->replace_flag(CF, (res > a));
+    this->store_flag(CF, (res > a));
   }
   if (apply_mask & AF) {
     // AF should be set if any nonzero bits were borrowed into the lowest
     // nybble. The logic here is similar to the CF logic, but applies only to
     // the lowest 4 bytes.
-    this->replace_flag(AF, ((res & 0x0F) > (a & 0x0F)));
+    this->store_flag(AF, ((res & 0x0F) > (a & 0x0F)));
   }
-
-  return res;
 }
 
-template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
-T X86Emulator::Regs::set_flags_integer_subtract_with_borrow(T a, T b, uint32_t apply_mask) {
-  // If CF is not set, this operation is the same as a normal subtract. The rest
-  // of this function will assume CF was set.
-  if (!this->read_flag(Regs::CF)) {
-    return this->set_flags_integer_subtract(a, b, apply_mask);
-  }
-
+// As with add-with-carry, this is only used if CF was set before the
+// operation.
+template <typename T>
+void X86Emulator::Regs::apply_flags_integer_subtract_with_borrow(T a, T b, uint32_t apply_mask) const {
   T res = a - b - 1;
 
-  this->set_flags_integer_result(res, apply_mask);
+  this->apply_flags_integer_result(res, apply_mask);
 
   if (apply_mask & OF) {
     // Perhaps surprisingly, the overflow logic is the same in the borrow case
@@ -630,7 +626,7 @@ T X86Emulator::Regs::set_flags_integer_subtract_with_borrow(T a, T b, uint32_t a
     // FF 80 1 7E 0 (-1   - -128 - 1 != 126)   -- + 0
     // FF 81 1 7D 0 (-1   - -127 - 1 != 125)   -- + 0
     // FF FF 1 FF 0 (-1   - -1   - 1 == -1)    -- - 0
-    this->replace_flag(OF,
+    this->store_flag(OF,
         ((a & msb_for_type<T>) != (b & msb_for_type<T>)) &&
             ((a & msb_for_type<T>) != (res & msb_for_type<T>)));
   }
@@ -639,14 +635,99 @@ T X86Emulator::Regs::set_flags_integer_subtract_with_borrow(T a, T b, uint32_t a
     // non-borrow case, but use >= instead of >. This is because the result
     // cannot logically be equal to the minuend: CF was set, so we must have
     // subtracted at least 1.
-    this->replace_flag(CF, (res >= a));
+    this->store_flag(CF, (res >= a));
   }
   if (apply_mask & AF) {
     // Again, this is analogous to the AF condition in the non-borrow case.
-    this->replace_flag(AF, ((res & 0x0F) >= (a & 0x0F)));
+    this->store_flag(AF, ((res & 0x0F) >= (a & 0x0F)));
+  }
+}
+
+template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
+void X86Emulator::Regs::set_flags_integer_result(T res, uint32_t apply_mask) {
+  this->record_lazy_flags<T>(LazyFlagsOp::RESULT, res, 0, apply_mask);
+}
+
+template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
+void X86Emulator::Regs::set_flags_bitwise_result(T res, uint32_t apply_mask) {
+  this->record_lazy_flags<T>(LazyFlagsOp::BITWISE, res, 0, apply_mask);
+}
+
+template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
+T X86Emulator::Regs::set_flags_integer_add(T a, T b, uint32_t apply_mask) {
+  this->record_lazy_flags<T>(LazyFlagsOp::ADD, a, b, apply_mask);
+  return a + b;
+}
+
+template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
+T X86Emulator::Regs::set_flags_integer_add_with_carry(T a, T b, uint32_t apply_mask) {
+  // CF has to be read now rather than when the flags are computed, since it
+  // may be changed in between (e.g. by clc)
+  if (!this->read_flag(Regs::CF)) {
+    return this->set_flags_integer_add(a, b, apply_mask);
+  }
+  this->record_lazy_flags<T>(LazyFlagsOp::ADD_WITH_CARRY, a, b, apply_mask);
+  return a + b + 1;
+}
+
+template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
+T X86Emulator::Regs::set_flags_integer_subtract(T a, T b, uint32_t apply_mask) {
+  this->record_lazy_flags<T>(LazyFlagsOp::SUBTRACT, a, b, apply_mask);
+  return a - b;
+}
+
+template <typename T, enable_if_t<is_unsigned<T>::value, bool>>
+T X86Emulator::Regs::set_flags_integer_subtract_with_borrow(T a, T b, uint32_t apply_mask) {
+  if (!this->read_flag(Regs::CF)) {
+    return this->set_flags_integer_subtract(a, b, apply_mask);
   }
+  this->record_lazy_flags<T>(LazyFlagsOp::SUBTRACT_WITH_BORROW, a, b, apply_mask);
+  return a - b - 1;
+}
 
-  return res;
+template <typename T>
+void X86Emulator::Regs::apply_lazy_flags() const {
+  T a = this->lazy_flags_a;
+  T b = this->lazy_flags_b;
+  switch (this->lazy_flags_op) {
+    case LazyFlagsOp::RESULT:
+      this->apply_flags_integer_result<T>(a, this->lazy_flags_mask);
+      break;
+    case LazyFlagsOp::BITWISE:
+      this->apply_flags_bitwise_result<T>(a, this->lazy_flags_mask);
+      break;
+    case LazyFlagsOp::ADD:
+      this->apply_flags_integer_add<T>(a, b, this->lazy_flags_mask);
+      break;
+    case LazyFlagsOp::ADD_WITH_CARRY:
+      this->apply_flags_integer_add_with_carry<T>(a, b, this->lazy_flags_mask);
+      break;
+    case LazyFlagsOp::SUBTRACT:
+      this->apply_flags_integer_subtract<T>(a, b, this->lazy_flags_mask);
+      break;
+    case LazyFlagsOp::SUBTRACT_WITH_BORROW:
+      this->apply_flags_integer_subtract_with_borrow<T>(a, b, this->lazy_flags_mask);
+      break;
+    default:
+      throw logic_error("invalid lazy flags operation");
+  }
+}
+
+void X86Emulator::Regs::resolve_lazy_flags() const {
+  switch (this->lazy_flags_size) {
+    case 1:
+      this->apply_lazy_flags<uint8_t>();
+      break;
+    case 2:
+      this->apply_lazy_flags<uint16_t>();
+      break;
+    case 4:
+      this->apply_lazy_flags<uint32_t>();
+      break;
+    default:
+      throw logic_error("invalid lazy flags operand size");
+  }
+  this->lazy_flags_mask = 0;
 }
 
 void X86Emulator::Regs::import_state(FILE* stream) {
@@ -658,7 +739,7 @@ void X86Emulator::Regs::import_state(FILE* stream) {
   for (size_t x = 0; x < 8; x++) {
     this->regs[x].u = freadx<le_uint32_t>(stream);
   }
-  this->eflags = freadx<le_uint32_t>(stream);
+  this->write_eflags(freadx<le_uint32_t>(stream));
   this->eip = freadx<le_uint32_t>(stream);
   if (version >= 1) {
     for (size_t x = 0; x < 8; x++) {
@@ -679,7 +760,7 @@ void X86Emulator::Regs::export_state(FILE* stream) const {
   for (size_t x = 0; x < 8; x++) {
     fwritex<le_uint32_t>(stream, this->regs[x].u);
   }
-  fwritex<le_uint32_t>(stream, this->eflags);
+  fwritex<le_uint32_t>(stream, this->read_eflags());
   fwritex<le_uint32_t>(stream, this->eip);
   for (size_t x = 0; x < 8; x++) {
     fwritex<le_uint64_t>(stream, this->xmm[x].u64[0]);
@@ -4297,16 +4378,11 @@ const char* X86Emulator::Overrides::overridden_segment_name() const {
   return name_for_segment(this->segment);
 }
 
-void X86Emulator::execute() {
-  this->execution_labels_computed = false;
-  for (;;) {
-    // Call debug hook if present
-    if (this->debug_hook) {
-      try {
-        this->debug_hook(*this);
-      } catch (const terminate_emulation&) {
-        break;
-      }
+template <bool CallDebugHook>
+void X86Emulator::execute_loop() {
+  while (static_cast<bool>(this->debug_hook) == CallDebugHook) {
+    if constexpr (CallDebugHook) {
+      this->debug_hook(*this);
     }
 
     // Execute a cycle. This is a loop because prefix bytes are implemented as
@@ -4326,6 +4402,20 @@ void X86Emulator::execute() {
 
     this->instructions_executed++;
   }
+}
+
+void X86Emulator::execute() {
+  this->execution_labels_computed = false;
+  try {
+    for (;;) {
+      if (this->debug_hook) {
+        this->execute_loop<true>();
+      } else {
+        this->execute_loop<false>();
+      }
+    }
+  } catch (const terminate_emulation&) {
+  }
   this->execution_labels.clear();
 }
 
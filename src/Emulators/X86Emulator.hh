@@ -287,9 +287,11 @@ public:
     inline void w_edi(uint32_t v) { this->write<le_uint32_t>(7, v); }
 
     inline uint32_t read_eflags() const {
+      this->resolve_flags();
       return this->eflags;
     }
     inline void write_eflags(uint32_t v) {
+      this->lazy_flags_mask = 0;
       this->eflags = v;
     }
 
@@ -333,6 +335,14 @@ public:
 
     bool check_condition(uint8_t cc);
 
+    // Computes any flags that are still pending from the last set_flags_*
+    // call. Everything that reads eflags does this automatically.
+    inline void resolve_flags() const {
+      if (this->lazy_flags_mask) {
+        this->resolve_lazy_flags();
+      }
+    }
+
     void import_state(FILE* stream);
     void export_state(FILE* stream) const;
 
@@ -340,7 +350,67 @@ public:
     IntReg regs[8];
     XMMReg xmm[8];
 
-    uint32_t eflags;
+    // The set_flags_* functions don't compute flags immediately; they record
+    // the operation and its operands, and the flags are computed only when
+    // something reads them. Most flag results are overwritten by the next
+    // arithmetic instruction without ever being read. lazy_flags_mask is the
+    // set of flags in eflags that are out of date; the other lazy_flags_*
+    // fields describe the operation that produces them.
+    enum class LazyFlagsOp : uint8_t {
+      RESULT = 0,
+      BITWISE,
+      ADD,
+      ADD_WITH_CARRY,
+      SUBTRACT,
+      SUBTRACT_WITH_BORROW,
+    };
+    mutable uint32_t eflags;
+    mutable uint32_t lazy_flags_mask;
+    LazyFlagsOp lazy_flags_op;
+    uint8_t lazy_flags_size; // Operand size in bytes
+    uint32_t lazy_flags_a; // Result for RESULT and BITWISE
+    uint32_t lazy_flags_b;
+
+    template <typename T>
+    inline void record_lazy_flags(LazyFlagsOp op, T a, T b, uint32_t apply_mask) {
+      // Only include the flags that the operation actually changes
+      if (op == LazyFlagsOp::RESULT) {
+        apply_mask &= (SF | ZF | PF);
+      } else if (op == LazyFlagsOp::BITWISE) {
+        apply_mask &= (SF | ZF | PF | OF | CF);
+      } else {
+        apply_mask &= Regs::default_int_flags;
+      }
+      // If the new operation doesn't overwrite all the pending flags, the
+      // pending ones have to be computed now
+      if (this->lazy_flags_mask & ~apply_mask) {
+        this->resolve_lazy_flags();
+      }
+      this->lazy_flags_mask = apply_mask;
+      this->lazy_flags_op = op;
+      this->lazy_flags_size = sizeof(T);
+      this->lazy_flags_a = a;
+      this->lazy_flags_b = b;
+    }
+    void resolve_lazy_flags() const;
+    template <typename T>
+    void apply_lazy_flags() const;
+
+    inline void store_flag(uint32_t mask, bool value) const {
+      this->eflags = (this->eflags & ~mask) | (value ? mask : 0);
+    }
+    template <typename T>
+    void apply_flags_integer_result(T res, uint32_t apply_mask) const;
+    template <typename T>
+    void apply_flags_bitwise_result(T res, uint32_t apply_mask) const;
+    template <typename T>
+    void apply_flags_integer_add(T a, T b, uint32_t apply_mask) const;
+    template <typename T>
+    void apply_flags_integer_add_with_carry(T a, T b, uint32_t apply_mask) const;
+    template <typename T>
+    void apply_flags_integer_subtract(T a, T b, uint32_t apply_mask) const;
+    template <typename T>
+    void apply_flags_integer_subtract_with_borrow(T a, T b, uint32_t apply_mask) const;
   };
 
   explicit X86Emulator(std::shared_ptr<MemoryContext> mem);
@@ -437,6 +507,12 @@ protected:
 
   void compute_execution_labels() const;
 
+  // Runs until terminate_emulation is thrown, or until the debug hook is
+  // installed or removed (e.g. by the syscall handler), so execute() can switch
+  // loops.
+  template <bool CallDebugHook>
+  void execute_loop();
+
   struct DecodedRM {
     int8_t non_ea_reg;
     int8_t ea_reg; // -1 = no reg
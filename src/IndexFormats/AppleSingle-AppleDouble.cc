@@ -158,11 +158,16 @@ DecodedAppleSingle parse_applesingle_appledouble(const string& data) {
   return parse_applesingle_appledouble(r);
 }
 
-ResourceFile parse_applesingle_appledouble_resource_fork(const string& data) {
-  auto parsed = parse_applesingle_appledouble(data);
+ResourceFile parse_applesingle_appledouble_resource_fork(StringReader& r) {
+  auto parsed = parse_applesingle_appledouble(r);
   return std::move(parsed.resource_fork);
 }
 
+ResourceFile parse_applesingle_appledouble_resource_fork(const string& data) {
+  StringReader r(data.data(), data.size());
+  return parse_applesingle_appledouble_resource_fork(r);
+}
+
 string DecodedAppleSingle::serialize() const {
   size_t offset = 0;
   vector<pair<Entry, const string*>> entries;
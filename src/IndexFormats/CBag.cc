@@ -23,9 +23,7 @@ struct CBagEntry {
   char name[0x3F];
 } __attribute__((packed));
 
-ResourceFile parse_cbag(const string& data) {
-  StringReader r(data);
-
+ResourceFile parse_cbag(StringReader& r) {
   uint32_t count = r.get_u32b();
 
   ResourceFile ret(IndexFormat::CBAG);
@@ -39,4 +37,9 @@ ResourceFile parse_cbag(const string& data) {
   return ret;
 }
 
+ResourceFile parse_cbag(const string& data) {
+  StringReader r(data);
+  return parse_cbag(r);
+}
+
 } // namespace ResourceDASM
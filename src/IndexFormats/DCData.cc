@@ -26,8 +26,7 @@ struct ResourceEntry {
   be_int16_t id;
 } __attribute__((packed));
 
-ResourceFile parse_dc_data(const string& data) {
-  StringReader r(data);
+ResourceFile parse_dc_data(StringReader& r) {
   const auto& h = r.get<ResourceHeader>();
 
   ResourceFile ret(IndexFormat::DC_DATA);
@@ -40,4 +39,9 @@ ResourceFile parse_dc_data(const string& data) {
   return ret;
 }
 
+ResourceFile parse_dc_data(const string& data) {
+  StringReader r(data);
+  return parse_dc_data(r);
+}
+
 } // namespace ResourceDASM
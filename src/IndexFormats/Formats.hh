@@ -32,12 +32,15 @@ struct DecodedAppleSingle {
 };
 DecodedAppleSingle parse_applesingle_appledouble(StringReader& r);
 DecodedAppleSingle parse_applesingle_appledouble(const std::string& data);
+ResourceFile parse_applesingle_appledouble_resource_fork(StringReader& r);
 ResourceFile parse_applesingle_appledouble_resource_fork(const std::string& data);
 
 // CBag.cc
+ResourceFile parse_cbag(StringReader& r);
 ResourceFile parse_cbag(const std::string& data);
 
 // DCData.cc
+ResourceFile parse_dc_data(StringReader& r);
 ResourceFile parse_dc_data(const std::string& data);
 
 // Directory.cc
@@ -45,13 +48,17 @@ ResourceFile load_resource_file_from_directory(const std::string& dir_path);
 void save_resource_file_to_directory(const ResourceFile& rf, const std::string& dir_path);
 
 // HIRF.cc
+ResourceFile parse_hirf(StringReader& r);
 ResourceFile parse_hirf(const std::string& data);
 
 // MacBinary.cc
+std::pair<StringReader, StringReader> parse_macbinary(const StringReader& r);
 std::pair<StringReader, StringReader> parse_macbinary(const std::string& data);
+ResourceFile parse_macbinary_resource_fork(const StringReader& r);
 ResourceFile parse_macbinary_resource_fork(const std::string& data);
 
 // Mohawk.cc
+ResourceFile parse_mohawk(StringReader& r);
 ResourceFile parse_mohawk(const std::string& data);
 
 // ResourceFork.cc
@@ -38,9 +38,7 @@ struct HIRFTopLevelResourceHeader {
   // uint32_t size;
 } __attribute__((packed));
 
-ResourceFile parse_hirf(const string& data) {
-  StringReader r(data.data(), data.size());
-
+ResourceFile parse_hirf(StringReader& r) {
   const auto& header = r.get<HIRFFileHeader>();
   if (header.magic != 0x4952455A) {
     throw runtime_error("file is not a HIRF archive");
@@ -64,4 +62,9 @@ ResourceFile parse_hirf(const string& data) {
   return ret;
 }
 
+ResourceFile parse_hirf(const string& data) {
+  StringReader r(data.data(), data.size());
+  return parse_hirf(r);
+}
+
 } // namespace ResourceDASM
@@ -129,8 +129,9 @@ struct MacBinaryHeader {
   }
 } __attribute__((packed));
 
-pair<StringReader, StringReader> parse_macbinary(const string& data) {
-  StringReader r(data);
+pair<StringReader, StringReader> parse_macbinary(const StringReader& base_r) {
+  StringReader r = base_r;
+  r.go(0);
 
   const auto& header = r.get<MacBinaryHeader>();
 
@@ -155,9 +156,17 @@ pair<StringReader, StringReader> parse_macbinary(const string& data) {
   return make_pair(data_r, resource_r);
 }
 
+pair<StringReader, StringReader> parse_macbinary(const string& data) {
+  return parse_macbinary(StringReader(data));
+}
+
+ResourceFile parse_macbinary_resource_fork(const StringReader& r) {
+  auto resource_r = parse_macbinary(r).second;
+  return parse_resource_fork(resource_r);
+}
+
 ResourceFile parse_macbinary_resource_fork(const string& data) {
-  auto r = parse_macbinary(data).second;
-  return parse_resource_fork(r);
+  return parse_macbinary_resource_fork(StringReader(data));
 }
 
 } // namespace ResourceDASM
@@ -136,9 +136,7 @@ static vector<ResourceEntry> load_index(StringReader& r) {
   return ret;
 }
 
-ResourceFile parse_mohawk(const string& data) {
-  StringReader r(data.data(), data.size());
-
+ResourceFile parse_mohawk(StringReader& r) {
   ResourceFile ret(IndexFormat::MOHAWK);
   vector<ResourceEntry> resource_entries = load_index(r);
   for (const auto& e : resource_entries) {
@@ -150,4 +148,9 @@ ResourceFile parse_mohawk(const string& data) {
   return ret;
 }
 
+ResourceFile parse_mohawk(const string& data) {
+  StringReader r(data.data(), data.size());
+  return parse_mohawk(r);
+}
+
 } // namespace ResourceDASM
@@ -0,0 +1,52 @@
+#include "MappedFile.hh"
+
+#include <phosg/Filesystem.hh>
+#include <phosg/Platform.hh>
+
+#ifndef PHOSG_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace phosg;
+
+namespace ResourceDASM {
+
+MappedFile::MappedFile(const string& filename)
+    : mapped_data(nullptr),
+      mapped_size(0) {
+#ifndef PHOSG_WINDOWS
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw cannot_open_file(filename);
+  }
+
+  struct stat st;
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      this->mapped_data = addr;
+      this->mapped_size = st.st_size;
+    }
+  }
+  close(fd);
+  if (this->mapped_data) {
+    return;
+  }
+#endif
+
+  this->contents = load_file(filename);
+}
+
+MappedFile::~MappedFile() {
+#ifndef PHOSG_WINDOWS
+  if (this->mapped_data) {
+    munmap(this->mapped_data, this->mapped_size);
+  }
+#endif
+}
+
+} // namespace ResourceDASM
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <phosg/Strings.hh>
+#include <string>
+
+namespace ResourceDASM {
+
+using namespace phosg;
+
+// A read-only view of a file's entire contents. When possible, the file is
+// memory-mapped instead of being read into memory, so large inputs don't have
+// to be copied to the heap before parsing them. If the file can't be mapped
+// (e.g. on Windows, or for some special files like resource forks on some
+// filesystems), its contents are read into memory instead; either way, the
+// interface is the same. The data is only valid while this object exists.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& filename);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile(MappedFile&&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile& operator=(MappedFile&&) = delete;
+  ~MappedFile();
+
+  inline const void* data() const {
+    return this->mapped_data ? this->mapped_data : this->contents.data();
+  }
+  inline size_t size() const {
+    return this->mapped_data ? this->mapped_size : this->contents.size();
+  }
+  inline StringReader reader() const {
+    return StringReader(this->data(), this->size());
+  }
+
+private:
+  void* mapped_data;
+  size_t mapped_size;
+  std::string contents; // Only used if the file couldn't be mapped
+};
+
+} // namespace ResourceDASM
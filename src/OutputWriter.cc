@@ -0,0 +1,61 @@
+#include "OutputWriter.hh"
+
+#include <phosg/Filesystem.hh>
+
+using namespace std;
+using namespace phosg;
+
+namespace ResourceDASM {
+
+OutputWriter::OutputWriter(Backend backend, size_t buffer_size)
+    : backend(std::move(backend)),
+      buffer_size(buffer_size) {
+  this->buffer.reserve(this->buffer_size);
+}
+
+OutputWriter::OutputWriter(FILE* stream, size_t buffer_size)
+    : OutputWriter([stream](const void* data, size_t size) -> void {
+        fwritex(stream, data, size);
+      },
+          buffer_size) {}
+
+OutputWriter::~OutputWriter() {
+  try {
+    this->flush();
+  } catch (const exception&) {
+  }
+}
+
+void OutputWriter::write(const void* data, size_t size) {
+  // Large writes bypass the buffer entirely, so they aren't copied twice
+  if (this->buffer.size() + size > this->buffer_size) {
+    this->flush();
+    if (size >= this->buffer_size) {
+      this->backend(data, size);
+      return;
+    }
+  }
+  this->buffer.append(reinterpret_cast<const char*>(data), size);
+}
+
+void OutputWriter::flush() {
+  if (!this->buffer.empty()) {
+    // Clear the buffer even if the backend throws, so we don't try to write
+    // the same data again in the destructor
+    try {
+      this->backend(this->buffer.data(), this->buffer.size());
+    } catch (...) {
+      this->buffer.clear();
+      throw;
+    }
+    this->buffer.clear();
+  }
+}
+
+function<void(const char*, size_t)> OutputWriter::callback() {
+  return [this](const char* data, size_t size) -> void {
+    this->write(data, size);
+  };
+}
+
+} // namespace ResourceDASM
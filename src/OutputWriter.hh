@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <format>
+#include <functional>
+#include <iterator>
+#include <string>
+
+namespace ResourceDASM {
+
+// A buffered output sink. Text and data written to an OutputWriter are
+// collected in a buffer, which is passed to the backend function whenever it
+// grows past buffer_size and when flush() is called. This allows large outputs
+// (for example, disassembly of big CODE resources) to be written incrementally
+// without building the entire output in memory first.
+class OutputWriter {
+public:
+  using Backend = std::function<void(const void* data, size_t size)>;
+
+  static constexpr size_t DEFAULT_BUFFER_SIZE = 0x10000;
+
+  explicit OutputWriter(Backend backend, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+  // Writes to the given stream, which is not closed when the writer is destroyed
+  explicit OutputWriter(FILE* stream, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+  OutputWriter(const OutputWriter&) = delete;
+  OutputWriter(OutputWriter&&) = delete;
+  OutputWriter& operator=(const OutputWriter&) = delete;
+  OutputWriter& operator=(OutputWriter&&) = delete;
+  // Any buffered data is flushed at destruction time, but errors from the
+  // backend are ignored then; call flush() explicitly to handle them.
+  ~OutputWriter();
+
+  void write(const void* data, size_t size);
+  inline void write(const std::string& data) {
+    this->write(data.data(), data.size());
+  }
+
+  template <typename... ArgTs>
+  void write_fmt(std::format_string<ArgTs...> fmt, ArgTs&&... args) {
+    std::format_to(std::back_inserter(this->buffer), fmt, std::forward<ArgTs>(args)...);
+    if (this->buffer.size() >= this->buffer_size) {
+      this->flush();
+    }
+  }
+
+  void flush();
+
+  // Returns a function that writes to this OutputWriter, for use with
+  // functions that take a write callback (e.g. M68KEmulator::disassemble).
+  // The returned function must not be called after the writer is destroyed.
+  std::function<void(const char*, size_t)> callback();
+
+private:
+  Backend backend;
+  size_t buffer_size;
+  std::string buffer;
+};
+
+} // namespace ResourceDASM
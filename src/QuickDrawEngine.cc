@@ -35,6 +35,12 @@ pict_contains_undecodable_quicktime::pict_contains_undecodable_quicktime(
 
 QuickDrawPortInterface::~QuickDrawPortInterface() {}
 
+void QuickDrawPortInterface::write_span(ssize_t x, ssize_t y, const uint32_t* colors, size_t count) {
+  for (size_t z = 0; z < count; z++) {
+    this->write(x + z, y, colors[z]);
+  }
+}
+
 static const ColorTable& get_color_table(StringReader& r) {
   size_t s = r.get<ColorTable>(false).size();
   return r.get<ColorTable>(true, s);
@@ -66,7 +72,7 @@ pair<Pattern, ImageRGB888> QuickDrawEngine::pict_read_pixel_pattern(StringReader
     const auto& header = r.get<PixelMapHeader>();
     const auto& ctable = get_color_table(r);
 
-    uint16_t row_bytes = header.flags_row_bytes & 0x7FFF;
+    uint16_t row_bytes = header.flags_row_bytes & 0x3FFF;
     const auto& pixel_map = r.get<PixelMapData>(true, header.bounds.height() * row_bytes);
 
     return make_pair(std::move(monochrome_pattern), decode_color_image(header, pixel_map, &ctable));
@@ -618,45 +624,120 @@ string QuickDrawEngine::unpack_bits(StringReader& r, size_t row_count,
       failure_strs[0], failure_strs[1]));
 }
 
+// Replaces out with the parts of the [start, end) spans in a that are also in
+// spans in b. Both inputs must be in ascending order and non-overlapping.
+static void intersect_spans(
+    vector<pair<int32_t, int32_t>>& out,
+    const vector<pair<int32_t, int32_t>>& a,
+    const vector<pair<int32_t, int32_t>>& b) {
+  out.clear();
+  size_t a_index = 0;
+  size_t b_index = 0;
+  while ((a_index < a.size()) && (b_index < b.size())) {
+    int32_t start = max<int32_t>(a[a_index].first, b[b_index].first);
+    int32_t end = min<int32_t>(a[a_index].second, b[b_index].second);
+    if (start < end) {
+      out.emplace_back(start, end);
+    }
+    if (a[a_index].second < b[b_index].second) {
+      a_index++;
+    } else {
+      b_index++;
+    }
+  }
+}
+
+void QuickDrawEngine::pict_write_rows_clipped(
+    const Rect& dest_rect,
+    const Region& mask_region,
+    function<void(uint32_t* colors, size_t y)> decode_row) {
+  // The port's bounds are in port coordinates; everything else here is in
+  // PICT coordinates
+  const Rect& port_bounds = this->port->get_bounds();
+  ssize_t port_x1 = port_bounds.x1 + this->pict_bounds.x1;
+  ssize_t port_x2 = port_bounds.x2 + this->pict_bounds.x1;
+  ssize_t port_y1 = port_bounds.y1 + this->pict_bounds.y1;
+  ssize_t port_y2 = port_bounds.y2 + this->pict_bounds.y1;
+
+  auto clip_region_it = this->port->get_clip_region().iterate(dest_rect);
+  // TODO: The mask region is in dest-space, right?
+  auto mask_region_it = mask_region.iterate(dest_rect);
+
+  vector<uint32_t> colors(dest_rect.width());
+  vector<pair<int32_t, int32_t>> clip_spans;
+  vector<pair<int32_t, int32_t>> mask_spans;
+  vector<pair<int32_t, int32_t>> spans;
+  for (ssize_t y = 0; y < dest_rect.height(); y++) {
+    ssize_t pict_y = dest_rect.y1 + y;
+    if ((pict_y >= port_y1) && (pict_y < port_y2)) {
+      clip_region_it.get_row_spans(clip_spans);
+      mask_region_it.get_row_spans(mask_spans);
+      intersect_spans(spans, clip_spans, mask_spans);
+
+      bool row_decoded = false;
+      for (const auto& [span_x1, span_x2] : spans) {
+        ssize_t x1 = max<ssize_t>(span_x1, port_x1);
+        ssize_t x2 = min<ssize_t>(span_x2, port_x2);
+        if (x1 >= x2) {
+          continue;
+        }
+        if (!row_decoded) {
+          decode_row(colors.data(), y);
+          row_decoded = true;
+        }
+        this->port->write_span(x1 - this->pict_bounds.x1, pict_y - this->pict_bounds.y1,
+            &colors[x1 - dest_rect.x1], x2 - x1);
+      }
+    }
+
+    clip_region_it.next_line();
+    mask_region_it.next_line();
+  }
+}
+
 void QuickDrawEngine::pict_copy_bits_indexed_color(StringReader& r, uint16_t opcode) {
   bool is_packed = opcode & 0x08;
   bool has_mask_region = opcode & 0x01;
 
-  Rect bounds;
-  Rect source_rect;
-  Rect dest_rect;
-  uint16_t mode __attribute__((unused));
-  shared_ptr<Region> mask_region;
-  ImageRGB888 source_image(0, 0);
-
   // TODO: should we support pixmaps in v1? Currently we do, but I don't know if
   // this is technically correct behavior
   bool is_pixmap = r.get_u8(false) & 0x80;
   if (is_pixmap) {
     const auto& header = r.get<PixelMapHeader>();
-    bounds = header.bounds;
 
     const auto& ctable = get_color_table(r);
 
-    source_rect = r.get<Rect>();
-    dest_rect = r.get<Rect>();
+    Rect source_rect = r.get<Rect>();
+    Rect dest_rect = r.get<Rect>();
     // TODO: transfer mode, e.g. srcCopy, srcOr, blend (see Imaging with Quickdraw, page 4-38)
     /* uint16_t mode = */ r.get_u16b();
 
+    if (!header.bounds.contains(source_rect)) {
+      string source_s = source_rect.str();
+      string bounds_s = header.bounds.str();
+      throw runtime_error(std::format("source {} is not within bounds {}", source_s, bounds_s));
+    }
     if ((source_rect.width() != dest_rect.width()) ||
         (source_rect.height() != dest_rect.height())) {
       throw runtime_error("source and destination rect dimensions do not match");
     }
 
-    if (has_mask_region) {
-      mask_region = make_shared<Region>(r);
-    }
+    auto mask_region = has_mask_region ? Region(r) : Region(dest_rect);
 
-    uint16_t row_bytes = header.flags_row_bytes & 0x7FFF;
+    uint16_t row_bytes = header.flags_row_bytes & 0x3FFF;
     string data = is_packed ? unpack_bits(r, header.bounds.height(), row_bytes, header.pixel_size == 0x10) : r.read(header.bounds.height() * row_bytes);
     const PixelMapData* pixel_map = reinterpret_cast<const PixelMapData*>(data.data());
 
-    source_image = decode_color_image(header, *pixel_map, &ctable);
+    // Rows are decoded one at a time directly into the port, so the entire
+    // source image is never decoded
+    ColorImageRowDecoder decoder(header, &ctable);
+    vector<uint32_t> source_row(header.bounds.width());
+    size_t source_x = source_rect.x1 - header.bounds.x1;
+    size_t source_y = source_rect.y1 - header.bounds.y1;
+    this->pict_write_rows_clipped(dest_rect, mask_region, [&](uint32_t* colors, size_t y) -> void {
+      decoder.decode_row(source_row.data(), *pixel_map, source_y + y);
+      memcpy(colors, &source_row[source_x], source_rect.width() * sizeof(uint32_t));
+    });
 
   } else {
     const auto& args = r.get<PictCopyBitsMonochromeArgs>();
@@ -670,33 +751,41 @@ void QuickDrawEngine::pict_copy_bits_indexed_color(StringReader& r, uint16_t opc
         (args.source_rect.height() != args.dest_rect.height())) {
       throw runtime_error("source and destination rect dimensions do not match");
     }
-    bounds = args.header.bounds;
-    source_rect = args.source_rect;
-    dest_rect = args.dest_rect;
-    mode = args.mode;
 
-    if (has_mask_region) {
-      mask_region = make_shared<Region>(r);
+    auto mask_region = has_mask_region ? Region(r) : Region(args.dest_rect);
+
+    size_t row_bytes = args.header.flags_row_bytes & 0x7FFF;
+    string data = is_packed ? unpack_bits(r, args.header.bounds.height(), row_bytes, false) : r.read(args.header.bounds.height() * row_bytes);
+
+    // These are the same checks decode_monochrome_image does
+    size_t bounds_width = args.header.bounds.width();
+    size_t bounds_height = args.header.bounds.height();
+    if (row_bytes == 0) {
+      if (bounds_width & 7) {
+        throw runtime_error("width must be a multiple of 8 unless row_bytes is specified");
+      }
+      row_bytes = bounds_width / 8;
+    }
+    if (row_bytes * 8 < bounds_width) {
+      throw runtime_error("row_bytes is too small for the bitmap width");
+    }
+    if (data.size() != row_bytes * bounds_height) {
+      throw runtime_error(std::format(
+          "incorrect data size: expected {} bytes, got {} bytes", row_bytes * bounds_height, data.size()));
     }
 
-    string data = is_packed ? unpack_bits(r, args.header.bounds.height(), args.header.flags_row_bytes, false) : r.read(args.header.bounds.height() * args.header.flags_row_bytes);
-    auto mono_source_image = decode_monochrome_image(data.data(), data.size(),
-        args.header.bounds.width(), args.header.bounds.height(),
-        args.header.flags_row_bytes);
-    source_image = mono_source_image.convert_monochrome_to_color(0xFFFFFFFF, 0x000000FF);
+    // Set bits are black; clear bits are white
+    size_t source_x = args.source_rect.x1 - args.header.bounds.x1;
+    size_t source_y = args.source_rect.y1 - args.header.bounds.y1;
+    size_t width = args.source_rect.width();
+    this->pict_write_rows_clipped(args.dest_rect, mask_region, [&](uint32_t* colors, size_t y) -> void {
+      const uint8_t* row_data = reinterpret_cast<const uint8_t*>(&data[(source_y + y) * row_bytes]);
+      for (size_t x = 0; x < width; x++) {
+        size_t bit_x = source_x + x;
+        colors[x] = ((row_data[bit_x >> 3] >> (7 - (bit_x & 7))) & 1) ? 0x000000FF : 0xFFFFFFFF;
+      }
+    });
   }
-
-  // TODO: the clipping region should apply here too
-  this->port->blit(source_image,
-      dest_rect.x1 - this->pict_bounds.x1,
-      dest_rect.y1 - this->pict_bounds.y1,
-      source_rect.x2 - source_rect.x1,
-      source_rect.y2 - source_rect.y1,
-      source_rect.x1 - bounds.x1,
-      source_rect.y1 - bounds.y1,
-      mask_region,
-      dest_rect.x1,
-      dest_rect.y1);
 }
 
 void QuickDrawEngine::pict_packed_copy_bits_direct_color(StringReader& r, uint16_t opcode) {
@@ -733,44 +822,35 @@ void QuickDrawEngine::pict_packed_copy_bits_direct_color(StringReader& r, uint16
   size_t row_bytes = args.header.bounds.width() * bytes_per_pixel;
   string data = unpack_bits(r, args.header.bounds.height(), row_bytes, args.header.pixel_size == 0x10);
 
-  auto clip_region_it = this->port->get_clip_region().iterate(args.dest_rect);
-  // TODO: The mask region is in dest-space, right?
-  auto mask_region_it = mask_region.iterate(args.dest_rect);
-
-  for (ssize_t y = 0; y < args.source_rect.height(); y++) {
+  size_t width = args.source_rect.width();
+  this->pict_write_rows_clipped(args.dest_rect, mask_region, [&](uint32_t* colors, size_t y) -> void {
     size_t row_offset = row_bytes * y;
+    if ((args.header.component_size == 8) && (args.header.component_count == 3)) {
+      for (size_t x = 0; x < width; x++) {
+        colors[x] = rgba8888(
+            data[row_offset + x],
+            data[row_offset + (row_bytes / 3) + x],
+            data[row_offset + (2 * row_bytes / 3) + x]);
+      }
 
-    for (ssize_t x = 0; x < args.source_rect.width(); x++) {
-      if (this->port->get_bounds().contains(x + args.dest_rect.x1 - this->pict_bounds.x1, y + args.dest_rect.y1 - this->pict_bounds.y1) && clip_region_it.check() && mask_region_it.check()) {
-        uint32_t color;
-        if ((args.header.component_size == 8) && (args.header.component_count == 3)) {
-          color = rgba8888(
-              data[row_offset + x],
-              data[row_offset + (row_bytes / 3) + x],
-              data[row_offset + (2 * row_bytes / 3) + x]);
-
-        } else if ((args.header.component_size == 8) && (args.header.component_count == 4)) {
-          // The first component is ignored
-          color = rgba8888(
-              data[row_offset + (row_bytes / 4) + x],
-              data[row_offset + (2 * row_bytes / 4) + x],
-              data[row_offset + (3 * row_bytes / 4) + x]);
-
-        } else if (args.header.component_size == 5) { // xrgb1555
-          color = rgba8888_for_xrgb1555(*reinterpret_cast<const be_uint16_t*>(&data[row_offset + 2 * x]));
-        } else {
-          throw logic_error("unimplemented channel width");
-        }
-        this->port->write(x + args.dest_rect.x1 - this->pict_bounds.x1, y + args.dest_rect.y1 - this->pict_bounds.y1, color);
+    } else if ((args.header.component_size == 8) && (args.header.component_count == 4)) {
+      // The first component is ignored
+      for (size_t x = 0; x < width; x++) {
+        colors[x] = rgba8888(
+            data[row_offset + (row_bytes / 4) + x],
+            data[row_offset + (2 * row_bytes / 4) + x],
+            data[row_offset + (3 * row_bytes / 4) + x]);
       }
 
-      clip_region_it.right();
-      mask_region_it.right();
-    }
+    } else if (args.header.component_size == 5) { // xrgb1555
+      for (size_t x = 0; x < width; x++) {
+        colors[x] = rgba8888_for_xrgb1555(*reinterpret_cast<const be_uint16_t*>(&data[row_offset + 2 * x]));
+      }
 
-    clip_region_it.next_line();
-    mask_region_it.next_line();
-  }
+    } else {
+      throw logic_error("unimplemented channel width");
+    }
+  });
 }
 
 // QuickTime embedded file support
@@ -24,6 +24,11 @@ public:
   virtual size_t width() const = 0;
   virtual size_t height() const = 0;
   virtual void write(ssize_t x, ssize_t y, uint32_t color) = 0;
+  // Writes count pixels starting at (x, y) and going right. The engine only
+  // calls this with spans that are entirely within the port's bounds. The
+  // default implementation calls write() for each pixel; ports should override
+  // this if they can do better.
+  virtual void write_span(ssize_t x, ssize_t y, const uint32_t* colors, size_t count);
   virtual void blit(
       const ImageRGB888& src,
       ssize_t dest_x,
@@ -226,6 +231,17 @@ protected:
   static std::string unpack_bits(StringReader& r, size_t row_count,
       uint16_t row_bytes, bool chunks_are_words);
 
+  // Writes the pixels in dest_rect (in PICT coordinates) that are within the
+  // port's bounds, the port's clip region, and mask_region. decode_row is
+  // called at most once for each row, in increasing order of y, and is not
+  // called for rows that have no visible pixels, so it must not depend on
+  // having been called for the previous row. It must write dest_rect.width()
+  // colors.
+  void pict_write_rows_clipped(
+      const Rect& dest_rect,
+      const Region& mask_region,
+      std::function<void(uint32_t* colors, size_t y)> decode_row);
+
   void pict_copy_bits_indexed_color(StringReader& r, uint16_t opcode);
   void pict_packed_copy_bits_direct_color(StringReader& r, uint16_t opcode);
 
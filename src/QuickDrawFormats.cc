@@ -277,6 +277,61 @@ bool Region::Iterator::check() const {
   return this->current_loc_in_region;
 }
 
+void Region::Iterator::get_row_spans(vector<pair<int32_t, int32_t>>& spans) const {
+  spans.clear();
+
+  auto add_span = [&](int32_t start, int32_t end) -> void {
+    start = max<int32_t>(start, this->target_rect.x1);
+    end = min<int32_t>(end, this->target_rect.x2);
+    if (start < end) {
+      spans.emplace_back(start, end);
+    }
+  };
+
+  if (this->region_is_rect) {
+    if ((this->y >= this->region->rect.y1) && (this->y < this->region->rect.y2)) {
+      add_span(this->region->rect.x1, this->region->rect.x2);
+    }
+    return;
+  }
+
+  // This follows the same rules as right(): inversion points toggle whether
+  // we're in the region, and reaching the right edge of the rect leaves the
+  // region. Points past the right edge toggle it again, unless there's a point
+  // exactly on the edge: the edge takes precedence there, so that point is
+  // never consumed, and neither are any points after it. Similarly, points to
+  // the left of where reset_x() starts are never reached, and neither are any
+  // points after them.
+  int32_t start_x = min<int32_t>(this->region->rect.x1, this->target_rect.x1);
+  bool in_region = false;
+  bool passed_right_edge = false;
+  int32_t span_start = 0;
+  for (int16_t inv_x : this->current_row_inversions) {
+    if (inv_x < start_x) {
+      break;
+    }
+    if (!passed_right_edge && (inv_x >= this->region->rect.x2)) {
+      if (in_region) {
+        add_span(span_start, this->region->rect.x2);
+        in_region = false;
+      }
+      passed_right_edge = true;
+      if (inv_x == this->region->rect.x2) {
+        break;
+      }
+    }
+    if (in_region) {
+      add_span(span_start, inv_x);
+    } else {
+      span_start = inv_x;
+    }
+    in_region = !in_region;
+  }
+  if (in_region) {
+    add_span(span_start, passed_right_edge ? this->target_rect.x2 : this->region->rect.x2);
+  }
+}
+
 Fixed::Fixed() : value(0) {}
 
 Fixed::Fixed(int16_t whole, uint16_t decimal) : value((whole << 16) | decimal) {}
@@ -514,13 +569,110 @@ const ColorTableEntry* ColorTable::get_entry(int16_t id) const {
   return nullptr;
 }
 
-template <PixelFormat Format>
-Image<Format> decode_color_image_t(
-    const PixelMapHeader& header,
-    const PixelMapData& pixel_map,
-    const ColorTable* ctable,
-    const PixelMapData* mask_map,
-    size_t mask_row_bytes) {
+// Expands one row of a pixel map into one 32-bit value per pixel (color IDs for
+// indexed-color images, or the raw pixel values for direct-color images). This
+// is equivalent to calling PixelMapData::lookup_entry for each pixel in the
+// row, but only dispatches on the pixel size once, and unpacks whole bytes at
+// a time for sub-byte pixel sizes.
+static void expand_pixel_map_row(uint32_t* out, const uint8_t* row_data, uint16_t pixel_size, size_t width) {
+  switch (pixel_size) {
+    case 1:
+    case 2:
+    case 4: {
+      uint8_t pixels_per_byte = 8 / pixel_size;
+      uint8_t value_mask = (1 << pixel_size) - 1;
+      size_t x = 0;
+      for (; x + pixels_per_byte <= width; x += pixels_per_byte) {
+        uint8_t b = row_data[x / pixels_per_byte];
+        for (uint8_t z = 0; z < pixels_per_byte; z++) {
+          out[x + z] = (b >> (8 - pixel_size * (z + 1))) & value_mask;
+        }
+      }
+      if (x < width) {
+        uint8_t b = row_data[x / pixels_per_byte];
+        for (uint8_t z = 0; x < width; x++, z++) {
+          out[x] = (b >> (8 - pixel_size * (z + 1))) & value_mask;
+        }
+      }
+      break;
+    }
+    case 8:
+      for (size_t x = 0; x < width; x++) {
+        out[x] = row_data[x];
+      }
+      break;
+    case 16: {
+      const be_uint16_t* row_data16 = reinterpret_cast<const be_uint16_t*>(row_data);
+      for (size_t x = 0; x < width; x++) {
+        out[x] = row_data16[x];
+      }
+      break;
+    }
+    case 32: {
+      const be_uint32_t* row_data32 = reinterpret_cast<const be_uint32_t*>(row_data);
+      for (size_t x = 0; x < width; x++) {
+        out[x] = row_data32[x];
+      }
+      break;
+    }
+    default:
+      throw runtime_error("pixel size is not 1, 2, 4, 8, 16, or 32 bits");
+  }
+}
+
+IndexedColorLookupTable::IndexedColorLookupTable(const ColorTable* ctable, uint16_t pixel_size)
+    : ctable(ctable),
+      pixel_size(pixel_size) {
+  if (this->pixel_size <= 8) {
+    size_t num_ids = 1 << this->pixel_size;
+    this->colors.resize(num_ids);
+    this->statuses.resize(num_ids);
+    for (size_t id = 0; id < num_ids; id++) {
+      this->statuses[id] = this->resolve(&this->colors[id], id);
+    }
+  }
+}
+
+IndexedColorLookupTable::Status IndexedColorLookupTable::resolve(uint32_t* color, uint32_t color_id) const {
+  const auto* e = this->ctable->get_entry(color_id);
+  if (e) {
+    *color = e->c.rgba8888();
+    return Status::FOUND;
+  }
+  // Some rare pixmaps appear to use 0xFF as black, so we handle that
+  // manually here. TODO: figure out if this is the right behavior
+  if (color_id == static_cast<uint32_t>((1 << this->pixel_size) - 1)) {
+    *color = 0x000000FF;
+    return Status::DEFAULT_BLACK;
+  }
+  *color = 0;
+  return Status::MISSING;
+}
+
+uint32_t IndexedColorLookupTable::lookup(uint32_t color_id, uint8_t alpha) const {
+  uint32_t color;
+  Status status;
+  if (color_id < this->statuses.size()) {
+    color = this->colors[color_id];
+    status = this->statuses[color_id];
+  } else {
+    status = this->resolve(&color, color_id);
+  }
+  switch (status) {
+    case Status::FOUND:
+      return (color & 0xFFFFFF00) | alpha;
+    case Status::DEFAULT_BLACK:
+      return color;
+    default:
+      throw runtime_error(std::format("color {:X} not found in color map", color_id));
+  }
+}
+
+ColorImageRowDecoder::ColorImageRowDecoder(const PixelMapHeader& header, const ColorTable* ctable)
+    : pixel_size(header.pixel_size),
+      width(header.bounds.width()),
+      row_bytes(header.flags_row_bytes & 0x3FFF),
+      row_values(this->width) {
 
   // According to Apple's docs, pixel_type is 0 for indexed color and 0x0010 for
   // direct color, even for 32-bit images
@@ -542,41 +694,67 @@ Image<Format> decode_color_image_t(
     throw runtime_error("unsupported 32-bit channel width");
   }
 
+  if (header.pixel_type == 0) {
+    this->lut = make_unique<IndexedColorLookupTable>(ctable, this->pixel_size);
+  }
+}
+
+void ColorImageRowDecoder::decode_row(
+    uint32_t* out,
+    const PixelMapData& pixel_map,
+    size_t y,
+    const PixelMapData* mask_map,
+    size_t mask_row_bytes) {
+  if (this->width == 0) {
+    return;
+  }
+  expand_pixel_map_row(this->row_values.data(), &pixel_map.data[y * this->row_bytes], this->pixel_size, this->width);
+
+  if (this->lut) {
+    if (mask_map) {
+      this->mask_values.resize(this->width);
+      expand_pixel_map_row(this->mask_values.data(), &mask_map->data[y * mask_row_bytes], 1, this->width);
+      for (size_t x = 0; x < this->width; x++) {
+        out[x] = this->lut->lookup(this->row_values[x], this->mask_values[x] ? 0xFF : 0x00);
+      }
+    } else {
+      for (size_t x = 0; x < this->width; x++) {
+        out[x] = this->lut->lookup(this->row_values[x], 0xFF);
+      }
+    }
+
+  } else if (this->pixel_size == 0x0010) { // xrgb1555
+    for (size_t x = 0; x < this->width; x++) {
+      out[x] = rgba8888_for_xrgb1555(this->row_values[x]);
+    }
+
+  } else if (this->pixel_size == 0x0020) { // xrgb8888
+    for (size_t x = 0; x < this->width; x++) {
+      out[x] = rgba8888_for_argb8888(this->row_values[x]) | 0x000000FF;
+    }
+
+  } else {
+    throw runtime_error("unsupported pixel format");
+  }
+}
+
+template <PixelFormat Format>
+Image<Format> decode_color_image_t(
+    const PixelMapHeader& header,
+    const PixelMapData& pixel_map,
+    const ColorTable* ctable,
+    const PixelMapData* mask_map,
+    size_t mask_row_bytes) {
+  ColorImageRowDecoder decoder(header, ctable);
+
   size_t width = header.bounds.width();
   size_t height = header.bounds.height();
   Image<Format> img(width, height);
+  vector<uint32_t> row(width);
   for (size_t y = 0; y < height; y++) {
+    decoder.decode_row(row.data(), pixel_map, y, mask_map, mask_row_bytes);
     for (size_t x = 0; x < width; x++) {
-      uint32_t color_id = pixel_map.lookup_entry(header.pixel_size, header.flags_row_bytes & 0x3FFF, x, y);
-
-      if (header.pixel_type == 0) {
-        const auto* e = ctable->get_entry(color_id);
-        if (e) {
-          uint8_t alpha = 0xFF;
-          if (mask_map) {
-            alpha = mask_map->lookup_entry(1, mask_row_bytes, x, y) ? 0xFF : 0x00;
-          }
-          img.write(x, y, e->c.rgba8888(alpha));
-
-          // Some rare pixmaps appear to use 0xFF as black, so we handle that
-          // manually here. TODO: figure out if this is the right behavior
-        } else if (color_id == static_cast<uint32_t>((1 << header.pixel_size) - 1)) {
-          img.write(x, y, 0x0000000FF);
-
-        } else {
-          throw runtime_error(std::format("color {:X} not found in color map", color_id));
-        }
-
-      } else if (header.pixel_size == 0x0010 && header.component_size == 5) { // xrgb1555
-        img.write(x, y, rgba8888_for_xrgb1555(color_id));
-
-      } else if (header.pixel_size == 0x0020 && header.component_size == 8) {
-        // xrgb8888
-        img.write(x, y, rgba8888_for_argb8888(color_id) | 0x000000FF);
-
-      } else {
-        throw runtime_error("unsupported pixel format");
-      }
+      img.write(x, y, row[x]);
     }
   }
   return img;
@@ -6,6 +6,7 @@
 #include <sys/types.h>
 
 #include <map>
+#include <memory>
 #include <phosg/Image.hh>
 #include <phosg/Strings.hh>
 #include <set>
@@ -71,6 +72,12 @@ struct Region {
 
     bool check() const;
 
+    // Replaces spans with the runs of pixels on the current row that are in
+    // the region and within the target rect, as [start, end) pairs in
+    // ascending order. This gives the same result as calling check() for each
+    // pixel in the row, but doesn't move the iterator.
+    void get_row_spans(std::vector<std::pair<int32_t, int32_t>>& spans) const;
+
   private:
     const Region* region;
     Rect target_rect;
@@ -126,6 +133,59 @@ ImageRGB888 decode_8bit_image(
     size_t h,
     const std::vector<Color8>* color_table = &default_icon_color_table_8bit);
 
+// Maps indexed color IDs to colors. For pixel sizes up to 8 bits, the colors
+// for all possible IDs are computed up front, so ColorTable::get_entry (which
+// may search the entire table) isn't called for every pixel.
+class IndexedColorLookupTable {
+public:
+  IndexedColorLookupTable(const ColorTable* ctable, uint16_t pixel_size);
+  ~IndexedColorLookupTable() = default;
+
+  // Returns the color for the given ID, with the given alpha value if the color
+  // is in the color table. Throws if the color isn't in the table.
+  uint32_t lookup(uint32_t color_id, uint8_t alpha) const;
+
+private:
+  enum class Status : uint8_t {
+    FOUND = 0,
+    DEFAULT_BLACK,
+    MISSING,
+  };
+
+  const ColorTable* ctable;
+  uint16_t pixel_size;
+  std::vector<uint32_t> colors;
+  std::vector<Status> statuses;
+
+  Status resolve(uint32_t* color, uint32_t color_id) const;
+};
+
+// Decodes a color pixel map one row at a time, for callers that don't need the
+// entire image at once. Rows are decoded to RGBA8888 values; the alpha channel
+// is always 0xFF unless a mask bitmap is given.
+class ColorImageRowDecoder {
+public:
+  ColorImageRowDecoder(const PixelMapHeader& header, const ColorTable* ctable);
+  ~ColorImageRowDecoder() = default;
+
+  // Writes header.bounds.width() values to out
+  void decode_row(
+      uint32_t* out,
+      const PixelMapData& pixel_map,
+      size_t y,
+      const PixelMapData* mask_map = nullptr,
+      size_t mask_row_bytes = 0);
+
+private:
+  uint16_t pixel_size;
+  size_t width;
+  size_t row_bytes;
+  std::unique_ptr<IndexedColorLookupTable> lut; // null for direct-color images
+
+  std::vector<uint32_t> row_values;
+  std::vector<uint32_t> mask_values;
+};
+
 // Decodes a color pixel map, optionally with a mask bitmap.
 ImageRGB888 decode_color_image(const PixelMapHeader& header, const PixelMapData& pixel_map, const ColorTable* ctable);
 ImageRGBA8888N decode_color_image_masked(
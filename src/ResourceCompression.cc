@@ -4,11 +4,21 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <phosg/Encoding.hh>
+#include <phosg/Filesystem.hh>
+#include <phosg/Hash.hh>
+#include <phosg/Random.hh>
 #include <phosg/Time.hh>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "Emulators/M68KEmulator.hh"
@@ -22,6 +32,189 @@ using namespace phosg;
 namespace ResourceDASM {
 using Resource = ResourceFile::Resource;
 
+static thread_local function<void(const string&)> decompression_log_fn;
+
+function<void(const string&)> set_decompression_log_fn(function<void(const string&)> fn) {
+  return std::exchange(decompression_log_fn, std::move(fn));
+}
+
+void write_decompression_log_raw(const string& data) {
+  if (decompression_log_fn) {
+    decompression_log_fn(data);
+  } else {
+    fwritex(stderr, data);
+  }
+}
+
+// Bump this if anything changes that could affect the output of emulated
+// decompressors (e.g. emulator bug fixes), so stale cache entries aren't used
+static constexpr uint32_t DECOMPRESSION_CACHE_VERSION = 1;
+
+// Each cache file begins with one of these bytes, followed by the decompressed
+// data (for successful entries)
+static constexpr uint8_t DECOMPRESSION_CACHE_ENTRY_SUCCEEDED = 0x00;
+static constexpr uint8_t DECOMPRESSION_CACHE_ENTRY_FAILED = 0x01;
+
+DecompressionCache::DecompressionCache(const string& directory, uint64_t max_size)
+    : directory(directory),
+      max_size(max_size),
+      current_size(0),
+      current_size_known(false) {
+  std::filesystem::create_directories(this->directory);
+}
+
+string DecompressionCache::key_for(
+    const string& compressed_data,
+    int16_t dcmp_id,
+    const void* decompressor_data,
+    size_t decompressor_size,
+    bool is_ppc,
+    uint64_t decompress_flags) {
+  // Only STRICT_MEMORY can affect the result; the other flags only affect
+  // logging or which decompressors are tried
+  string key_data = std::format("{}:{}:{}:{}:",
+      DECOMPRESSION_CACHE_VERSION,
+      is_ppc ? "ncmp" : "dcmp",
+      dcmp_id,
+      (decompress_flags & DecompressionFlag::STRICT_MEMORY) ? "strict" : "lax");
+  key_data += SHA1(decompressor_data, decompressor_size).bin();
+  key_data += SHA1(compressed_data.data(), compressed_data.size()).bin();
+  return SHA1(key_data.data(), key_data.size()).hex();
+}
+
+string DecompressionCache::filename_for_key(const string& key) const {
+  // Split entries into subdirectories so no single directory gets too large
+  return std::format("{}/{}/{}", this->directory, key.substr(0, 2), key);
+}
+
+bool DecompressionCache::get(const string& key, string& data, bool& failed) {
+  string filename = this->filename_for_key(key);
+  string contents;
+  try {
+    contents = load_file(filename);
+  } catch (const exception&) {
+    return false;
+  }
+  if (contents.empty()) {
+    return false;
+  }
+
+  // Update the entry's modification time, which is used to decide which
+  // entries to evict first. If this fails (e.g. because another process just
+  // evicted the entry), we still have the data, so we can just ignore it.
+  std::error_code ec;
+  std::filesystem::last_write_time(filename, std::filesystem::file_time_type::clock::now(), ec);
+
+  if (static_cast<uint8_t>(contents[0]) == DECOMPRESSION_CACHE_ENTRY_FAILED) {
+    failed = true;
+    data.clear();
+  } else if (static_cast<uint8_t>(contents[0]) == DECOMPRESSION_CACHE_ENTRY_SUCCEEDED) {
+    failed = false;
+    data = contents.substr(1);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void DecompressionCache::put(const string& key, const string& data) {
+  string contents;
+  contents.reserve(data.size() + 1);
+  contents.push_back(DECOMPRESSION_CACHE_ENTRY_SUCCEEDED);
+  contents += data;
+  this->write_entry(key, contents);
+}
+
+void DecompressionCache::put_failure(const string& key) {
+  this->write_entry(key, string(1, DECOMPRESSION_CACHE_ENTRY_FAILED));
+}
+
+void DecompressionCache::write_entry(const string& key, const string& contents) {
+  // Write to a temporary file, then rename it into place. rename() is atomic,
+  // so other processes sharing the cache never see a partially-written entry.
+  string filename = this->filename_for_key(key);
+  string temp_filename = std::format("{}.tmp.{:016X}", filename, random_object<uint64_t>());
+  try {
+    std::filesystem::create_directories(filename.substr(0, filename.rfind('/')));
+    save_file(temp_filename, contents);
+    std::filesystem::rename(temp_filename, filename);
+  } catch (const exception& e) {
+    // Failing to write to the cache isn't fatal; we just won't be able to skip
+    // the decompressor next time
+    std::error_code ec;
+    std::filesystem::remove(temp_filename, ec);
+    write_decompression_log("warning: cannot write decompression cache entry: {}\n", e.what());
+    return;
+  }
+
+  lock_guard g(this->lock);
+  if (!this->current_size_known) {
+    this->scan_and_evict();
+  } else {
+    this->current_size += contents.size();
+    if (this->current_size > this->max_size) {
+      this->scan_and_evict();
+    }
+  }
+}
+
+void DecompressionCache::scan_and_evict() {
+  // Other processes may be using the same cache, so we can't just keep track
+  // of what we've written; we have to look at all the entries
+  struct Entry {
+    std::filesystem::file_time_type mtime;
+    uint64_t size;
+    std::filesystem::path path;
+  };
+  vector<Entry> entries;
+  uint64_t total_size = 0;
+  std::error_code ec;
+  for (auto it = std::filesystem::recursive_directory_iterator(this->directory, ec);
+      !ec && (it != std::filesystem::recursive_directory_iterator());
+      it.increment(ec)) {
+    std::error_code item_ec;
+    if (!it->is_regular_file(item_ec) || item_ec) {
+      continue;
+    }
+    auto& e = entries.emplace_back();
+    e.mtime = it->last_write_time(item_ec);
+    e.size = it->file_size(item_ec);
+    e.path = it->path();
+    if (item_ec) {
+      entries.pop_back();
+    } else {
+      total_size += e.size;
+    }
+  }
+
+  // Evict the least recently used entries until the cache is 10% below its
+  // size limit, so we don't have to scan again after every write
+  if (total_size > this->max_size) {
+    sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) -> bool {
+      return a.mtime < b.mtime;
+    });
+    uint64_t target_size = this->max_size - (this->max_size / 10);
+    for (const auto& e : entries) {
+      if (total_size <= target_size) {
+        break;
+      }
+      std::error_code remove_ec;
+      if (std::filesystem::remove(e.path, remove_ec)) {
+        total_size -= e.size;
+      }
+    }
+  }
+
+  this->current_size = total_size;
+  this->current_size_known = true;
+}
+
+static shared_ptr<DecompressionCache> decompression_cache;
+
+void set_decompression_cache(shared_ptr<DecompressionCache> cache) {
+  decompression_cache = std::move(cache);
+}
+
 struct DecompressorImplementation {
   // This field is used for internal decompressors
   typedef string (*decompress_fn)(
@@ -158,6 +351,592 @@ struct PPC32DecompressorInputHeader {
   be_uint32_t syscall_opcode;
 } __attribute__((packed));
 
+// A decompressor loaded into emulated memory, along with an emulator that can
+// run it. Loading a decompressor (copying its code into memory, parsing and
+// relocating PEF files for ncmps, creating the emulator, etc.) often takes
+// longer than actually running it on a small resource, so loaded decompressors
+// are kept in a pool and reused for all resources that use the same
+// decompressor. Between runs, only the stack, input, output, and working buffer
+// regions are freed; they're allocated again for each run, so every run starts
+// with them zeroed, just as if the decompressor had been loaded from scratch.
+struct LoadedDecompressor {
+  // Key in EmulatedDecompressorPool; see EmulatedDecompressorPool::key_for
+  string key;
+
+  shared_ptr<MemoryContext> mem;
+  bool use_ppc_emulator;
+  uint32_t entry_pc;
+  uint32_t entry_r2;
+
+  // Contents of all memory blocks allocated while loading the decompressor.
+  // Some decompressors modify their own code or data (e.g. Ben Mickaelian's
+  // self-modifying decompressor), so these are restored before each run.
+  vector<pair<uint32_t, string>> loaded_blocks;
+
+  // Call stubs created by GetTrapAddress. These persist across runs, but their
+  // contents are also restored before each run, as above.
+  unordered_map<uint16_t, uint32_t> trap_to_call_stub_addr;
+
+  // Addresses of the stack, input, output, and working buffer regions that are
+  // allocated during the current run, if any
+  vector<uint32_t> data_region_addrs;
+
+  // Exactly one of these is not null, depending on use_ppc_emulator
+  unique_ptr<M68KEmulator> m68k_emu;
+  unique_ptr<PPC32Emulator> ppc32_emu;
+
+  LoadedDecompressor(const DecompressorImplementation& decompressor, const string& key, bool verbose);
+  LoadedDecompressor(const LoadedDecompressor&) = delete;
+  LoadedDecompressor(LoadedDecompressor&&) = delete;
+  LoadedDecompressor& operator=(const LoadedDecompressor&) = delete;
+  LoadedDecompressor& operator=(LoadedDecompressor&&) = delete;
+  ~LoadedDecompressor() = default;
+
+  void restore_loaded_state();
+  uint32_t allocate_data_region(uint32_t addr, size_t size);
+  void free_data_regions();
+};
+
+LoadedDecompressor::LoadedDecompressor(
+    const DecompressorImplementation& decompressor, const string& key, bool verbose)
+    : key(key),
+      mem(make_shared<MemoryContext>()),
+      use_ppc_emulator(false),
+      entry_pc(0),
+      entry_r2(0) {
+  if (!decompressor.is_ppc) {
+    // Figure out where in the dcmp to start execution. There appear to be
+    // two formats: one that has 'dcmp' in bytes 4-8 where execution
+    // appears to just start at byte 0 (usually it's a branch opcode), and
+    // one where the first three words appear to be offsets to various
+    // functions, followed by code. The second word appears to be the main
+    // entry point in this format, so we use that to determine where to
+    // start execution.
+    // TODO: It looks like the decompression implementation in ResEdit
+    // assumes the second format (with the three offsets) if and only if
+    // the compressed resource has header format 9. This feels kind of bad
+    // because... shouldn't the dcmp format be a property of the dcmp
+    // resource, not the resource being decompressed? We use a heuristic
+    // here instead, which seems correct for all decompressors I've seen.
+    uint32_t entry_offset;
+    if (decompressor.size < 10) {
+      throw runtime_error("decompressor resource is too short");
+    }
+    uint32_t internal_signature = *reinterpret_cast<const be_uint32_t*>(
+        reinterpret_cast<const uint8_t*>(decompressor.data) + 4);
+    if (internal_signature == RESOURCE_TYPE_dcmp) {
+      entry_offset = 0;
+    } else {
+      // TODO: Call init and exit for decompressors that have them. It's
+      // not clear (yet) what the arguments to init and exit should be...
+      // they each apparently take one argument based on how they adjust
+      // the stack before returning, but every decompressor I've seen
+      // ignores the argument's value.
+      entry_offset = *reinterpret_cast<const be_uint16_t*>(
+          reinterpret_cast<const uint8_t*>(decompressor.data) + 2);
+    }
+
+    // Load the dcmp into emulated memory. dcmp resources are just raw
+    // 68K code; there's no header beyond what's described above.
+    size_t code_region_size = decompressor.size;
+    uint32_t code_addr = 0xF0000000;
+    this->mem->allocate_at(code_addr, code_region_size);
+    this->mem->memcpy(code_addr, decompressor.data, decompressor.size);
+
+    this->entry_pc = code_addr + entry_offset;
+    if (verbose) {
+      write_decompression_log("loaded code at {:08X}:{:X}\n", code_addr, code_region_size);
+      write_decompression_log("dcmp entry offset is {:08X} (loaded at {:X})\n",
+          entry_offset, this->entry_pc);
+    }
+
+  } else { // decompressor.is_ppc == true
+    // ncmp resources are entire PEF files, so we have to parse the
+    // header and run relocations (if any) while loading them.
+    PEFFile f("<ncmp>", decompressor.data, decompressor.size);
+    f.load_into("<ncmp>", this->mem, 0xF0000000);
+    this->use_ppc_emulator = f.is_ppc();
+
+    // ncmp decompressors don't appear to define any of the standard
+    // export symbols (init/main/term); instead, they define a single
+    // export symbol in the export table.
+    // TODO: It's possible that ncmps are allowed to define init and
+    // term. Presumably this would be similar to how the unused functions
+    // work in dcmp v9 above... reverse-engineer ResEdit some more and
+    // figure this out.
+    if (!f.init().name.empty()) {
+      throw runtime_error("ncmp decompressor has init symbol");
+    }
+    if (!f.main().name.empty()) {
+      throw runtime_error("ncmp decompressor has main symbol");
+    }
+    if (!f.term().name.empty()) {
+      throw runtime_error("ncmp decompressor has term symbol");
+    }
+    const auto& exports = f.exports();
+    if (exports.size() != 1) {
+      throw runtime_error("ncmp decompressor does not export exactly one symbol");
+    }
+
+    // The start symbol is actually a transition vector, which is the code
+    // address followed by the desired value in r2.
+    string start_symbol_name = "<ncmp>:" + exports.begin()->second.name;
+    uint32_t start_symbol_addr = this->mem->get_symbol_addr(start_symbol_name);
+    this->entry_pc = this->mem->read_u32b(start_symbol_addr);
+    this->entry_r2 = this->mem->read_u32b(start_symbol_addr + 4);
+
+    if (verbose) {
+      write_decompression_log("ncmp entry pc is {:08X} with r2 = {:08X}\n",
+          this->entry_pc, this->entry_r2);
+    }
+  }
+
+  for (const auto& [addr, size] : this->mem->allocated_blocks()) {
+    this->loaded_blocks.emplace_back(addr, this->mem->read(addr, size));
+  }
+
+  if (this->use_ppc_emulator) {
+    this->ppc32_emu = make_unique<PPC32Emulator>(this->mem);
+  } else {
+    this->m68k_emu = make_unique<M68KEmulator>(this->mem);
+  }
+}
+
+void LoadedDecompressor::restore_loaded_state() {
+  for (const auto& [addr, data] : this->loaded_blocks) {
+    this->mem->memcpy(addr, data.data(), data.size());
+  }
+  for (const auto& [trap_number, call_stub_addr] : this->trap_to_call_stub_addr) {
+    be_uint16_t* call_stub = this->mem->at<be_uint16_t>(call_stub_addr, 4);
+    call_stub[0] = 0xA000 | trap_number; // A-trap opcode
+    call_stub[1] = 0x4E75; // rts
+  }
+  if (this->m68k_emu) {
+    this->m68k_emu->registers() = M68KEmulator::Regs();
+  }
+  if (this->ppc32_emu) {
+    this->ppc32_emu->registers() = PPC32Emulator::Regs();
+  }
+}
+
+uint32_t LoadedDecompressor::allocate_data_region(uint32_t addr, size_t size) {
+  this->mem->allocate_at(addr, size);
+  this->data_region_addrs.emplace_back(addr);
+  return addr;
+}
+
+void LoadedDecompressor::free_data_regions() {
+  for (uint32_t addr : this->data_region_addrs) {
+    this->mem->free(addr);
+  }
+  this->data_region_addrs.clear();
+}
+
+class EmulatedDecompressorPool {
+public:
+  EmulatedDecompressorPool() = default;
+  EmulatedDecompressorPool(const EmulatedDecompressorPool&) = delete;
+  EmulatedDecompressorPool& operator=(const EmulatedDecompressorPool&) = delete;
+  ~EmulatedDecompressorPool() = default;
+
+  // Returns an idle instance of the given decompressor, or loads a new one if
+  // there are none. The caller has exclusive use of the returned instance until
+  // it calls release().
+  unique_ptr<LoadedDecompressor> acquire(const DecompressorImplementation& decompressor, bool verbose) {
+    string key = this->key_for(decompressor);
+    {
+      lock_guard g(this->lock);
+      auto it = this->idle_instances.find(key);
+      if ((it != this->idle_instances.end()) && !it->second.empty()) {
+        auto ret = std::move(it->second.back());
+        it->second.pop_back();
+        if (verbose) {
+          write_decompression_log("reusing loaded {} at {:08X}\n",
+              decompressor.is_ppc ? "ncmp" : "dcmp", ret->entry_pc);
+        }
+        return ret;
+      }
+    }
+    return make_unique<LoadedDecompressor>(decompressor, key, verbose);
+  }
+
+  // Returns an instance to the pool. The instance must not have any data
+  // regions allocated.
+  void release(unique_ptr<LoadedDecompressor> instance) {
+    lock_guard g(this->lock);
+    // Decompressors usually come from the resource file being processed, so
+    // there's no limit on how many different ones we could see over time. If
+    // there are too many, just start over instead of tracking which ones were
+    // used least recently.
+    if ((this->idle_instances.size() >= MAX_KEYS) && !this->idle_instances.count(instance->key)) {
+      this->idle_instances.clear();
+    }
+    auto& instances = this->idle_instances[instance->key];
+    if (instances.size() < MAX_IDLE_INSTANCES_PER_KEY) {
+      instances.emplace_back(std::move(instance));
+    }
+  }
+
+private:
+  static constexpr size_t MAX_KEYS = 64;
+  static constexpr size_t MAX_IDLE_INSTANCES_PER_KEY = 32;
+
+  mutex lock;
+  unordered_map<string, vector<unique_ptr<LoadedDecompressor>>> idle_instances;
+
+  static string key_for(const DecompressorImplementation& decompressor) {
+    // dcmp resources are usually only a few KB, so it's simplest to just use
+    // the entire contents as the key
+    string key(decompressor.is_ppc ? "ncmp:" : "dcmp:");
+    key.append(reinterpret_cast<const char*>(decompressor.data), decompressor.size);
+    return key;
+  }
+};
+
+static EmulatedDecompressorPool emulated_decompressor_pool;
+
+// Runs an emulated (dcmp or ncmp) decompressor on the given compressed data,
+// which includes the CompressedResourceHeader, and returns the decompressed
+// data.
+// Called from a catch block when an emulated decompressor fails. Rethrows the
+// current exception as a decompression_error if it came from the emulated code
+// (the emulators report bad memory accesses, invalid opcodes, and similar
+// problems as logic_error or runtime_error), or unchanged otherwise.
+[[noreturn]] static void rethrow_emulation_failure(const exception& e) {
+  if (dynamic_cast<const logic_error*>(&e) ||
+      (dynamic_cast<const runtime_error*>(&e) && !dynamic_cast<const system_error*>(&e))) {
+    throw decompression_error(e.what());
+  }
+  throw;
+}
+
+static string run_emulated_decompressor(
+    const DecompressorImplementation& decompressor,
+    const CompressedResourceHeader& header,
+    const string& data,
+    uint16_t output_extra_bytes,
+    uint64_t decompress_flags) {
+  bool debug_execution = !!(decompress_flags & DecompressionFlag::DEBUG_EXECUTION);
+  bool trace_execution = debug_execution || !!(decompress_flags & DecompressionFlag::TRACE_EXECUTION);
+  bool verbose = trace_execution || !!(decompress_flags & DecompressionFlag::VERBOSE);
+
+  // We'll set up memory appropriately, then use either M68KEmulator or
+  // PPC32Emulator to run the code contained in the dcmp or ncmp resource. The
+  // emulator and code come from the pool, unless we're going to attach a
+  // debugger to the emulator, in which case we use a new instance and don't
+  // put it back in the pool afterward.
+  unique_ptr<LoadedDecompressor> ld;
+  if (trace_execution) {
+    ld = make_unique<LoadedDecompressor>(decompressor, "", verbose);
+  } else {
+    ld = emulated_decompressor_pool.acquire(decompressor, verbose);
+  }
+  ld->restore_loaded_state();
+  auto& mem = ld->mem;
+  mem->set_strict(!!(decompress_flags & DecompressionFlag::STRICT_MEMORY));
+
+  size_t stack_region_size = 1024 * 16; // 16KB should be enough
+  size_t output_region_size = header.decompressed_size + output_extra_bytes;
+  // TODO: Looks like some decompressors expect zero bytes after the
+  // compressed input? Find out if this is true and fix it if not.
+  size_t input_region_size = data.size() + 0x100;
+  // TODO: This is probably way too big; probably we should use
+  // ((data.size() * 256) / working_buffer_fractional_size) instead here?
+  size_t working_buffer_region_size = data.size() * 256;
+
+  string ret;
+  try {
+    // Set up data memory regions. Slightly awkward assumption: decompressed
+    // data is never more than 256 times the size of the input data.
+    // We intentionally put the regions pretty far from each other in the
+    // address space in order to fail catastrophically in case of buffer
+    // underflows or overflows; this is useful for debugging the emulators.
+    uint32_t stack_addr = ld->allocate_data_region(0x10000000, stack_region_size);
+    uint32_t output_addr = ld->allocate_data_region(0x20000000, output_region_size);
+    uint32_t working_buffer_addr = ld->allocate_data_region(0x80000000, working_buffer_region_size);
+    uint32_t input_addr = ld->allocate_data_region(0xC0000000, input_region_size);
+    if (verbose) {
+      write_decompression_log("memory:\n");
+      write_decompression_log("  stack region at {:08X}:{:X}\n", stack_addr, stack_region_size);
+      write_decompression_log("  output region at {:08X}:{:X}\n", output_addr, output_region_size);
+      write_decompression_log("  working region at {:08X}:{:X}\n", working_buffer_addr, working_buffer_region_size);
+      write_decompression_log("  input region at {:08X}:{:X}\n", input_addr, input_region_size);
+    }
+    mem->memcpy(input_addr, data.data(), data.size());
+
+    uint64_t execution_start_time;
+    if (ld->use_ppc_emulator) {
+      // Set up header in stack region
+      uint32_t return_addr = stack_addr + stack_region_size - sizeof(PPC32DecompressorInputHeader) + offsetof(PPC32DecompressorInputHeader, set_r2_opcode);
+      auto* input_header = mem->at<PPC32DecompressorInputHeader>(
+          stack_addr + stack_region_size - sizeof(PPC32DecompressorInputHeader));
+      input_header->saved_r1 = 0xAAAAAAAA;
+      input_header->saved_cr = 0x00000000;
+      input_header->saved_lr = return_addr;
+      input_header->reserved1 = 0x00000000;
+      input_header->reserved2 = 0x00000000;
+      input_header->saved_r2 = ld->entry_r2;
+      input_header->unused[0] = 0x00000000;
+      input_header->unused[1] = 0x00000000;
+      input_header->set_r2_opcode = 0x3840FFFF; // li r2, -1
+      input_header->syscall_opcode = 0x44000002; // sc
+
+      auto& emu = *ld->ppc32_emu;
+
+      // Set up registers. r3-r6 are the function arguments, which are
+      // analogous to the arguments to dcmp resources.
+      auto& regs = emu.registers();
+      regs.r[1].u = stack_addr + stack_region_size - sizeof(PPC32DecompressorInputHeader);
+      regs.r[2].u = ld->entry_r2;
+      regs.r[3].u = input_addr + sizeof(CompressedResourceHeader);
+      regs.r[4].u = output_addr;
+      regs.r[5].u = (header.header_version == 9) ? input_addr : working_buffer_addr;
+      regs.r[6].u = input_region_size - sizeof(CompressedResourceHeader);
+      regs.lr = return_addr;
+      regs.pc = ld->entry_pc;
+      if (verbose) {
+        write_decompression_log("initial stack contents (input header data):\n");
+        write_decompression_log_raw(format_data(input_header, sizeof(*input_header), regs.r[1].u));
+      }
+
+      // Set up the debugger, if debugging is enabled
+      shared_ptr<EmulatorDebugger<PPC32Emulator>> debugger;
+      if (trace_execution || debug_execution) {
+        debugger = make_shared<EmulatorDebugger<PPC32Emulator>>();
+        debugger->bind(emu);
+        debugger->state.mode = debug_execution ? DebuggerMode::STEP : DebuggerMode::TRACE;
+      }
+
+      // Set up environment
+      emu.set_syscall_handler([&](PPC32Emulator& emu) -> void {
+        auto& regs = emu.registers();
+        // We don't support any syscalls in PPC mode - the only syscall that
+        // should occur is the one at the end of emulation, when r2 == -1.
+        if (regs.r[2].u != 0xFFFFFFFF) {
+          throw runtime_error("unimplemented syscall");
+        }
+        throw PPC32Emulator::terminate_emulation();
+      });
+
+      // Run the decompressor
+      execution_start_time = now();
+      try {
+        emu.execute();
+      } catch (const exception& e) {
+        if (verbose) {
+          uint64_t diff = now() - execution_start_time;
+          float duration = static_cast<float>(diff) / 1000000.0f;
+          write_decompression_log("powerpc decompressor execution failed ({:g}sec): {}\n", duration, e.what());
+        }
+        rethrow_emulation_failure(e);
+      }
+
+    } else { // Not a PPC decompressor (it's 68K instead)
+      // Set up header + args in the stack region
+      auto* input_header = mem->at<M68KDecompressorInputHeader>(
+          stack_addr + stack_region_size - sizeof(M68KDecompressorInputHeader));
+      input_header->return_addr = stack_addr + stack_region_size - sizeof(M68KDecompressorInputHeader) + offsetof(M68KDecompressorInputHeader, reset_opcode);
+      if (header.header_version == 9) {
+        input_header->args.v9.data_size = input_region_size - sizeof(CompressedResourceHeader);
+        input_header->args.v9.source_resource_header = input_addr;
+        input_header->args.v9.dest_buffer_addr = output_addr;
+        input_header->args.v9.source_buffer_addr = input_addr + sizeof(CompressedResourceHeader);
+      } else {
+        input_header->args.v8.data_size = input_region_size - sizeof(CompressedResourceHeader);
+        input_header->args.v8.working_buffer_addr = working_buffer_addr;
+        input_header->args.v8.dest_buffer_addr = output_addr;
+        input_header->args.v8.source_buffer_addr = input_addr + sizeof(CompressedResourceHeader);
+      }
+      input_header->reset_opcode = 0x4E70;
+      input_header->unused = 0x0000;
+
+      // Set up registers
+      auto& emu = *ld->m68k_emu;
+      auto& regs = emu.registers();
+      regs.a[7] = stack_addr + stack_region_size - sizeof(M68KDecompressorInputHeader);
+      regs.pc = ld->entry_pc;
+      if (verbose) {
+        write_decompression_log("initial stack contents (input header data):\n");
+        write_decompression_log_raw(format_data(input_header, sizeof(*input_header), regs.a[7]));
+      }
+
+      // Set up debugger
+      shared_ptr<EmulatorDebugger<M68KEmulator>> debugger;
+      if (trace_execution || debug_execution) {
+        debugger = make_shared<EmulatorDebugger<M68KEmulator>>();
+        debugger->bind(emu);
+        debugger->state.mode = debug_execution ? DebuggerMode::STEP : DebuggerMode::TRACE;
+      }
+
+      // Set up environment. Unlike in PPC-land, we implement a few basic
+      // system calls here, because there are some dcmps that actually use
+      // them.
+      auto& trap_to_call_stub_addr = ld->trap_to_call_stub_addr;
+      emu.set_syscall_handler([&](M68KEmulator& emu, uint16_t opcode) -> void {
+        auto& regs = emu.registers();
+        uint16_t trap_number;
+        bool auto_pop = false;
+        uint8_t flags = 0;
+
+        if (opcode & 0x0800) {
+          trap_number = opcode & 0x0BFF;
+          auto_pop = opcode & 0x0400;
+        } else {
+          trap_number = opcode & 0x00FF;
+          flags = (opcode >> 9) & 3;
+        }
+
+        // We only support a few traps here. Specifically:
+        // - System dcmp 2 uses BlockMove (which is essentially memcpy)
+        // - Ben Mickaelian's self-modifying decompressor uses
+        //   GetTrapAddress, but it suffices to simulate the asked-for traps
+        //   with stubs since the dcmp doesn't appear to use the return
+        //   value for anything important
+
+        if (trap_number == 0x002E) { // BlockMove
+          // A0 = src, A1 = dst, D0 = size
+          mem->memcpy(regs.a[1], regs.a[0], regs.d[0].u);
+          regs.d[0].u = 0; // Result code (0 = success)
+
+        } else if (trap_number == 0x0046) { // GetTrapAddress
+          uint16_t trap_number = regs.d[0].u & 0xFFFF;
+          if ((trap_number > 0x4F) && (trap_number != 0x54) && (trap_number != 0x57)) {
+            trap_number |= 0x0800;
+          }
+
+          // If it already has a call routine, just return that
+          try {
+            regs.a[0] = trap_to_call_stub_addr.at(trap_number);
+            if (verbose) {
+              write_decompression_log("GetTrapAddress: using cached call stub for trap {:04X} -> {:08X}\n",
+                  trap_number, regs.a[0]);
+            }
+
+          } catch (const out_of_range&) {
+            // Create a call stub. These are kept out of the arenas used for
+            // the data regions, since those are freed after each run.
+            uint32_t call_stub_addr = mem->allocate_within(0xE0000000, 0xF0000000, 4);
+            be_uint16_t* call_stub = mem->at<be_uint16_t>(call_stub_addr, 4);
+            trap_to_call_stub_addr.emplace(trap_number, call_stub_addr);
+            call_stub[0] = 0xA000 | trap_number; // A-trap opcode
+            call_stub[1] = 0x4E75; // rts
+
+            // Return the address
+            regs.a[0] = call_stub_addr;
+
+            if (verbose) {
+              write_decompression_log("GetTrapAddress: created call stub for trap {:04X} -> {:08X}\n",
+                  trap_number, regs.a[0]);
+            }
+          }
+
+        } else if (verbose) {
+          if (trap_number & 0x0800) {
+            write_decompression_log("warning: skipping unimplemented toolbox trap (num={:X}, auto_pop={})\n",
+                static_cast<uint16_t>(trap_number & 0x0BFF), auto_pop ? "true" : "false");
+          } else {
+            write_decompression_log("warning: skipping unimplemented os trap (num={:X}, flags={})\n",
+                static_cast<uint16_t>(trap_number & 0x00FF), flags);
+          }
+        }
+      });
+
+      // Run the decompressor
+      execution_start_time = now();
+      try {
+        emu.execute();
+      } catch (const exception& e) {
+        if (verbose) {
+          uint64_t diff = now() - execution_start_time;
+          float duration = static_cast<float>(diff) / 1000000.0f;
+          write_decompression_log("m68k decompressor execution failed ({:g}sec): {}\n", duration, e.what());
+          emu.print_state(stderr);
+        }
+        rethrow_emulation_failure(e);
+      }
+    }
+
+    if (verbose) {
+      uint64_t diff = now() - execution_start_time;
+      float duration = static_cast<float>(diff) / 1000000.0f;
+      write_decompression_log("note: decompressed resource in {:g} seconds ({} -> {} bytes)\n",
+          duration, data.size(), header.decompressed_size);
+    }
+
+    ret = mem->read(output_addr, header.decompressed_size);
+
+  } catch (const exception&) {
+    // If the instance can't be cleaned up, just let it be destroyed instead of
+    // returning it to the pool
+    if (!trace_execution) {
+      try {
+        ld->free_data_regions();
+        emulated_decompressor_pool.release(std::move(ld));
+      } catch (const exception&) {
+      }
+    }
+    throw;
+  }
+
+  if (!trace_execution) {
+    ld->free_data_regions();
+    emulated_decompressor_pool.release(std::move(ld));
+  }
+  return ret;
+}
+
+// Runs the system dcmp and ncmp for dcmp_id on the same data that a native
+// decompressor was run on, and reports any differences in the results. This
+// is used to find bugs in the native implementations.
+static void verify_native_decompression(
+    const CompressedResourceHeader& header,
+    const string& data,
+    int16_t dcmp_id,
+    uint16_t output_extra_bytes,
+    uint64_t decompress_flags,
+    const string& native_result) {
+  bool verbose = !!(decompress_flags & DecompressionFlag::VERBOSE);
+  // Tracing and debugging are meant for the decompressor being verified, not
+  // for the reference implementations
+  uint64_t emulation_flags = decompress_flags & DecompressionFlag::STRICT_MEMORY;
+
+  for (uint8_t is_ppc = 0; is_ppc < 2; is_ppc++) {
+    pair<const void*, size_t> sys_dcmp;
+    try {
+      sys_dcmp = get_system_decompressor(is_ppc, dcmp_id);
+    } catch (const out_of_range&) {
+      continue;
+    }
+    const char* sys_dcmp_type = is_ppc ? "ncmp" : "dcmp";
+
+    string emulated_result;
+    try {
+      emulated_result = run_emulated_decompressor(
+          DecompressorImplementation(sys_dcmp.first, sys_dcmp.second, is_ppc),
+          header, data, output_extra_bytes, emulation_flags);
+    } catch (const exception& e) {
+      write_decompression_log("warning: native decompressor {} succeeded, but system {} failed: {}\n",
+          dcmp_id, sys_dcmp_type, e.what());
+      continue;
+    }
+
+    if (emulated_result == native_result) {
+      if (verbose) {
+        write_decompression_log("note: native decompressor {} matches system {}\n", dcmp_id, sys_dcmp_type);
+      }
+      continue;
+    }
+
+    size_t min_size = min<size_t>(emulated_result.size(), native_result.size());
+    size_t offset = 0;
+    while ((offset < min_size) && (emulated_result[offset] == native_result[offset])) {
+      offset++;
+    }
+    write_decompression_log("warning: native decompressor {} does not match system {} (first difference at offset 0x{:X}; native result is 0x{:X} bytes, system result is 0x{:X} bytes)\n",
+        dcmp_id, sys_dcmp_type, offset, native_result.size(), emulated_result.size());
+  }
+}
+
 shared_ptr<Resource> decompress_resource(
     shared_ptr<const Resource> res,
     uint64_t decompress_flags,
@@ -211,9 +990,9 @@ shared_ptr<Resource> decompress_resource(
   }
 
   if (verbose) {
-    fwrite_fmt(stderr, "using dcmp/ncmp {} ({} implementation(s) available)\n",
+    write_decompression_log("using dcmp/ncmp {} ({} implementation(s) available)\n",
         dcmp_resource_id, decompressors.size());
-    fwrite_fmt(stderr, "note: data size is {} (0x{:X}); decompressed data size is {} (0x{:X}) bytes\n",
+    write_decompression_log("note: data size is {} (0x{:X}); decompressed data size is {} (0x{:X}) bytes\n",
         res->data.size(), res->data.size(),
         header.decompressed_size, header.decompressed_size);
   }
@@ -221,7 +1000,7 @@ shared_ptr<Resource> decompress_resource(
   for (size_t z = 0; z < decompressors.size(); z++) {
     const auto& decompressor = decompressors[z];
     if (verbose) {
-      fwrite_fmt(stderr, "attempting decompression with implementation {} of {}\n",
+      write_decompression_log("attempting decompression with implementation {} of {}\n",
           z + 1, decompressors.size());
     }
 
@@ -240,358 +1019,55 @@ shared_ptr<Resource> decompress_resource(
         }
         if (verbose) {
           float duration = static_cast<float>(now() - start_time) / 1000000.0f;
-          fwrite_fmt(stderr, "note: decompressed resource using internal decompressor in {:g} seconds ({} -> {} bytes)\n",
+          write_decompression_log("note: decompressed resource using internal decompressor in {:g} seconds ({} -> {} bytes)\n",
               duration, res->data.size(), decompressed_data.size());
         }
+        if (decompress_flags & DecompressionFlag::VERIFY_NATIVE) {
+          verify_native_decompression(
+              header, res->data, dcmp_resource_id, output_extra_bytes, decompress_flags, decompressed_data);
+        }
         result->data = std::move(decompressed_data);
 
       } else {
-        // This is an emulated decompressor. We'll set up memory appropriately,
-        // then use either M68KEmulator or PPC32Emulator to run the code
-        // contained in the dcmp or ncmp resource.
-
-        auto mem = make_shared<MemoryContext>();
-        if (decompress_flags & DecompressionFlag::STRICT_MEMORY) {
-          mem->set_strict(true);
+        // This is an emulated decompressor. These can be slow, so if we've
+        // run the same decompressor on the same data before, use the result
+        // from the cache instead (unless we're tracing or debugging it, in
+        // which case the user wants to see it run).
+        string cache_key;
+        if (decompression_cache && !trace_execution) {
+          cache_key = DecompressionCache::key_for(
+              res->data, dcmp_resource_id, decompressor.data, decompressor.size, decompressor.is_ppc, decompress_flags);
         }
 
-        uint32_t entry_pc = 0;
-        uint32_t entry_r2 = 0;
-        bool use_ppc_emulator;
-        if (!decompressor.is_ppc) {
-          use_ppc_emulator = false;
-
-          // Figure out where in the dcmp to start execution. There appear to be
-          // two formats: one that has 'dcmp' in bytes 4-8 where execution
-          // appears to just start at byte 0 (usually it's a branch opcode), and
-          // one where the first three words appear to be offsets to various
-          // functions, followed by code. The second word appears to be the main
-          // entry point in this format, so we use that to determine where to
-          // start execution.
-          // TODO: It looks like the decompression implementation in ResEdit
-          // assumes the second format (with the three offsets) if and only if
-          // the compressed resource has header format 9. This feels kind of bad
-          // because... shouldn't the dcmp format be a property of the dcmp
-          // resource, not the resource being decompressed? We use a heuristic
-          // here instead, which seems correct for all decompressors I've seen.
-          uint32_t entry_offset;
-          if (decompressor.size < 10) {
-            throw runtime_error("decompressor resource is too short");
-          }
-          uint32_t internal_signature = *reinterpret_cast<const be_uint32_t*>(
-              reinterpret_cast<const uint8_t*>(decompressor.data) + 4);
-          if (internal_signature == RESOURCE_TYPE_dcmp) {
-            entry_offset = 0;
-          } else {
-            // TODO: Call init and exit for decompressors that have them. It's
-            // not clear (yet) what the arguments to init and exit should be...
-            // they each apparently take one argument based on how they adjust
-            // the stack before returning, but every decompressor I've seen
-            // ignores the argument's value.
-            entry_offset = *reinterpret_cast<const be_uint16_t*>(
-                reinterpret_cast<const uint8_t*>(decompressor.data) + 2);
-          }
-
-          // Load the dcmp into emulated memory. dcmp resources are just raw
-          // 68K code; there's no header beyond what's described above.
-          size_t code_region_size = decompressor.size;
-          uint32_t code_addr = 0xF0000000;
-          mem->allocate_at(code_addr, code_region_size);
-          mem->memcpy(code_addr, decompressor.data, decompressor.size);
-
-          entry_pc = code_addr + entry_offset;
-          if (verbose) {
-            fwrite_fmt(stderr, "loaded code at {:08X}:{:X}\n", code_addr, code_region_size);
-            fwrite_fmt(stderr, "dcmp entry offset is {:08X} (loaded at {:X})\n",
-                entry_offset, entry_pc);
-          }
-
-        } else { // decompressor.is_ppc == true
-          // ncmp resources are entire PEF files, so we have to parse the
-          // header and run relocations (if any) while loading them.
-          PEFFile f("<ncmp>", decompressor.data, decompressor.size);
-          f.load_into("<ncmp>", mem, 0xF0000000);
-          use_ppc_emulator = f.is_ppc();
-
-          // ncmp decompressors don't appear to define any of the standard
-          // export symbols (init/main/term); instead, they define a single
-          // export symbol in the export table.
-          // TODO: It's possible that ncmps are allowed to define init and
-          // term. Presumably this would be similar to how the unused functions
-          // work in dcmp v9 above... reverse-engineer ResEdit some more and
-          // figure this out.
-          if (!f.init().name.empty()) {
-            throw runtime_error("ncmp decompressor has init symbol");
+        bool cache_failed = false;
+        if (!cache_key.empty() && decompression_cache->get(cache_key, result->data, cache_failed)) {
+          if (cache_failed) {
+            throw runtime_error("decompressor failed on this data in a previous run (cached result)");
           }
-          if (!f.main().name.empty()) {
-            throw runtime_error("ncmp decompressor has main symbol");
+          if (result->data.size() != header.decompressed_size) {
+            throw runtime_error("cached decompressed data has incorrect size");
           }
-          if (!f.term().name.empty()) {
-            throw runtime_error("ncmp decompressor has term symbol");
-          }
-          const auto& exports = f.exports();
-          if (exports.size() != 1) {
-            throw runtime_error("ncmp decompressor does not export exactly one symbol");
-          }
-
-          // The start symbol is actually a transition vector, which is the code
-          // address followed by the desired value in r2.
-          string start_symbol_name = "<ncmp>:" + exports.begin()->second.name;
-          uint32_t start_symbol_addr = mem->get_symbol_addr(start_symbol_name);
-          entry_pc = mem->read_u32b(start_symbol_addr);
-          entry_r2 = mem->read_u32b(start_symbol_addr + 4);
-
-          if (verbose) {
-            fwrite_fmt(stderr, "ncmp entry pc is {:08X} with r2 = {:08X}\n",
-                entry_pc, entry_r2);
-          }
-        }
-
-        size_t stack_region_size = 1024 * 16; // 16KB should be enough
-        size_t output_region_size = header.decompressed_size + output_extra_bytes;
-        // TODO: Looks like some decompressors expect zero bytes after the
-        // compressed input? Find out if this is true and fix it if not.
-        size_t input_region_size = res->data.size() + 0x100;
-        // TODO: This is probably way too big; probably we should use
-        // ((data.size() * 256) / working_buffer_fractional_size) instead here?
-        size_t working_buffer_region_size = res->data.size() * 256;
-
-        // Set up data memory regions. Slightly awkward assumption: decompressed
-        // data is never more than 256 times the size of the input data.
-        // We intentionally put the regions pretty far from each other in the
-        // address space in order to fail catastrophically in case of buffer
-        // underflows or overflows; this is useful for debugging the emulators.
-        uint32_t stack_addr = 0x10000000;
-        mem->allocate_at(stack_addr, stack_region_size);
-        if (!stack_addr) {
-          throw runtime_error("cannot allocate stack region");
-        }
-        uint32_t output_addr = 0x20000000;
-        mem->allocate_at(output_addr, output_region_size);
-        if (!output_addr) {
-          throw runtime_error("cannot allocate output region");
-        }
-        uint32_t working_buffer_addr = 0x80000000;
-        mem->allocate_at(working_buffer_addr, working_buffer_region_size);
-        if (!working_buffer_addr) {
-          throw runtime_error("cannot allocate working buffer region");
-        }
-        uint32_t input_addr = 0xC0000000;
-        mem->allocate_at(input_addr, input_region_size);
-        if (!input_addr) {
-          throw runtime_error("cannot allocate input region");
-        }
-        if (verbose) {
-          fwrite_fmt(stderr, "memory:\n");
-          fwrite_fmt(stderr, "  stack region at {:08X}:{:X}\n", stack_addr, stack_region_size);
-          fwrite_fmt(stderr, "  output region at {:08X}:{:X}\n", output_addr, output_region_size);
-          fwrite_fmt(stderr, "  working region at {:08X}:{:X}\n", working_buffer_addr, working_buffer_region_size);
-          fwrite_fmt(stderr, "  input region at {:08X}:{:X}\n", input_addr, input_region_size);
-        }
-        mem->memcpy(input_addr, res->data.data(), res->data.size());
-
-        uint64_t execution_start_time;
-        if (use_ppc_emulator) {
-          // Set up header in stack region
-          uint32_t return_addr = stack_addr + stack_region_size - sizeof(PPC32DecompressorInputHeader) + offsetof(PPC32DecompressorInputHeader, set_r2_opcode);
-          auto* input_header = mem->at<PPC32DecompressorInputHeader>(
-              stack_addr + stack_region_size - sizeof(PPC32DecompressorInputHeader));
-          input_header->saved_r1 = 0xAAAAAAAA;
-          input_header->saved_cr = 0x00000000;
-          input_header->saved_lr = return_addr;
-          input_header->reserved1 = 0x00000000;
-          input_header->reserved2 = 0x00000000;
-          input_header->saved_r2 = entry_r2;
-          input_header->unused[0] = 0x00000000;
-          input_header->unused[1] = 0x00000000;
-          input_header->set_r2_opcode = 0x3840FFFF; // li r2, -1
-          input_header->syscall_opcode = 0x44000002; // sc
-
-          // Create emulator
-          auto interrupt_manager = make_shared<InterruptManager>();
-          PPC32Emulator emu(mem);
-          emu.set_interrupt_manager(interrupt_manager);
-
-          // Set up registers. r3-r6 are the function arguments, which are
-          // analogous to the arguments to dcmp resources.
-          auto& regs = emu.registers();
-          regs.r[1].u = stack_addr + stack_region_size - sizeof(PPC32DecompressorInputHeader);
-          regs.r[2].u = entry_r2;
-          regs.r[3].u = input_addr + sizeof(CompressedResourceHeader);
-          regs.r[4].u = output_addr;
-          regs.r[5].u = (header.header_version == 9) ? input_addr : working_buffer_addr;
-          regs.r[6].u = input_region_size - sizeof(CompressedResourceHeader);
-          regs.lr = return_addr;
-          regs.pc = entry_pc;
           if (verbose) {
-            fwrite_fmt(stderr, "initial stack contents (input header data):\n");
-            print_data(stderr, input_header, sizeof(*input_header), regs.r[1].u);
-          }
-
-          // Set up the debugger, if debugging is enabled
-          shared_ptr<EmulatorDebugger<PPC32Emulator>> debugger;
-          if (trace_execution || debug_execution) {
-            debugger = make_shared<EmulatorDebugger<PPC32Emulator>>();
-            debugger->bind(emu);
-            debugger->state.mode = debug_execution ? DebuggerMode::STEP : DebuggerMode::TRACE;
+            write_decompression_log("note: using cached result for emulated decompressor ({} -> {} bytes)\n",
+                res->data.size(), result->data.size());
           }
 
-          // Set up environment
-          emu.set_syscall_handler([&](PPC32Emulator& emu) -> void {
-            auto& regs = emu.registers();
-            // We don't support any syscalls in PPC mode - the only syscall that
-            // should occur is the one at the end of emulation, when r2 == -1.
-            if (regs.r[2].u != 0xFFFFFFFF) {
-              throw runtime_error("unimplemented syscall");
-            }
-            throw PPC32Emulator::terminate_emulation();
-          });
-
-          // Run the decompressor
-          execution_start_time = now();
+        } else {
           try {
-            emu.execute();
-          } catch (const exception& e) {
-            if (verbose) {
-              uint64_t diff = now() - execution_start_time;
-              float duration = static_cast<float>(diff) / 1000000.0f;
-              fwrite_fmt(stderr, "powerpc decompressor execution failed ({:g}sec): {}\n", duration, e.what());
+            result->data = run_emulated_decompressor(
+                decompressor, header, res->data, output_extra_bytes, decompress_flags);
+          } catch (const decompression_error&) {
+            // Other exceptions aren't cached, since they may not be caused by
+            // the data
+            if (!cache_key.empty()) {
+              decompression_cache->put_failure(cache_key);
             }
             throw;
           }
-
-        } else { // Not a PPC decompressor (it's 68K instead)
-          // Set up header + args in the stack region
-          auto* input_header = mem->at<M68KDecompressorInputHeader>(
-              stack_addr + stack_region_size - sizeof(M68KDecompressorInputHeader));
-          input_header->return_addr = stack_addr + stack_region_size - sizeof(M68KDecompressorInputHeader) + offsetof(M68KDecompressorInputHeader, reset_opcode);
-          if (header.header_version == 9) {
-            input_header->args.v9.data_size = input_region_size - sizeof(CompressedResourceHeader);
-            input_header->args.v9.source_resource_header = input_addr;
-            input_header->args.v9.dest_buffer_addr = output_addr;
-            input_header->args.v9.source_buffer_addr = input_addr + sizeof(CompressedResourceHeader);
-          } else {
-            input_header->args.v8.data_size = input_region_size - sizeof(CompressedResourceHeader);
-            input_header->args.v8.working_buffer_addr = working_buffer_addr;
-            input_header->args.v8.dest_buffer_addr = output_addr;
-            input_header->args.v8.source_buffer_addr = input_addr + sizeof(CompressedResourceHeader);
-          }
-          input_header->reset_opcode = 0x4E70;
-          input_header->unused = 0x0000;
-
-          // Set up registers
-          M68KEmulator emu(mem);
-          auto& regs = emu.registers();
-          regs.a[7] = stack_addr + stack_region_size - sizeof(M68KDecompressorInputHeader);
-          regs.pc = entry_pc;
-          if (verbose) {
-            fwrite_fmt(stderr, "initial stack contents (input header data):\n");
-            print_data(stderr, input_header, sizeof(*input_header), regs.a[7]);
-          }
-
-          // Set up debugger
-          shared_ptr<EmulatorDebugger<M68KEmulator>> debugger;
-          if (trace_execution || debug_execution) {
-            debugger = make_shared<EmulatorDebugger<M68KEmulator>>();
-            debugger->bind(emu);
-            debugger->state.mode = debug_execution ? DebuggerMode::STEP : DebuggerMode::TRACE;
-          }
-
-          // Set up environment. Unlike in PPC-land, we implement a few basic
-          // system calls here, because there are some dcmps that actually use
-          // them.
-          unordered_map<uint16_t, uint32_t> trap_to_call_stub_addr;
-          emu.set_syscall_handler([&](M68KEmulator& emu, uint16_t opcode) -> void {
-            auto& regs = emu.registers();
-            uint16_t trap_number;
-            bool auto_pop = false;
-            uint8_t flags = 0;
-
-            if (opcode & 0x0800) {
-              trap_number = opcode & 0x0BFF;
-              auto_pop = opcode & 0x0400;
-            } else {
-              trap_number = opcode & 0x00FF;
-              flags = (opcode >> 9) & 3;
-            }
-
-            // We only support a few traps here. Specifically:
-            // - System dcmp 2 uses BlockMove (which is essentially memcpy)
-            // - Ben Mickaelian's self-modifying decompressor uses
-            //   GetTrapAddress, but it suffices to simulate the asked-for traps
-            //   with stubs since the dcmp doesn't appear to use the return
-            //   value for anything important
-
-            if (trap_number == 0x002E) { // BlockMove
-              // A0 = src, A1 = dst, D0 = size
-              mem->memcpy(regs.a[1], regs.a[0], regs.d[0].u);
-              regs.d[0].u = 0; // Result code (0 = success)
-
-            } else if (trap_number == 0x0046) { // GetTrapAddress
-              uint16_t trap_number = regs.d[0].u & 0xFFFF;
-              if ((trap_number > 0x4F) && (trap_number != 0x54) && (trap_number != 0x57)) {
-                trap_number |= 0x0800;
-              }
-
-              // If it already has a call routine, just return that
-              try {
-                regs.a[0] = trap_to_call_stub_addr.at(trap_number);
-                if (verbose) {
-                  fwrite_fmt(stderr, "GetTrapAddress: using cached call stub for trap {:04X} -> {:08X}\n",
-                      trap_number, regs.a[0]);
-                }
-
-              } catch (const out_of_range&) {
-                // Create a call stub
-                uint32_t call_stub_addr = mem->allocate(4);
-                be_uint16_t* call_stub = mem->at<be_uint16_t>(call_stub_addr, 4);
-                trap_to_call_stub_addr.emplace(trap_number, call_stub_addr);
-                call_stub[0] = 0xA000 | trap_number; // A-trap opcode
-                call_stub[1] = 0x4E75; // rts
-
-                // Return the address
-                regs.a[0] = call_stub_addr;
-
-                if (verbose) {
-                  fwrite_fmt(stderr, "GetTrapAddress: created call stub for trap {:04X} -> {:08X}\n",
-                      trap_number, regs.a[0]);
-                }
-              }
-
-            } else if (verbose) {
-              if (trap_number & 0x0800) {
-                fwrite_fmt(stderr, "warning: skipping unimplemented toolbox trap (num={:X}, auto_pop={})\n",
-                    static_cast<uint16_t>(trap_number & 0x0BFF), auto_pop ? "true" : "false");
-              } else {
-                fwrite_fmt(stderr, "warning: skipping unimplemented os trap (num={:X}, flags={})\n",
-                    static_cast<uint16_t>(trap_number & 0x00FF), flags);
-              }
-            }
-          });
-
-          // Run the decompressor
-          execution_start_time = now();
-          try {
-            emu.execute();
-          } catch (const exception& e) {
-            if (verbose) {
-              uint64_t diff = now() - execution_start_time;
-              float duration = static_cast<float>(diff) / 1000000.0f;
-              fwrite_fmt(stderr, "m68k decompressor execution failed ({:g}sec): {}\n", duration, e.what());
-              emu.print_state(stderr);
-            }
-            throw;
+          if (!cache_key.empty()) {
+            decompression_cache->put(cache_key, result->data);
           }
         }
-
-        if (verbose) {
-          uint64_t diff = now() - execution_start_time;
-          float duration = static_cast<float>(diff) / 1000000.0f;
-          fwrite_fmt(stderr, "note: decompressed resource in {:g} seconds ({} -> {} bytes)\n",
-              duration, res->data.size(), header.decompressed_size);
-        }
-
-        result->data = mem->read(output_addr, header.decompressed_size);
       }
 
       // If we get here, the resource was decompressed and res->data was
@@ -601,7 +1077,7 @@ shared_ptr<Resource> decompress_resource(
 
     } catch (const exception& e) {
       if (verbose) {
-        fwrite_fmt(stderr, "decompressor implementation {} of {} failed: {}\n",
+        write_decompression_log("decompressor implementation {} of {} failed: {}\n",
             z + 1, decompressors.size(), e.what());
       }
     }
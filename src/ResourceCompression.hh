@@ -2,7 +2,12 @@
 
 #include <stdint.h>
 
+#include <format>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
 
 #include "ResourceFile.hh"
 
@@ -22,8 +27,80 @@ enum DecompressionFlag {
   SKIP_NATIVE = 0x0100, // Don't use native decompressors
   RETRY = 0x0200, // Decompress even if res has DECOMPRESSION_FAILED flag
   STRICT_MEMORY = 0x0400, // Don't allow unallocated memory access
+  VERIFY_NATIVE = 0x0800, // Compare native decompressors' output against the system dcmp/ncmp
 };
 
+// Thrown by emulated decompressors when the decompressor itself fails on its
+// input (e.g. it accesses invalid memory or executes an unimplemented opcode).
+// Emulation is deterministic, so these failures are recorded in the
+// DecompressionCache; other errors (e.g. running out of memory) aren't, since
+// they may not happen next time.
+class decompression_error : public std::runtime_error {
+public:
+  explicit decompression_error(const std::string& what) : runtime_error(what) {}
+  ~decompression_error() = default;
+};
+
+// An on-disk cache of the results of emulated decompressors, keyed by a hash
+// of the compressed data and the decompressor's code. Native decompressors are
+// fast enough that their results aren't cached. Multiple processes can safely
+// use the same cache directory at the same time. When the total size of the
+// entries exceeds max_size, the least recently used entries are deleted.
+class DecompressionCache {
+public:
+  DecompressionCache(const std::string& directory, uint64_t max_size);
+  DecompressionCache(const DecompressionCache&) = delete;
+  DecompressionCache(DecompressionCache&&) = delete;
+  DecompressionCache& operator=(const DecompressionCache&) = delete;
+  DecompressionCache& operator=(DecompressionCache&&) = delete;
+  ~DecompressionCache() = default;
+
+  static std::string key_for(
+      const std::string& compressed_data,
+      int16_t dcmp_id,
+      const void* decompressor_data,
+      size_t decompressor_size,
+      bool is_ppc,
+      uint64_t decompress_flags);
+
+  // Returns false if there's no entry for key. If there is an entry, returns
+  // true and sets failed to true if the decompressor failed; otherwise, sets
+  // failed to false and data to the decompressed data.
+  bool get(const std::string& key, std::string& data, bool& failed);
+  void put(const std::string& key, const std::string& data);
+  void put_failure(const std::string& key);
+
+private:
+  std::string directory;
+  uint64_t max_size;
+
+  std::mutex lock; // Guards the following fields
+  uint64_t current_size; // Approximate; other processes may have changed it
+  bool current_size_known;
+
+  std::string filename_for_key(const std::string& key) const;
+  void write_entry(const std::string& key, const std::string& contents);
+  void scan_and_evict();
+};
+
+// Sets the function that receives this thread's decompression log messages
+// (failures, cache warnings, and everything printed with the VERBOSE flag). If
+// no function is set, they're written to stderr. Programs that decompress on
+// several threads can use this to keep each task's messages together. Output
+// from TRACE_EXECUTION and DEBUG_EXECUTION, and CPU state dumps, always go
+// directly to stderr. Returns the previous function.
+std::function<void(const std::string&)> set_decompression_log_fn(std::function<void(const std::string&)> fn);
+void write_decompression_log_raw(const std::string& data);
+
+template <typename... ArgTs>
+void write_decompression_log(std::format_string<ArgTs...> fmt, ArgTs&&... args) {
+  write_decompression_log_raw(std::format(fmt, std::forward<ArgTs>(args)...));
+}
+
+// Sets the cache used by decompress_resource. This should be called before
+// any resources are decompressed; the default is to not use a cache.
+void set_decompression_cache(std::shared_ptr<DecompressionCache> cache);
+
 std::shared_ptr<ResourceFile::Resource> decompress_resource(
     std::shared_ptr<const ResourceFile::Resource> res,
     uint64_t flags,
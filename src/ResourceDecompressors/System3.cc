@@ -7,6 +7,8 @@
 #include <string>
 #include <vector>
 
+#include "../DataCodecs/LZOutputBuffer.hh"
+
 using namespace std;
 using namespace phosg;
 
@@ -651,12 +653,11 @@ string decompress_system3(
     const void* source,
     size_t size) {
   BitReader r(source, size * 8);
-  StringWriter w;
-  w.str().reserve(header.decompressed_size);
+  LZOutputBuffer w(header.decompressed_size);
 
   bool stream_block_allowed = true;
-  while (w.str().size() < header.decompressed_size) {
-    size_t bytes_written_before_command = w.str().size();
+  while (w.size() < header.decompressed_size) {
+    size_t bytes_written_before_command = w.size();
 
     // Decode the next command
 
@@ -686,25 +687,18 @@ string decompress_system3(
       }
 
     } else {
-      if (backreference_offset > w.str().size()) {
+      if (backreference_offset > w.size()) {
         throw runtime_error("backreference beyond beginning of string");
       }
-      // It'd be nice to use memcpy or operator+ or something faster here, but:
-      // 1. The string can be reallocated and moved during this loop (even
-      //    though we called .reserve above), and
-      // 2. Backreferences technically can overlap the current end to form a
-      //    repeating pattern.
-      for (; backreference_bytes > 0; backreference_bytes--) {
-        w.put_s8(w.str()[w.str().size() - backreference_offset]);
-      }
+      w.copy_backreference(backreference_offset, backreference_bytes);
     }
 
-    if (w.str().size() <= bytes_written_before_command) {
+    if (w.size() <= bytes_written_before_command) {
       throw logic_error("decompression did not advance");
     }
   }
 
-  return w.str();
+  return w.finish();
 }
 
 } // namespace ResourceDASM
@@ -106,7 +106,9 @@ ResourceFile::Resource::Resource(uint32_t type, int16_t id, uint16_t flags, stri
 
 ResourceFile::ResourceFile() : ResourceFile(IndexFormat::NONE) {}
 
-ResourceFile::ResourceFile(IndexFormat format) : format(format) {}
+ResourceFile::ResourceFile(IndexFormat format)
+    : format(format),
+      decompression_state(make_shared<DecompressionState>()) {}
 
 bool ResourceFile::add(const Resource& res_obj) {
   auto res = make_shared<Resource>(res_obj);
@@ -194,26 +196,77 @@ bool ResourceFile::resource_exists(uint32_t type, const char* name) const {
 
 shared_ptr<const ResourceFile::Resource> ResourceFile::decompress_if_requested(
     shared_ptr<Resource> res, uint64_t decompress_flags) const {
-  if (res->flags & ResourceFlag::FLAG_COMPRESSED) {
-    if (!res->decompressed_resource) {
-      if (!(decompress_flags & DecompressionFlag::RETRY) &&
-          (res->flags & ResourceFlag::FLAG_DECOMPRESSION_FAILED)) {
-        return res;
+  if (!(res->flags & ResourceFlag::FLAG_COMPRESSED)) {
+    return res;
+  }
+
+  auto& state = *this->decompression_state;
+  unique_lock g(state.lock);
+
+  // If another thread is already decompressing this resource, wait for it to
+  // finish instead of doing the same work again
+  auto this_thread_id = this_thread::get_id();
+  for (;;) {
+    auto it = state.in_progress.find(res.get());
+    if (it == state.in_progress.end()) {
+      break;
+    }
+    // Follow the chain of waits starting at the thread that's decompressing
+    // this resource. If it leads back to this thread, waiting would deadlock
+    // (this includes the case where this thread is decompressing the resource
+    // itself), so fail instead; the exception propagates to this thread's
+    // outer decompressor, which then unblocks any threads waiting on it.
+    for (auto owner = it->second;;) {
+      if (owner == this_thread_id) {
+        throw runtime_error("resource decompression depends on itself");
       }
-      if (decompress_flags & DecompressionFlag::DISABLED) {
-        return res;
+      auto wait_it = state.waiting_for.find(owner);
+      if (wait_it == state.waiting_for.end()) {
+        break;
       }
-      try {
-        res->decompressed_resource = decompress_resource(res, decompress_flags, this);
-      } catch (const exception& e) {
-        fwrite_fmt(stderr, "failed to decompress resource: {}\n", e.what());
-        res->flags |= ResourceFlag::FLAG_DECOMPRESSION_FAILED;
-        return res;
+      auto owner_it = state.in_progress.find(wait_it->second);
+      if (owner_it == state.in_progress.end()) {
+        break;
       }
+      owner = owner_it->second;
     }
+    state.waiting_for[this_thread_id] = res.get();
+    state.decompression_finished.wait(g);
+    state.waiting_for.erase(this_thread_id);
+  }
+
+  if (res->decompressed_resource) {
     return res->decompressed_resource;
   }
-  return res;
+  if (!(decompress_flags & DecompressionFlag::RETRY) &&
+      (res->flags & ResourceFlag::FLAG_DECOMPRESSION_FAILED)) {
+    return res;
+  }
+  if (decompress_flags & DecompressionFlag::DISABLED) {
+    return res;
+  }
+
+  // Don't hold the lock while decompressing, since the decompressor may need
+  // to get other resources from this file (e.g. dcmp resources)
+  state.in_progress.emplace(res.get(), this_thread_id);
+  g.unlock();
+  shared_ptr<const Resource> decompressed_res;
+  try {
+    decompressed_res = decompress_resource(res, decompress_flags, this);
+  } catch (const exception& e) {
+    write_decompression_log("failed to decompress resource: {}\n", e.what());
+  }
+  g.lock();
+  state.in_progress.erase(res.get());
+  state.decompression_finished.notify_all();
+
+  if (!decompressed_res) {
+    res->flags |= ResourceFlag::FLAG_DECOMPRESSION_FAILED;
+    return res;
+  }
+  res->flags &= ~ResourceFlag::FLAG_DECOMPRESSION_FAILED;
+  res->decompressed_resource = std::move(decompressed_res);
+  return res->decompressed_resource;
 }
 
 shared_ptr<const ResourceFile::Resource> ResourceFile::get_resource(
@@ -2370,6 +2423,12 @@ public:
   virtual void write(ssize_t x, ssize_t y, uint32_t color) {
     this->image().write(x, y, color);
   }
+  virtual void write_span(ssize_t x, ssize_t y, const uint32_t* colors, size_t count) {
+    auto& img = this->image();
+    for (size_t z = 0; z < count; z++) {
+      img.write(x + z, y, colors[z]);
+    }
+  }
   virtual void blit(
       const ImageRGB888& src,
       ssize_t dest_x,
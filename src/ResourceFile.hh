@@ -5,10 +5,14 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <phosg/Filesystem.hh>
 #include <phosg/Image.hh>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "Emulators/M68KEmulator.hh"
@@ -82,6 +86,12 @@ public:
     Resource(uint32_t type, int16_t id, uint16_t flags, std::string&& name, std::string&& data);
   };
 
+  // get_resource() and the decode functions may be called from multiple
+  // threads at the same time, as long as no thread is modifying the
+  // ResourceFile (with add(), remove(), etc.) at the same time. If multiple
+  // threads request the same compressed resource, it is only decompressed
+  // once; the other threads wait for the result.
+
   // add() does not overwrite a resource if one already exists with the same
   // name. To replace an existing resource, remove() it first. (Note that
   // remove() will invalidate all references to the deleted resource that were
@@ -866,6 +876,17 @@ private:
   std::multimap<std::string, std::shared_ptr<Resource>> name_to_resource;
   std::unordered_map<int16_t, std::shared_ptr<Resource>> system_dcmp_cache;
 
+  // Guards the decompressed_resource field and FLAG_DECOMPRESSION_FAILED of all
+  // resources in this file. This is shared between copies of the ResourceFile,
+  // since the copies also share the Resource objects.
+  struct DecompressionState {
+    std::mutex lock;
+    std::condition_variable decompression_finished;
+    std::unordered_map<const Resource*, std::thread::id> in_progress;
+    std::unordered_map<std::thread::id, const Resource*> waiting_for;
+  };
+  std::shared_ptr<DecompressionState> decompression_state;
+
   std::shared_ptr<const Resource> decompress_if_requested(std::shared_ptr<Resource> res, uint64_t decompress_flags) const;
 
   DecodedInstrumentResource decode_INST_recursive(
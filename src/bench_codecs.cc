@@ -0,0 +1,380 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <format>
+#include <functional>
+#include <map>
+#include <memory>
+#include <phosg/Filesystem.hh>
+#include <phosg/Strings.hh>
+#include <phosg/Time.hh>
+#include <string>
+#include <vector>
+
+#include "Audio/Mixing.hh"
+#include "DataCodecs/Codecs.hh"
+#include "DataCodecs/LZOutputBuffer.hh"
+#include "Emulators/InterruptManager.hh"
+#include "Emulators/M68KEmulator.hh"
+#include "Emulators/MemoryContext.hh"
+#include "IndexFormats/Formats.hh"
+#include "ResourceCompression.hh"
+#include "ResourceDecompressors/System.hh"
+
+using namespace std;
+using namespace phosg;
+using namespace ResourceDASM;
+
+// Throughput benchmarks for performance-sensitive inner loops. This isn't built
+// by default; configure with -DBUILD_BENCHMARKS=ON to build it. Results are only
+// meaningful when compared between builds on the same machine.
+
+static constexpr uint64_t MIN_BENCHMARK_USECS = 500000;
+
+// Results are added to this so the compiler can't discard the benchmarked work
+static uint64_t checksum = 0;
+
+// Runs fn repeatedly for at least MIN_BENCHMARK_USECS and prints its throughput.
+// Each call to fn processes the given number of bytes, or instructions if
+// is_instructions is true.
+static void run_benchmark(
+    const char* filter,
+    const char* name,
+    size_t units_per_iteration,
+    function<void()> fn,
+    bool is_instructions = false) {
+  if (filter && !strstr(name, filter)) {
+    return;
+  }
+  fn(); // Warm up caches and lazily-initialized state
+  uint64_t iterations = 0;
+  uint64_t start_time = now();
+  uint64_t elapsed;
+  do {
+    fn();
+    iterations++;
+    elapsed = now() - start_time;
+  } while (elapsed < MIN_BENCHMARK_USECS);
+
+  double secs = static_cast<double>(elapsed) / 1000000.0;
+  double units_per_sec = static_cast<double>(units_per_iteration * iterations) / secs;
+  if (is_instructions) {
+    fwrite_fmt(stdout, "{:<36} {:10.1f} Minsns/s  ({} iterations)\n", name, units_per_sec / 1000000.0, iterations);
+  } else {
+    fwrite_fmt(stdout, "{:<36} {:10.1f} MB/s  ({} iterations)\n", name, units_per_sec / 1048576.0, iterations);
+  }
+}
+
+// Returns data that looks like a typical PackBits input: runs of various
+// lengths mixed with literal bytes
+static string make_packbits_input(size_t size) {
+  string ret;
+  ret.reserve(size);
+  uint32_t state = 0x12345678;
+  while (ret.size() < size) {
+    state = state * 1103515245 + 12345;
+    size_t count = ((state >> 16) & 0x3F) + 1;
+    if (state & 0x80000000) {
+      ret.append(count, static_cast<char>(state >> 8));
+    } else {
+      for (size_t z = 0; z < count; z++) {
+        state = state * 1103515245 + 12345;
+        ret.push_back(static_cast<char>(state >> 24));
+      }
+    }
+  }
+  ret.resize(size);
+  return ret;
+}
+
+static void benchmark_packbits_data(const char* filter, const string& name_prefix, const string& data) {
+  string packed = pack_bits(data);
+  if (unpack_bits(packed) != data) {
+    throw logic_error(name_prefix + ": PackBits round trip failed");
+  }
+  string name = name_prefix + "/pack";
+  run_benchmark(filter, name.c_str(), data.size(), [&]() {
+    checksum += pack_bits(data).size();
+  });
+  name = name_prefix + "/unpack";
+  run_benchmark(filter, name.c_str(), data.size(), [&]() {
+    checksum += unpack_bits(packed).size();
+  });
+}
+
+// The synthetic input's runs are uniformly distributed, which real images'
+// aren't, so real data can be benchmarked too by passing --packbits-input
+static void benchmark_packbits(const char* filter, const vector<string>& input_filenames) {
+  benchmark_packbits_data(filter, "packbits", make_packbits_input(0x400000));
+  for (const auto& filename : input_filenames) {
+    benchmark_packbits_data(filter, "packbits/" + filename, load_file(filename));
+  }
+}
+
+static void benchmark_lz_buffer(const char* filter) {
+  static constexpr size_t OUTPUT_SIZE = 0x400000;
+  // Distance 1 is a fill, distances below the count are overlapping copies,
+  // and the rest are plain memcpys
+  for (size_t distance : {1, 3, 16, 0x400}) {
+    string name = std::format("lz_buffer/backreference/{}", distance);
+    run_benchmark(filter, name.c_str(), OUTPUT_SIZE, [&]() {
+      LZOutputBuffer buf(OUTPUT_SIZE);
+      for (size_t z = 0; z < 0x400; z++) {
+        buf.put_u8(z);
+      }
+      while (buf.size() < OUTPUT_SIZE) {
+        buf.copy_backreference(distance, 18);
+      }
+      checksum += buf.finish().size();
+    });
+  }
+  run_benchmark(filter, "lz_buffer/put_u8", OUTPUT_SIZE, [&]() {
+    LZOutputBuffer buf(OUTPUT_SIZE);
+    for (size_t z = 0; z < OUTPUT_SIZE; z++) {
+      buf.put_u8(z);
+    }
+    checksum += buf.finish().size();
+  });
+}
+
+// Benchmarks the native decompressors on all of the compressed resources in a
+// resource fork, grouped by dcmp ID. Throughput is in decompressed bytes.
+static void benchmark_resource_decompression(const char* filter, const string& filename) {
+  static constexpr uint64_t NATIVE_ONLY_FLAGS = DecompressionFlag::SKIP_FILE_DCMP |
+      DecompressionFlag::SKIP_FILE_NCMP |
+      DecompressionFlag::SKIP_SYSTEM_DCMP |
+      DecompressionFlag::SKIP_SYSTEM_NCMP;
+
+  auto rf = parse_resource_fork(load_file(filename));
+  map<int16_t, vector<shared_ptr<const ResourceFile::Resource>>> resources_by_dcmp_id;
+  map<int16_t, size_t> decompressed_bytes_by_dcmp_id;
+  for (const auto& [type, id] : rf.all_resources()) {
+    auto res = rf.get_resource(type, id, DecompressionFlag::DISABLED);
+    if (!(res->flags & ResourceFlag::FLAG_COMPRESSED) || (res->data.size() < sizeof(CompressedResourceHeader))) {
+      continue;
+    }
+    const auto& header = *reinterpret_cast<const CompressedResourceHeader*>(res->data.data());
+    if (header.magic != 0xA89F6572) {
+      continue;
+    }
+    int16_t dcmp_id = (header.header_version == 9)
+        ? static_cast<int16_t>(header.version.v9.dcmp_resource_id)
+        : static_cast<int16_t>(header.version.v8.dcmp_resource_id);
+    // Only include resources that decompress successfully, so the timed runs
+    // don't include any exception handling
+    try {
+      size_t decompressed_size = decompress_resource(res, NATIVE_ONLY_FLAGS, nullptr)->data.size();
+      resources_by_dcmp_id[dcmp_id].emplace_back(res);
+      decompressed_bytes_by_dcmp_id[dcmp_id] += decompressed_size;
+    } catch (const exception& e) {
+      fwrite_fmt(stderr, "warning: skipping {:08X}:{}: {}\n", type, id, e.what());
+    }
+  }
+
+  for (const auto& [dcmp_id, resources] : resources_by_dcmp_id) {
+    string name = std::format("decompress/system{}/{}", dcmp_id, filename);
+    run_benchmark(filter, name.c_str(), decompressed_bytes_by_dcmp_id.at(dcmp_id), [&]() {
+      for (const auto& res : resources) {
+        checksum += decompress_resource(res, NATIVE_ONLY_FLAGS, nullptr)->data.size();
+      }
+    });
+  }
+}
+
+// Benchmarks one of the data codecs on a file containing compressed data (for
+// example, a resource exported by resource_dasm with --save-raw=yes).
+// Throughput is in decompressed bytes.
+static void benchmark_codec_decompression(const char* filter, const string& codec_name, const string& filename) {
+  static const map<string, function<string(const string&)>> decompress_fns = {
+      {"dinopark", [](const string& data) { return decompress_dinopark_tycoon_data(data); }},
+      {"macski", [](const string& data) { return decompress_macski_multi(data); }},
+      {"presage", [](const string& data) { return decompress_presage_lzss(data); }},
+      {"soundmusicsys", [](const string& data) { return decompress_soundmusicsys_lzss(data); }},
+  };
+  const auto& decompress_fn = decompress_fns.at(codec_name);
+
+  string data = load_file(filename);
+  size_t decompressed_size = decompress_fn(data).size();
+  string name = std::format("decompress/{}/{}", codec_name, filename);
+  run_benchmark(filter, name.c_str(), decompressed_size, [&]() {
+    checksum += decompress_fn(data).size();
+  });
+}
+
+static void benchmark_mixing(const char* filter) {
+  static constexpr size_t NUM_SAMPLES = 0x100000;
+  vector<float> src(NUM_SAMPLES);
+  for (size_t z = 0; z < NUM_SAMPLES; z++) {
+    src[z] = static_cast<float>(z % 200) / 100.0f - 1.0f;
+  }
+  vector<float> dest(NUM_SAMPLES * 2, 0.0f);
+
+  run_benchmark(filter, "mixing/mix_samples", NUM_SAMPLES * sizeof(float), [&]() {
+    Audio::mix_samples(dest.data(), src.data(), NUM_SAMPLES);
+  });
+  run_benchmark(filter, "mixing/pan_mono_to_stereo", NUM_SAMPLES * sizeof(float), [&]() {
+    Audio::pan_mono_to_stereo(dest.data(), src.data(), NUM_SAMPLES, 0.25f, 0.75f);
+  });
+
+  auto table = Audio::make_sinc_table(0.9);
+  static constexpr size_t NUM_SINC_OUTPUTS = 0x10000;
+  run_benchmark(filter, "mixing/apply_sinc_filter", NUM_SINC_OUTPUTS * sizeof(float), [&]() {
+    float sum = 0.0f;
+    for (size_t z = 0; z < NUM_SINC_OUTPUTS; z++) {
+      sum += Audio::apply_sinc_filter(table.data(), src.data() + z, static_cast<double>(z % 7) / 7.0);
+    }
+    checksum += static_cast<uint64_t>(sum);
+  });
+  checksum += static_cast<uint64_t>(dest[0]);
+}
+
+static void benchmark_memory_context(const char* filter) {
+  static constexpr size_t BLOCK_SIZE = 0x100000;
+  for (bool strict : {false, true}) {
+    auto mem = make_shared<MemoryContext>();
+    mem->set_strict(strict);
+    uint32_t addr = mem->allocate(BLOCK_SIZE);
+    // Fill in a few other blocks, so the strict check has more than one to
+    // choose from
+    for (size_t z = 0; z < 0x20; z++) {
+      mem->allocate(0x1000);
+    }
+
+    string name = std::format("memory_context/read_u32b{}", strict ? "/strict" : "");
+    run_benchmark(filter, name.c_str(), BLOCK_SIZE, [&]() {
+      uint32_t sum = 0;
+      for (uint32_t offset = 0; offset < BLOCK_SIZE; offset += 4) {
+        sum += mem->read_u32b(addr + offset);
+      }
+      checksum += sum;
+    });
+    name = std::format("memory_context/write_u32b{}", strict ? "/strict" : "");
+    run_benchmark(filter, name.c_str(), BLOCK_SIZE, [&]() {
+      for (uint32_t offset = 0; offset < BLOCK_SIZE; offset += 4) {
+        mem->write_u32b(addr + offset, offset);
+      }
+    });
+  }
+}
+
+static void benchmark_m68k_run_loop(const char* filter) {
+  static constexpr uint32_t LOOP_ITERATIONS = 0x40000;
+  // Each loop iteration executes 5 instructions
+  StringWriter w;
+  w.put_u16b(0x7000); // moveq.l    D0, 0
+  w.put_u16b(0x7200); // moveq.l    D1, 0
+  w.put_u16b(0x5280); // loop: addq.l D0, 1
+  w.put_u16b(0xE389); // lsl.l      D1, 1
+  w.put_u16b(0x4A80); // tst.l      D0
+  w.put_u16b(0x0C80); // cmpi.l     D0, LOOP_ITERATIONS
+  w.put_u32b(LOOP_ITERATIONS);
+  w.put_u16b(0x66F2); // bne        loop
+  w.put_u16b(0x4E70); // reset (ends emulation)
+
+  struct Variant {
+    const char* name;
+    bool block_cache;
+    bool interrupts;
+    bool debug_hook;
+  };
+  static const Variant variants[] = {
+      {"m68k/run_loop", true, false, false},
+      {"m68k/run_loop/no_block_cache", false, false, false},
+      {"m68k/run_loop/interrupts", true, true, false},
+      {"m68k/run_loop/debug_hook", true, false, true},
+  };
+  for (const auto& variant : variants) {
+    auto mem = make_shared<MemoryContext>();
+    uint32_t code_addr = mem->allocate(0x1000);
+    mem->write(code_addr, w.str());
+    uint32_t stack_addr = mem->allocate(0x1000);
+
+    M68KEmulator emu(mem);
+    emu.set_block_cache_enabled(variant.block_cache);
+    if (variant.interrupts) {
+      emu.set_interrupt_manager(make_shared<InterruptManager>());
+    }
+    if (variant.debug_hook) {
+      emu.set_debug_hook([](M68KEmulator&) {});
+    }
+
+    run_benchmark(
+        filter, variant.name, LOOP_ITERATIONS * 5, [&]() {
+          auto& regs = emu.registers();
+          regs.pc = code_addr;
+          regs.a[7] = stack_addr + 0x1000;
+          emu.execute();
+          checksum += regs.d[0].u;
+        },
+        true);
+  }
+}
+
+static void print_usage() {
+  fwrite_fmt(stderr, "\
+Usage: bench_codecs [options] [FILTER]\n\
+\n\
+Runs throughput benchmarks for performance-sensitive inner loops. If FILTER\n\
+is given, only runs the benchmarks whose names contain it.\n\
+\n\
+Options:\n\
+  --packbits-input=FILENAME\n\
+      Also benchmark packing and unpacking the contents of this file, in\n\
+      addition to the synthetic PackBits data. This should be uncompressed data\n\
+      that PackBits would be used on in practice, such as PICT pixel data or\n\
+      raw resource data exported by resource_dasm. May be given multiple times.\n\
+  --resource-file=FILENAME\n\
+      Benchmark the native System decompressors (dcmp 0 through 3) on all of\n\
+      the compressed resources in this resource fork. May be given multiple\n\
+      times.\n\
+  --codec-input=CODEC:FILENAME\n\
+      Benchmark decompressing the contents of this file with the given codec.\n\
+      CODEC may be dinopark, macski, presage, or soundmusicsys. May be given\n\
+      multiple times.\n");
+}
+
+int main(int argc, char** argv) {
+  const char* filter = nullptr;
+  vector<string> packbits_input_filenames;
+  vector<string> resource_filenames;
+  vector<pair<string, string>> codec_inputs;
+  for (int x = 1; x < argc; x++) {
+    if (!strcmp(argv[x], "--help")) {
+      print_usage();
+      return 0;
+    } else if (!strncmp(argv[x], "--packbits-input=", 17)) {
+      packbits_input_filenames.emplace_back(&argv[x][17]);
+    } else if (!strncmp(argv[x], "--resource-file=", 16)) {
+      resource_filenames.emplace_back(&argv[x][16]);
+    } else if (!strncmp(argv[x], "--codec-input=", 14)) {
+      const char* colon = strchr(&argv[x][14], ':');
+      if (!colon) {
+        fwrite_fmt(stderr, "--codec-input requires a codec name and a filename\n");
+        return 2;
+      }
+      codec_inputs.emplace_back(string(&argv[x][14], colon - &argv[x][14]), colon + 1);
+    } else if (!filter && argv[x][0] != '-') {
+      filter = argv[x];
+    } else {
+      fwrite_fmt(stderr, "invalid or excessive option: {}\n", argv[x]);
+      print_usage();
+      return 2;
+    }
+  }
+
+  benchmark_packbits(filter, packbits_input_filenames);
+  benchmark_lz_buffer(filter);
+  for (const auto& filename : resource_filenames) {
+    benchmark_resource_decompression(filter, filename);
+  }
+  for (const auto& [codec_name, filename] : codec_inputs) {
+    benchmark_codec_decompression(filter, codec_name, filename);
+  }
+  benchmark_mixing(filter);
+  benchmark_memory_context(filter);
+  benchmark_m68k_run_loop(filter);
+
+  fwrite_fmt(stderr, "(checksum: {:016X})\n", checksum);
+  return 0;
+}
@@ -6,6 +6,7 @@
 #include <phosg/Encoding.hh>
 #include <phosg/Filesystem.hh>
 #include <phosg/Strings.hh>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
@@ -44,6 +45,14 @@ Format options (one of the following must be given):\n\
       data directly to the output.\n\
   --sms\n\
       Decompress data using SoundMusicSys LZSS encoding.\n\
+\n\
+Other options:\n\
+  --stream\n\
+      Decode the input incrementally, writing output as it\'s produced, so\n\
+      memory usage doesn\'t depend on the size of the data. This is supported\n\
+      for all of the above formats except --pack-bits and --macski. If the\n\
+      input is corrupt, some output may already have been written when the\n\
+      error is detected.\n\
 ");
 }
 
@@ -58,10 +67,70 @@ enum class Encoding {
   UNPACK_BITS,
 };
 
+static unique_ptr<StreamDecoder> make_stream_decoder(Encoding encoding, StreamDecoder::OutputFn output_fn) {
+  switch (encoding) {
+    case Encoding::SOUNDMUSICSYS:
+      return make_soundmusicsys_lzss_stream_decoder(std::move(output_fn));
+    case Encoding::PRESAGE_LZSS:
+      return make_presage_lzss_stream_decoder(std::move(output_fn));
+    case Encoding::DINOPARK_TYCOON:
+      return make_dinopark_tycoon_stream_decoder(std::move(output_fn));
+    case Encoding::UNPACK_PATHWAYS:
+      return make_unpack_pathways_stream_decoder(std::move(output_fn));
+    case Encoding::UNPACK_BITS:
+      return make_unpack_bits_stream_decoder(std::move(output_fn));
+    default:
+      throw invalid_argument("--stream is not supported for this format");
+  }
+}
+
+static void decode_stream(Encoding encoding, const char* input_filename, const char* output_filename) {
+  bool input_is_stdin = !input_filename || !strcmp(input_filename, "-");
+  bool output_is_stdout = !output_filename || !strcmp(output_filename, "-");
+
+  // Create the decoder before opening the output file, so we don't create an
+  // empty file if the format isn't supported
+  FILE* out_f = stdout;
+  auto decoder = make_stream_decoder(encoding, [&](const void* data, size_t size) -> void {
+    fwritex(out_f, data, size);
+  });
+
+  decltype(fopen_unique("", "")) in_file;
+  FILE* in_f = stdin;
+  if (!input_is_stdin) {
+    in_file = fopen_unique(input_filename, "rb");
+    in_f = in_file.get();
+  }
+
+  decltype(fopen_unique("", "")) out_file;
+  if (!output_is_stdout) {
+    out_file = fopen_unique(output_filename, "wb");
+    out_f = out_file.get();
+  } else if (!input_is_stdin) {
+    out_file = fopen_unique(std::format("{}.dec", input_filename), "wb");
+    out_f = out_file.get();
+  }
+
+  string buffer(STREAM_DECODER_CHUNK_SIZE, '\0');
+  for (;;) {
+    size_t bytes_read = fread(buffer.data(), 1, buffer.size(), in_f);
+    if (bytes_read == 0) {
+      if (ferror(in_f)) {
+        throw runtime_error("cannot read from input");
+      }
+      break;
+    }
+    decoder->feed(buffer.data(), bytes_read);
+  }
+  decoder->finish();
+  fflush(out_f);
+}
+
 int main(int argc, char** argv) {
   const char* input_filename = nullptr;
   const char* output_filename = nullptr;
   Encoding encoding = Encoding::MISSING;
+  bool stream = false;
   for (int z = 1; z < argc; z++) {
     if (!strcmp(argv[z], "--dinopark")) {
       encoding = Encoding::DINOPARK_TYCOON;
@@ -77,6 +146,8 @@ int main(int argc, char** argv) {
       encoding = Encoding::PACK_BITS;
     } else if (!strcmp(argv[z], "--unpack-bits")) {
       encoding = Encoding::UNPACK_BITS;
+    } else if (!strcmp(argv[z], "--stream")) {
+      stream = true;
     } else if (!input_filename) {
       input_filename = argv[z];
     } else if (!output_filename) {
@@ -93,6 +164,11 @@ int main(int argc, char** argv) {
     return 2;
   }
 
+  if (stream) {
+    decode_stream(encoding, input_filename, output_filename);
+    return 0;
+  }
+
   string input_data;
   if (!input_filename || !strcmp(input_filename, "-")) {
     input_data = read_all(stdin);
@@ -1,14 +1,22 @@
 #include <stdio.h>
+#include <string.h>
 
+#include <algorithm>
+#include <array>
 #include <filesystem>
 #include <phosg/Filesystem.hh>
+#include <phosg/Hash.hh>
+#include <phosg/Tools.hh>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "Cli.hh"
 #include "IndexFormats/Formats.hh"
+#include "MappedFile.hh"
 #include "ResourceFile.hh"
 #include "TextCodecs.hh"
 
@@ -47,6 +55,248 @@ static void print_duplicates(int16_t first_id, const string& second_filename, co
   fwrite_fmt(stderr, "\n");
 }
 
+// Writes a modified resource file back to the input file
+static void write_resource_file(string filename, const ResourceFile& rf, bool use_data_fork, bool make_backup) {
+  if (make_backup) {
+    std::filesystem::rename(filename, filename + ".bak");
+  }
+  string output_data = serialize_resource_fork(rf);
+
+  if (!use_data_fork) {
+    if (make_backup) {
+      // Attempting to open the resource fork of a nonexistent file will fail
+      // without creating the file, so we touch the file first to make sure it
+      // will exist when we write the output.
+      (void)fopen_unique(filename, "a+");
+    }
+    filename += PATH_RSRCFORKSPEC;
+  }
+  save_file(filename, output_data);
+}
+
+static ResourceFile load_input_resource_file(const string& filename, bool use_data_fork) {
+  return parse_resource_fork(load_file(use_data_fork ? filename : (filename + PATH_RSRCFORKSPEC)));
+}
+
+// One resource in the index used by --streaming mode. Only the resource's
+// hash is kept, not its data, so the index stays small even for very large
+// numbers of input files.
+struct IndexEntry {
+  array<uint8_t, 16> hash; // First 128 bits of the SHA1 of the data
+  uint32_t size;
+  uint32_t type;
+  int16_t id;
+  uint32_t file_index;
+};
+
+// Loads and hashes the resources in one input file, then discards the file
+static vector<IndexEntry> index_input_file(
+    const char* basename,
+    uint32_t file_index,
+    bool use_data_fork,
+    const map<uint32_t, ResourceIDs>& input_res_types) {
+  string filename = basename;
+  if (!use_data_fork) {
+    filename += PATH_RSRCFORKSPEC;
+  }
+  if (std::filesystem::is_directory(filename) || (std::filesystem::file_size(filename) == 0)) {
+    throw runtime_error("file does not exist, is empty or is not a file");
+  }
+
+  MappedFile input(filename);
+  auto r = input.reader();
+  ResourceFile rf = parse_resource_fork(r);
+
+  vector<IndexEntry> ret;
+  for (const auto& [type, id] : rf.all_resources()) {
+    if (!input_res_types.empty()) {
+      auto types_it = input_res_types.find(type);
+      if ((types_it == input_res_types.end()) || !types_it->second[id]) {
+        continue;
+      }
+    }
+    auto resource = rf.get_resource(type, id);
+    string hash = SHA1(resource->data.data(), resource->data.size()).bin();
+    auto& e = ret.emplace_back();
+    memcpy(e.hash.data(), hash.data(), e.hash.size());
+    e.size = resource->data.size();
+    e.type = type;
+    e.id = id;
+    e.file_index = file_index;
+  }
+  return ret;
+}
+
+static void save_index(const string& filename, const vector<IndexEntry>& index, const vector<const char*>& input_filenames) {
+  auto f = fopen_unique(filename, "wt");
+  for (const auto& e : index) {
+    fwrite_fmt(f.get(), "{}\t{}\t{}\t{}\t{}\n",
+        format_data_string(e.hash.data(), e.hash.size()),
+        e.size,
+        string_for_resource_type(e.type),
+        e.id,
+        input_filenames[e.file_index]);
+  }
+}
+
+// Like the default mode, but only one input file is loaded at a time (per
+// thread), and duplicates are found by comparing hashes instead of data. The
+// hashes are 128 bits, so collisions aren't a practical concern for reporting,
+// but duplicates' data is still compared before they're deleted.
+static uint32_t find_duplicates_streaming(
+    const vector<const char*>& input_filenames,
+    map<uint32_t, ResourceIDs> input_res_types,
+    bool use_data_fork,
+    bool delete_duplicates,
+    bool make_backup,
+    size_t num_jobs,
+    const string& index_filename) {
+
+  // 1. Hash all resources in all files
+  vector<vector<IndexEntry>> file_indexes(input_filenames.size());
+  vector<string> file_errors(input_filenames.size());
+  vector<uint32_t> file_nums;
+  while (file_nums.size() < input_filenames.size()) {
+    file_nums.emplace_back(file_nums.size());
+  }
+  auto index_task = [&](const uint32_t& file_index, size_t) -> bool {
+    try {
+      file_indexes[file_index] = index_input_file(input_filenames[file_index], file_index, use_data_fork, input_res_types);
+    } catch (const exception& e) {
+      file_errors[file_index] = e.what();
+    }
+    return false;
+  };
+  parallel_range(file_nums, index_task, min<size_t>(num_jobs, max<size_t>(file_nums.size(), 1)));
+
+  vector<IndexEntry> index;
+  for (size_t z = 0; z < input_filenames.size(); z++) {
+    if (!file_errors[z].empty()) {
+      fwrite_fmt(stderr, "Input file '{}' could not be indexed: {}\n", input_filenames[z], file_errors[z]);
+    }
+    index.insert(index.end(), file_indexes[z].begin(), file_indexes[z].end());
+    file_indexes[z].clear();
+    file_indexes[z].shrink_to_fit();
+  }
+  fwrite_fmt(stderr, "Indexed {} resources in {} files\n", index.size(), input_filenames.size());
+
+  // Sort the index so that identical resources are adjacent, with the
+  // original (lowest ID in the earliest file) first in each group
+  sort(index.begin(), index.end(), [](const IndexEntry& a, const IndexEntry& b) -> bool {
+    return tie(a.type, a.size, a.hash, a.file_index, a.id) < tie(b.type, b.size, b.hash, b.file_index, b.id);
+  });
+  if (!index_filename.empty()) {
+    save_index(index_filename, index, input_filenames);
+    fwrite_fmt(stderr, "Saved index to '{}'\n", index_filename);
+  }
+
+  if (input_res_types.empty()) {
+    for (const auto& e : index) {
+      input_res_types.emplace(e.type, ResourceIDs(ResourceIDs::Init::ALL));
+    }
+  }
+
+  // 2. Find and print duplicates, one resource type at a time
+  uint32_t num_duplicates = 0;
+  // Duplicates to delete, once their data has been checked against the
+  // original's
+  struct DeletionCandidate {
+    uint32_t original_file_index;
+    int16_t original_id;
+    uint32_t file_index;
+    uint32_t type;
+    int16_t id;
+  };
+  vector<DeletionCandidate> deletion_candidates;
+  auto index_it = index.begin();
+  for (const auto& [res_type, res_ids] : input_res_types) {
+    string res_type_str = string_for_resource_type(res_type);
+    fwrite_fmt(stderr, "Searching for duplicate {} resources with IDs ", res_type_str), res_ids.print(stderr, true);
+
+    while ((index_it != index.end()) && (index_it->type < res_type)) {
+      index_it++;
+    }
+
+    //  first filename -> first ID -> second filename -> second ID
+    map<string, map<int16_t, map<string, set<int16_t>>>> duplicates;
+    while ((index_it != index.end()) && (index_it->type == res_type)) {
+      auto first = index_it;
+      for (index_it++;
+          (index_it != index.end()) && (index_it->type == res_type) && (index_it->size == first->size) && (index_it->hash == first->hash);
+          index_it++) {
+        duplicates[input_filenames[first->file_index]][first->id][input_filenames[index_it->file_index]].insert(index_it->id);
+        if (delete_duplicates) {
+          deletion_candidates.emplace_back(DeletionCandidate{
+              first->file_index, first->id, index_it->file_index, res_type, index_it->id});
+        }
+        ++num_duplicates;
+      }
+    }
+
+    for (const auto& [first_filename, first_ids] : duplicates) {
+      fwrite_fmt(stderr, "  The following {} resources in file '{}' have duplicates:\n", res_type_str, first_filename);
+      for (const auto& [first_id, second_filenames] : first_ids) {
+        if (auto same_filename = second_filenames.find(first_filename); same_filename != second_filenames.end()) {
+          print_duplicates(first_id, "", same_filename->second);
+        }
+        for (const auto& [second_filename, second_ids] : second_filenames) {
+          if (second_filename != first_filename) {
+            print_duplicates(first_id, second_filename, second_ids);
+          }
+        }
+      }
+    }
+  }
+
+  // 3. Compare each duplicate's data with the original's before deleting it,
+  // so a hash collision can never cause a resource to be deleted. Candidates
+  // are sorted by file so at most two files are loaded at once.
+  // file index -> type -> IDs to delete
+  map<uint32_t, map<uint32_t, set<int16_t>>> deletions;
+  sort(deletion_candidates.begin(), deletion_candidates.end(), [](const DeletionCandidate& a, const DeletionCandidate& b) -> bool {
+    return tie(a.original_file_index, a.file_index) < tie(b.original_file_index, b.file_index);
+  });
+  uint32_t loaded_original_file_index = 0xFFFFFFFF;
+  uint32_t loaded_file_index = 0xFFFFFFFF;
+  ResourceFile original_rf;
+  ResourceFile candidate_rf;
+  for (const auto& c : deletion_candidates) {
+    if (c.original_file_index != loaded_original_file_index) {
+      original_rf = load_input_resource_file(input_filenames[c.original_file_index], use_data_fork);
+      loaded_original_file_index = c.original_file_index;
+    }
+    if (c.file_index != loaded_file_index) {
+      candidate_rf = load_input_resource_file(input_filenames[c.file_index], use_data_fork);
+      loaded_file_index = c.file_index;
+    }
+    if (original_rf.get_resource(c.type, c.original_id)->data == candidate_rf.get_resource(c.type, c.id)->data) {
+      deletions[c.file_index][c.type].insert(c.id);
+    } else {
+      fwrite_fmt(stderr, "Not deleting {}:{} in '{}': its hash matches {} in '{}' but its data does not\n",
+          string_for_resource_type(c.type), c.id, input_filenames[c.file_index],
+          c.original_id, input_filenames[c.original_file_index]);
+    }
+  }
+  original_rf = ResourceFile();
+  candidate_rf = ResourceFile();
+
+  // 4. Delete the duplicates. Only the files that have any are loaded again.
+  for (const auto& [file_index, type_ids] : deletions) {
+    string filename = input_filenames[file_index];
+    ResourceFile rf = load_input_resource_file(filename, use_data_fork);
+    size_t num_deletions = 0;
+    for (const auto& [type, ids] : type_ids) {
+      for (int16_t id : ids) {
+        num_deletions += rf.remove(type, id);
+      }
+    }
+    write_resource_file(filename, rf, use_data_fork, make_backup);
+    fwrite_fmt(stderr, "Saved file '{}' with {} deletions\n", filename, num_deletions);
+  }
+
+  return num_duplicates;
+}
+
 static void print_usage() {
   fputs("\
 Usage: dupe_finder [options] input-filename [input-filename...]\n\
@@ -81,6 +331,18 @@ Duplicate resources finder input options:\n\
   --backup\n\
       Rename the original input file to 'input-filename.bak' before\n\
       writing the new, modified file.\n\
+  --streaming\n\
+      Load one input file at a time (per thread) and compare resources by\n\
+      128-bit hashes instead of comparing their data, so only a small index\n\
+      is kept in memory. Use this for very large numbers of input files.\n\
+      With --delete, each duplicate's data is still compared with the\n\
+      original's before it is deleted.\n\
+  --jobs=N\n\
+      In --streaming mode, hash up to N input files at once. If N is 0 (the\n\
+      default), use as many threads as there are CPU cores in the system.\n\
+  --save-index=FILENAME\n\
+      Save the index of resource hashes, sizes, types, IDs and filenames to\n\
+      this file, one resource per line. Implies --streaming.\n\
 \n",
       stderr);
 }
@@ -98,6 +360,9 @@ int main(int argc, const char** argv) {
     bool use_data_fork = false;
     bool delete_duplicates = false;
     bool make_backup = false;
+    bool streaming = false;
+    size_t num_jobs = 0;
+    string index_filename;
 
     for (int x = 1; x < argc; x++) {
       if (!strncmp(argv[x], "--", 2)) {
@@ -107,6 +372,13 @@ int main(int argc, const char** argv) {
           delete_duplicates = true;
         } else if (!strcmp(argv[x], "--backup")) {
           make_backup = true;
+        } else if (!strcmp(argv[x], "--streaming")) {
+          streaming = true;
+        } else if (!strncmp(argv[x], "--jobs=", 7)) {
+          num_jobs = strtoull(&argv[x][7], nullptr, 0);
+        } else if (!strncmp(argv[x], "--save-index=", 13)) {
+          index_filename = &argv[x][13];
+          streaming = true;
         } else if (!strncmp(argv[x], "--target=", 9)) {
           ResourceIDs ids(ResourceIDs::Init::NONE);
           uint32_t type = parse_cli_type_ids(&argv[x][9], &ids);
@@ -127,6 +399,16 @@ int main(int argc, const char** argv) {
       return 2;
     }
 
+    if (streaming) {
+      if (num_jobs == 0) {
+        num_jobs = thread::hardware_concurrency();
+      }
+      uint32_t num_duplicates = find_duplicates_streaming(
+          input_filenames, input_res_types, use_data_fork, delete_duplicates, make_backup, num_jobs, index_filename);
+      fwrite_fmt(stderr, "Found{} {} duplicates\n", delete_duplicates ? " and deleted" : "", num_duplicates);
+      return 0;
+    }
+
     // Load resource files
     vector<InputFile> input_files;
     for (const char* basename : input_filenames) {
@@ -235,22 +517,7 @@ int main(int argc, const char** argv) {
     if (delete_duplicates) {
       for (const InputFile& file : input_files) {
         if (file.num_deletions > 0) {
-          string filename = file.filename;
-          if (make_backup) {
-            std::filesystem::rename(filename, filename + ".bak");
-          }
-          string output_data = serialize_resource_fork(file.resources);
-
-          if (!use_data_fork) {
-            if (make_backup) {
-              // Attempting to open the resource fork of a nonexistent file will fail
-              // without creating the file, so we touch the file first to make sure it
-              // will exist when we write the output.
-              (void)fopen_unique(filename, "a+");
-            }
-            filename += PATH_RSRCFORKSPEC;
-          }
-          save_file(filename, output_data);
+          write_resource_file(file.filename, file.resources, use_data_fork, make_backup);
           fwrite_fmt(stderr, "Saved file '{}' with {} deletions\n", file.filename, file.num_deletions);
         }
       }
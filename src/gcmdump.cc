@@ -8,11 +8,19 @@
 #include <unistd.h>
 
 #include <filesystem>
+#include <format>
 #include <phosg/Encoding.hh>
 #include <phosg/Filesystem.hh>
 #include <phosg/Strings.hh>
+#include <phosg/Tools.hh>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
+
+#include "MappedFile.hh"
 
 using namespace std;
 
@@ -131,51 +139,57 @@ uint32_t dol_file_size(const DOLHeader* dol) {
   return max_offset;
 }
 
+struct ExtractTask {
+  string filename;
+  uint64_t offset;
+  uint64_t size;
+};
+
 void parse_until(
-    FILE* f,
+    vector<ExtractTask>& tasks,
     const FSTEntry* fst,
     const char* string_table,
     int start,
     int end,
     int64_t base_offset,
-    const unordered_set<string>& target_filenames) {
+    const unordered_set<string>& target_filenames,
+    const string& dir) {
 
   int x;
-  string pwd = std::filesystem::current_path().string();
-  pwd += '/';
-  size_t pwd_end = pwd.size();
   for (x = start; x < end; x++) {
     if (fst[x].is_dir()) {
       phosg::fwrite_fmt(stderr, "> entry: {:08X} $ {:08X} {:08X} {:08X} {}{}/\n", x,
           fst[x].file.dir_flag_string_offset.load(),
           fst[x].file.file_offset.load(),
-          fst[x].file.file_size.load(), pwd,
+          fst[x].file.file_size.load(), dir,
           &string_table[fst[x].string_offset()]);
 
-      pwd += sanitize_filename(&string_table[fst[x].file.dir_flag_string_offset & 0x00FFFFFF]);
-      std::filesystem::create_directories(pwd);
-      std::filesystem::current_path(pwd);
-      parse_until(f, fst, string_table, x + 1, fst[x].dir.next_offset, base_offset, target_filenames);
-      pwd.resize(pwd_end);
-      std::filesystem::current_path(pwd.c_str());
+      // The directory's contents are the entries up to next_offset, which must
+      // be within the parent directory's entries
+      uint32_t next_offset = fst[x].dir.next_offset;
+      if ((next_offset <= static_cast<uint32_t>(x)) || (next_offset > static_cast<uint32_t>(end))) {
+        throw runtime_error(std::format(
+            "directory entry {:08X} has invalid next offset {:08X}", x, next_offset));
+      }
+
+      string subdir = dir + sanitize_filename(&string_table[fst[x].file.dir_flag_string_offset & 0x00FFFFFF]);
+      std::filesystem::create_directories(subdir);
+      parse_until(tasks, fst, string_table, x + 1, next_offset, base_offset, target_filenames, subdir + "/");
 
-      x = fst[x].dir.next_offset - 1;
+      x = next_offset - 1;
 
     } else {
       phosg::fwrite_fmt(stderr, "> entry: {:08X} $ {:08X} {:08X} {:08X} {}{}\n", x,
           fst[x].file.dir_flag_string_offset.load(),
           fst[x].file.file_offset.load(), fst[x].file.file_size.load(),
-          pwd, &string_table[fst[x].string_offset()]);
+          dir, &string_table[fst[x].string_offset()]);
 
       if (target_filenames.empty() ||
           target_filenames.count(&string_table[fst[x].string_offset()])) {
-        string filename = sanitize_filename(&string_table[fst[x].string_offset()]);
-        try {
-          fseek(f, fst[x].file.file_offset + base_offset, SEEK_SET);
-          phosg::save_file(filename, phosg::freadx(f, fst[x].file.file_size));
-        } catch (const exception& e) {
-          phosg::fwrite_fmt(stderr, "!!! failed to write file: {}\n", e.what());
-        }
+        tasks.emplace_back(ExtractTask{
+            .filename = dir + sanitize_filename(&string_table[fst[x].string_offset()]),
+            .offset = static_cast<uint64_t>(fst[x].file.file_offset + base_offset),
+            .size = fst[x].file.file_size});
       }
     }
   }
@@ -190,18 +204,21 @@ enum Format {
 int main(int argc, char** argv) {
 
   if (argc < 2) {
-    phosg::fwrite_fmt(stderr, "Usage: {} [--gcm|--tgc] <filename> [files_to_extract]\n", argv[0]);
+    phosg::fwrite_fmt(stderr, "Usage: {} [--gcm|--tgc] [--jobs=N] <filename> [files_to_extract]\n", argv[0]);
     return -1;
   }
 
   Format format = Format::UNKNOWN;
   const char* filename = nullptr;
+  size_t num_jobs = 0;
   unordered_set<string> target_filenames;
   for (int x = 1; x < argc; x++) {
     if (!strcmp(argv[x], "--gcm")) {
       format = Format::GCM;
     } else if (!strcmp(argv[x], "--tgc")) {
       format = Format::TGC;
+    } else if (!strncmp(argv[x], "--jobs=", 7)) {
+      num_jobs = strtoull(&argv[x][7], nullptr, 0);
     } else if (!filename) {
       filename = argv[x];
     } else {
@@ -212,11 +229,17 @@ int main(int argc, char** argv) {
     phosg::fwrite_fmt(stderr, "no filename given\n");
     return -1;
   }
+  if (num_jobs == 0) {
+    num_jobs = thread::hardware_concurrency();
+  }
 
-  auto f = phosg::fopen_unique(filename, "rb");
+  // The image is mapped instead of read, so extracting a file just writes a
+  // slice of the mapping to the output file, without copying it to the heap
+  // first
+  ResourceDASM::MappedFile image(filename);
+  auto r = image.reader();
 
-  ImageHeader header;
-  phosg::freadx(f.get(), &header, sizeof(ImageHeader));
+  const auto& header = r.pget<ImageHeader>(0);
   if (format == Format::UNKNOWN) {
     if (header.gcm.gc_magic == 0xC2339F3D) {
       format = Format::GCM;
@@ -251,45 +274,83 @@ int main(int argc, char** argv) {
     return -3;
   }
 
+  // These are written before the FST files, and failing to write any of them
+  // is fatal
+
   // if there are target filenames and default.dol isn't specified, don't
   // extract it
   if (target_filenames.empty() || target_filenames.count("default.dol")) {
-    fseek(f.get(), dol_offset, SEEK_SET);
-    string dol_data = phosg::freadx(f.get(), sizeof(DOLHeader));
-    uint32_t dol_size = dol_file_size(reinterpret_cast<const DOLHeader*>(dol_data.data()));
-
-    dol_data += phosg::freadx(f.get(), dol_size - sizeof(DOLHeader));
-
-    phosg::save_file("default.dol", dol_data);
+    uint32_t dol_size = dol_file_size(&r.pget<DOLHeader>(dol_offset));
+    phosg::save_file("default.dol", r.pgetv(dol_offset, dol_size), dol_size);
   }
 
   if (target_filenames.empty() || target_filenames.count("__gcm_header__.bin")) {
-    fseek(f.get(), gcm_offset, SEEK_SET);
-    phosg::save_file("__gcm_header__.bin", phosg::freadx(f.get(), 0x2440));
+    phosg::save_file("__gcm_header__.bin", r.pgetv(gcm_offset, 0x2440), 0x2440);
   }
 
   if (target_filenames.empty() || target_filenames.count("apploader.bin")) {
-    fseek(f.get(), gcm_offset + 0x2440, SEEK_SET);
-    string data = phosg::freadx(f.get(), sizeof(ApploaderHeader));
-    const auto* header = reinterpret_cast<const ApploaderHeader*>(data.data());
-    data += phosg::freadx(f.get(), header->size + header->trailer_size);
-    phosg::save_file("apploader.bin", data);
+    const auto& apploader_header = r.pget<ApploaderHeader>(gcm_offset + 0x2440);
+    size_t apploader_size = sizeof(ApploaderHeader) + apploader_header.size + apploader_header.trailer_size;
+    phosg::save_file("apploader.bin", r.pgetv(gcm_offset + 0x2440, apploader_size), apploader_size);
   }
 
-  fseek(f.get(), fst_offset, SEEK_SET);
-  string fst_data = phosg::freadx(f.get(), fst_size);
-  const FSTEntry* fst = reinterpret_cast<const FSTEntry*>(fst_data.data());
-
   // if there are target filenames and fst.bin isn't specified, don't extract it
   if (target_filenames.empty() || target_filenames.count("fst.bin")) {
-    phosg::save_file("fst.bin", fst_data);
+    phosg::save_file("fst.bin", r.pgetv(fst_offset, fst_size), fst_size);
+  }
+
+  if (fst_size < sizeof(FSTEntry)) {
+    phosg::fwrite_fmt(stderr, "fst is too small to contain the root entry\n");
+    return -3;
   }
+  const FSTEntry* fst = &r.pget<FSTEntry>(fst_offset, fst_size);
 
-  int num_entries = fst[0].root.num_entries;
+  uint32_t num_entries = fst[0].root.num_entries;
   phosg::fwrite_fmt(stderr, "> root: {:08X} files\n", num_entries);
 
-  char* string_table = (char*)fst + (sizeof(FSTEntry) * num_entries);
-  parse_until(f.get(), fst, string_table, 1, num_entries, base_offset, target_filenames);
+  if (sizeof(FSTEntry) * num_entries > fst_size) {
+    phosg::fwrite_fmt(stderr, "fst is too small for {} entries\n", num_entries);
+    return -3;
+  }
+  const char* string_table = reinterpret_cast<const char*>(fst) + (sizeof(FSTEntry) * num_entries);
+  // All directories are created while walking the FST, so the files can be
+  // written in any order afterward
+  vector<ExtractTask> tasks;
+  try {
+    parse_until(tasks, fst, string_table, 1, num_entries, base_offset, target_filenames, "");
+  } catch (const exception& e) {
+    phosg::fwrite_fmt(stderr, "fst is invalid: {}\n", e.what());
+    return -3;
+  }
+
+  // Different entries can have the same path after sanitize_filename. Only the
+  // last one is written (as if the files were written in FST order), so
+  // parallel writes never go to the same file.
+  unordered_map<string, size_t> last_task_index_for_filename;
+  for (size_t z = 0; z < tasks.size(); z++) {
+    last_task_index_for_filename[tasks[z].filename] = z;
+  }
+  if (last_task_index_for_filename.size() != tasks.size()) {
+    vector<ExtractTask> unique_tasks;
+    for (size_t z = 0; z < tasks.size(); z++) {
+      if (last_task_index_for_filename.at(tasks[z].filename) == z) {
+        unique_tasks.emplace_back(std::move(tasks[z]));
+      } else {
+        phosg::fwrite_fmt(stderr, "> skipping {} (overwritten by a later entry with the same name)\n", tasks[z].filename);
+      }
+    }
+    tasks = std::move(unique_tasks);
+  }
+
+  auto extract_task = [&](const ExtractTask& task, size_t) -> bool {
+    try {
+      phosg::save_file(task.filename, r.pgetv(task.offset, task.size), task.size);
+    } catch (const exception& e) {
+      phosg::fwrite_fmt(stderr, "!!! failed to write file {}: {}\n", task.filename, e.what());
+    }
+    return false;
+  };
+  phosg::parallel_range(tasks, extract_task, min<size_t>(num_jobs, max<size_t>(tasks.size(), 1)));
 
   return 0;
 }
@@ -569,11 +569,12 @@ int main(int argc, char** argv) {
   } else if (behavior == Behavior::DISASSEMBLE_XBE) {
     disassemble_executable<XBEFile>(out_stream, in_filename, data, &labels, print_hex_view_for_code, all_sections_as_code);
 
+  } else if (behavior == Behavior::DISASSEMBLE_M68K) {
+    M68KEmulator::disassemble(out_stream, data.data(), data.size(), start_address, &labels);
+
   } else {
     string disassembly;
-    if (behavior == Behavior::DISASSEMBLE_M68K) {
-      disassembly = M68KEmulator::disassemble(data.data(), data.size(), start_address, &labels);
-    } else if (behavior == Behavior::DISASSEMBLE_PPC) {
+    if (behavior == Behavior::DISASSEMBLE_PPC) {
       disassembly = PPC32Emulator::disassemble(data.data(), data.size(), start_address, &labels);
     } else if (behavior == Behavior::DISASSEMBLE_X86) {
       disassembly = X86Emulator::disassemble(data.data(), data.size(), start_address, &labels);
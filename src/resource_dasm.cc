@@ -11,14 +11,18 @@
 #include <deque>
 #include <filesystem>
 #include <functional>
+#include <mutex>
 #include <optional>
 #include <phosg/Encoding.hh>
 #include <phosg/Filesystem.hh>
+#include <phosg/Hash.hh>
 #include <phosg/Image.hh>
 #include <phosg/JSON.hh>
 #include <phosg/Platform.hh>
 #include <phosg/Process.hh>
 #include <phosg/Strings.hh>
+#include <phosg/Tools.hh>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -35,6 +39,8 @@
 #include "ImageSaver.hh"
 #include "IndexFormats/Formats.hh"
 #include "Lookups.hh"
+#include "MappedFile.hh"
+#include "OutputWriter.hh"
 #include "ResourceCompression.hh"
 #include "ResourceFile.hh"
 #include "ResourceIDs.hh"
@@ -57,7 +63,8 @@ static constexpr char FILENAME_FORMAT_STANDARD_TYPE_XDIRS[] = "%f/%t/%i%N";
 static constexpr char FILENAME_FORMAT_TYPE_FIRST[] = "%t/%f_%i%n";
 static constexpr char FILENAME_FORMAT_TYPE_FIRST_DIRS[] = "%t/%f/%i%n";
 
-static string disassembly_for_dcmp(
+static void write_disassembly_for_dcmp(
+    function<void(const char*, size_t)> write,
     const ResourceFile::DecodedDecompressorResource& dcmp) {
   multimap<uint32_t, string> labels;
   if (dcmp.init_label >= 0) {
@@ -69,37 +76,358 @@ static string disassembly_for_dcmp(
   if (dcmp.exit_label >= 0) {
     labels.emplace(dcmp.exit_label, "exit");
   }
-  return M68KEmulator::disassemble(
-      dcmp.code.data(), dcmp.code.size(), dcmp.pc_offset, &labels);
+  M68KEmulator::disassemble(
+      write, dcmp.code.data(), dcmp.code.size(), dcmp.pc_offset, &labels);
 }
 
-class ResourceExporter {
-private:
+// Creates output directories on behalf of one or more ResourceExporters. This
+// is shared between all workers when exporting in parallel, so it's safe to
+// call from multiple threads; it also remembers which directories it has
+// already created so we don't have to stat them again for every output file.
+class DirectoryCreator {
+public:
+  DirectoryCreator() = default;
+  ~DirectoryCreator() = default;
+
   void ensure_directories_exist(const string& filename) {
-    vector<string> tokens = split(filename, '/');
-    if (tokens.empty()) {
+    size_t last_slash_pos = filename.rfind('/');
+    // dir can be empty if filename is at the root of an absolute path; just
+    // skip it
+    if (last_slash_pos == string::npos || last_slash_pos == 0) {
       return;
     }
-    tokens.pop_back();
+    string dir = filename.substr(0, last_slash_pos);
 
-    if (tokens.empty()) {
-      return;
+    lock_guard g(this->lock);
+    if (this->created_dirs.emplace(dir).second && !std::filesystem::is_directory(dir)) {
+      try {
+        std::filesystem::create_directories(dir);
+      } catch (const exception&) {
+        this->created_dirs.erase(dir);
+        throw;
+      }
     }
+  }
 
-    string dir;
-    bool first_token = true;
-    for (const string& token : tokens) {
-      if (!first_token) {
-        dir.push_back('/');
-      } else {
-        first_token = false;
+private:
+  mutex lock;
+  unordered_set<string> created_dirs;
+};
+
+// Bump this whenever a change to the decoders would change the output for
+// resources that were already exported, so --incremental re-exports them
+static constexpr uint32_t EXPORT_MANIFEST_DECODER_VERSION = 1;
+
+// Remembers which input files have already been exported, so later runs with
+// --incremental can skip the files that haven't changed. The manifest is a
+// journal with one JSON object per line; an entry is appended as soon as each
+// file is completely exported, so if a run is interrupted, the next run skips
+// the files that were already done. Later entries for the same file replace
+// earlier ones, and save() rewrites the journal without the replaced entries.
+// Each entry also lists the output files written for its input file, so that
+// outputs which are no longer produced (because their resources or input files
+// were removed) can be deleted, and so that deleted outputs are regenerated.
+// This is shared between all workers when exporting in parallel.
+class ExportManifest {
+public:
+  struct Entry {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    string content_hash; // SHA1 of the input file, in hex
+    string config_hash; // Identifies the decoder version and export options
+    bool exported_any = false; // Return value of disassemble_file
+    vector<string> output_filenames;
+  };
+
+  ExportManifest(const string& filename, const string& config_hash)
+      : filename(filename),
+        config_hash(config_hash),
+        journal(fopen_unique(filename, "at")) {
+    string contents = load_file(this->filename);
+    for (const auto& line : split(contents, '\n')) {
+      if (line.empty()) {
+        continue;
       }
-      dir += token;
-      // dir can be / if filename is an absolute path; just skip it
-      if (dir != "/" && !std::filesystem::is_directory(dir)) {
-        std::filesystem::create_directories(dir);
+      // The last line may be incomplete if the previous run was interrupted
+      // while writing it; just ignore it (that file will be exported again)
+      try {
+        auto json = JSON::parse(line);
+        Entry e;
+        e.size = json.get_int("size");
+        e.mtime = json.get_int("mtime");
+        e.content_hash = json.get_string("content_hash");
+        e.config_hash = json.get_string("config_hash");
+        e.exported_any = json.get_bool("exported_any");
+        for (const auto& output_json : json.at("outputs").as_list()) {
+          e.output_filenames.emplace_back(output_json->as_string());
+        }
+        this->entries[json.get_string("path")] = std::move(e);
+      } catch (const exception&) {
+      }
+    }
+    for (const auto& [path, e] : this->entries) {
+      for (const auto& output_filename : e.output_filenames) {
+        this->output_refcounts[output_filename]++;
+      }
+    }
+  }
+  ExportManifest(const ExportManifest&) = delete;
+  ExportManifest(ExportManifest&&) = delete;
+  ExportManifest& operator=(const ExportManifest&) = delete;
+  ExportManifest& operator=(ExportManifest&&) = delete;
+  ~ExportManifest() = default;
+
+  // Returns true if input_filename hasn't changed since it was last exported
+  // with the same decoder version and options, and all the output files from
+  // that export still exist. In that case, exported_any is set to what
+  // disassemble_file returned when it was exported. Otherwise, returns false
+  // and fills in entry, which should be passed to record() once the file is
+  // exported. The content hash is only computed if the file's size or
+  // modification time differ from the manifest's entry.
+  bool check(const string& input_filename, Entry& entry, bool& exported_any) {
+    entry.size = std::filesystem::file_size(input_filename);
+    entry.mtime = std::filesystem::last_write_time(input_filename).time_since_epoch().count();
+    entry.config_hash = this->config_hash;
+
+    Entry prev_entry;
+    bool has_prev_entry;
+    {
+      lock_guard g(this->lock);
+      this->checked_filenames.emplace(input_filename);
+      auto it = this->entries.find(input_filename);
+      has_prev_entry = (it != this->entries.end());
+      if (has_prev_entry) {
+        prev_entry = it->second;
+      }
+    }
+    if (!has_prev_entry || (prev_entry.config_hash != entry.config_hash) || (prev_entry.size != entry.size)) {
+      entry.content_hash = this->hash_file(input_filename);
+      return false;
+    }
+    if (prev_entry.mtime == entry.mtime) {
+      if (!this->all_outputs_exist(prev_entry)) {
+        entry.content_hash = prev_entry.content_hash;
+        return false;
+      }
+      exported_any = prev_entry.exported_any;
+      return true;
+    }
+
+    // The file was touched, but its contents might not have changed (e.g. if
+    // it was copied again from the same source). If they didn't, update the
+    // modification time so we don't have to hash it again next time.
+    entry.content_hash = this->hash_file(input_filename);
+    if ((entry.content_hash != prev_entry.content_hash) || !this->all_outputs_exist(prev_entry)) {
+      return false;
+    }
+    entry.exported_any = prev_entry.exported_any;
+    entry.output_filenames = prev_entry.output_filenames;
+    this->record(input_filename, entry);
+    exported_any = prev_entry.exported_any;
+    return true;
+  }
+
+  // Records that input_filename was exported. Output files listed in the
+  // previous entry for input_filename that aren't in the new entry (and aren't
+  // listed by any other entry) are deleted.
+  void record(const string& input_filename, const Entry& entry) {
+    string line = this->serialize_entry(input_filename, entry);
+
+    lock_guard g(this->lock);
+    this->replace_entry_locked(input_filename, &entry);
+    // Flush after each entry, so the entry is kept even if the process is
+    // killed before it finishes
+    fwritex(this->journal.get(), line);
+    fflush(this->journal.get());
+  }
+
+  // Deletes the entries (and output files) for input files within root_path
+  // that weren't checked during this run, since they no longer exist or no
+  // longer have any resources. Then rewrites the manifest without the entries
+  // that have been replaced or deleted.
+  void save(const string& root_path) {
+    lock_guard g(this->lock);
+
+    vector<string> removed_filenames;
+    for (const auto& [path, e] : this->entries) {
+      if (!this->checked_filenames.count(path) && path.starts_with(root_path) &&
+          ((path.size() == root_path.size()) || root_path.ends_with('/') || (path[root_path.size()] == '/'))) {
+        removed_filenames.emplace_back(path);
+      }
+    }
+    for (const auto& path : removed_filenames) {
+      this->replace_entry_locked(path, nullptr);
+    }
+
+    string contents;
+    for (const auto& [path, e] : this->entries) {
+      contents += this->serialize_entry(path, e);
+    }
+
+    // Write to a temporary file, then rename it into place, so the manifest
+    // is never left incomplete
+    string temp_filename = this->filename + ".tmp";
+    save_file(temp_filename, contents);
+    this->journal.reset();
+    std::filesystem::rename(temp_filename, this->filename);
+    this->journal = fopen_unique(this->filename, "at");
+  }
+
+private:
+  string filename;
+  string config_hash;
+
+  mutex lock; // Guards the following fields
+  unordered_map<string, Entry> entries;
+  unordered_map<string, size_t> output_refcounts; // Number of entries listing each output file
+  unordered_set<string> checked_filenames; // Input files passed to check() during this run
+  decltype(fopen_unique("", "")) journal;
+
+  // Replaces (or deletes, if entry is null) the entry for input_filename, and
+  // deletes any output files that are no longer listed by any entry
+  void replace_entry_locked(const string& input_filename, const Entry* entry) {
+    if (entry) {
+      for (const auto& output_filename : entry->output_filenames) {
+        this->output_refcounts[output_filename]++;
+      }
+    }
+    auto it = this->entries.find(input_filename);
+    if (it != this->entries.end()) {
+      for (const auto& output_filename : it->second.output_filenames) {
+        auto refcount_it = this->output_refcounts.find(output_filename);
+        if (--refcount_it->second == 0) {
+          this->output_refcounts.erase(refcount_it);
+          std::error_code ec;
+          std::filesystem::remove(output_filename, ec);
+        }
+      }
+    }
+    if (entry) {
+      this->entries[input_filename] = *entry;
+    } else if (it != this->entries.end()) {
+      this->entries.erase(it);
+    }
+  }
+
+  static bool all_outputs_exist(const Entry& entry) {
+    for (const auto& output_filename : entry.output_filenames) {
+      if (!std::filesystem::exists(output_filename)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static string serialize_entry(const string& input_filename, const Entry& entry) {
+    auto outputs_json = JSON::list();
+    for (const auto& output_filename : entry.output_filenames) {
+      outputs_json.emplace_back(output_filename);
+    }
+    auto json = JSON::dict({
+        {"path", input_filename},
+        {"size", static_cast<int64_t>(entry.size)},
+        {"mtime", entry.mtime},
+        {"content_hash", entry.content_hash},
+        {"config_hash", entry.config_hash},
+        {"exported_any", entry.exported_any},
+        {"outputs", std::move(outputs_json)},
+    });
+    return json.serialize() + "\n";
+  }
+
+  static string hash_file(const string& filename) {
+    MappedFile input(filename);
+    return SHA1(input.data(), input.size()).hex();
+  }
+};
+
+// Returns a string that changes when the given external program changes, so it
+// can be included in the manifest's config hash. Like run_process, this looks
+// up programs in PATH if the name doesn't contain a slash.
+static string external_program_config_data(const string& name) {
+  vector<string> candidates;
+  const char* path_env = getenv("PATH");
+  if ((name.find('/') != string::npos) || !path_env) {
+    candidates.emplace_back(name);
+  } else {
+    for (const auto& dir : split(path_env, ':')) {
+      candidates.emplace_back((dir.empty() ? "." : dir) + "/" + name);
+    }
+  }
+  for (const auto& candidate : candidates) {
+    try {
+      if (std::filesystem::is_regular_file(candidate)) {
+        MappedFile f(candidate);
+        return std::format("{}:{}", candidate, SHA1(f.data(), f.size()).hex());
       }
+    } catch (const exception&) {
+    }
+  }
+  return name + ":(missing)";
+}
+
+// Collects log output from tasks that run in parallel and passes it to
+// write_fn in task order. Each task's output is written as soon as that task
+// and all tasks before it are done, so the result reads like a serial run.
+class OrderedLogWriter {
+public:
+  OrderedLogWriter(size_t num_tasks, function<void(const string&)> write_fn)
+      : logs(num_tasks),
+        complete(num_tasks, false),
+        next_index(0),
+        write_fn(std::move(write_fn)) {}
+  ~OrderedLogWriter() = default;
+
+  void write(size_t task_index, string&& log) {
+    lock_guard g(this->lock);
+    this->logs.at(task_index) = std::move(log);
+    this->complete.at(task_index) = true;
+    for (; (this->next_index < this->logs.size()) && this->complete[this->next_index]; this->next_index++) {
+      this->write_fn(this->logs[this->next_index]);
+      this->logs[this->next_index].clear();
+      this->logs[this->next_index].shrink_to_fit();
+    }
+  }
+
+private:
+  mutex lock;
+  vector<string> logs;
+  vector<bool> complete;
+  size_t next_index;
+  function<void(const string&)> write_fn;
+};
+
+class ResourceExporter {
+private:
+  void ensure_directories_exist(const string& filename) {
+    this->directory_creator->ensure_directories_exist(filename);
+  }
+
+  template <typename... ArgTs>
+  void write_log(std::format_string<ArgTs...> fmt, ArgTs&&... args) {
+    if (this->log_buffer) {
+      this->log_buffer->append(std::format(fmt, std::forward<ArgTs>(args)...));
+    } else {
+      fwrite_fmt(stderr, fmt, std::forward<ArgTs>(args)...);
+    }
+  }
+
+  void write_log_raw(const string& data) {
+    if (this->log_buffer) {
+      this->log_buffer->append(data);
+    } else {
+      fwritex(stderr, data);
+    }
+  }
+
+  // Logs the name of an output file that was just written, and records it for
+  // the manifest if there is one
+  void note_output_file(const string& filename) {
+    if (this->written_output_files) {
+      lock_guard g(this->written_output_files->lock);
+      this->written_output_files->filenames.emplace_back(filename);
     }
+    this->write_log("... {}\n", filename);
   }
 
   string output_filename(
@@ -225,7 +553,29 @@ private:
     string filename = this->output_filename(base_filename, res, after);
     this->ensure_directories_exist(filename);
     save_file(filename, data);
-    fwrite_fmt(stderr, "... {}\n", filename);
+    this->note_output_file(filename);
+  }
+
+  // Opens the output file for a decoded resource and calls write_fn to write
+  // its contents, so large outputs don't have to be built in memory first. If
+  // write_fn throws, the incomplete file is deleted.
+  void write_decoded_text(
+      const string& base_filename,
+      shared_ptr<const ResourceFile::Resource> res,
+      const string& after,
+      function<void(OutputWriter&)> write_fn) {
+    string filename = this->output_filename(base_filename, res, after);
+    this->ensure_directories_exist(filename);
+    try {
+      auto f = fopen_unique(filename, "wb");
+      OutputWriter w(f.get());
+      write_fn(w);
+      w.flush();
+    } catch (const exception&) {
+      std::filesystem::remove(filename);
+      throw;
+    }
+    this->note_output_file(filename);
   }
 
   template <PixelFormat Format>
@@ -237,7 +587,7 @@ private:
     string filename = this->output_filename(base_filename, res, after);
     this->ensure_directories_exist(filename);
     filename = this->image_saver.save_image(img, filename);
-    fwrite_fmt(stderr, "... {}\n", filename);
+    this->note_output_file(filename);
   }
 
   void write_decoded_TMPL(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
@@ -549,10 +899,24 @@ private:
   }
 
   void write_icns(const string& base_filename, const shared_ptr<const ResourceFile::Resource>& icon) {
-    // Already exported? Save time and don't export it again
-    if (exported_family_icns.find(icon->id) != exported_family_icns.end()) {
-      return;
+    // Already exported (or being exported by another worker)? Save time and
+    // don't export it again
+    {
+      lock_guard g(this->exported_family_icns->lock);
+      if (!this->exported_family_icns->ids.emplace(icon->id).second) {
+        return;
+      }
+    }
+    try {
+      this->write_icns_family(base_filename, icon);
+    } catch (const exception&) {
+      lock_guard g(this->exported_family_icns->lock);
+      this->exported_family_icns->ids.erase(icon->id);
+      throw;
     }
+  }
+
+  void write_icns_family(const string& base_filename, const shared_ptr<const ResourceFile::Resource>& icon) {
 
     // Load all of the family's icons
     shared_ptr<const ResourceFile::Resource> icsN = load_family_icon(icon, RESOURCE_TYPE_icsN);
@@ -598,8 +962,6 @@ private:
     data.pput_u32b(4, data.size());
 
     this->write_decoded_data(base_filename, icon, ".icns", data.str());
-
-    exported_family_icns.insert(icon->id);
   }
 
   void write_decoded_ICNN(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
@@ -888,7 +1250,7 @@ private:
       fwrite_fmt(f.get(), "#   bitmap offset: {}; width: {}\n", decoded.missing_glyph.bitmap_offset, decoded.missing_glyph.bitmap_width);
       fwrite_fmt(f.get(), "#   character offset: {}; width: {}\n", decoded.missing_glyph.offset, decoded.missing_glyph.width);
 
-      fwrite_fmt(stderr, "... {}\n", description_filename);
+      this->note_output_file(description_filename);
     }
 
     this->write_decoded_image(
@@ -1147,18 +1509,19 @@ private:
   }
 
   void write_decoded_CODE(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
-    string disassembly;
     if (res->id == 0) {
       auto decoded = this->current_rf->decode_CODE_0(res);
-      disassembly += std::format("# above A5 size: 0x{:08X}\n", decoded.above_a5_size);
-      disassembly += std::format("# below A5 size: 0x{:08X}\n", decoded.below_a5_size);
-      for (size_t x = 0; x < decoded.jump_table.size(); x++) {
-        const auto& e = decoded.jump_table[x];
-        if (e.code_resource_id || e.offset) {
-          disassembly += std::format("# export {} [A5 + 0x{:X}]: CODE {} offset 0x{:X} after header\n",
-              x, 0x22 + (x * 8), e.code_resource_id, e.offset);
+      this->write_decoded_text(base_filename, res, ".txt", [&](OutputWriter& w) -> void {
+        w.write_fmt("# above A5 size: 0x{:08X}\n", decoded.above_a5_size);
+        w.write_fmt("# below A5 size: 0x{:08X}\n", decoded.below_a5_size);
+        for (size_t x = 0; x < decoded.jump_table.size(); x++) {
+          const auto& e = decoded.jump_table[x];
+          if (e.code_resource_id || e.offset) {
+            w.write_fmt("# export {} [A5 + 0x{:X}]: CODE {} offset 0x{:X} after header\n",
+                x, 0x22 + (x * 8), e.code_resource_id, e.offset);
+          }
         }
-      }
+      });
 
     } else {
       auto decoded = this->current_rf->decode_CODE(res);
@@ -1178,46 +1541,44 @@ private:
       } catch (const exception&) {
       }
 
-      if (decoded.first_jump_table_entry < 0) {
-        disassembly += "# far model CODE resource\n";
-        disassembly += std::format("# near model jump table entries starting at A5 + 0x{:08X} ({} of them)\n",
-            decoded.near_entry_start_a5_offset, decoded.near_entry_count);
-        disassembly += std::format("# far model jump table entries starting at A5 + 0x{:08X} ({} of them)\n",
-            decoded.far_entry_start_a5_offset, decoded.far_entry_count);
-        disassembly += std::format("# A5 relocation data at 0x{:08X}\n", decoded.a5_relocation_data_offset);
-        for (uint32_t addr : decoded.a5_relocation_addresses) {
-          disassembly += std::format("#   A5 relocation at {:08X}\n", addr);
-        }
-        disassembly += std::format("# A5 is 0x{:08X}\n", decoded.a5);
-        disassembly += std::format("# PC relocation data at 0x{:08X}\n", decoded.pc_relocation_data_offset);
-        for (uint32_t addr : decoded.pc_relocation_addresses) {
-          disassembly += std::format("#   PC relocation at {:08X}\n", addr);
-        }
-        disassembly += std::format("# load address is 0x{:08X}\n", decoded.load_address);
-      } else {
-        disassembly += "# near model CODE resource\n";
-        if (decoded.num_jump_table_entries == 0) {
-          disassembly += std::format("# this CODE claims to have no jump table entries (but starts at {:04X})\n", decoded.first_jump_table_entry);
+      this->write_decoded_text(base_filename, res, ".txt", [&](OutputWriter& w) -> void {
+        if (decoded.first_jump_table_entry < 0) {
+          w.write("# far model CODE resource\n");
+          w.write_fmt("# near model jump table entries starting at A5 + 0x{:08X} ({} of them)\n",
+              decoded.near_entry_start_a5_offset, decoded.near_entry_count);
+          w.write_fmt("# far model jump table entries starting at A5 + 0x{:08X} ({} of them)\n",
+              decoded.far_entry_start_a5_offset, decoded.far_entry_count);
+          w.write_fmt("# A5 relocation data at 0x{:08X}\n", decoded.a5_relocation_data_offset);
+          for (uint32_t addr : decoded.a5_relocation_addresses) {
+            w.write_fmt("#   A5 relocation at {:08X}\n", addr);
+          }
+          w.write_fmt("# A5 is 0x{:08X}\n", decoded.a5);
+          w.write_fmt("# PC relocation data at 0x{:08X}\n", decoded.pc_relocation_data_offset);
+          for (uint32_t addr : decoded.pc_relocation_addresses) {
+            w.write_fmt("#   PC relocation at {:08X}\n", addr);
+          }
+          w.write_fmt("# load address is 0x{:08X}\n", decoded.load_address);
         } else {
-          disassembly += std::format("# jump table entries: {}-{} ({} of them)\n",
-              decoded.first_jump_table_entry,
-              decoded.first_jump_table_entry + decoded.num_jump_table_entries - 1,
-              decoded.num_jump_table_entries);
+          w.write("# near model CODE resource\n");
+          if (decoded.num_jump_table_entries == 0) {
+            w.write_fmt("# this CODE claims to have no jump table entries (but starts at {:04X})\n", decoded.first_jump_table_entry);
+          } else {
+            w.write_fmt("# jump table entries: {}-{} ({} of them)\n",
+                decoded.first_jump_table_entry,
+                decoded.first_jump_table_entry + decoded.num_jump_table_entries - 1,
+                decoded.num_jump_table_entries);
+          }
         }
-      }
 
-      disassembly += M68KEmulator::disassemble(
-          decoded.code.data(), decoded.code.size(), 0, &labels, true, &jump_table);
+        M68KEmulator::disassemble(
+            w.callback(), decoded.code.data(), decoded.code.size(), 0, &labels, true, &jump_table);
+      });
     }
-
-    this->write_decoded_data(base_filename, res, ".txt", disassembly);
   }
 
   void write_decoded_DRVR(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
     auto decoded = this->current_rf->decode_DRVR(res);
 
-    string disassembly;
-
     vector<const char*> flags_strs;
     if (decoded.flags & ResourceFile::DecodedDriverResource::Flag::ENABLE_READ) {
       flags_strs.emplace_back("ENABLE_READ");
@@ -1242,76 +1603,76 @@ private:
     }
     string flags_str = join(flags_strs, ", ");
 
-    if (decoded.name.empty()) {
-      disassembly += "# no name present\n";
-    } else {
-      disassembly += std::format("# name: {}\n", decoded.name);
-    }
-
-    if (flags_str.empty()) {
-      disassembly += std::format("# flags: 0x{:04X}\n", decoded.flags);
-    } else {
-      disassembly += std::format("# flags: 0x{:04X} ({})\n", decoded.flags, flags_str);
-    }
-
-    disassembly += std::format("# delay: {}\n", decoded.delay);
-    disassembly += std::format("# event mask: 0x{:04X}\n", decoded.event_mask);
-    disassembly += std::format("# menu id: {}\n", decoded.menu_id);
-
-    multimap<uint32_t, string> labels;
+    this->write_decoded_text(base_filename, res, ".txt", [&](OutputWriter& w) -> void {
+      if (decoded.name.empty()) {
+        w.write("# no name present\n");
+      } else {
+        w.write_fmt("# name: {}\n", decoded.name);
+      }
 
-    auto add_label = [&](uint16_t label, const char* name) {
-      if (label == 0) {
-        disassembly += std::format("# {} label: not set\n", name);
+      if (flags_str.empty()) {
+        w.write_fmt("# flags: 0x{:04X}\n", decoded.flags);
       } else {
-        disassembly += std::format("# {} label: {:04X}\n", name, label);
-        labels.emplace(label, name);
+        w.write_fmt("# flags: 0x{:04X} ({})\n", decoded.flags, flags_str);
       }
-    };
-    add_label(decoded.open_label, "open");
-    add_label(decoded.prime_label, "prime");
-    add_label(decoded.control_label, "control");
-    add_label(decoded.status_label, "status");
-    add_label(decoded.close_label, "close");
 
-    disassembly += M68KEmulator::disassemble(
-        decoded.code.data(), decoded.code.size(), decoded.code_start_offset, &labels);
+      w.write_fmt("# delay: {}\n", decoded.delay);
+      w.write_fmt("# event mask: 0x{:04X}\n", decoded.event_mask);
+      w.write_fmt("# menu id: {}\n", decoded.menu_id);
 
-    this->write_decoded_data(base_filename, res, ".txt", disassembly);
+      multimap<uint32_t, string> labels;
+
+      auto add_label = [&](uint16_t label, const char* name) {
+        if (label == 0) {
+          w.write_fmt("# {} label: not set\n", name);
+        } else {
+          w.write_fmt("# {} label: {:04X}\n", name, label);
+          labels.emplace(label, name);
+        }
+      };
+      add_label(decoded.open_label, "open");
+      add_label(decoded.prime_label, "prime");
+      add_label(decoded.control_label, "control");
+      add_label(decoded.status_label, "status");
+      add_label(decoded.close_label, "close");
+
+      M68KEmulator::disassemble(
+          w.callback(), decoded.code.data(), decoded.code.size(), decoded.code_start_offset, &labels);
+    });
   }
 
   void write_decoded_RSSC(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
     auto decoded = this->current_rf->decode_RSSC(res);
 
-    multimap<uint32_t, string> labels;
-    string disassembly;
-    size_t function_count = sizeof(decoded.function_offsets) / sizeof(decoded.function_offsets[0]);
-    for (size_t z = 0; z < function_count; z++) {
-      if (decoded.function_offsets[z] == 0) {
-        disassembly += std::format("# export_{} => (not set)\n", z);
-      } else {
-        disassembly += std::format("# export_{} => {:08X}\n", z, decoded.function_offsets[z]);
+    this->write_decoded_text(base_filename, res, ".txt", [&](OutputWriter& w) -> void {
+      multimap<uint32_t, string> labels;
+      size_t function_count = sizeof(decoded.function_offsets) / sizeof(decoded.function_offsets[0]);
+      for (size_t z = 0; z < function_count; z++) {
+        if (decoded.function_offsets[z] == 0) {
+          w.write_fmt("# export_{} => (not set)\n", z);
+        } else {
+          w.write_fmt("# export_{} => {:08X}\n", z, decoded.function_offsets[z]);
+        }
+        labels.emplace(decoded.function_offsets[z], std::format("export_{}", z));
       }
-      labels.emplace(decoded.function_offsets[z], std::format("export_{}", z));
-    }
-    disassembly += M68KEmulator::disassemble(
-        decoded.code.data(), decoded.code.size(), 0x16, &labels);
-
-    this->write_decoded_data(base_filename, res, ".txt", disassembly);
+      M68KEmulator::disassemble(
+          w.callback(), decoded.code.data(), decoded.code.size(), 0x16, &labels);
+    });
   }
 
   void write_decoded_dcmp(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
     auto decoded = this->current_rf->decode_dcmp(res);
-    string disassembly = disassembly_for_dcmp(decoded);
-    this->write_decoded_data(base_filename, res, ".txt", disassembly);
+    this->write_decoded_text(base_filename, res, ".txt", [&](OutputWriter& w) -> void {
+      write_disassembly_for_dcmp(w.callback(), decoded);
+    });
   }
 
   void write_decoded_inline_68k(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
     multimap<uint32_t, string> labels;
     labels.emplace(0, "start");
-    string result = M68KEmulator::disassemble(res->data.data(), res->data.size(), 0,
-        &labels);
-    this->write_decoded_data(base_filename, res, ".txt", result);
+    this->write_decoded_text(base_filename, res, ".txt", [&](OutputWriter& w) -> void {
+      M68KEmulator::disassemble(w.callback(), res->data.data(), res->data.size(), 0, &labels);
+    });
   }
 
   void write_decoded_inline_ppc32(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
@@ -1328,7 +1689,7 @@ private:
     this->ensure_directories_exist(filename);
     auto f = fopen_unique(filename, "wt");
     pef.print(f.get());
-    fwrite_fmt(stderr, "... {}\n", filename);
+    this->note_output_file(filename);
   }
 
   void write_decoded_expt_nsrd(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
@@ -1340,7 +1701,7 @@ private:
     print_data(f.get(), decoded.header);
     fputc('\n', f.get());
     decoded.pef.print(f.get());
-    fwrite_fmt(stderr, "... {}\n", filename);
+    this->note_output_file(filename);
   }
 
   void write_decoded_inline_68k_or_pef(const string& base_filename, shared_ptr<const ResourceFile::Resource> res) {
@@ -1493,6 +1854,7 @@ private:
         fwrite_fmt(f.get(), "#   text: \"{}\"\n", text);
       }
     }
+    this->note_output_file(filename);
   }
 
   JSON generate_json_for_INST(
@@ -1538,7 +1900,7 @@ private:
         snd_is_mp3 = decoded_snd.is_mp3;
 
       } catch (const exception& e) {
-        fwrite_fmt(stderr, "warning: failed to get sound metadata for instrument {} region {:X}-{:X} from snd/csnd/esnd {}: {}\n",
+        this->write_log("warning: failed to get sound metadata for instrument {} region {:X}-{:X} from snd/csnd/esnd {}: {}\n",
             id, rgn.key_low, rgn.key_high, rgn.snd_id, e.what());
       }
 
@@ -1627,7 +1989,7 @@ private:
           instruments.emplace_back(generate_json_for_INST(
               base_filename, it.first, this->current_rf->decode_INST(it.second), s->semitone_shift));
         } catch (const exception& e) {
-          fwrite_fmt(stderr, "warning: failed to add instrument {} from INST {}: {}\n",
+          this->write_log("warning: failed to add instrument {} from INST {}: {}\n",
               it.first, it.second, e.what());
         }
       }
@@ -1640,7 +2002,7 @@ private:
         instruments.emplace_back(generate_json_for_INST(
             base_filename, id, this->current_rf->decode_INST(id), s ? s->semitone_shift : 0));
       } catch (const exception& e) {
-        fwrite_fmt(stderr, "warning: failed to add instrument {}: {}\n", id, e.what());
+        this->write_log("warning: failed to add instrument {}: {}\n", id, e.what());
       }
     }
 
@@ -1800,13 +2162,34 @@ private:
     // On HFS+, the resource fork always exists, but might be empty. On APFS,
     // the resource fork is optional.
     if ((this->index_format == IndexFormat::DIRECTORY) && !std::filesystem::is_directory(resource_fork_filename)) {
-      fwrite_fmt(stderr, ">>> {} ({})\n", filename, "directory is missing");
+      this->write_log(">>> {} ({})\n", filename, "directory is missing");
       return false;
     } else if ((this->index_format != IndexFormat::DIRECTORY) && (!std::filesystem::is_regular_file(resource_fork_filename) || (std::filesystem::file_size(resource_fork_filename) == 0))) {
-      fwrite_fmt(stderr, ">>> {} ({})\n", filename, this->use_data_fork ? "file is empty" : "resource fork missing or empty");
+      this->write_log(">>> {} ({})\n", filename, this->use_data_fork ? "file is empty" : "resource fork missing or empty");
       return false;
     } else {
-      fwrite_fmt(stderr, ">>> {}\n", filename);
+      this->write_log(">>> {}\n", filename);
+    }
+
+    // In incremental mode, skip the file if it hasn't changed since it was
+    // last exported. Directory-format inputs don't have a single file to check,
+    // so they're always exported.
+    ExportManifest::Entry manifest_entry;
+    bool use_manifest = this->manifest && (this->index_format != IndexFormat::DIRECTORY);
+    if (use_manifest) {
+      bool exported_any = false;
+      try {
+        if (this->manifest->check(resource_fork_filename, manifest_entry, exported_any)) {
+          this->write_log("... (unchanged since last export)\n");
+          return exported_any;
+        }
+      } catch (const exception& e) {
+        this->write_log("warning: cannot check {} against the manifest: {}\n", filename, e.what());
+        use_manifest = false;
+      }
+      if (use_manifest) {
+        this->written_output_files = make_shared<WrittenOutputFiles>();
+      }
     }
 
     // Compute the base filename
@@ -1815,45 +2198,52 @@ private:
 
     // Get the resources from the file
     try {
-      switch (this->index_format) {
-        case IndexFormat::RESOURCE_FORK:
-          this->open_resource_file(parse_resource_fork(load_file(resource_fork_filename)));
-          break;
-        case IndexFormat::DIRECTORY:
-          this->open_resource_file(load_resource_file_from_directory(resource_fork_filename));
-          break;
-        case IndexFormat::MACBINARY:
-          this->open_resource_file(parse_macbinary_resource_fork(load_file(resource_fork_filename)));
-          break;
-        case IndexFormat::APPLESINGLE_APPLEDOUBLE:
-          this->open_resource_file(parse_applesingle_appledouble_resource_fork(load_file(resource_fork_filename)));
-          break;
-        case IndexFormat::MOHAWK:
-          this->open_resource_file(parse_mohawk(load_file(resource_fork_filename)));
-          break;
-        case IndexFormat::HIRF:
-          this->open_resource_file(parse_hirf(load_file(resource_fork_filename)));
-          break;
-        case IndexFormat::DC_DATA:
-          this->open_resource_file(parse_dc_data(load_file(resource_fork_filename)));
-          break;
-        case IndexFormat::CBAG:
-          this->open_resource_file(parse_cbag(load_file(resource_fork_filename)));
-          break;
-        default:
-          throw logic_error("invalid index format");
+      if (this->index_format == IndexFormat::DIRECTORY) {
+        this->open_resource_file(load_resource_file_from_directory(resource_fork_filename));
+
+      } else {
+        // Parse the index directly from the mapped file, so the file's
+        // contents aren't copied to the heap before each resource's data is
+        // copied out of them
+        MappedFile input(resource_fork_filename);
+        auto r = input.reader();
+        switch (this->index_format) {
+          case IndexFormat::RESOURCE_FORK:
+            this->open_resource_file(parse_resource_fork(r));
+            break;
+          case IndexFormat::MACBINARY:
+            this->open_resource_file(parse_macbinary_resource_fork(r));
+            break;
+          case IndexFormat::APPLESINGLE_APPLEDOUBLE:
+            this->open_resource_file(parse_applesingle_appledouble_resource_fork(r));
+            break;
+          case IndexFormat::MOHAWK:
+            this->open_resource_file(parse_mohawk(r));
+            break;
+          case IndexFormat::HIRF:
+            this->open_resource_file(parse_hirf(r));
+            break;
+          case IndexFormat::DC_DATA:
+            this->open_resource_file(parse_dc_data(r));
+            break;
+          case IndexFormat::CBAG:
+            this->open_resource_file(parse_cbag(r));
+            break;
+          default:
+            throw logic_error("invalid index format");
+        }
       }
     } catch (const cannot_open_file&) {
-      fwrite_fmt(stderr, "failed on {}: cannot open file\n", filename);
+      this->write_log("failed on {}: cannot open file\n", filename);
       return false;
     } catch (const io_error& e) {
-      fwrite_fmt(stderr, "failed on {}: cannot read data\n", filename);
+      this->write_log("failed on {}: cannot read data\n", filename);
       return false;
     } catch (const runtime_error& e) {
-      fwrite_fmt(stderr, "failed on {}: corrupt resource index ({})\n", filename, e.what());
+      this->write_log("failed on {}: corrupt resource index ({})\n", filename, e.what());
       return false;
     } catch (const out_of_range& e) {
-      fwrite_fmt(stderr, "failed on {}: corrupt resource index\n", filename);
+      this->write_log("failed on {}: corrupt resource index\n", filename);
       return false;
     }
 
@@ -1861,18 +2251,25 @@ private:
     try {
       auto resources = this->current_rf->all_resources();
 
+      vector<pair<uint32_t, int16_t>> included_resources;
       bool has_INST = false;
       for (const auto& it : resources) {
         if (!is_included(it.first, it.second) || is_excluded(it.first, it.second)) {
           continue;
         }
-
-        const auto& res = this->current_rf->get_resource(it.first, it.second, this->decompress_flags);
-
         if (it.first == RESOURCE_TYPE_INST) {
           has_INST = true;
         }
-        ret |= this->export_resource(base_filename, res);
+        included_resources.emplace_back(it);
+      }
+
+      if ((this->resource_jobs > 1) && (included_resources.size() > 1)) {
+        this->export_resources_parallel(base_filename, included_resources, ret);
+      } else {
+        for (const auto& it : included_resources) {
+          const auto& res = this->current_rf->get_resource(it.first, it.second, this->decompress_flags);
+          ret |= this->export_resource(base_filename, res);
+        }
       }
 
       // Special case: if we disassembled any INSTs and the save-raw behavior is
@@ -1883,46 +2280,114 @@ private:
         try {
           auto json = generate_json_for_SONG(base_filename, nullptr);
           save_file(json_filename, json.serialize(JSON::SerializeOption::FORMAT));
-          fwrite_fmt(stderr, "... {}\n", json_filename);
+          this->note_output_file(json_filename);
 
         } catch (const exception& e) {
-          fwrite_fmt(stderr, "failed to write smssynth env template {}: {}\n",
+          this->write_log("failed to write smssynth env template {}: {}\n",
               json_filename, e.what());
         }
       }
 
+      // Only record the file once all of its resources have been exported, so
+      // if this run is interrupted, the next one will export it again
+      if (use_manifest) {
+        manifest_entry.exported_any = ret;
+        manifest_entry.output_filenames = std::move(this->written_output_files->filenames);
+        this->manifest->record(resource_fork_filename, manifest_entry);
+      }
+
     } catch (const exception& e) {
-      fwrite_fmt(stderr, "failed on {}: {}\n", filename, e.what());
+      this->write_log("failed on {}: {}\n", filename, e.what());
     }
 
     this->current_rf.reset();
+    this->written_output_files.reset();
     return ret;
   }
 
+  // Exports resources from the current file on multiple threads. Log output
+  // is written in the same order as if the resources were exported serially.
+  // If any resource throws, ret is set as it would be if the resources before
+  // it had been exported serially, and the exception is rethrown.
+  void export_resources_parallel(
+      const string& base_filename,
+      const vector<pair<uint32_t, int16_t>>& resources,
+      bool& ret) {
+    size_t num_workers = min<size_t>(this->resource_jobs, resources.size());
+    vector<unique_ptr<ResourceExporter>> workers;
+    while (workers.size() < num_workers) {
+      workers.emplace_back(make_unique<ResourceExporter>(*this));
+    }
+
+    OrderedLogWriter log_writer(resources.size(), [this](const string& log) -> void {
+      this->write_log_raw(log);
+    });
+    // Not vector<bool>, since workers write to adjacent entries concurrently
+    vector<uint8_t> results(resources.size(), 0);
+    vector<exception_ptr> exceptions(resources.size());
+    vector<size_t> indexes;
+    while (indexes.size() < resources.size()) {
+      indexes.emplace_back(indexes.size());
+    }
+
+    auto export_task = [&](const size_t& index, size_t thread_num) -> bool {
+      auto& worker = *workers.at(thread_num);
+      string log;
+      worker.log_buffer = &log;
+      auto prev_log_fn = set_decompression_log_fn([&log](const string& data) { log += data; });
+      try {
+        const auto& [type, id] = resources[index];
+        const auto& res = worker.current_rf->get_resource(type, id, worker.decompress_flags);
+        results[index] = worker.export_resource(base_filename, res);
+      } catch (const exception&) {
+        exceptions[index] = current_exception();
+      }
+      set_decompression_log_fn(std::move(prev_log_fn));
+      worker.log_buffer = nullptr;
+      log_writer.write(index, std::move(log));
+      return false;
+    };
+    parallel_range(indexes, export_task, num_workers);
+
+    for (size_t z = 0; z < resources.size(); z++) {
+      if (exceptions[z]) {
+        rethrow_exception(exceptions[z]);
+      }
+      ret |= results[z];
+    }
+  }
+
+  static vector<string> sorted_directory_items(const string& filename) {
+    unordered_set<string> items;
+    for (const auto& item : std::filesystem::directory_iterator(filename)) {
+      items.emplace(item.path().filename().string());
+    }
+
+    vector<string> sorted_items;
+    sorted_items.insert(sorted_items.end(), items.begin(), items.end());
+    sort(sorted_items.begin(), sorted_items.end());
+    return sorted_items;
+  }
+
+  string sub_out_dir_for_directory(const string& filename) const {
+    size_t last_slash_pos = filename.rfind('/');
+    string base_filename = (last_slash_pos == string::npos) ? filename : filename.substr(last_slash_pos + 1);
+    return this->out_dir.empty() ? base_filename : (this->out_dir + "/" + base_filename);
+  }
+
   bool disassemble_path(const string& filename) {
     if ((this->index_format != IndexFormat::DIRECTORY) && std::filesystem::is_directory(filename)) {
-      fwrite_fmt(stderr, ">>> {} (directory)\n", filename);
+      this->write_log(">>> {} (directory)\n", filename);
 
-      unordered_set<string> items;
+      vector<string> sorted_items;
       try {
-        for (const auto& item : std::filesystem::directory_iterator(filename)) {
-          items.emplace(item.path().filename().string());
-        }
+        sorted_items = this->sorted_directory_items(filename);
       } catch (const runtime_error& e) {
-        fwrite_fmt(stderr, "warning: can\'t list directory: {}\n", e.what());
+        this->write_log("warning: can\'t list directory: {}\n", e.what());
         return false;
       }
 
-      vector<string> sorted_items;
-      sorted_items.insert(sorted_items.end(), items.begin(), items.end());
-      sort(sorted_items.begin(), sorted_items.end());
-
-      size_t last_slash_pos = filename.rfind('/');
-      string base_filename = (last_slash_pos == string::npos) ? filename : filename.substr(last_slash_pos + 1);
-
-      string sub_out_dir = this->out_dir.empty()
-          ? base_filename
-          : (this->out_dir + "/" + base_filename);
+      string sub_out_dir = this->sub_out_dir_for_directory(filename);
       bool ret = false;
       for (const string& item : sorted_items) {
         sub_out_dir.swap(this->out_dir);
@@ -1936,6 +2401,92 @@ private:
     }
   }
 
+  // One entry in the flattened list of work for a parallel export. Entries for
+  // directories have an empty filename; they only carry the log output that a
+  // serial run would have produced when entering the directory.
+  struct ExportTask {
+    string filename;
+    string out_dir;
+    string log;
+    bool result = false;
+  };
+
+  // Walks the input tree in the same order as disassemble_path, but only
+  // records the files to export instead of exporting them
+  void collect_export_tasks(vector<ExportTask>& tasks, const string& filename) {
+    if ((this->index_format != IndexFormat::DIRECTORY) && std::filesystem::is_directory(filename)) {
+      size_t dir_task_index = tasks.size();
+      tasks.emplace_back().log = std::format(">>> {} (directory)\n", filename);
+
+      vector<string> sorted_items;
+      try {
+        sorted_items = this->sorted_directory_items(filename);
+      } catch (const runtime_error& e) {
+        tasks[dir_task_index].log += std::format("warning: can\'t list directory: {}\n", e.what());
+        return;
+      }
+
+      string sub_out_dir = this->sub_out_dir_for_directory(filename);
+      for (const string& item : sorted_items) {
+        sub_out_dir.swap(this->out_dir);
+        this->collect_export_tasks(tasks, filename + "/" + item);
+        sub_out_dir.swap(this->out_dir);
+      }
+
+    } else {
+      auto& task = tasks.emplace_back();
+      task.filename = filename;
+      task.out_dir = this->out_dir;
+    }
+  }
+
+  bool disassemble_path_parallel(const string& filename) {
+    vector<ExportTask> tasks;
+    this->collect_export_tasks(tasks, filename);
+
+    // Each worker buffers the log output for the file it's working on, so the
+    // output appears in the same order as in a serial run
+    OrderedLogWriter log_writer(tasks.size(), [](const string& log) -> void {
+      fwritex(stderr, log);
+    });
+    vector<size_t> file_task_indexes;
+    for (size_t z = 0; z < tasks.size(); z++) {
+      if (tasks[z].filename.empty()) {
+        log_writer.write(z, std::move(tasks[z].log));
+      } else {
+        file_task_indexes.emplace_back(z);
+      }
+    }
+
+    size_t num_workers = min<size_t>(this->num_jobs, max<size_t>(file_task_indexes.size(), 1));
+    vector<unique_ptr<ResourceExporter>> workers;
+    while (workers.size() < num_workers) {
+      workers.emplace_back(make_unique<ResourceExporter>(*this));
+    }
+
+    auto disassemble_task = [&](const size_t& task_index, size_t thread_num) -> bool {
+      auto& worker = *workers.at(thread_num);
+      auto& task = tasks[task_index];
+
+      string log;
+      worker.out_dir = task.out_dir;
+      worker.log_buffer = &log;
+      auto prev_log_fn = set_decompression_log_fn([&log](const string& data) { log += data; });
+      task.result = worker.disassemble_file(task.filename);
+      set_decompression_log_fn(std::move(prev_log_fn));
+      worker.log_buffer = nullptr;
+      log_writer.write(task_index, std::move(log));
+      return false;
+    };
+    parallel_range(file_task_indexes, disassemble_task, num_workers);
+
+    bool ret = false;
+    for (const auto& task : tasks) {
+      ret |= task.result;
+    }
+    return ret;
+  }
+
 public:
   enum class SaveRawBehavior {
     NEVER = 0,
@@ -1959,7 +2510,45 @@ public:
         skip_templates(false),
         export_icon_family_as_image(true),
         export_icon_family_as_icns(true),
-        image_saver() {}
+        image_saver(),
+        num_jobs(1),
+        resource_jobs(1),
+        directory_creator(make_shared<DirectoryCreator>()),
+        log_buffer(nullptr),
+        exported_family_icns(make_shared<ExportedIconFamilies>()) {}
+  // Copies the export options and the currently-open file from another
+  // exporter, but not its log buffer (this is used to create workers for
+  // parallel exports)
+  ResourceExporter(const ResourceExporter& other)
+      : type_to_decode_fn(other.type_to_decode_fn),
+        index_format(other.index_format),
+        use_data_fork(other.use_data_fork),
+        filename_format(other.filename_format),
+        save_raw(other.save_raw),
+        decompress_flags(other.decompress_flags),
+        target_types_ids(other.target_types_ids),
+        skip_types_ids(other.skip_types_ids),
+        target_ids(other.target_ids),
+        target_names(other.target_names),
+        skip_ids(other.skip_ids),
+        skip_names(other.skip_names),
+        external_preprocessor_command(other.external_preprocessor_command),
+        target_compressed_behavior(other.target_compressed_behavior),
+        skip_templates(other.skip_templates),
+        export_icon_family_as_image(other.export_icon_family_as_image),
+        export_icon_family_as_icns(other.export_icon_family_as_icns),
+        image_saver(other.image_saver),
+        num_jobs(1),
+        resource_jobs(other.resource_jobs),
+        manifest(other.manifest),
+        base_out_dir(other.base_out_dir),
+        out_dir(other.out_dir),
+        directory_creator(other.directory_creator),
+        log_buffer(nullptr),
+        current_rf(other.current_rf),
+        exported_family_icns(other.exported_family_icns),
+        written_output_files(other.written_output_files) {}
+  ResourceExporter& operator=(const ResourceExporter&) = delete;
   ~ResourceExporter() = default;
 
   IndexFormat index_format;
@@ -1979,16 +2568,34 @@ public:
   bool export_icon_family_as_image;
   bool export_icon_family_as_icns;
   ImageSaver image_saver;
+  size_t num_jobs; // Number of input files to export at once
+  size_t resource_jobs; // Number of resources to export at once in each file
+  shared_ptr<ExportManifest> manifest; // If not null, unchanged files are skipped
 
 private:
   string base_out_dir; // Fixed part of filename (e.g. <file>.out)
   string out_dir; // Recursive part of filename (dirs after <file>.out)
-  unique_ptr<ResourceFile> current_rf;
-  unordered_set<int32_t> exported_family_icns;
+  shared_ptr<DirectoryCreator> directory_creator; // Shared with all workers
+  string* log_buffer; // If not null, log output goes here instead of stderr
+  shared_ptr<ResourceFile> current_rf; // Shared with resource export workers
+  // IDs of icon families already exported as .icns files from current_rf
+  struct ExportedIconFamilies {
+    mutex lock;
+    unordered_set<int32_t> ids;
+  };
+  shared_ptr<ExportedIconFamilies> exported_family_icns;
+  // Output files written for current_rf, if it's being recorded in the
+  // manifest. Shared with resource export workers.
+  struct WrittenOutputFiles {
+    mutex lock;
+    vector<string> filenames;
+  };
+  shared_ptr<WrittenOutputFiles> written_output_files;
 
 public:
   void open_resource_file(ResourceFile&& rf) {
-    this->current_rf = make_unique<ResourceFile>(std::move(rf));
+    this->current_rf = make_shared<ResourceFile>(std::move(rf));
+    this->exported_family_icns = make_shared<ExportedIconFamilies>();
   }
 
   void set_decoder_alias(uint32_t from_type, uint32_t to_type) {
@@ -2014,9 +2621,9 @@ public:
     if (decompression_failed || is_compressed) {
       auto type_str = string_for_resource_type(res->type);
       if (decompression_failed) {
-        fwrite_fmt(stderr, "warning: failed to decompress resource {}:{}; saving raw compressed data\n", type_str, res->id);
+        this->write_log("warning: failed to decompress resource {}:{}; saving raw compressed data\n", type_str, res->id);
       } else {
-        fwrite_fmt(stderr, "note: resource {}:{} is compressed; saving raw compressed data\n", type_str, res->id);
+        this->write_log("note: resource {}:{} is compressed; saving raw compressed data\n", type_str, res->id);
       }
     }
     if ((this->target_compressed_behavior == TargetCompressedBehavior::TARGET) &&
@@ -2038,7 +2645,7 @@ public:
     if (!is_compressed && !this->external_preprocessor_command.empty()) {
       auto result = run_process(this->external_preprocessor_command, &res->data, false);
       if (result.exit_status != 0) {
-        fwrite_fmt(stderr, "\
+        this->write_log("\
 warning: external preprocessor failed with exit status 0x{:X}\n\
 \n\
 stdout ({} bytes):\n\
@@ -2049,7 +2656,7 @@ stderr ({} bytes):\n\
 \n",
             result.exit_status, result.stdout_contents.size(), result.stdout_contents, result.stderr_contents.size(), result.stderr_contents);
       } else {
-        fwrite_fmt(stderr, "note: external preprocessor succeeded and returned {} bytes\n", result.stdout_contents.size());
+        this->write_log("note: external preprocessor succeeded and returned {} bytes\n", result.stdout_contents.size());
         res_to_decode = make_shared<ResourceFile::Resource>(
             res->type, res->id, res->flags, res->name, std::move(result.stdout_contents));
       }
@@ -2087,9 +2694,9 @@ stderr ({} bytes):\n\
         auto type_str = string_for_resource_type(res->type);
         if (remapped_type != res->type) {
           auto remapped_type_str = string_for_resource_type(remapped_type);
-          fwrite_fmt(stderr, "warning: failed to decode resource {}:{} (remapped to {}): {}\n", type_str, res->id, remapped_type_str, e.what());
+          this->write_log("warning: failed to decode resource {}:{} (remapped to {}): {}\n", type_str, res->id, remapped_type_str, e.what());
         } else {
-          fwrite_fmt(stderr, "warning: failed to decode resource {}:{}: {}\n", type_str, res->id, e.what());
+          this->write_log("warning: failed to decode resource {}:{}: {}\n", type_str, res->id, e.what());
         }
       }
     }
@@ -2118,9 +2725,9 @@ stderr ({} bytes):\n\
           auto type_str = string_for_resource_type(res->type);
           if (remapped_type != res->type) {
             auto remapped_type_str = string_for_resource_type(remapped_type);
-            fwrite_fmt(stderr, "warning: failed to decode resource {}:{} (remapped to {}) with template {}: {}\n", type_str, res->id, remapped_type_str, tmpl_res->id, e.what());
+            this->write_log("warning: failed to decode resource {}:{} (remapped to {}) with template {}: {}\n", type_str, res->id, remapped_type_str, tmpl_res->id, e.what());
           } else {
-            fwrite_fmt(stderr, "warning: failed to decode resource {}:{} with template {}: {}\n", type_str, res->id, tmpl_res->id, e.what());
+            this->write_log("warning: failed to decode resource {}:{} with template {}: {}\n", type_str, res->id, tmpl_res->id, e.what());
           }
         }
       }
@@ -2139,9 +2746,9 @@ stderr ({} bytes):\n\
           auto type_str = string_for_resource_type(res->type);
           if (remapped_type != res->type) {
             auto remapped_type_str = string_for_resource_type(remapped_type);
-            fwrite_fmt(stderr, "warning: failed to decode resource {}:{} (remapped to {}) with system template: {}\n", type_str, res->id, remapped_type_str, e.what());
+            this->write_log("warning: failed to decode resource {}:{} (remapped to {}) with system template: {}\n", type_str, res->id, remapped_type_str, e.what());
           } else {
-            fwrite_fmt(stderr, "warning: failed to decode resource {}:{} with system template: {}\n", type_str, res->id, e.what());
+            this->write_log("warning: failed to decode resource {}:{} with system template: {}\n", type_str, res->id, e.what());
           }
         }
       }
@@ -2173,9 +2780,9 @@ stderr ({} bytes):\n\
         } else {
           save_file(out_filename, res_to_decode->data);
         }
-        fwrite_fmt(stderr, "... {}\n", out_filename);
+        this->note_output_file(out_filename);
       } catch (const exception& e) {
-        fwrite_fmt(stderr, "warning: failed to save raw data: {}\n", e.what());
+        this->write_log("warning: failed to save raw data: {}\n", e.what());
       }
     }
     return decoded || write_raw;
@@ -2183,7 +2790,9 @@ stderr ({} bytes):\n\
 
   bool disassemble(const string& filename, const string& base_out_dir) {
     this->base_out_dir = base_out_dir;
-    return this->disassemble_path(filename);
+    return (this->num_jobs > 1)
+        ? this->disassemble_path_parallel(filename)
+        : this->disassemble_path(filename);
   }
 };
 
@@ -2452,6 +3061,12 @@ Resource decompression options:\n\
       Don\'t attempt to use the default 68K decompressors.\n\
   --skip-system-ncmp\n\
       Don\'t attempt to use the default PEF decompressors.\n\
+  --verify-native-dcmp\n\
+      When a resource is decompressed with a native decompressor, also run the\n\
+      default 68K and PEF decompressors with the same ID on it, and print a\n\
+      warning if their results don\'t match the native decompressor\'s result.\n\
+      This makes decompression much slower, and is only useful for finding\n\
+      bugs in the native decompressors.\n\
   --verbose-decompression\n\
       Show log output when running resource decompressors.\n\
   --strict-decompression\n\
@@ -2470,6 +3085,17 @@ Resource decompression options:\n\
       decompressors are stopped immediately before the first opcode is run, and\n\
       you get an m68kexec-style debugger shell to control emulation and inspect\n\
       its state. Run `help` in the shell to see the available commands.\n\
+  --decompression-cache=DIR\n\
+      Save the results of emulated decompressors in DIR, and use the saved\n\
+      results instead of running the decompressors again if the same resource\n\
+      data is decompressed later (in this run or any future run). Multiple\n\
+      resource_dasm processes can use the same cache directory at once. This\n\
+      option has no effect on native decompressors, or when decompressors are\n\
+      being traced or debugged.\n\
+  --decompression-cache-size=BYTES\n\
+      Limit the total size of the decompression cache. When the cache grows\n\
+      beyond this size, the least recently used results are deleted. The\n\
+      default is 1073741824 (1GB).\n\
   --disassemble-system-dcmp=N\n\
   --disassemble-system-ncmp=N\n\
       Disassemble the included default 68K or PEF decompressor and print the\n\
@@ -2503,6 +3129,28 @@ Resource decoding options:\n\
       Don\'t attempt to use TMPL resources to convert resources to text files.\n\
 \n\
 Resource disassembly output options:\n\
+  --jobs=N\n\
+      Export up to N input files at once when input_filename is a directory.\n\
+      If N is 0, use as many threads as there are CPU cores in the system. The\n\
+      output files and log messages are the same as when exporting one file at\n\
+      a time, but log messages for each file are only written once the file is\n\
+      done. (Output from --trace-decompression and --debug-decompression is\n\
+      not buffered, so it may be interleaved.) The default is 1.\n\
+  --resource-jobs=N\n\
+      Export up to N resources from each input file at once. This is most\n\
+      useful for single files that contain many large or compressed resources.\n\
+      N=0 has the same meaning as for --jobs, and the log messages are still\n\
+      written in resource type and ID order. The default is 1.\n\
+  --incremental\n\
+      Keep a manifest of exported input files in the output directory, and\n\
+      skip files that haven\'t changed since they were last exported with the\n\
+      same options and resource_dasm version (and the same external programs,\n\
+      such as the --external-preprocessor command). Files whose output files\n\
+      were deleted are exported again, and output files that are no longer\n\
+      produced (because their resources or input files were removed) are\n\
+      deleted. Files are recorded as soon as they\'re done, so an interrupted\n\
+      run can be resumed by running the same command again. Input directories\n\
+      given with --index-format=directory are always exported.\n\
   --save-raw=no\n\
       Don\'t save any raw files; only save decoded resources. For resources that\n\
       can\'t be decoded, no output file is created.\n\
@@ -2608,11 +3256,14 @@ int main(int argc, char** argv) {
   bool decode_pict_file = false;
   bool modify_resource_map = false;
   bool parse_data = false;
+  bool incremental = false;
   bool create_resource_map = false;
   bool use_output_data_fork = false; // Only used if modify_resource_map == true
   int32_t disassemble_system_dcmp_id = 0x7FFFFFFF;
   int32_t disassemble_system_ncmp_id = 0x7FFFFFFF;
   uint32_t describe_system_template_type = 0;
+  string decompression_cache_dir;
+  uint64_t decompression_cache_size = 0x40000000; // 1GB
   for (int x = 1; x < argc; x++) {
     if (argv[x][0] == '-') {
       if (!strncmp(argv[x], "--disassemble-system-dcmp=", 26)) {
@@ -2842,6 +3493,11 @@ int main(int argc, char** argv) {
       } else if (!strcmp(argv[x], "--debug-decompression")) {
         exporter.decompress_flags |= DecompressionFlag::DEBUG_EXECUTION;
 
+      } else if (!strncmp(argv[x], "--decompression-cache=", 22)) {
+        decompression_cache_dir = &argv[x][22];
+      } else if (!strncmp(argv[x], "--decompression-cache-size=", 27)) {
+        decompression_cache_size = strtoull(&argv[x][27], nullptr, 0);
+
       } else if (!strcmp(argv[x], "--skip-file-dcmp")) {
         exporter.decompress_flags |= DecompressionFlag::SKIP_FILE_DCMP;
       } else if (!strcmp(argv[x], "--skip-file-ncmp")) {
@@ -2852,6 +3508,21 @@ int main(int argc, char** argv) {
         exporter.decompress_flags |= DecompressionFlag::SKIP_SYSTEM_DCMP;
       } else if (!strcmp(argv[x], "--skip-system-ncmp")) {
         exporter.decompress_flags |= DecompressionFlag::SKIP_SYSTEM_NCMP;
+      } else if (!strcmp(argv[x], "--verify-native-dcmp")) {
+        exporter.decompress_flags |= DecompressionFlag::VERIFY_NATIVE;
+
+      } else if (!strncmp(argv[x], "--jobs=", 7)) {
+        exporter.num_jobs = strtoull(&argv[x][7], nullptr, 0);
+        if (exporter.num_jobs == 0) {
+          exporter.num_jobs = std::thread::hardware_concurrency();
+        }
+      } else if (!strcmp(argv[x], "--incremental")) {
+        incremental = true;
+      } else if (!strncmp(argv[x], "--resource-jobs=", 16)) {
+        exporter.resource_jobs = strtoull(&argv[x][16], nullptr, 0);
+        if (exporter.resource_jobs == 0) {
+          exporter.resource_jobs = std::thread::hardware_concurrency();
+        }
 
       } else if (!exporter.image_saver.process_cli_arg(argv[x])) {
         fwrite_fmt(stderr, "invalid option: {}\n", argv[x]);
@@ -2873,8 +3544,9 @@ int main(int argc, char** argv) {
   if (disassemble_system_dcmp_id != 0x7FFFFFFF) {
     auto data = get_system_decompressor(false, disassemble_system_dcmp_id);
     auto decoded = ResourceFile::decode_dcmp(data.first, data.second);
-    string disassembly = disassembly_for_dcmp(decoded);
-    fwritex(stdout, disassembly);
+    OutputWriter w(stdout);
+    write_disassembly_for_dcmp(w.callback(), decoded);
+    w.flush();
     return 0;
   } else if (disassemble_system_ncmp_id != 0x7FFFFFFF) {
     auto data = get_system_decompressor(true, disassemble_system_ncmp_id);
@@ -2893,6 +3565,10 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (!decompression_cache_dir.empty()) {
+    set_decompression_cache(make_shared<DecompressionCache>(decompression_cache_dir, decompression_cache_size));
+  }
+
   if (modify_resource_map && modifications.empty() && !create_resource_map) {
     throw runtime_error("multiple incompatible modes were specified");
   }
@@ -2939,11 +3615,54 @@ int main(int argc, char** argv) {
         out_dir = filename + ".out";
       }
       std::filesystem::create_directories(out_dir);
-      if (!exporter.disassemble(filename, out_dir)) {
-        return 3;
-      } else {
-        return 0;
+
+      if (incremental) {
+        // Any option that could change the output files has to be part of the
+        // config hash, so we include all options except those that only
+        // affect how the work is scheduled
+        string config_data = std::format("{}", EXPORT_MANIFEST_DECODER_VERSION);
+        bool uses_external_decoders = true;
+        for (int x = 1; x < argc; x++) {
+          if (!strncmp(argv[x], "--", 2) &&
+              strncmp(argv[x], "--jobs=", 7) &&
+              strncmp(argv[x], "--resource-jobs=", 16) &&
+              strcmp(argv[x], "--incremental")) {
+            config_data.push_back('\0');
+            config_data += argv[x];
+          }
+          if (!strcmp(argv[x], "--skip-external-decoders")) {
+            uses_external_decoders = false;
+          }
+        }
+        // The output also depends on the system decompressors and on any
+        // external programs, so their contents are part of the config hash
+        for (int16_t id = 0; id < 4; id++) {
+          for (bool use_ncmp : {false, true}) {
+            try {
+              auto [data, size] = get_system_decompressor(use_ncmp, id);
+              config_data.push_back('\0');
+              config_data += SHA1(data, size).hex();
+            } catch (const out_of_range&) {
+            }
+          }
+        }
+        if (!exporter.external_preprocessor_command.empty()) {
+          config_data.push_back('\0');
+          config_data += external_program_config_data(exporter.external_preprocessor_command[0]);
+        }
+        if (uses_external_decoders) {
+          config_data.push_back('\0');
+          config_data += external_program_config_data("picttoppm");
+        }
+        exporter.manifest = make_shared<ExportManifest>(
+            out_dir + "/.resource_dasm_manifest", SHA1(config_data.data(), config_data.size()).hex());
+      }
+
+      bool ret = exporter.disassemble(filename, out_dir);
+      if (exporter.manifest) {
+        exporter.manifest->save(filename);
       }
+      return ret ? 0 : 3;
     }
 
   } else { // modify_resource_map == true